@@ -18,7 +18,7 @@ LOCAL_C_INCLUDES := $(MY_GSTREAMER_HLS_INCLUDE_PATH)
 LOCAL_C_INCLUDES += $(MY_GSTREAMER_HLS_INCLUDE_PATH)
 LOCAL_EXPORT_C_INCLUDES := $(MY_GSTREAMER_HLS_INCLUDE_PATH)
 LOCAL_MODULE    := skippyHLS
-LOCAL_SRC_FILES += $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_fragment.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_hlsdemux.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_m3u8.cpp $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_uridownloader.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_m3u8_parser.cpp $(MY_GSTREAMER_HLS_SOURCE_PATH)/oggOpusdec.cpp
+LOCAL_SRC_FILES += $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_aes.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_fragment.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_fragment_cache.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_hlsdemux.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_m3u8.cpp $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_uridownloader.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_m3u8_parser.cpp $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_spill_file.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_ogg_framer.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_mp3_framer.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_ts_demuxer.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_host_selector.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_bandwidth_estimator.c $(MY_GSTREAMER_HLS_SOURCE_PATH)/skippy_task_pool.c
 LOCAL_SHARED_LIBRARIES := gstreamer_android
 LOCAL_LDLIBS := -llog -landroid -lstdc++
 include $(BUILD_SHARED_LIBRARY)
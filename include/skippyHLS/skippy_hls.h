@@ -3,6 +3,21 @@
 #include <glib.h>
 
 #define SKIPPY_HLS_DOWNLOAD_AHEAD "skippy-download-ahead"
+#define SKIPPY_HLS_MAX_BUFFER_BYTES "skippy-max-buffer-bytes"
+#define SKIPPY_HLS_SPILL_DIRECTORY "skippy-spill-directory"
+#define SKIPPY_HLS_MP3_SLICE_SIZE "skippy-mp3-slice-size"
+#define SKIPPY_HLS_OPUS_SLICE_SIZE "skippy-opus-slice-size"
+#define SKIPPY_HLS_OPUS_BATCH_DURATION "skippy-opus-batch-duration"
+#define SKIPPY_HLS_MP3_FRAMING "skippy-mp3-framing"
+#define SKIPPY_HLS_AAC_FRAMING "skippy-aac-framing"
+#define SKIPPY_HLS_TS_DEMUXING "skippy-ts-demuxing"
+#define SKIPPY_HLS_PARALLEL_RANGES "skippy-parallel-ranges"
+#define SKIPPY_HLS_STALL_MIN_RATE "skippy-stall-min-rate"
+#define SKIPPY_HLS_STALL_WINDOW "skippy-stall-window"
+#define SKIPPY_HLS_HEDGE_PERCENTILE "skippy-hedge-percentile"
+#define SKIPPY_HLS_HEDGE_HOST "skippy-hedge-host"
+#define SKIPPY_HLS_HOSTS "skippy-hosts"
+#define SKIPPY_HLS_ADAPTIVE_BUFFER "skippy-adaptive-buffer"
 #define GST_SKIPPY_HLS_ERROR skippy_hls_error_quark()
 
 G_BEGIN_DECLS
@@ -0,0 +1,189 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_adts_framer.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include <gst/base/gstadapter.h>
+
+#include "skippy_adts_framer.h"
+#include "skippy_mp3_framer.h"
+
+#define ADTS_SAMPLES_PER_BLOCK 1024
+#define ADTS_CRC_SIZE 2
+
+GST_DEBUG_CATEGORY_STATIC (skippy_adts_framer_debug);
+#define GST_CAT_DEFAULT skippy_adts_framer_debug
+
+struct _SkippyAdtsFramer
+{
+  GstAdapter *adapter;
+  gboolean synced;      /* The data starts right after the last frame we returned */
+};
+
+static const guint adts_sample_rates[13] = {
+  96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+gboolean
+skippy_adts_header_parse (const guint8 * data, SkippyAdtsHeader * info)
+{
+  guint rate_index;
+
+  // Sync word and a layer of 0
+  if (data[0] != 0xff || (data[1] & 0xf6) != 0xf0) {
+    return FALSE;
+  }
+  rate_index = (data[2] >> 2) & 0xf;
+  if (rate_index >= G_N_ELEMENTS (adts_sample_rates)) {
+    return FALSE;
+  }
+
+  info->version = (data[1] & 0x08) ? 2 : 4;
+  info->profile = data[2] >> 6;
+  info->sample_rate = adts_sample_rates[rate_index];
+  info->channels = ((data[2] & 0x1) << 2) | (data[3] >> 6);
+  info->samples_per_frame = ADTS_SAMPLES_PER_BLOCK * ((data[6] & 0x3) + 1);
+  info->header_size = SKIPPY_ADTS_HEADER_SIZE + ((data[1] & 0x1) ? 0 : ADTS_CRC_SIZE);
+  info->frame_size = ((data[3] & 0x3) << 11) | (data[4] << 3) | (data[5] >> 5);
+  return info->frame_size > info->header_size;
+}
+
+gssize
+skippy_adts_find_frame (const guint8 * data, gsize size, SkippyAdtsHeader * info)
+{
+  SkippyAdtsHeader next;
+  gsize i;
+
+  for (i = 0; i + SKIPPY_ADTS_HEADER_SIZE <= size; i++) {
+    if (data[i] != 0xff || !skippy_adts_header_parse (data + i, info)) {
+      continue;
+    }
+    // A sync word can as well be in the middle of some payload, the next frame has to agree
+    if (i + info->frame_size + SKIPPY_ADTS_HEADER_SIZE <= size
+      && (!skippy_adts_header_parse (data + i + info->frame_size, &next)
+        || next.version != info->version || next.sample_rate != info->sample_rate
+        || next.channels != info->channels)) {
+      continue;
+    }
+    return i;
+  }
+  return -1;
+}
+
+static gpointer skippy_adts_framer_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_adts_framer_debug, "skippyhls-adts-framer", 0, "HLS ADTS framer");
+  return NULL;
+}
+
+SkippyAdtsFramer *
+skippy_adts_framer_new (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+  SkippyAdtsFramer *framer;
+
+  g_once (&init_once, skippy_adts_framer_init_once, NULL);
+
+  framer = g_slice_new0 (SkippyAdtsFramer);
+  framer->adapter = gst_adapter_new ();
+  return framer;
+}
+
+void
+skippy_adts_framer_free (SkippyAdtsFramer * framer)
+{
+  g_object_unref (framer->adapter);
+  g_slice_free (SkippyAdtsFramer, framer);
+}
+
+void
+skippy_adts_framer_flush (SkippyAdtsFramer * framer)
+{
+  gst_adapter_clear (framer->adapter);
+  framer->synced = FALSE;
+}
+
+void
+skippy_adts_framer_push (SkippyAdtsFramer * framer, GstBuffer * buffer)
+{
+  gst_adapter_push (framer->adapter, buffer);
+}
+
+GstBuffer *
+skippy_adts_framer_next_frame (SkippyAdtsFramer * framer, SkippyAdtsHeader * info, gboolean * discont)
+{
+  const guint8 *data;
+  gsize avail;
+  gssize skip;
+
+  *discont = !framer->synced;
+
+  while ((avail = gst_adapter_available (framer->adapter)) >= SKIPPY_ADTS_HEADER_SIZE) {
+    data = gst_adapter_map (framer->adapter, MIN (avail, SKIPPY_MP3_TAG_HEADER_SIZE));
+
+    // Packed audio carries its time stamp in an ID3 tag in front of every fragment
+    skip = skippy_mp3_tag_size (data, MIN (avail, SKIPPY_MP3_TAG_HEADER_SIZE));
+    if (skip != 0) {
+      gst_adapter_unmap (framer->adapter);
+      if (skip < 0 || (gsize) skip > avail) {
+        return NULL;
+      }
+      GST_DEBUG ("Skipping ID3 tag of %" G_GSSIZE_FORMAT " bytes", skip);
+      gst_adapter_flush (framer->adapter, skip);
+      continue;
+    }
+
+    if (framer->synced && skippy_adts_header_parse (data, info)) {
+      gst_adapter_unmap (framer->adapter);
+    } else {
+      gst_adapter_unmap (framer->adapter);
+      // Lost track: the first frame header we find has to be confirmed by the one following it
+      data = gst_adapter_map (framer->adapter, avail);
+      skip = skippy_adts_find_frame (data, avail, info);
+      if (skip >= 0 && skip + info->frame_size + SKIPPY_ADTS_HEADER_SIZE > avail) {
+        // Can't confirm yet
+        gst_adapter_unmap (framer->adapter);
+        gst_adapter_flush (framer->adapter, skip);
+        return NULL;
+      }
+      gst_adapter_unmap (framer->adapter);
+      if (skip < 0) {
+        gst_adapter_flush (framer->adapter, avail - (SKIPPY_ADTS_HEADER_SIZE - 1));
+        return NULL;
+      }
+      if (skip > 0) {
+        GST_DEBUG ("Skipping %" G_GSSIZE_FORMAT " bytes to resync", skip);
+        gst_adapter_flush (framer->adapter, skip);
+        // Might have been a tag we only see the end of, check again from here
+        *discont = TRUE;
+        framer->synced = FALSE;
+        continue;
+      }
+      framer->synced = TRUE;
+    }
+
+    if (gst_adapter_available (framer->adapter) < info->frame_size) {
+      return NULL;
+    }
+    return gst_adapter_take_buffer_fast (framer->adapter, info->frame_size);
+  }
+  return NULL;
+}
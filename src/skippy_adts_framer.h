@@ -0,0 +1,69 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_adts_framer.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Without the CRC that may follow
+#define SKIPPY_ADTS_HEADER_SIZE 7
+
+// What an ADTS frame header (ISO 13818-7) tells us about the AAC frame
+typedef struct
+{
+  guint version;                /* 2 for MPEG-2, 4 for MPEG-4 */
+  guint profile;                /* Audio object type minus one, 1 for AAC LC */
+  guint sample_rate;
+  guint channels;               /* 0 when a program config element in the frame tells */
+  guint samples_per_frame;
+  gsize header_size;            /* Including the CRC if there is one */
+  gsize frame_size;             /* Bytes including the header */
+} SkippyAdtsHeader;
+
+// Returns FALSE if the SKIPPY_ADTS_HEADER_SIZE bytes of data are not a valid frame header
+gboolean skippy_adts_header_parse (const guint8 * data, SkippyAdtsHeader * info);
+
+// Looks for the first frame in the data, confirmed by the header of the frame following it
+// if that is in the data too. Returns its offset or -1.
+gssize skippy_adts_find_frame (const guint8 * data, gsize size, SkippyAdtsHeader * info);
+
+// Splits an ADTS stream into whole frames, headers included, dropping ID3 tags and garbage in between.
+// Works like the MP3 framer, frames reference the memory of the buffers pushed in.
+typedef struct _SkippyAdtsFramer SkippyAdtsFramer;
+
+SkippyAdtsFramer *skippy_adts_framer_new (void);
+void skippy_adts_framer_free (SkippyAdtsFramer * framer);
+
+// Takes ownership of the buffer
+void skippy_adts_framer_push (SkippyAdtsFramer * framer, GstBuffer * buffer);
+
+// Returns the next complete frame or NULL if there is none yet. Discont is set when the frame doesn't
+// follow the one returned before, i.e we had to resync. Caller owns the returned buffer.
+GstBuffer *skippy_adts_framer_next_frame (SkippyAdtsFramer * framer, SkippyAdtsHeader * info, gboolean * discont);
+
+// Drops all pending data, for seeking
+void skippy_adts_framer_flush (SkippyAdtsFramer * framer);
+
+G_END_DECLS
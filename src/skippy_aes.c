@@ -0,0 +1,308 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_aes.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <nettle/aes.h>
+#include <nettle/cbc.h>
+
+#include <gst/gst.h>
+
+#include "skippy_aes.h"
+
+// Max time we wait for another thread fetching the same key before fetching it ourselves
+#define KEY_FETCH_WAIT_TIMEOUT (10 * G_TIME_SPAN_SECOND)
+
+GST_DEBUG_CATEGORY_STATIC (skippy_aes_debug);
+#define GST_CAT_DEFAULT skippy_aes_debug
+
+typedef struct
+{
+  guint8 key[SKIPPY_AES_BLOCK_SIZE];
+  gboolean loaded;              /* FALSE while the fetch is in flight */
+  guint claim;                  /* Of the lookup that owns the fetch */
+} SkippyAesKeyCacheEntry;
+
+static GMutex key_cache_lock;
+static GCond key_cache_cond;
+static GHashTable *key_cache = NULL;
+static GQueue key_cache_order = G_QUEUE_INIT;
+static guint key_cache_last_claim = 0;
+
+static gpointer skippy_aes_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_aes_debug, "skippyhls-aes", 0, "AES-128 decryption");
+  return NULL;
+}
+
+static void skippy_aes_ensure_init ()
+{
+  static GOnce init_once = G_ONCE_INIT;
+  g_once (&init_once, skippy_aes_init_once, NULL);
+}
+
+void
+skippy_aes_decryptor_init (SkippyAesDecryptor *dec, const guint8 *key, const guint8 *iv)
+{
+  skippy_aes_ensure_init ();
+
+  // Nettle picks AES-NI / ARMv8 crypto extensions at runtime when built with fat binary support
+  aes128_set_decrypt_key (&dec->ctx, key);
+  memcpy (dec->iv, iv, SKIPPY_AES_BLOCK_SIZE);
+  dec->carry_len = 0;
+  dec->has_held = FALSE;
+}
+
+// Writes out the held back plaintext block (if any) and returns the number of bytes written
+static gsize
+skippy_aes_decryptor_release_held (SkippyAesDecryptor *dec, guint8 *out)
+{
+  if (!dec->has_held) {
+    return 0;
+  }
+  memcpy (out, dec->held, SKIPPY_AES_BLOCK_SIZE);
+  dec->has_held = FALSE;
+  return SKIPPY_AES_BLOCK_SIZE;
+}
+
+// Writes out the held back plaintext block without its PKCS7 padding
+static gsize
+skippy_aes_decryptor_release_last (SkippyAesDecryptor *dec, guint8 *out)
+{
+  guint8 pad;
+  gsize i, len = SKIPPY_AES_BLOCK_SIZE;
+
+  if (!dec->has_held) {
+    return 0;
+  }
+  if (dec->carry_len) {
+    GST_WARNING ("Ciphertext is not block aligned, dropping %d trailing bytes", (int) dec->carry_len);
+    dec->carry_len = 0;
+  }
+
+  pad = dec->held[SKIPPY_AES_BLOCK_SIZE - 1];
+  if (pad >= 1 && pad <= SKIPPY_AES_BLOCK_SIZE) {
+    len = SKIPPY_AES_BLOCK_SIZE - pad;
+    for (i = len; i < SKIPPY_AES_BLOCK_SIZE; i++) {
+      if (dec->held[i] != pad) {
+        len = SKIPPY_AES_BLOCK_SIZE;
+        break;
+      }
+    }
+  }
+  if (len == SKIPPY_AES_BLOCK_SIZE) {
+    GST_WARNING ("Invalid PKCS7 padding in last block, keeping it");
+  }
+
+  memcpy (out, dec->held, len);
+  dec->has_held = FALSE;
+  return len;
+}
+
+gsize
+skippy_aes_decryptor_process (SkippyAesDecryptor *dec, const guint8 *in, gsize in_len, guint8 *out, gboolean is_last)
+{
+  gsize out_len = 0, fill, blocks_len;
+
+  // Complete the block left over from the previous chunk first
+  if (dec->carry_len > 0) {
+    fill = MIN (SKIPPY_AES_BLOCK_SIZE - dec->carry_len, in_len);
+    memcpy (dec->carry + dec->carry_len, in, fill);
+    dec->carry_len += fill;
+    in += fill;
+    in_len -= fill;
+    if (dec->carry_len == SKIPPY_AES_BLOCK_SIZE) {
+      out_len += skippy_aes_decryptor_release_held (dec, out + out_len);
+      cbc_decrypt (&dec->ctx, (nettle_cipher_func *) aes128_decrypt, SKIPPY_AES_BLOCK_SIZE,
+        dec->iv, SKIPPY_AES_BLOCK_SIZE, dec->held, dec->carry);
+      dec->has_held = TRUE;
+      dec->carry_len = 0;
+    }
+  }
+
+  // Decrypt all complete blocks straight into the output, except the last one which we hold back
+  blocks_len = in_len - (in_len % SKIPPY_AES_BLOCK_SIZE);
+  if (blocks_len > 0) {
+    out_len += skippy_aes_decryptor_release_held (dec, out + out_len);
+    if (blocks_len > SKIPPY_AES_BLOCK_SIZE) {
+      cbc_decrypt (&dec->ctx, (nettle_cipher_func *) aes128_decrypt, SKIPPY_AES_BLOCK_SIZE,
+        dec->iv, blocks_len - SKIPPY_AES_BLOCK_SIZE, out + out_len, in);
+      out_len += blocks_len - SKIPPY_AES_BLOCK_SIZE;
+    }
+    cbc_decrypt (&dec->ctx, (nettle_cipher_func *) aes128_decrypt, SKIPPY_AES_BLOCK_SIZE,
+      dec->iv, SKIPPY_AES_BLOCK_SIZE, dec->held, in + blocks_len - SKIPPY_AES_BLOCK_SIZE);
+    dec->has_held = TRUE;
+  }
+
+  // Keep the incomplete tail for the next chunk
+  if (in_len > blocks_len) {
+    memcpy (dec->carry + dec->carry_len, in + blocks_len, in_len - blocks_len);
+    dec->carry_len += in_len - blocks_len;
+  }
+
+  if (is_last) {
+    out_len += skippy_aes_decryptor_release_last (dec, out + out_len);
+  }
+  return out_len;
+}
+
+// Key cache mutex must be locked
+static GHashTable*
+skippy_aes_key_cache_get_locked ()
+{
+  if (!key_cache) {
+    key_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  }
+  return key_cache;
+}
+
+// Key cache mutex must be locked
+static void
+skippy_aes_key_cache_remove_locked (const gchar *key_uri)
+{
+  gpointer cached_key;
+
+  if (g_hash_table_lookup_extended (key_cache, key_uri, &cached_key, NULL)) {
+    g_queue_remove (&key_cache_order, cached_key);
+    g_hash_table_remove (key_cache, key_uri);
+  }
+}
+
+// Evicts the loaded key used least recently once we're full, fetches in flight are left alone.
+// Key cache mutex must be locked
+static void
+skippy_aes_key_cache_insert_locked (const gchar *key_uri, SkippyAesKeyCacheEntry *entry)
+{
+  gchar *cached_key = g_strdup (key_uri);
+  GList *link;
+
+  if (g_queue_get_length (&key_cache_order) >= SKIPPY_AES_KEY_CACHE_SIZE) {
+    for (link = key_cache_order.tail; link; link = link->prev) {
+      SkippyAesKeyCacheEntry *evicted = g_hash_table_lookup (key_cache, link->data);
+      if (evicted->loaded) {
+        GST_DEBUG ("Evicting key: %s", (const gchar *) link->data);
+        skippy_aes_key_cache_remove_locked (link->data);
+        break;
+      }
+    }
+  }
+  // The table owns the key, the queue only points to it
+  g_queue_push_head (&key_cache_order, cached_key);
+  g_hash_table_insert (skippy_aes_key_cache_get_locked (), cached_key, entry);
+}
+
+// MT-safe
+SkippyAesKeyCacheResult
+skippy_aes_key_cache_lookup (const gchar *key_uri, guint8 *key, guint *claim,
+  SkippyAesKeyCacheCancelled cancelled, gpointer user_data)
+{
+  SkippyAesKeyCacheEntry *entry;
+  gpointer cached_key;
+  gint64 deadline = g_get_monotonic_time () + KEY_FETCH_WAIT_TIMEOUT;
+
+  skippy_aes_ensure_init ();
+
+  *claim = 0;
+  g_mutex_lock (&key_cache_lock);
+  // Somebody else is fetching this key: wait for the result instead of fetching it twice
+  while ((entry = g_hash_table_lookup (skippy_aes_key_cache_get_locked (), key_uri)) && !entry->loaded) {
+    if (cancelled && cancelled (user_data)) {
+      g_mutex_unlock (&key_cache_lock);
+      GST_DEBUG ("Cancelled waiting for key fetch in flight: %s", key_uri);
+      return SKIPPY_AES_KEY_CACHE_CANCELLED;
+    }
+    if (!g_cond_wait_until (&key_cache_cond, &key_cache_lock, deadline)) {
+      GST_WARNING ("Timed out waiting for key fetch in flight: %s", key_uri);
+      g_mutex_unlock (&key_cache_lock);
+      return SKIPPY_AES_KEY_CACHE_MISS;
+    }
+  }
+
+  if (entry) {
+    memcpy (key, entry->key, SKIPPY_AES_BLOCK_SIZE);
+    // Used last now
+    g_hash_table_lookup_extended (key_cache, key_uri, &cached_key, NULL);
+    g_queue_remove (&key_cache_order, cached_key);
+    g_queue_push_head (&key_cache_order, cached_key);
+    g_mutex_unlock (&key_cache_lock);
+    GST_TRACE ("Key cache hit: %s", key_uri);
+    return SKIPPY_AES_KEY_CACHE_HIT;
+  }
+
+  // Claim the fetch, zero is what lookups that didn't claim anything get
+  entry = g_new0 (SkippyAesKeyCacheEntry, 1);
+  if (++key_cache_last_claim == 0) {
+    key_cache_last_claim++;
+  }
+  entry->claim = *claim = key_cache_last_claim;
+  skippy_aes_key_cache_insert_locked (key_uri, entry);
+  g_mutex_unlock (&key_cache_lock);
+  GST_DEBUG ("Key cache miss: %s", key_uri);
+  return SKIPPY_AES_KEY_CACHE_MISS;
+}
+
+// MT-safe
+void
+skippy_aes_key_cache_store (const gchar *key_uri, const guint8 *key)
+{
+  SkippyAesKeyCacheEntry *entry;
+
+  g_mutex_lock (&key_cache_lock);
+  entry = g_hash_table_lookup (skippy_aes_key_cache_get_locked (), key_uri);
+  if (!entry) {
+    entry = g_new0 (SkippyAesKeyCacheEntry, 1);
+    skippy_aes_key_cache_insert_locked (key_uri, entry);
+  }
+  memcpy (entry->key, key, SKIPPY_AES_BLOCK_SIZE);
+  entry->loaded = TRUE;
+  g_cond_broadcast (&key_cache_cond);
+  g_mutex_unlock (&key_cache_lock);
+}
+
+// Gives up a claimed fetch (i.e download failed) so that waiting threads can retry.
+// Only the owner of the claim does, anybody else leaves the fetch in flight alone.
+//
+// MT-safe
+void
+skippy_aes_key_cache_release (const gchar *key_uri, guint claim)
+{
+  SkippyAesKeyCacheEntry *entry;
+
+  g_mutex_lock (&key_cache_lock);
+  entry = g_hash_table_lookup (skippy_aes_key_cache_get_locked (), key_uri);
+  if (entry && !entry->loaded && claim && entry->claim == claim) {
+    skippy_aes_key_cache_remove_locked (key_uri);
+  }
+  g_cond_broadcast (&key_cache_cond);
+  g_mutex_unlock (&key_cache_lock);
+}
+
+// Wakes up all lookups waiting for a fetch in flight, so that they check whether they got cancelled
+//
+// MT-safe
+void
+skippy_aes_key_cache_wake (void)
+{
+  g_mutex_lock (&key_cache_lock);
+  g_cond_broadcast (&key_cache_cond);
+  g_mutex_unlock (&key_cache_lock);
+}
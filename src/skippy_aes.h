@@ -0,0 +1,72 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_aes.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <nettle/aes.h>
+
+G_BEGIN_DECLS
+
+#define SKIPPY_AES_BLOCK_SIZE 16
+// Keys we remember, the ones used least recently get evicted first
+#define SKIPPY_AES_KEY_CACHE_SIZE 256
+
+// Streaming AES-128-CBC decryptor for HLS media segments
+// Ciphertext can be fed in chunks of any size. Only the last complete plaintext block
+// is held back (it may carry the PKCS7 padding), so memory usage does not depend on segment size.
+typedef struct _SkippyAesDecryptor
+{
+  struct aes128_ctx ctx;
+  guint8 iv[SKIPPY_AES_BLOCK_SIZE];     /* Previous ciphertext block (CBC chaining) */
+  guint8 carry[SKIPPY_AES_BLOCK_SIZE];  /* Incomplete ciphertext block from the previous chunk */
+  gsize carry_len;
+  guint8 held[SKIPPY_AES_BLOCK_SIZE];   /* Last plaintext block, released with the next chunk */
+  gboolean has_held;
+} SkippyAesDecryptor;
+
+void skippy_aes_decryptor_init (SkippyAesDecryptor *dec, const guint8 *key, const guint8 *iv);
+
+// Decrypts a chunk of ciphertext into out, which must have room for in_len + 2 * SKIPPY_AES_BLOCK_SIZE bytes.
+// Set is_last on the final chunk (in_len may be 0) to strip the padding.
+// Returns the number of plaintext bytes written.
+gsize skippy_aes_decryptor_process (SkippyAesDecryptor *dec, const guint8 *in, gsize in_len, guint8 *out, gboolean is_last);
+
+// Process-wide key cache. A MISS with a non-zero claim means the caller now owns the fetch for this URI and must
+// call either _store or _release with that claim. Concurrent lookups for a URI being fetched wait for the result,
+// or until cancelled returns TRUE. It is called with the cache lock held, whoever makes it return TRUE calls _wake.
+// Lookups that time out waiting get a MISS with a zero claim: they fetch the key without owning the entry.
+typedef enum {
+  SKIPPY_AES_KEY_CACHE_HIT,
+  SKIPPY_AES_KEY_CACHE_MISS,
+  SKIPPY_AES_KEY_CACHE_CANCELLED
+} SkippyAesKeyCacheResult;
+
+typedef gboolean (*SkippyAesKeyCacheCancelled) (gpointer user_data);
+
+SkippyAesKeyCacheResult skippy_aes_key_cache_lookup (const gchar *key_uri, guint8 *key, guint *claim,
+  SkippyAesKeyCacheCancelled cancelled, gpointer user_data);
+void skippy_aes_key_cache_store (const gchar *key_uri, const guint8 *key);
+void skippy_aes_key_cache_release (const gchar *key_uri, guint claim);
+void skippy_aes_key_cache_wake (void);
+
+G_END_DECLS
@@ -0,0 +1,192 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_bandwidth_estimator.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "skippy_bandwidth_estimator.h"
+
+// Data is measured in samples spanning at least that long, shorter ones left at the end of a transfer
+// count from half of it on
+#define SAMPLE_DURATION (200*G_TIME_SPAN_MILLISECOND)
+// Weight of a new sample in the estimate
+#define SAMPLE_WEIGHT 0.2
+// Samples off the estimate by more than that factor are outliers, unless that many come in a row
+#define OUTLIER_FACTOR 4.0
+#define OUTLIER_MAX_RUN 3
+// The estimate is reported at most that often
+#define REPORT_INTERVAL (1*G_TIME_SPAN_SECOND)
+
+GST_DEBUG_CATEGORY_STATIC (skippy_bandwidth_estimator_debug);
+#define GST_CAT_DEFAULT skippy_bandwidth_estimator_debug
+
+struct _SkippyBandwidthEstimator
+{
+  gint ref_count;
+  GMutex lock;
+  guint transfers;            /* Running in parallel */
+  gint64 sample_start;        /* Monotonic time, 0 until the first data of the transfers arrived */
+  gsize sample_bytes;
+  gdouble estimate;           /* Bytes per second */
+  gdouble outliers;           /* Sum of the outliers in a row */
+  guint outlier_run;
+  gint outlier_direction;
+  gint64 last_report;
+};
+
+static gpointer skippy_bandwidth_estimator_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_bandwidth_estimator_debug, "skippyhls-bandwidth", 0, "HLS bandwidth estimation");
+  return NULL;
+}
+
+SkippyBandwidthEstimator *
+skippy_bandwidth_estimator_new (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+  SkippyBandwidthEstimator *estimator;
+
+  g_once (&init_once, skippy_bandwidth_estimator_init_once, NULL);
+
+  estimator = g_slice_new0 (SkippyBandwidthEstimator);
+  estimator->ref_count = 1;
+  g_mutex_init (&estimator->lock);
+  return estimator;
+}
+
+SkippyBandwidthEstimator *
+skippy_bandwidth_estimator_ref (SkippyBandwidthEstimator * estimator)
+{
+  g_atomic_int_inc (&estimator->ref_count);
+  return estimator;
+}
+
+void
+skippy_bandwidth_estimator_unref (SkippyBandwidthEstimator * estimator)
+{
+  if (!g_atomic_int_dec_and_test (&estimator->ref_count)) {
+    return;
+  }
+  g_mutex_clear (&estimator->lock);
+  g_slice_free (SkippyBandwidthEstimator, estimator);
+}
+
+// Takes a sample into the estimate. Expects the lock to be held.
+static void
+skippy_bandwidth_estimator_add_sample (SkippyBandwidthEstimator * estimator, gsize bytes, gint64 duration)
+{
+  gdouble rate = (gdouble) bytes * G_TIME_SPAN_SECOND / duration;
+  gint direction;
+
+  if (estimator->estimate <= 0) {
+    estimator->estimate = rate;
+    return;
+  }
+
+  direction = rate > estimator->estimate * OUTLIER_FACTOR ? 1 : rate * OUTLIER_FACTOR < estimator->estimate ? -1 : 0;
+  if (direction) {
+    if (direction != estimator->outlier_direction) {
+      estimator->outlier_direction = direction;
+      estimator->outlier_run = 0;
+      estimator->outliers = 0;
+    }
+    estimator->outlier_run++;
+    estimator->outliers += rate;
+    if (estimator->outlier_run < OUTLIER_MAX_RUN) {
+      GST_LOG ("Dropping outlier of %.0f bytes/s against %.0f bytes/s", rate, estimator->estimate);
+      return;
+    }
+    // Not an outlier anymore, the link changed
+    GST_DEBUG ("Throughput moved from %.0f bytes/s to %.0f bytes/s", estimator->estimate,
+      estimator->outliers / estimator->outlier_run);
+    estimator->estimate = estimator->outliers / estimator->outlier_run;
+  } else {
+    estimator->estimate = SAMPLE_WEIGHT * rate + (1 - SAMPLE_WEIGHT) * estimator->estimate;
+  }
+  estimator->outlier_direction = 0;
+  estimator->outlier_run = 0;
+  estimator->outliers = 0;
+}
+
+void
+skippy_bandwidth_estimator_begin (SkippyBandwidthEstimator * estimator)
+{
+  g_mutex_lock (&estimator->lock);
+  // Joining transfers already running just add to their sample
+  if (estimator->transfers++ == 0) {
+    estimator->sample_start = 0;
+    estimator->sample_bytes = 0;
+  }
+  g_mutex_unlock (&estimator->lock);
+}
+
+gboolean
+skippy_bandwidth_estimator_add_bytes (SkippyBandwidthEstimator * estimator, gsize bytes)
+{
+  gint64 now = g_get_monotonic_time ();
+  gboolean report = FALSE;
+
+  g_mutex_lock (&estimator->lock);
+  if (!estimator->transfers) {
+    g_mutex_unlock (&estimator->lock);
+    return FALSE;
+  }
+  // The first data only tells us when the transfer really started
+  if (!estimator->sample_start) {
+    estimator->sample_start = now;
+    g_mutex_unlock (&estimator->lock);
+    return FALSE;
+  }
+  estimator->sample_bytes += bytes;
+  if (now - estimator->sample_start >= SAMPLE_DURATION) {
+    skippy_bandwidth_estimator_add_sample (estimator, estimator->sample_bytes, now - estimator->sample_start);
+    estimator->sample_start = now;
+    estimator->sample_bytes = 0;
+    if (estimator->estimate > 0 && now - estimator->last_report >= REPORT_INTERVAL) {
+      estimator->last_report = now;
+      report = TRUE;
+    }
+  }
+  g_mutex_unlock (&estimator->lock);
+  return report;
+}
+
+void
+skippy_bandwidth_estimator_end (SkippyBandwidthEstimator * estimator)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&estimator->lock);
+  if (estimator->transfers && --estimator->transfers == 0
+    && estimator->sample_start && now - estimator->sample_start >= SAMPLE_DURATION / 2) {
+    skippy_bandwidth_estimator_add_sample (estimator, estimator->sample_bytes, now - estimator->sample_start);
+  }
+  g_mutex_unlock (&estimator->lock);
+}
+
+guint64
+skippy_bandwidth_estimator_get (SkippyBandwidthEstimator * estimator)
+{
+  guint64 bits;
+
+  g_mutex_lock (&estimator->lock);
+  bits = (guint64) (estimator->estimate * 8);
+  g_mutex_unlock (&estimator->lock);
+  return bits;
+}
@@ -0,0 +1,49 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_bandwidth_estimator.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Estimates the throughput of the link from data arriving while a transfer runs. The time until the first data
+// of a transfer arrives is left out, so are the gaps between transfers. Samples far off the estimate are dropped
+// as outliers unless they keep coming. All functions are MT-safe.
+// Reference counted: transfers running in parallel share one, their data adds up over the time they run.
+typedef struct _SkippyBandwidthEstimator SkippyBandwidthEstimator;
+
+SkippyBandwidthEstimator *skippy_bandwidth_estimator_new (void);
+SkippyBandwidthEstimator *skippy_bandwidth_estimator_ref (SkippyBandwidthEstimator * estimator);
+void skippy_bandwidth_estimator_unref (SkippyBandwidthEstimator * estimator);
+
+// A transfer got its response, measuring starts with the first data arriving unless others run already
+void skippy_bandwidth_estimator_begin (SkippyBandwidthEstimator * estimator);
+// Data arrived. Returns TRUE when it is time to report the estimate again.
+gboolean skippy_bandwidth_estimator_add_bytes (SkippyBandwidthEstimator * estimator, gsize bytes);
+// A transfer we began is over, whatever follows until the next one is idle time
+void skippy_bandwidth_estimator_end (SkippyBandwidthEstimator * estimator);
+
+// Bits per second, 0 until we measured anything
+guint64 skippy_bandwidth_estimator_get (SkippyBandwidthEstimator * estimator);
+
+G_END_DECLS
@@ -61,6 +61,8 @@ static void
 skippy_fragment_init (SkippyFragment * fragment)
 {
   fragment->download_start_time = gst_util_get_timestamp ();
+  fragment->time_to_first_byte = GST_CLOCK_TIME_NONE;
+  fragment->sequence_number = 0;
   fragment->start_time = 0;
   fragment->stop_time = 0;
   fragment->duration = 0;
@@ -70,6 +72,11 @@ skippy_fragment_init (SkippyFragment * fragment)
   fragment->cancelled = FALSE;
   fragment->discontinuous = FALSE;
   fragment->size = 0;
+  fragment->key_uri = NULL;
+  fragment->map_uri = NULL;
+  fragment->map_range_start = 0;
+  fragment->map_range_end = -1;
+  fragment->key_loaded = FALSE;
 }
 
 SkippyFragment *
@@ -92,6 +99,7 @@ skippy_fragment_dispose (GObject * object)
   g_free (fragment->uri);
   
   g_free (fragment->key_uri);
+  g_free (fragment->map_uri);
 
   G_OBJECT_CLASS (skippy_fragment_parent_class)->dispose (object);
 
@@ -43,13 +43,19 @@ struct _SkippyFragment
   GObject parent;
 
   gchar* uri;                    /* URI of the fragment */
+  guint64 sequence_number;       /* Index of the fragment in the playlist */
   gchar *key_uri;                /* Encryption key */
   guint8 iv[16];                 /* Encryption IV */
+  guint8 key[16];                /* AES-128 key data (valid once key_loaded is set) */
+  gboolean key_loaded;           /* Whether the key for key_uri has been loaded */
   gint64 range_start, range_end; /* Byte range @ URI */
+  gchar *map_uri;                /* Media initialization section (EXT-X-MAP) */
+  gint64 map_range_start, map_range_end; /* Byte range @ map URI */
   gboolean completed;            /* Whether the fragment is complete or not */
   gboolean cancelled;            /* Wether the fragment download was cancelled */
   guint64 download_start_time;   /* Epoch time when the download started */
   guint64 download_stop_time;    /* Epoch time when the download finished */
+  GstClockTime time_to_first_byte; /* From the request to the response, GST_CLOCK_TIME_NONE if none came */
   guint64 start_time;            /* Media start time of the fragment */
   guint64 stop_time;             /* Media stop time of the fragment */
   guint64 duration;              /* Media fragment duration */
@@ -0,0 +1,268 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_fragment_cache.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "skippy_fragment_cache.h"
+
+GST_DEBUG_CATEGORY_STATIC (skippy_fragment_cache_debug);
+#define GST_CAT_DEFAULT skippy_fragment_cache_debug
+
+typedef struct
+{
+  guint64 sequence_number;
+  GstClockTime start_time;
+  GstClockTime stop_time;
+  GstBufferList *buffers;
+  gsize size;
+} SkippyFragmentCacheEntry;
+
+struct _SkippyFragmentCache
+{
+  GMutex lock;
+  GQueue entries;                       /* Completely retained fragments */
+  SkippyFragmentCacheEntry *recording;  /* Fragment currently being downloaded */
+  gsize size;                           /* Bytes retained in complete entries */
+  gsize max_bytes;
+};
+
+static gpointer skippy_fragment_cache_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_fragment_cache_debug, "skippyhls-fragment-cache", 0, "HLS fragment cache");
+  return NULL;
+}
+
+static void
+skippy_fragment_cache_entry_free (SkippyFragmentCacheEntry * entry)
+{
+  gst_buffer_list_unref (entry->buffers);
+  g_slice_free (SkippyFragmentCacheEntry, entry);
+}
+
+SkippyFragmentCache *
+skippy_fragment_cache_new (gsize max_bytes)
+{
+  static GOnce init_once = G_ONCE_INIT;
+  g_once (&init_once, skippy_fragment_cache_init_once, NULL);
+
+  SkippyFragmentCache *cache = g_slice_new0 (SkippyFragmentCache);
+  g_mutex_init (&cache->lock);
+  g_queue_init (&cache->entries);
+  cache->max_bytes = max_bytes;
+  return cache;
+}
+
+void
+skippy_fragment_cache_free (SkippyFragmentCache * cache)
+{
+  skippy_fragment_cache_clear (cache);
+  g_mutex_clear (&cache->lock);
+  g_slice_free (SkippyFragmentCache, cache);
+}
+
+// Cache lock must be held
+static void
+skippy_fragment_cache_remove_locked (SkippyFragmentCache * cache, GList * link)
+{
+  SkippyFragmentCacheEntry *entry = link->data;
+  GST_TRACE ("Evicting fragment %" G_GUINT64_FORMAT " (%" G_GSIZE_FORMAT " bytes)", entry->sequence_number, entry->size);
+  cache->size -= entry->size;
+  g_queue_delete_link (&cache->entries, link);
+  skippy_fragment_cache_entry_free (entry);
+}
+
+// Cache lock must be held
+static GList *
+skippy_fragment_cache_find_locked (SkippyFragmentCache * cache, guint64 sequence_number)
+{
+  GList *l;
+  for (l = cache->entries.head; l; l = l->next) {
+    if (((SkippyFragmentCacheEntry *) l->data)->sequence_number == sequence_number) {
+      return l;
+    }
+  }
+  return NULL;
+}
+
+// MT-safe
+void
+skippy_fragment_cache_begin (SkippyFragmentCache * cache, guint64 sequence_number, GstClockTime start_time, GstClockTime stop_time)
+{
+  SkippyFragmentCacheEntry *entry = g_slice_new0 (SkippyFragmentCacheEntry);
+  entry->sequence_number = sequence_number;
+  entry->start_time = start_time;
+  entry->stop_time = stop_time;
+  entry->buffers = gst_buffer_list_new ();
+
+  g_mutex_lock (&cache->lock);
+  if (cache->recording) {
+    skippy_fragment_cache_entry_free (cache->recording);
+  }
+  cache->recording = entry;
+  g_mutex_unlock (&cache->lock);
+}
+
+// MT-safe
+void
+skippy_fragment_cache_append (SkippyFragmentCache * cache, GstBuffer * buffer)
+{
+  g_mutex_lock (&cache->lock);
+  if (cache->recording) {
+    gst_buffer_list_add (cache->recording->buffers, gst_buffer_ref (buffer));
+    cache->recording->size += gst_buffer_get_size (buffer);
+  }
+  g_mutex_unlock (&cache->lock);
+}
+
+// MT-safe
+void
+skippy_fragment_cache_commit (SkippyFragmentCache * cache)
+{
+  GList *link;
+  SkippyFragmentCacheEntry *entry;
+
+  g_mutex_lock (&cache->lock);
+  entry = cache->recording;
+  cache->recording = NULL;
+  if (!entry) {
+    g_mutex_unlock (&cache->lock);
+    return;
+  }
+  if (gst_buffer_list_length (entry->buffers) == 0) {
+    skippy_fragment_cache_entry_free (entry);
+    g_mutex_unlock (&cache->lock);
+    return;
+  }
+  // Replace an eventual older copy of this fragment
+  if ((link = skippy_fragment_cache_find_locked (cache, entry->sequence_number))) {
+    skippy_fragment_cache_remove_locked (cache, link);
+  }
+  g_queue_push_tail (&cache->entries, entry);
+  cache->size += entry->size;
+  GST_DEBUG ("Retained fragment %" G_GUINT64_FORMAT " (%" GST_TIME_FORMAT " - %" GST_TIME_FORMAT ", %" G_GSIZE_FORMAT " bytes)",
+    entry->sequence_number, GST_TIME_ARGS (entry->start_time), GST_TIME_ARGS (entry->stop_time), entry->size);
+  g_mutex_unlock (&cache->lock);
+}
+
+// MT-safe
+void
+skippy_fragment_cache_abort (SkippyFragmentCache * cache)
+{
+  g_mutex_lock (&cache->lock);
+  if (cache->recording) {
+    skippy_fragment_cache_entry_free (cache->recording);
+    cache->recording = NULL;
+  }
+  g_mutex_unlock (&cache->lock);
+}
+
+// MT-safe
+GstBufferList *
+skippy_fragment_cache_lookup (SkippyFragmentCache * cache, guint64 sequence_number)
+{
+  GList *link;
+  GstBufferList *buffers = NULL;
+
+  g_mutex_lock (&cache->lock);
+  if ((link = skippy_fragment_cache_find_locked (cache, sequence_number))) {
+    buffers = gst_buffer_list_ref (((SkippyFragmentCacheEntry *) link->data)->buffers);
+  }
+  g_mutex_unlock (&cache->lock);
+  return buffers;
+}
+
+// MT-safe
+void
+skippy_fragment_cache_evict (SkippyFragmentCache * cache, GstClockTime position, GstClockTime retain_behind)
+{
+  GList *l, *next, *farthest;
+  GstClockTime keep_from = position > retain_behind ? position - retain_behind : 0;
+  GstClockTime distance, max_distance;
+  SkippyFragmentCacheEntry *entry;
+
+  g_mutex_lock (&cache->lock);
+  for (l = cache->entries.head; l; l = next) {
+    next = l->next;
+    if (((SkippyFragmentCacheEntry *) l->data)->stop_time <= keep_from) {
+      skippy_fragment_cache_remove_locked (cache, l);
+    }
+  }
+
+  while (cache->max_bytes && cache->size > cache->max_bytes && cache->entries.head) {
+    farthest = NULL;
+    max_distance = 0;
+    for (l = cache->entries.head; l; l = l->next) {
+      entry = l->data;
+      distance = entry->start_time > position ? entry->start_time - position :
+        (entry->stop_time < position ? position - entry->stop_time : 0);
+      if (!farthest || distance > max_distance) {
+        farthest = l;
+        max_distance = distance;
+      }
+    }
+    skippy_fragment_cache_remove_locked (cache, farthest);
+  }
+  g_mutex_unlock (&cache->lock);
+}
+
+// MT-safe
+void
+skippy_fragment_cache_clear (SkippyFragmentCache * cache)
+{
+  g_mutex_lock (&cache->lock);
+  while (cache->entries.head) {
+    skippy_fragment_cache_remove_locked (cache, cache->entries.head);
+  }
+  if (cache->recording) {
+    skippy_fragment_cache_entry_free (cache->recording);
+    cache->recording = NULL;
+  }
+  g_mutex_unlock (&cache->lock);
+}
+
+// MT-safe
+gsize
+skippy_fragment_cache_get_size (SkippyFragmentCache * cache)
+{
+  gsize size;
+  g_mutex_lock (&cache->lock);
+  size = cache->size;
+  g_mutex_unlock (&cache->lock);
+  return size;
+}
+
+// MT-safe
+gsize
+skippy_fragment_cache_get_size_behind (SkippyFragmentCache * cache, GstClockTime position)
+{
+  GList *l;
+  SkippyFragmentCacheEntry *entry;
+  gsize size = 0;
+
+  g_mutex_lock (&cache->lock);
+  for (l = cache->entries.head; l; l = l->next) {
+    entry = l->data;
+    if (entry->stop_time <= position) {
+      size += entry->size;
+    }
+  }
+  g_mutex_unlock (&cache->lock);
+  return size;
+}
@@ -0,0 +1,54 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_fragment_cache.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Retains the buffers we pushed downstream per fragment (sequence number and media time range),
+// so that seeking into a fragment we already downloaded can replay it without any network request.
+// Buffers are shared by reference with the download queue, so retaining them costs no copy.
+typedef struct _SkippyFragmentCache SkippyFragmentCache;
+
+SkippyFragmentCache *skippy_fragment_cache_new (gsize max_bytes);
+void skippy_fragment_cache_free (SkippyFragmentCache * cache);
+
+// Recording of the fragment currently being downloaded
+void skippy_fragment_cache_begin (SkippyFragmentCache * cache, guint64 sequence_number, GstClockTime start_time, GstClockTime stop_time);
+void skippy_fragment_cache_append (SkippyFragmentCache * cache, GstBuffer * buffer);
+void skippy_fragment_cache_commit (SkippyFragmentCache * cache);
+void skippy_fragment_cache_abort (SkippyFragmentCache * cache);
+
+// Returns the buffers of a completely retained fragment or NULL. Caller owns the returned list.
+GstBufferList *skippy_fragment_cache_lookup (SkippyFragmentCache * cache, guint64 sequence_number);
+
+// Drops fragments ending before position - retain_behind, then the ones farthest from position until within the byte limit
+void skippy_fragment_cache_evict (SkippyFragmentCache * cache, GstClockTime position, GstClockTime retain_behind);
+void skippy_fragment_cache_clear (SkippyFragmentCache * cache);
+
+gsize skippy_fragment_cache_get_size (SkippyFragmentCache * cache);
+// Bytes of the retained fragments ending before position (the ones no longer held by the download queue)
+gsize skippy_fragment_cache_get_size_behind (SkippyFragmentCache * cache, GstClockTime position);
+
+G_END_DECLS
@@ -31,29 +31,90 @@
 #include <math.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <gst/base/gsttypefindhelper.h>
 
 #include "skippy_hlsdemux.h"
 #include "skippyHLS/skippy_hls.h"
 #include "skippy_hls_priv.h"
+#include "skippy_aes.h"
+#include "skippy_task_pool.h"
 #include "glib.h"
 
 #define RETRY_TIME_BASE (500*GST_MSECOND)
 #define RETRY_MAX_TIME_UNTIL (45*GST_SECOND)
 
-// Must be doubles above zero
-#define BUFFER_WATERMARK_HIGH_RATIO 0.5
+// Must be doubles above zero, relative to download-ahead - low must not exceed high
+// We download in bursts from the low to the high mark so that the radio can idle in between
+#define BUFFER_WATERMARK_HIGH_RATIO 1.0
 #define BUFFER_WATERMARK_LOW_RATIO 0.5
 
 #define DEFAULT_BUFFER_DURATION (30*GST_SECOND)
 #define MIN_BUFFER_DURATION (10*GST_SECOND)
 
+// Adaptive buffer target: we buffer the most while the pessimistic throughput (mean less one standard deviation of the
+// bandwidth estimates after recent downloads) is up to the low headroom times the media byte rate, and the least from
+// the high headroom on
+#define DEFAULT_ADAPTIVE_BUFFER TRUE
+#define ADAPTIVE_BUFFER_MIN_SAMPLES 3
+#define ADAPTIVE_BUFFER_LOW_HEADROOM 1.5
+#define ADAPTIVE_BUFFER_HIGH_HEADROOM 4.0
+// Smaller changes of the target are not worth it
+#define ADAPTIVE_BUFFER_STEP (2*GST_SECOND)
+
 #define MAX_FAILED_COUNT 20
 
+// How much already played media we keep around for seeking back
+#define FRAGMENT_CACHE_RETAIN_BEHIND (30*GST_SECOND)
+#define FRAGMENT_CACHE_MAX_BYTES (4*1024*1024)
+
+// Fragments starting further ahead of the playhead go to the spill file (when a spill directory is set)
+#define SPILL_AHEAD_THRESHOLD (10*GST_SECOND)
+#define SPILL_FILE_MAX_BYTES (32*1024*1024)
+// Safety net for the scheduler, it normally gets woken up by the download queue
+#define SCHEDULER_MAX_IDLE (60*GST_SECOND)
+
 #define OPUS_FORMAT_PARAM "hls_opus_64_url"
 #define MP3_FORMAT_PARAM "hls_mp3_128_url"
 #define FORMAT_PARAM "format"
 #define FORMAT_OPUS_PARAM "format=hls_opus_64_url"
 
+// Size of the buffers we hand on per codec, 0 passes the received buffers through as they are
+#define DEFAULT_MP3_SLICE_SIZE 0
+#define DEFAULT_OPUS_SLICE_SIZE 0
+// Opus packets are handed on in batches spanning at least that much media, 0 batches per Ogg page
+#define DEFAULT_OPUS_BATCH_DURATION 0
+// Whether we split MP3 into frames ourselves, otherwise downstream needs a parser
+#define DEFAULT_MP3_FRAMING FALSE
+// Same for AAC in ADTS
+#define DEFAULT_AAC_FRAMING FALSE
+// Whether we take audio out of MPEG-TS ourselves, otherwise downstream needs a demuxer
+#define DEFAULT_TS_DEMUXING FALSE
+// Large fragments get loaded in up to that many byte ranges at once, none smaller than the minimum
+#define PARALLEL_RANGE_MIN_SIZE (256*1024)
+// Media downloads going slower than the minimum rate over a whole window get resumed over a new connection, 0 for never
+#define DEFAULT_STALL_MIN_RATE 0
+#define DEFAULT_STALL_WINDOW (4*GST_SECOND)
+
+#define OPUS_SAMPLE_RATE 48000
+// Bytes we ask for when we don't know yet where the Opus header pages of a stream end
+#define OPUS_HEADER_PROBE_SIZE (16*1024)
+// Seeking into an Opus fragment: bisect over byte ranges of that size for a page close enough before the target,
+// unless the target is that near to the fragment start anyway
+#define OPUS_SEEK_PROBE_SIZE (8*1024)
+#define OPUS_SEEK_MAX_PROBES 4
+#define OPUS_SEEK_TOLERANCE (1*GST_SECOND)
+#define OPUS_SEEK_MIN_SKIP (2*GST_SECOND)
+// Streams we remember the Opus header size of
+#define OPUS_HEADER_CACHE_SIZE 64
+// Byte rate of hls_opus_64_url, until we measured one
+#define OPUS_DEFAULT_BYTE_RATE (64000/8)
+// Seeking into an MP3 fragment: start loading at the byte the target maps to with a constant bitrate
+#define MP3_SEEK_MIN_SKIP (1*GST_SECOND)
+// Byte rate of hls_mp3_128_url, until we saw a frame header
+#define MP3_DEFAULT_BYTE_RATE (128000/8)
+// PES time stamps further apart than that are a discontinuity in the stream
+#define TS_PTS_MAX_GAP (5*GST_SECOND)
+
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src_%u",
     GST_PAD_SRC,
     GST_PAD_SOMETIMES,
@@ -66,6 +127,12 @@ static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
 
 GST_DEBUG_CATEGORY_STATIC (skippy_hls_demux_debug);
 #define GST_CAT_DEFAULT skippy_hls_demux_debug
+
+// Size of the Opus header pages (OpusHead & OpusTags) per stream, lives across element instances.
+// Keeps the streams used most recently, the queue holds the keys of the table with the latest first.
+static GMutex opus_header_cache_lock;
+static GHashTable *opus_header_cache = NULL;
+static GQueue opus_header_cache_order = G_QUEUE_INIT;
 #define SKIPPY_HLS_DOWNLOAD_AHEAD "skippy-download-ahead"
 
 //NOTE: if an error is considered recoverable from category will be STREAM, code DEMUX.
@@ -87,12 +154,49 @@ typedef enum
   STAT_TIME_OF_FIRST_PLAYLIST,
   STAT_TIME_TO_PLAYLIST,
   STAT_TIME_TO_DOWNLOAD_FRAGMENT,
-  STAT_CODEC_TYPE
+  STAT_CODEC_TYPE,
+  STAT_MEMORY_USAGE,
+  STAT_RADIO_ACTIVE_TIME,
+  STAT_HEDGED_REQUESTS,
+  STAT_BUFFER_TARGET
 } SkippyHLSDemuxStats;
 
+// What the stream task loop gets woken up for
+typedef enum
+{
+  EVENT_SCHEDULE,     // Check the buffer levels and fetch the next fragment if we should
+  EVENT_FETCH_DONE,   // The fetch is through with its fragment
+  EVENT_RETRY,        // Backoff after a failure is over
+  EVENT_SEEK          // Apply a seek
+} SkippyHLSDemuxEventType;
+
+// How to go on after a fetch
+typedef enum
+{
+  FETCH_NEXT,         // Schedule the next fragment
+  FETCH_RETRY,        // Try again after a backoff
+  FETCH_IDLE          // Nothing to do until we seek
+} SkippyHLSDemuxFetchOutcome;
+
+typedef struct
+{
+  SkippyHLSDemux *demux;
+  SkippyHLSDemuxEventType type;
+  guint epoch;
+  SkippyHLSDemuxFetchOutcome outcome; /* Of EVENT_FETCH_DONE */
+  GstEvent *seek;                     /* Of EVENT_SEEK */
+} SkippyHLSDemuxEvent;
+
+enum
+{
+  PROP_0,
+  PROP_BANDWIDTH_ESTIMATE
+};
+
 /* GObject */
 static void skippy_hls_demux_dispose (GObject * obj);
 static void skippy_hls_demux_finalize (GObject * obj);
+static void skippy_hls_demux_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
 
 /* GstElement */
 static GstStateChangeReturn
@@ -106,7 +210,6 @@ static gboolean skippy_hls_demux_sink_event (GstPad * pad, GstObject * parent, G
 static gboolean skippy_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event);
 static gboolean skippy_hls_demux_src_query (GstPad * pad, GstObject * parent, GstQuery * query);
 static gboolean skippy_hls_demux_handle_seek (SkippyHLSDemux *demux, GstEvent * event);
-static void skippy_hls_demux_stream_loop (SkippyHLSDemux * demux);
 static void skippy_hls_demux_stop (SkippyHLSDemux * demux);
 static void skippy_hls_demux_pause (SkippyHLSDemux * demux);
 static void skippy_hls_demux_reset (SkippyHLSDemux * demux);
@@ -114,11 +217,25 @@ static void skippy_hls_demux_link_pads (SkippyHLSDemux * demux);
 static gboolean skippy_hls_demux_refresh_playlist (SkippyHLSDemux * demux);
 static GstFlowReturn skippy_hls_demux_proxy_pad_chain (GstPad *pad, GstObject *parent, GstBuffer *buffer);
 static gboolean skippy_hls_demux_proxy_pad_event (GstPad *pad, GstObject *parent, GstEvent *event);
+static GstPadProbeReturn skippy_hls_demux_queue_sink_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+static GstPadProbeReturn skippy_hls_demux_queue_src_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+static void skippy_hls_demux_clear_playhead_marks_locked (SkippyHLSDemux * demux);
+static SkippyHLSDemuxEvent *skippy_hls_demux_event_new_locked (SkippyHLSDemux * demux, SkippyHLSDemuxEventType type);
+static void skippy_hls_demux_post_event (SkippyHLSDemux * demux, SkippyHLSDemuxEvent * event);
+static void skippy_hls_demux_post_locked (SkippyHLSDemux * demux, SkippyHLSDemuxEventType type);
+static void skippy_hls_demux_reset_loop_locked (SkippyHLSDemux * demux);
+static void skippy_hls_demux_join_fetch (SkippyHLSDemux * demux);
+static void skippy_hls_demux_pause_loop (SkippyHLSDemux * demux);
+static void skippy_hls_demux_start_timer_locked (SkippyHLSDemux * demux, GSource ** timer, GstClockTime timeout,
+  SkippyHLSDemuxEventType type);
 
 /* Utility functions */
 static void skippy_hls_demux_append_query_param_to_hls_url (gchar **url, const gchar* query_param_name, const gchar* query_param_value);
 static void http_replace_query_parameter(gchar **url, const gchar* query_param_name, const gchar* query_param_value);
 static GstFlowReturn skippy_hls_demux_read_ogg_and_push_opus_packets(SkippyHLSDemux *demux, GstBuffer *buffer);
+static GstClockTime skippy_hls_demux_opus_granule_to_time (SkippyHLSDemux *demux, gint64 granule);
+static const SkippyHLSDemuxPacketizer* skippy_hls_demux_find_packetizer (GstCaps *caps);
+static void skippy_hls_demux_set_input_caps (SkippyHLSDemux *demux, GstCaps *caps);
 
 #define skippy_hls_demux_parent_class parent_class
 G_DEFINE_TYPE (SkippyHLSDemux, skippy_hls_demux, GST_TYPE_BIN);
@@ -135,6 +252,13 @@ skippy_hls_demux_class_init (SkippyHLSDemuxClass * klass)
 
   gobject_class->dispose = skippy_hls_demux_dispose;
   gobject_class->finalize = skippy_hls_demux_finalize;
+  gobject_class->get_property = skippy_hls_demux_get_property;
+
+  // Also posted as "skippy-hlsdemux-bandwidth" element messages while it changes
+  g_object_class_install_property (gobject_class, PROP_BANDWIDTH_ESTIMATE,
+      g_param_spec_uint64 ("bandwidth-estimate", "Bandwidth estimate",
+          "Bandwidth of the link in bits per second as measured on media downloads (0 = unknown yet)",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
   element_class->change_state = GST_DEBUG_FUNCPTR (skippy_hls_demux_change_state);
   element_class->set_context = skippy_hls_demux_set_context;
@@ -157,17 +281,32 @@ skippy_hls_demux_class_init (SkippyHLSDemuxClass * klass)
       "Skippy HLS client");
 }
 
+static void
+skippy_hls_demux_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (object);
+
+  switch (prop_id) {
+  case PROP_BANDWIDTH_ESTIMATE:
+    g_value_set_uint64 (value, skippy_uri_downloader_get_bandwidth (demux->downloader));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    break;
+  }
+}
+
 // Creating the element with all the internal components whose lifetime will span across states
 // See: _dispose and _finalize functions where we free all of this
 static void
 skippy_hls_demux_init (SkippyHLSDemux * demux)
 {
+  GstPad *queue_srcpad;
+
   // Pads
   demux->srcpad = NULL;
   demux->sinkpad = gst_pad_new_from_static_template (&sinktemplate, "sink");
 
-  demux->out_adapter = gst_adapter_new();
-
   // Configure sink pad
   gst_pad_set_chain_function (demux->sinkpad, GST_DEBUG_FUNCPTR (skippy_hls_demux_sink_data));
   gst_pad_set_event_function (demux->sinkpad, GST_DEBUG_FUNCPTR (skippy_hls_demux_sink_event));
@@ -175,14 +314,30 @@ skippy_hls_demux_init (SkippyHLSDemux * demux)
 
   // Member objects
   demux->client = skippy_m3u8_client_new ();
+  demux->fragment_cache = skippy_fragment_cache_new (FRAGMENT_CACHE_MAX_BYTES);
+  demux->host_selector = skippy_host_selector_new ();
   demux->playlist = NULL;                 // Storage for initial playlist
   demux->caps = NULL;
-  demux->oggDemux = createOggDecoder();
+  demux->ogg_framer = skippy_ogg_framer_new ();
+  demux->mp3_framer = skippy_mp3_framer_new ();
+  demux->aac_framer = skippy_adts_framer_new ();
+  demux->ts_demuxer = skippy_ts_demuxer_new ();
+  demux->init_sections = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) gst_buffer_unref);
+  demux->init_section_key = NULL;
   demux->rand_gen = g_rand_new();         //  Random number generator (seed taken from /dev/urandom or current ts)
 
   // Internal elements
   demux->download_queue = gst_element_factory_make ("queue2", "skippyhlsdemux-download-queue");
   demux->queue_sinkpad = gst_element_get_static_pad (demux->download_queue, "sink");
+  // Track what goes in and out of the queue to know where playback is without asking downstream
+  queue_srcpad = gst_element_get_static_pad (demux->download_queue, "src");
+  gst_pad_add_probe (demux->queue_sinkpad,
+    GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST | GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+    skippy_hls_demux_queue_sink_probe, demux, NULL);
+  gst_pad_add_probe (queue_srcpad,
+    GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+    skippy_hls_demux_queue_src_probe, demux, NULL);
+  gst_object_unref (queue_srcpad);
   demux->downloader = skippy_uri_downloader_new (TRUE);
   demux->playlist_downloader = skippy_uri_downloader_new (FALSE);
 
@@ -201,21 +356,76 @@ skippy_hls_demux_init (SkippyHLSDemux * demux)
   gst_segment_init (&demux->segment, GST_FORMAT_TIME);
 
   demux->download_ahead = DEFAULT_BUFFER_DURATION;
+  demux->adaptive_buffer = DEFAULT_ADAPTIVE_BUFFER;
+  demux->buffer_target = GST_CLOCK_TIME_NONE;
+  demux->throughput_count = 0;
   demux->force_secure_hls = FALSE;
+
+  demux->mp3_slice_size = DEFAULT_MP3_SLICE_SIZE;
+  demux->mp3_framing = DEFAULT_MP3_FRAMING;
+  demux->aac_framing = DEFAULT_AAC_FRAMING;
+  demux->ts_demuxing = DEFAULT_TS_DEMUXING;
+  demux->stall_min_rate = DEFAULT_STALL_MIN_RATE;
+  demux->stall_window = DEFAULT_STALL_WINDOW;
+  demux->hedging = FALSE;
+  demux->hedge_to_mirror = FALSE;
+  demux->opus_slice_size = DEFAULT_OPUS_SLICE_SIZE;
+  demux->opus_batch_duration = DEFAULT_OPUS_BATCH_DURATION;
+  demux->opus_batch = NULL;
+  demux->opus_batch_start = GST_CLOCK_TIME_NONE;
+  demux->opus_pre_skip = 0;
+  demux->opus_granule = -1;
+
+  demux->spill_file = NULL;
+  demux->spill_directory = NULL;
+  demux->spill_fragment = FALSE;
+  demux->max_buffer_bytes = 0;
+  demux->media_byte_rate = 0;
+  demux->playback_position = GST_CLOCK_TIME_NONE;
+  demux->memory_usage_peak = 0;
+
+  g_queue_init (&demux->playhead_marks);
+  demux->queue_bytes_in = 0;
+  demux->queue_bytes_out = 0;
+  demux->wake_armed = FALSE;
+  demux->wake_position = GST_CLOCK_TIME_NONE;
+  demux->wake_queue_bytes = 0;
+
+  demux->burst_start_time = 0;
+  demux->burst_bytes = 0;
+  demux->radio_active_time = 0;
   
   demux->dataCodec = UNKNOWN;
-  demux->opus_init_data = g_malloc (129);
-  demux->opus_init_data_written = 0;
-  demux->opus_0_fragment_cached = FALSE;
+  demux->packetizer = skippy_hls_demux_find_packetizer (NULL);
+  demux->opus_header_size = 0;
+  demux->opus_header_complete = FALSE;
+  demux->opus_header_fetch = FALSE;
+  demux->opus_header_probe_failed = FALSE;
+  demux->mp3_header_known = FALSE;
+  demux->mp3_vbr = FALSE;
+  demux->aac_header_known = FALSE;
+  demux->mp3_resync_offset = -1;
+  demux->mp3_resync_start = GST_CLOCK_TIME_NONE;
+  demux->frame_next_pts = GST_CLOCK_TIME_NONE;
+  demux->frame_discont = FALSE;
+  demux->ts_packetizer = NULL;
+  demux->ts_pts_offset = 0;
+  demux->ts_last_pts = GST_CLOCK_TIME_NONE;
   demux->opus_seek_processing_pending = FALSE;
   demux->last_seeking_position = GST_CLOCK_TIME_NONE;
   demux->last_page_pos_ms = 0;
 
-  // Thread
-  g_cond_init (&demux->wait_cond);
+  // Event loop, on threads we share with all other instances
   g_rec_mutex_init (&demux->stream_lock);
-  demux->stream_task = gst_task_new ((GstTaskFunction) skippy_hls_demux_stream_loop, demux, NULL);
-  gst_task_set_lock (demux->stream_task, &demux->stream_lock);
+  g_cond_init (&demux->fetch_cond);
+  demux->loop_state = GST_TASK_STOPPED;
+  demux->loop_context = skippy_task_pool_acquire_loop ();
+  demux->loop_epoch = 0;
+  demux->pause_epoch = 0;
+  demux->seeks_pending = 0;
+  demux->fetching = FALSE;
+  demux->retry_source = NULL;
+  demux->idle_source = NULL;
 }
 
 // Dispose: Remove everything we allocated in _init
@@ -230,13 +440,21 @@ skippy_hls_demux_dispose (GObject * obj)
   skippy_hls_demux_reset (demux);
   skippy_hls_demux_stop (demux);
 
-  if (demux->out_adapter) {
-    g_object_unref (demux->out_adapter);
-    demux->out_adapter = NULL;
+  if (demux->ogg_framer) {
+    skippy_ogg_framer_free (demux->ogg_framer);
+    demux->ogg_framer = NULL;
   }
-
-  if (demux->oggDemux) {
-    destroyOggDecoder(demux->oggDemux);
+  if (demux->mp3_framer) {
+    skippy_mp3_framer_free (demux->mp3_framer);
+    demux->mp3_framer = NULL;
+  }
+  if (demux->aac_framer) {
+    skippy_adts_framer_free (demux->aac_framer);
+    demux->aac_framer = NULL;
+  }
+  if (demux->ts_demuxer) {
+    skippy_ts_demuxer_free (demux->ts_demuxer);
+    demux->ts_demuxer = NULL;
   }
 
   // Remove M3U8 client
@@ -245,18 +463,40 @@ skippy_hls_demux_dispose (GObject * obj)
     demux->client = NULL;
   }
 
+  // Release retained fragments
+  if (demux->fragment_cache) {
+    skippy_fragment_cache_free (demux->fragment_cache);
+    demux->fragment_cache = NULL;
+  }
+
+  if (demux->host_selector) {
+    skippy_host_selector_free (demux->host_selector);
+    demux->host_selector = NULL;
+  }
+
+  // Buffers still living in the spill file keep it mapped until they are gone
+  if (demux->spill_file) {
+    skippy_spill_file_unref (demux->spill_file);
+    demux->spill_file = NULL;
+  }
+  g_free (demux->spill_directory);
+  demux->spill_directory = NULL;
+
+  if (demux->init_sections) {
+    g_hash_table_unref (demux->init_sections);
+    demux->init_sections = NULL;
+  }
+
+  GST_OBJECT_LOCK (demux);
+  skippy_hls_demux_clear_playhead_marks_locked (demux);
+  GST_OBJECT_UNLOCK (demux);
+
   // Release ref to queue sinkpad
   if (demux->queue_sinkpad) {
     g_object_unref (demux->queue_sinkpad);
     demux->queue_sinkpad = NULL;
   }
 
-  // Clean up thread
-  if (demux->stream_task) {
-    gst_object_unref (demux->stream_task);
-    demux->stream_task = NULL;
-  }
-
   if (demux->queue_proxy_pad) {
     gst_object_unref (demux->queue_proxy_pad);
     demux->queue_proxy_pad = NULL;
@@ -267,16 +507,6 @@ skippy_hls_demux_dispose (GObject * obj)
     demux->caps = NULL;
   }
   
-  if (demux->opus_init_data) {
-    g_free (demux->opus_init_data);
-    demux->opus_init_data = NULL;
-  }
-  
-  if (demux->out_adapter) {
-    g_object_unref (demux->out_adapter);
-    demux->out_adapter = NULL;
-  }
-  
   if (demux->rand_gen) {
     g_rand_free (demux->rand_gen);
     demux->rand_gen = NULL;
@@ -293,7 +523,8 @@ skippy_hls_demux_finalize (GObject * obj)
   GST_DEBUG ("Finalizing ...");
   SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (obj);
   g_rec_mutex_clear (&demux->stream_lock);
-  g_cond_clear (&demux->wait_cond);
+  g_cond_clear (&demux->fetch_cond);
+  skippy_task_pool_release_loop (demux->loop_context);
   G_OBJECT_CLASS (parent_class)->finalize (obj);
   GST_DEBUG ("Finalized.");
 }
@@ -315,10 +546,37 @@ skippy_hls_demux_reset (SkippyHLSDemux * demux)
   demux->download_failed_count = 0;
   demux->continuing = FALSE;
 
-  if (demux->oggDemux) {
-    destroyOggDecoder(demux->oggDemux);
-    demux->oggDemux = createOggDecoder();
-  }
+  if (demux->ogg_framer) {
+    skippy_ogg_framer_flush (demux->ogg_framer);
+  }
+  if (demux->mp3_framer) {
+    skippy_mp3_framer_flush (demux->mp3_framer);
+  }
+  if (demux->aac_framer) {
+    skippy_adts_framer_flush (demux->aac_framer);
+  }
+  demux->frame_next_pts = GST_CLOCK_TIME_NONE;
+  demux->frame_discont = FALSE;
+  if (demux->ts_demuxer) {
+    skippy_ts_demuxer_reset (demux->ts_demuxer);
+  }
+  demux->ts_packetizer = NULL;
+  demux->ts_last_pts = GST_CLOCK_TIME_NONE;
+  if (demux->opus_batch) {
+    gst_buffer_list_unref (demux->opus_batch);
+    demux->opus_batch = NULL;
+  }
+  demux->opus_pre_skip = 0;
+  demux->opus_granule = -1;
+  // A new stream has its own header
+  demux->opus_header_size = 0;
+  demux->opus_header_complete = FALSE;
+  demux->opus_header_probe_failed = FALSE;
+  demux->mp3_header_known = FALSE;
+  demux->mp3_vbr = FALSE;
+  demux->aac_header_known = FALSE;
+  demux->mp3_resync_offset = -1;
+  demux->mp3_resync_start = GST_CLOCK_TIME_NONE;
 
   // Get rid of eventual playlist data
   if (demux->playlist) {
@@ -326,6 +584,23 @@ skippy_hls_demux_reset (SkippyHLSDemux * demux)
     demux->playlist = NULL;
   }
 
+  if (demux->fragment_cache) {
+    skippy_fragment_cache_clear (demux->fragment_cache);
+  }
+  if (demux->init_sections) {
+    g_hash_table_remove_all (demux->init_sections);
+  }
+  g_free (demux->init_section_key);
+  demux->init_section_key = NULL;
+  demux->playback_position = GST_CLOCK_TIME_NONE;
+  demux->media_byte_rate = 0;
+  // What we measured against the last stream's bitrate is no use for the next one
+  demux->buffer_target = GST_CLOCK_TIME_NONE;
+  demux->throughput_count = 0;
+  memset (demux->throughputs, 0, sizeof (demux->throughputs));
+  demux->burst_start_time = 0;
+  skippy_hls_demux_clear_playhead_marks_locked (demux);
+
   if (demux->download_queue) {
     GST_OBJECT_UNLOCK (demux);
     // Download queue is unlimited
@@ -340,10 +615,10 @@ skippy_hls_demux_reset (SkippyHLSDemux * demux)
   GST_OBJECT_UNLOCK (demux);
 }
 
-// Called for state change from PAUSED -> READY and during seek handling
-// Schedules the streaming thread to paused state, cancels all ongoing downloads,
-// Locks&unlocks the streaming thread in order for this function to block until the
-// thread is actually in paused state (task function exited)
+// Called for state change from PAUSED -> READY
+// Pauses the event loop, cancels all ongoing downloads,
+// Locks&unlocks the stream lock in order for this function to block until the
+// loop is actually in paused state (event handler exited) and waits for the fetch to end
 //
 // MT-safe
 static void
@@ -352,20 +627,22 @@ skippy_hls_demux_pause (SkippyHLSDemux * demux)
   GST_DEBUG ("Pausing task ...");
   // Pause the task
   GST_OBJECT_LOCK (demux);
-  gst_task_pause (demux->stream_task);
-  // Signal the thread in case it's waiting
+  demux->loop_state = GST_TASK_PAUSED;
   demux->continuing = TRUE;
   demux->download_failed_count = 0;
-  GST_TASK_SIGNAL (demux->stream_task);
-  g_cond_signal (&demux->wait_cond);
+  // Whatever was posted so far is of no use anymore, seeks included
+  skippy_hls_demux_reset_loop_locked (demux);
+  demux->pause_epoch++;
+  demux->seeks_pending = 0;
   GST_OBJECT_UNLOCK (demux);
   GST_DEBUG ("Checking for ongoing downloads to cancel ...");
-  // Now cancel all downloads to make the stream function exit quickly in case there are some
+  // Now cancel all downloads to make the loop and the fetch exit quickly in case there are some
   skippy_uri_downloader_interrupt (demux->downloader);
   skippy_uri_downloader_interrupt (demux->playlist_downloader);
   // Block until we're done cancelling
   g_rec_mutex_lock (&demux->stream_lock);
   g_rec_mutex_unlock (&demux->stream_lock);
+  skippy_hls_demux_join_fetch (demux);
   // Make sure these will handle the next download requested
   skippy_uri_downloader_continue (demux->downloader);
   skippy_uri_downloader_continue (demux->playlist_downloader);
@@ -373,31 +650,43 @@ skippy_hls_demux_pause (SkippyHLSDemux * demux)
 }
 
 // Called for state change from READY -> NULL
-// This will stop & join the task (given it's not stopped yet) in a blocking way
-// Which means the function will block until the task is stopped i.e streaming thread is joined.
-// This function assumes the task is already in paused state (i.e task loop not running)
-// Therefore calling this function should not imply any waiting for the task function to exit
-// but is simply to allow eventual further deallocation of the task resources (unref'ing the task).
-// However we can also just restart the task once it has been stopped.
+// This will stop the event loop (given it's not paused yet) in a blocking way.
+// The loop thread itself is shared and keeps running, our events just don't get handled anymore.
+// However we can also just restart the loop once it has been stopped.
 //
 // MT-safe
 static void
 skippy_hls_demux_stop (SkippyHLSDemux *demux)
 {
-  // Let's join the streaming thread
+  GstTaskState state;
+
   GST_DEBUG ("Stopping task ...");
-  if (gst_task_get_state (demux->stream_task) != GST_TASK_PAUSED) {
+  GST_OBJECT_LOCK (demux);
+  state = demux->loop_state;
+  GST_OBJECT_UNLOCK (demux);
+  if (state != GST_TASK_PAUSED) {
     skippy_hls_demux_pause(demux);
   }
+  // In case the fetch paused the loop itself
+  skippy_hls_demux_join_fetch (demux);
 
-  g_return_if_fail(gst_task_get_state (demux->stream_task) == GST_TASK_PAUSED);
-
-  if (gst_task_get_state (demux->stream_task) != GST_TASK_STOPPED) {
-    gst_task_join (demux->stream_task);
-  }
+  GST_OBJECT_LOCK (demux);
+  demux->loop_state = GST_TASK_STOPPED;
+  GST_OBJECT_UNLOCK (demux);
   GST_DEBUG ("Stopped streaming task");
 }
 
+// Stops handling events until we seek, from the fetch: at the end of the playlist or after a fatal error
+//
+// MT-safe
+static void
+skippy_hls_demux_pause_loop (SkippyHLSDemux * demux)
+{
+  GST_OBJECT_LOCK (demux);
+  demux->loop_state = GST_TASK_PAUSED;
+  GST_OBJECT_UNLOCK (demux);
+}
+
 // The state change handler: simply calls the pause, stop and reset functions above
 // and afterwards the parent handler
 //
@@ -417,17 +706,17 @@ skippy_hls_demux_change_state (GstElement * element, GstStateChange transition)
       // Therefore no need to lock the object here
       skippy_hls_demux_reset (demux);
       break;
-    // Start streaming thread
+    // Start stream task loop
     case GST_STATE_CHANGE_READY_TO_PAUSED:
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
       break;
     case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
       break;
-    // Interrupt streaming thread
+    // Interrupt stream task loop
     case GST_STATE_CHANGE_PAUSED_TO_READY:
       skippy_hls_demux_pause (demux);
-      // Can be called while streaming thread is running
+      // Can be called while the stream task loop is running
       break;
     // Shut down
     case GST_STATE_CHANGE_READY_TO_NULL:
@@ -451,6 +740,85 @@ skippy_hls_demux_set_context (GstElement *element, GstContext *context)
     demux->download_ahead = buffer_ahead;
   }
 
+  gboolean adaptive_buffer = FALSE;
+  if (gst_structure_get_boolean (context_structure, SKIPPY_HLS_ADAPTIVE_BUFFER, &adaptive_buffer)) {
+    demux->adaptive_buffer = adaptive_buffer;
+  }
+
+  guint64 max_buffer_bytes = 0;
+  if (gst_structure_get_uint64 (context_structure, SKIPPY_HLS_MAX_BUFFER_BYTES, &max_buffer_bytes)) {
+    demux->max_buffer_bytes = max_buffer_bytes;
+  }
+
+  guint slice_size = 0;
+  if (gst_structure_get_uint (context_structure, SKIPPY_HLS_MP3_SLICE_SIZE, &slice_size)) {
+    demux->mp3_slice_size = slice_size;
+  }
+  if (gst_structure_get_uint (context_structure, SKIPPY_HLS_OPUS_SLICE_SIZE, &slice_size)) {
+    demux->opus_slice_size = slice_size;
+  }
+
+  gboolean framing = FALSE;
+  if (gst_structure_get_boolean (context_structure, SKIPPY_HLS_MP3_FRAMING, &framing)) {
+    demux->mp3_framing = framing;
+  }
+  if (gst_structure_get_boolean (context_structure, SKIPPY_HLS_AAC_FRAMING, &framing)) {
+    demux->aac_framing = framing;
+  }
+
+  gboolean ts_demuxing = FALSE;
+  if (gst_structure_get_boolean (context_structure, SKIPPY_HLS_TS_DEMUXING, &ts_demuxing)) {
+    demux->ts_demuxing = ts_demuxing;
+  }
+
+  guint parallel_ranges = 0;
+  if (gst_structure_get_uint (context_structure, SKIPPY_HLS_PARALLEL_RANGES, &parallel_ranges)) {
+    skippy_uri_downloader_set_parallel_ranges (demux->downloader, parallel_ranges, PARALLEL_RANGE_MIN_SIZE);
+  }
+
+  guint stall_min_rate = 0;
+  GstClockTime stall_window = 0;
+  gboolean stall_changed = FALSE;
+  if (gst_structure_get_uint (context_structure, SKIPPY_HLS_STALL_MIN_RATE, &stall_min_rate)) {
+    demux->stall_min_rate = stall_min_rate;
+    stall_changed = TRUE;
+  }
+  if (gst_structure_get_uint64 (context_structure, SKIPPY_HLS_STALL_WINDOW, &stall_window) && stall_window) {
+    demux->stall_window = stall_window;
+    stall_changed = TRUE;
+  }
+  if (stall_changed) {
+    skippy_uri_downloader_set_stall_watchdog (demux->downloader, demux->stall_min_rate, demux->stall_window);
+  }
+
+  // Without a hedge host of their own, hedge requests go to the mirror doing best after the one we load from
+  // (SKIPPY_HLS_HOSTS), or to the same host when there are no mirrors
+  guint hedge_percentile = 0;
+  if (gst_structure_get_uint (context_structure, SKIPPY_HLS_HEDGE_PERCENTILE, &hedge_percentile)) {
+    const gchar* hedge_host = gst_structure_get_string (context_structure, SKIPPY_HLS_HEDGE_HOST);
+    skippy_uri_downloader_set_hedging (demux->downloader, MIN (hedge_percentile, 100), hedge_host);
+    demux->hedging = hedge_percentile > 0;
+    demux->hedge_to_mirror = demux->hedging && !hedge_host;
+  }
+
+  const gchar* hosts = gst_structure_get_string (context_structure, SKIPPY_HLS_HOSTS);
+  if (hosts) {
+    skippy_host_selector_set_hosts (demux->host_selector, hosts);
+  }
+
+  GstClockTime batch_duration = 0;
+  if (gst_structure_get_uint64 (context_structure, SKIPPY_HLS_OPUS_BATCH_DURATION, &batch_duration)) {
+    demux->opus_batch_duration = batch_duration;
+  }
+
+  const gchar* spill_directory = gst_structure_get_string (context_structure, SKIPPY_HLS_SPILL_DIRECTORY);
+  if (spill_directory) {
+    GST_OBJECT_LOCK (demux);
+    g_free (demux->spill_directory);
+    demux->spill_directory = g_strdup (spill_directory);
+    GST_OBJECT_UNLOCK (demux);
+  }
+
   GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
 }
 
@@ -490,6 +858,41 @@ skippy_hls_demux_post_stat_msg (SkippyHLSDemux * demux, SkippyHLSDemuxStats metr
       "codec-type", G_TYPE_UINT, size,
       NULL);
       break;
+  case STAT_MEMORY_USAGE:
+    GST_TRACE ("Statistic: STAT_MEMORY_USAGE");
+    structure = gst_structure_new (SKIPPY_HLS_DEMUX_STATISTIC_MSG_NAME,
+      "buffer-memory-bytes", G_TYPE_UINT64, (guint64) size,
+      "buffer-memory-peak-bytes", G_TYPE_UINT64, (guint64) demux->memory_usage_peak,
+      "buffer-spilled-bytes", G_TYPE_UINT64, (guint64) (demux->spill_file ? skippy_spill_file_get_used (demux->spill_file) : 0),
+      NULL);
+    break;
+  case STAT_RADIO_ACTIVE_TIME:
+    GST_TRACE ("Statistic: STAT_RADIO_ACTIVE_TIME");
+    structure = gst_structure_new (SKIPPY_HLS_DEMUX_STATISTIC_MSG_NAME,
+      "radio-active-time", GST_TYPE_CLOCK_TIME, time_val,
+      "radio-active-total", GST_TYPE_CLOCK_TIME, demux->radio_active_time,
+      "burst-size", G_TYPE_UINT64, (guint64) size,
+      NULL);
+    break;
+  case STAT_HEDGED_REQUESTS: {
+    guint requests, hedged, won;
+    GST_TRACE ("Statistic: STAT_HEDGED_REQUESTS");
+    skippy_uri_downloader_get_hedge_stats (demux->downloader, &requests, &hedged, &won);
+    structure = gst_structure_new (SKIPPY_HLS_DEMUX_STATISTIC_MSG_NAME,
+      "hedge-requests", G_TYPE_UINT, requests,
+      "hedge-sent", G_TYPE_UINT, hedged,
+      "hedge-won", G_TYPE_UINT, won,
+      NULL);
+    break;
+  }
+  case STAT_BUFFER_TARGET:
+    GST_TRACE ("Statistic: STAT_BUFFER_TARGET");
+    structure = gst_structure_new (SKIPPY_HLS_DEMUX_STATISTIC_MSG_NAME,
+      "buffer-target", GST_TYPE_CLOCK_TIME, time_val,
+      "throughput", G_TYPE_UINT64, (guint64) size,
+      "media-byte-rate", G_TYPE_UINT64, demux->media_byte_rate,
+      NULL);
+    break;
   default:
     GST_ERROR ("Can't post unknown stats type");
     return;
@@ -501,6 +904,36 @@ skippy_hls_demux_post_stat_msg (SkippyHLSDemux * demux, SkippyHLSDemuxStats metr
   );
 }
 
+// Marks the start of a download burst, does nothing when one is already running
+// Runs in the stream task loop or the fetch, see skippy_hls_demux_handle_schedule.
+static void
+skippy_hls_demux_begin_burst (SkippyHLSDemux * demux)
+{
+  if (demux->burst_start_time) {
+    return;
+  }
+  GST_DEBUG ("Starting download burst");
+  demux->burst_start_time = g_get_monotonic_time ();
+  demux->burst_bytes = 0;
+}
+
+// Ends the current download burst (the radio can go idle now) and reports how long it was active
+// Runs in the stream task loop or the fetch, see skippy_hls_demux_handle_schedule.
+static void
+skippy_hls_demux_end_burst (SkippyHLSDemux * demux)
+{
+  GstClockTime active_time;
+
+  if (!demux->burst_start_time) {
+    return;
+  }
+  active_time = (g_get_monotonic_time () - demux->burst_start_time) * GST_USECOND;
+  demux->radio_active_time += active_time;
+  demux->burst_start_time = 0;
+  GST_DEBUG ("Download burst of %" G_GSIZE_FORMAT " bytes took %" GST_TIME_FORMAT, demux->burst_bytes, GST_TIME_ARGS (active_time));
+  skippy_hls_demux_post_stat_msg (demux, STAT_RADIO_ACTIVE_TIME, active_time, demux->burst_bytes);
+}
+
 // Queries current source URI from upstream element
 // Returns NULL when query was not successful
 // Caller owns returned pointer
@@ -520,39 +953,6 @@ skippy_hls_demux_query_location (SkippyHLSDemux * demux)
   return uri;
 }
 
-// Queries current playback position from downstream element
-// Returns MAXINT64 when query was not successful (which might happen in some pipeline states)
-//
-// MT-safe
-static gint64
-skippy_hls_demux_query_position (SkippyHLSDemux * demux)
-{
-  GstFormat format;
-  gint64 pos;
-  GstQuery* query;
-  gboolean query_ret;
-
-  // Query current playback position from downstream
-  query = gst_query_new_position (GST_FORMAT_TIME);
-  query_ret = gst_pad_peer_query (demux->srcpad, query);
-  if (query_ret) {
-    gst_query_parse_position (query, &format, &pos);
-    if (format != GST_FORMAT_TIME) {
-      GST_ERROR ("Position query result is not in TIME format");
-      query_ret = FALSE;
-    }
-  }
-  gst_query_unref (query);
-
-  if (!query_ret) {
-    // If we didn't get a proper position we could be anywhere in the stream
-    // and should assume it's MAX int in order to keep re-buffering going
-    pos = GST_CLOCK_TIME_NONE;
-  }
-  GST_TRACE ("Position query result: %" GST_TIME_FORMAT, GST_TIME_ARGS ((GstClockTime) pos));
-  return pos;
-}
-
 // Sets the duration field of our object according to the M3U8 parser output
 // This function is called only from the first playlist handler. So only in the source thread.
 //
@@ -578,6 +978,97 @@ skippy_hls_demux_update_duration (SkippyHLSDemux * demux)
   gst_element_post_message (GST_ELEMENT (demux), gst_message_new_duration_changed (GST_OBJECT (demux)));
 }
 
+// Whether all codecs in the list match one of the prefixes
+static gboolean
+skippy_hls_demux_codecs_match (gchar **codecs, const gchar * const *prefixes)
+{
+  gchar **codec;
+  const gchar * const *prefix;
+  gboolean match = codecs[0] != NULL;
+
+  for (codec = codecs; *codec && match; codec++) {
+    match = FALSE;
+    for (prefix = prefixes; *prefix && !match; prefix++) {
+      match = g_str_has_prefix (g_strstrip (*codec), *prefix);
+    }
+  }
+  return match;
+}
+
+// What the playlist tells about the media: our own renditions say so in the format parameter, for others
+// CODECS (RFC 6381) and the file extension of the fragments together say which codec comes in which container.
+// Returns NULL if we can't be sure, typefinding tells then.
+static GstCaps*
+skippy_hls_demux_get_playlist_caps (SkippyHLSDemux * demux)
+{
+  static const gchar * const mp3_codecs[] = { "mp4a.40.34", "mp4a.69", "mp4a.6b", "mp4a.6B", "mp3", NULL };
+  static const gchar * const aac_codecs[] = { "mp4a.40.", NULL };
+  static const gchar * const ts_audio_codecs[] = { "mp4a.", "mp3", NULL };
+  gchar *playlist_uri, *codecs, *path = NULL, **codec_list;
+  SkippyFragment *fragment;
+  GstUri *uri;
+  GstCaps *caps = NULL;
+
+  playlist_uri = skippy_m3u8_client_get_current_playlist (demux->client);
+  if (playlist_uri && strstr (playlist_uri, FORMAT_OPUS_PARAM)) {
+    caps = gst_caps_from_string ("audio/ogg");
+  } else if (playlist_uri && strstr (playlist_uri, FORMAT_PARAM "=" MP3_FORMAT_PARAM)) {
+    caps = gst_caps_from_string ("audio/mpeg, mpegversion=(int)1, layer=(int)3");
+  }
+  g_free (playlist_uri);
+  if (caps) {
+    return caps;
+  }
+
+  codecs = skippy_m3u8_client_get_codecs (demux->client);
+  fragment = skippy_m3u8_client_get_fragment (demux->client, 0);
+  // Fragmented MP4 gets typefound from its init section
+  if (!codecs || !fragment || fragment->map_uri) {
+    goto done;
+  }
+  if ((uri = gst_uri_from_string (fragment->uri))) {
+    path = g_ascii_strdown (gst_uri_get_path (uri) ? gst_uri_get_path (uri) : "", -1);
+    gst_uri_unref (uri);
+  }
+  if (!path) {
+    goto done;
+  }
+
+  codec_list = g_strsplit (codecs, ",", -1);
+  if (g_str_has_suffix (path, ".ts") && skippy_hls_demux_codecs_match (codec_list, ts_audio_codecs)) {
+    caps = gst_caps_from_string ("video/mpegts, systemstream=(boolean)true, packetsize=(int)188");
+  } else if (g_str_has_suffix (path, ".mp3") && skippy_hls_demux_codecs_match (codec_list, mp3_codecs)) {
+    caps = gst_caps_from_string ("audio/mpeg, mpegversion=(int)1, layer=(int)3");
+  } else if (g_str_has_suffix (path, ".aac") && skippy_hls_demux_codecs_match (codec_list, aac_codecs)
+    && !skippy_hls_demux_codecs_match (codec_list, mp3_codecs)) {
+    caps = gst_caps_from_string ("audio/mpeg, mpegversion=(int)4, stream-format=(string)adts");
+  }
+  g_strfreev (codec_list);
+
+done:
+  g_free (path);
+  g_free (codecs);
+  if (fragment) {
+    g_object_unref (fragment);
+  }
+  return caps;
+}
+
+// Skips typefinding the media when the playlist tells us what it is, sets up the codec before any data arrives
+// Not called while fetching.
+static void
+skippy_hls_demux_update_playlist_caps (SkippyHLSDemux * demux)
+{
+  GstCaps *caps = skippy_hls_demux_get_playlist_caps (demux);
+
+  skippy_uri_downloader_set_caps (demux->downloader, caps);
+  if (caps) {
+    GST_DEBUG_OBJECT (demux, "Media type from playlist: %" GST_PTR_FORMAT, caps);
+    skippy_hls_demux_set_input_caps (demux, caps);
+    gst_caps_unref (caps);
+  }
+}
+
 // This is called by the URL source (sinkpad) event handler on EOS to handle the initial playlist data
 //
 // MT-safe
@@ -635,6 +1126,8 @@ skippy_hls_demux_handle_first_playlist (SkippyHLSDemux* demux)
   // Updates duration field and posts message to bus
   skippy_hls_demux_update_duration (demux);
 
+  skippy_hls_demux_update_playlist_caps (demux);
+
   GST_DEBUG_OBJECT (demux, "Finished setting up playlist");
 
   // Make sure URI downloaders are ready asap
@@ -643,9 +1136,10 @@ skippy_hls_demux_handle_first_playlist (SkippyHLSDemux* demux)
 
   skippy_hls_demux_link_pads (demux);
   GST_OBJECT_LOCK (demux);
-  GstTaskState state;
-  if ((state = gst_task_get_state (demux->stream_task)) != GST_TASK_PAUSED)
-    gst_task_start (demux->stream_task);
+  if (demux->loop_state != GST_TASK_PAUSED) {
+    demux->loop_state = GST_TASK_STARTED;
+    skippy_hls_demux_post_locked (demux, EVENT_SCHEDULE);
+  }
   GST_OBJECT_UNLOCK (demux);
   GST_LOG ("Task started");
 
@@ -751,7 +1245,7 @@ skippy_hls_demux_link_pads (SkippyHLSDemux * demux)
 *
 *  Calling thread: source
 *
-*  This function will not handle data if the streaming thread is running
+*  This function will not handle data if the stream task loop is running
 *  MT-safe
 */
 static GstFlowReturn
@@ -778,7 +1272,7 @@ skippy_hls_demux_sink_data (GstPad * pad, GstObject * parent, GstBuffer * buf)
 *
 *  Calling thread: source
 *
-*  This function will not handle events if the streaming thread is running
+*  This function will not handle events if the stream task loop is running
 *  MT-safe
 */
 static gboolean
@@ -825,22 +1319,20 @@ skippy_hls_demux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
   return gst_pad_event_default (pad, parent, event);
 }
 
-// Handles seek events: Pauses the streaming thread, seeks the M3U8 parser to correct position,
-// modifies segment data in downloader element, set seeked flag, sends flush events onto output queue,
-// then restarts streaming thread.
+// Handles seek events: Flushes the output queue right away and leaves the rest to the stream task loop, which cancels
+// the ongoing fetch, seeks the M3U8 parser to correct position and modifies segment data. We don't wait for any of this.
+// Fragments still held by the fragment cache are replayed without any network request.
 //
 // MT-safe
 static gboolean
 skippy_hls_demux_handle_seek (SkippyHLSDemux *demux, GstEvent * event)
 {
-  gdouble rate;
+  SkippyHLSDemuxEvent *seek;
   GstFormat format;
-  GstSeekFlags flags;
-  GstSeekType start_type, stop_type;
-  gint64 start, stop;
+  gint64 start;
 
   // Parse seek event
-  gst_event_parse_seek (event, &rate, &format, &flags, &start_type, &start, &stop_type, &stop);
+  gst_event_parse_seek (event, NULL, &format, NULL, NULL, &start, NULL, NULL);
   if (format != GST_FORMAT_TIME) {
     GST_WARNING ("Received seek event not in time format");
     gst_event_unref (event);
@@ -849,14 +1341,48 @@ skippy_hls_demux_handle_seek (SkippyHLSDemux *demux, GstEvent * event)
 
   GST_INFO ("Handling seek event to: %" GST_TIME_FORMAT, GST_TIME_ARGS(start));
 
-  // NOTE: The order of sending flush start/stop and pausing the task in between in MANDATORY !!
+  // NOTE: The order of sending flush start/stop and stopping the fetch in between in MANDATORY !!
 
   GST_DEBUG_OBJECT (demux, "Sending flush start");
   gst_pad_send_event (demux->queue_sinkpad, gst_event_new_flush_start ());
 
-  // Pausing streaming task (blocking)
-  skippy_hls_demux_pause (demux);
-  // At this point we can be sure the stream loop is paused
+  GST_OBJECT_LOCK (demux);
+  demux->seeks_pending++;
+  seek = skippy_hls_demux_event_new_locked (demux, EVENT_SEEK);
+  seek->seek = event;
+  // Restart the loop in case we stopped at the end of the playlist
+  demux->loop_state = GST_TASK_STARTED;
+  GST_OBJECT_UNLOCK (demux);
+  // Unblocks the fetch, the loop takes it from there
+  skippy_uri_downloader_interrupt (demux->downloader);
+  skippy_hls_demux_post_event (demux, seek);
+  return TRUE;
+}
+
+// Applies a seek once the fetch is done. Runs in the stream task loop.
+static void
+skippy_hls_demux_apply_seek (SkippyHLSDemux *demux, GstEvent * event)
+{
+  gdouble rate;
+  GstFormat format;
+  GstSeekFlags flags;
+  GstSeekType start_type, stop_type;
+  gint64 start, stop;
+
+  gst_event_parse_seek (event, &rate, &format, &flags, &start_type, &start, &stop_type, &stop);
+
+  // Stop the fetch in flight and forget what we were waiting for
+  GST_OBJECT_LOCK (demux);
+  skippy_hls_demux_reset_loop_locked (demux);
+  demux->continuing = TRUE;
+  demux->download_failed_count = 0;
+  GST_OBJECT_UNLOCK (demux);
+  skippy_uri_downloader_interrupt (demux->downloader);
+  skippy_uri_downloader_interrupt (demux->playlist_downloader);
+  skippy_hls_demux_join_fetch (demux);
+  // Make sure these will handle the next download requested
+  skippy_uri_downloader_continue (demux->downloader);
+  skippy_uri_downloader_continue (demux->playlist_downloader);
 
   GST_DEBUG_OBJECT (demux, "Sending flush stop");
   gst_pad_send_event (demux->queue_sinkpad, gst_event_new_flush_stop (TRUE));
@@ -870,20 +1396,14 @@ skippy_hls_demux_handle_seek (SkippyHLSDemux *demux, GstEvent * event)
   demux->need_segment = TRUE;
   demux->last_seeking_position = start;
   
- // flushDecoder (demux->oggDemux);
-  destroyOggDecoder (demux->oggDemux);
-  demux->oggDemux = createOggDecoder();
-  demux->opus_seek_processing_pending = TRUE;
-  demux->last_page_pos_ms = 0;
-  //demux->opus_init_data_written = 0;
-
-  // Restart the streaming task
-  GST_DEBUG ("Restarting streaming task");
-  gst_task_start (demux->stream_task);
+  demux->packetizer->flush (demux);
 
-  // Handle and swallow event
-  gst_event_unref (event);
-  return TRUE;
+  GST_OBJECT_LOCK (demux);
+  demux->seeks_pending--;
+  // The fetch we joined may have paused the loop at the end of the playlist
+  demux->loop_state = GST_TASK_STARTED;
+  skippy_hls_demux_post_locked (demux, EVENT_SCHEDULE);
+  GST_OBJECT_UNLOCK (demux);
 }
 
 // Handles duration, URI and seeking queries: only access MT-safe M3U8 client to do this
@@ -950,18 +1470,19 @@ skippy_hls_demux_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
   return ret;
 }
 
-// Handles end of playlist: Sets streaming thread to paused state and pushes EOS event
+// Handles end of playlist: Pauses the stream task loop and pushes EOS event
 //
 // MT-safe
 static void
 skippy_hls_handle_end_of_playlist (SkippyHLSDemux * demux)
 {
   GST_DEBUG_OBJECT (demux, "Reached end of playlist, sending EOS");
+  skippy_hls_demux_end_burst (demux);
   GST_OBJECT_LOCK (demux);
   demux->position = 0;
   demux->position_downloaded = 0;
   GST_OBJECT_UNLOCK (demux);
-  gst_task_pause (demux->stream_task);
+  skippy_hls_demux_pause_loop (demux);
   gst_pad_send_event (demux->queue_sinkpad, gst_event_new_eos ());
 }
 
@@ -976,375 +1497,1678 @@ skippy_hls_demux_is_caching_allowed (SkippyHLSDemux * demux)
   return ret;
 }
 
+// Pushes media into the download queue, retaining it for the fragment currently recorded
+//
+// MT-safe
 static GstFlowReturn
-skippy_hls_demux_proxy_pad_chain (GstPad *pad, GstObject *parent, GstBuffer *buffer)
+skippy_hls_demux_push_to_queue (SkippyHLSDemux * demux, GstBuffer * buf)
 {
-  GST_TRACE ("Got %" GST_PTR_FORMAT, buffer);
+  GstBuffer *spilled;
 
-  GstFlowReturn ret_value = GST_FLOW_OK;
-  gboolean set_discont = FALSE, first_buffer_processed = FALSE;
-  GstClockTime buffer_pts = GST_CLOCK_TIME_NONE;
-  GstBuffer *buf = NULL;
-  gsize avail_out_size = 0;
-  SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (gst_pad_get_element_private (pad));
-  
-  if (!buffer) {
-    GST_WARNING ("Error: chain function invoked with NULL buffer!");
-    g_warn_if_reached ();
-    return ret_value;
+  // Far-ahead media goes to the spill file while there is room, we won't need it for a while
+  if (demux->spill_fragment && (spilled = skippy_spill_file_store (demux->spill_file, buf))) {
+    gst_buffer_unref (buf);
+    buf = spilled;
   }
+  skippy_fragment_cache_append (demux->fragment_cache, buf);
+  return gst_pad_chain (demux->queue_sinkpad, buf);
+}
 
-  GST_OBJECT_LOCK (demux);
-  if (G_UNLIKELY(demux->need_segment)) {
-    buffer_pts = demux->position;
-    if (!demux->need_stream_start) {
-      GST_DEBUG_OBJECT (demux, "Seek performed, buffer %p has discontinuity. Buffer PTS is %" GST_TIME_FORMAT, buffer, GST_TIME_ARGS (demux->position));
-      set_discont = TRUE;
-    }
-  } else {
-    set_discont = FALSE;
-  }
-  // check opus init
-  if (demux->dataCodec == OPUS) {
-    if (!(demux->opus_0_fragment_cached = (demux->opus_init_data_written >= 129))) {
-      if (buffer != NULL) {
-        GstMapInfo in_map;
-        gst_buffer_map(buffer, &in_map, GST_MAP_READ);
-        size_t number_of_bytes_to_write = (129 - demux->opus_init_data_written > in_map.size) ? in_map.size : 129 - demux->opus_init_data_written;
-        memcpy (demux->opus_init_data + demux->opus_init_data_written, in_map.data, number_of_bytes_to_write);
-        demux->opus_init_data_written += number_of_bytes_to_write;
-        gst_buffer_unmap (buffer, &in_map);
-      }
+// Same as above for a whole list of buffers, which the queue takes in one go
+//
+// MT-safe
+static GstFlowReturn
+skippy_hls_demux_push_list_to_queue (SkippyHLSDemux * demux, GstBufferList * list)
+{
+  GstBuffer *buf, *spilled;
+  guint i, len;
+
+  if (demux->spill_fragment) {
+    list = gst_buffer_list_make_writable (list);
+  }
+  len = gst_buffer_list_length (list);
+  for (i = 0; i < len; i++) {
+    buf = gst_buffer_list_get (list, i);
+    if (demux->spill_fragment && (spilled = skippy_spill_file_store (demux->spill_file, buf))) {
+      gst_buffer_list_remove (list, i, 1);
+      gst_buffer_list_insert (list, i, spilled);
+      buf = spilled;
     }
+    skippy_fragment_cache_append (demux->fragment_cache, buf);
   }
-  GST_OBJECT_UNLOCK (demux);
-
-  // first send eventual events upfront data
-  skippy_hls_demux_update_downstream_events (demux, TRUE, TRUE);
+  return gst_pad_chain_list (demux->queue_sinkpad, list);
+}
 
-  // now push the data chunked
-  gst_adapter_push(demux->out_adapter, buffer);
-  
-  while ((avail_out_size = gst_adapter_available(demux->out_adapter))) {
-    buf = gst_adapter_take_buffer(demux->out_adapter, avail_out_size > 4096 ? 4096 : avail_out_size);
-    if (!buf) {
-      GST_WARNING ("Error: no data available in adapter!");
-      g_warn_if_reached ();
-      return ret_value;
-    }
-    if (G_UNLIKELY(!first_buffer_processed)) {
-      first_buffer_processed = TRUE;
-      // set proper discont flag and time stamp if needed for the first buffer
-      if (set_discont) {
-        GST_DEBUG_OBJECT (demux, "Setting discontinuity on newly created buffer after seek");
-        GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
-      } else {
-        GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DISCONT);
-      }
-      // set pts for buf
-      GST_BUFFER_PTS(buf) = buffer_pts;
-    } else {
-      // for all subsequent buffers unset discont flag and mark PTS
-      // as GST_CLOCK_TIME_NONE (continous data)
-      GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DISCONT);
-      GST_BUFFER_PTS(buf) =  GST_CLOCK_TIME_NONE;
-    }
+// Hands the Opus packets collected so far to the download queue
+// Only called from the thread feeding the queue.
+static GstFlowReturn
+skippy_hls_demux_flush_opus_batch (SkippyHLSDemux * demux)
+{
+  GstBufferList *batch = demux->opus_batch;
 
-    // read opus packets from demuxer
-    if (demux->dataCodec == OPUS) {
-      ret_value = skippy_hls_demux_read_ogg_and_push_opus_packets(demux, buf);
-      gst_buffer_unref (buf);
-    } else {
-      // codec is mp3.
-      GST_BUFFER_DTS (buf) = GST_CLOCK_TIME_NONE;
-      ret_value = gst_pad_chain (demux->queue_sinkpad, buf);
-    }
-    
-    if (ret_value != GST_FLOW_OK) {
-      GST_WARNING ("Proxy pad was %s while invoking queue chain function", gst_flow_get_name (ret_value));
-    }
-  }
-  if (!first_buffer_processed) {
-    GST_WARNING ("Error: no data has been processed. Most likely no bytes are available in adapter!");
-    g_warn_if_reached ();
+  if (!batch) {
+    return GST_FLOW_OK;
   }
-  return ret_value;
+  demux->opus_batch = NULL;
+  demux->opus_batch_start = GST_CLOCK_TIME_NONE;
+  GST_TRACE ("Pushing batch of %u Opus packets", gst_buffer_list_length (batch));
+  return skippy_hls_demux_push_list_to_queue (demux, batch);
 }
 
-static gboolean
-skippy_hls_demux_proxy_pad_event (GstPad *pad, GstObject *parent, GstEvent *event)
+// Where a fragment starts in the byte stream going through the download queue
+// Lets us map the bytes that left the queue back to media time
+typedef struct
 {
-  GST_LOG ("Got %" GST_PTR_FORMAT, event);
+  GstClockTime start_time;
+  GstClockTime stop_time;
+  guint64 bytes_start;
+  guint64 bytes_end;    /* 0 until the next fragment starts */
+} SkippyHLSDemuxPlayheadMark;
 
-  SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (gst_pad_get_element_private (pad));
-  GstCaps *caps;
-  static GstStaticCaps ogg_static_caps = GST_STATIC_CAPS ("audio/ogg");
-  switch (event->type) {
-  case GST_EVENT_CAPS:
-    GST_OBJECT_LOCK (demux);
+// Expects the GST object mutex to be locked
+static void
+skippy_hls_demux_clear_playhead_marks_locked (SkippyHLSDemux * demux)
+{
+  SkippyHLSDemuxPlayheadMark *mark;
+  while ((mark = g_queue_pop_head (&demux->playhead_marks))) {
+    g_slice_free (SkippyHLSDemuxPlayheadMark, mark);
+  }
+  demux->queue_bytes_in = 0;
+  demux->queue_bytes_out = 0;
+}
+
+// Records that the data for the given media time range is about to be pushed into the download queue
+//
+// MT-safe
+static void
+skippy_hls_demux_mark_fragment (SkippyHLSDemux * demux, GstClockTime start_time, GstClockTime stop_time)
+{
+  SkippyHLSDemuxPlayheadMark *mark, *last;
+
+  mark = g_slice_new (SkippyHLSDemuxPlayheadMark);
+  mark->start_time = start_time;
+  mark->stop_time = stop_time;
+  mark->bytes_end = 0;
+
+  GST_OBJECT_LOCK (demux);
+  mark->bytes_start = demux->queue_bytes_in;
+  if ((last = g_queue_peek_tail (&demux->playhead_marks)) && !last->bytes_end) {
+    last->bytes_end = demux->queue_bytes_in;
+  }
+  g_queue_push_tail (&demux->playhead_marks, mark);
+  GST_OBJECT_UNLOCK (demux);
+}
+
+static guint64
+skippy_hls_demux_probe_info_get_size (GstPadProbeInfo * info)
+{
+  GstBufferList *list;
+  guint i, len;
+  guint64 size = 0;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    return gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info));
+  }
+  list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+  len = gst_buffer_list_length (list);
+  for (i = 0; i < len; i++) {
+    size += gst_buffer_get_size (gst_buffer_list_get (list, i));
+  }
+  return size;
+}
+
+// Checks the conditions the stream task is waiting for
+// Expects the GST object mutex to be locked
+static gboolean
+skippy_hls_demux_wakeup_due_locked (SkippyHLSDemux * demux)
+{
+  if (demux->wake_position != GST_CLOCK_TIME_NONE && demux->playback_position != GST_CLOCK_TIME_NONE
+    && demux->playback_position >= demux->wake_position) {
+    return TRUE;
+  }
+  return demux->queue_bytes_in - demux->queue_bytes_out <= demux->wake_queue_bytes;
+}
+
+// Moves the playhead estimate according to the bytes that left the download queue and wakes up the
+// stream task when it asked for it. Downstream still holds a bit of data, so we are slightly ahead of actual playback.
+// Expects the GST object mutex to be locked
+static void
+skippy_hls_demux_update_playhead_locked (SkippyHLSDemux * demux)
+{
+  SkippyHLSDemuxPlayheadMark *mark, *next;
+  guint64 offset;
+  GstClockTime pos;
+
+  // Forget about fragments that left the queue completely
+  while ((next = g_queue_peek_nth (&demux->playhead_marks, 1)) && next->bytes_start <= demux->queue_bytes_out) {
+    g_slice_free (SkippyHLSDemuxPlayheadMark, g_queue_pop_head (&demux->playhead_marks));
+  }
+
+  mark = g_queue_peek_head (&demux->playhead_marks);
+  if (mark && demux->queue_bytes_out >= mark->bytes_start) {
+    offset = demux->queue_bytes_out - mark->bytes_start;
+    if (mark->bytes_end > mark->bytes_start) {
+      pos = mark->start_time + gst_util_uint64_scale (offset, mark->stop_time - mark->start_time, mark->bytes_end - mark->bytes_start);
+    } else if (demux->media_byte_rate) {
+      pos = mark->start_time + gst_util_uint64_scale (offset, GST_SECOND, demux->media_byte_rate);
+    } else {
+      pos = mark->start_time;
+    }
+    pos = MIN (pos, mark->stop_time);
+    // Never go back between two segments (an Opus seek drops the pages before its target)
+    if (demux->playback_position == GST_CLOCK_TIME_NONE || pos > demux->playback_position) {
+      demux->playback_position = pos;
+    }
+  }
+
+  if (demux->wake_armed && skippy_hls_demux_wakeup_due_locked (demux)) {
+    GST_TRACE ("Waking up stream task at %" GST_TIME_FORMAT, GST_TIME_ARGS (demux->playback_position));
+    demux->wake_armed = FALSE;
+    skippy_hls_demux_post_locked (demux, EVENT_SCHEDULE);
+  }
+}
+
+// Counts the bytes entering the download queue, forgets about them when it gets flushed
+static GstPadProbeReturn
+skippy_hls_demux_queue_sink_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (user_data);
+
+  GST_OBJECT_LOCK (demux);
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_FLUSH) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) == GST_EVENT_FLUSH_STOP) {
+      skippy_hls_demux_clear_playhead_marks_locked (demux);
+      demux->playback_position = GST_CLOCK_TIME_NONE;
+    }
+  } else {
+    demux->queue_bytes_in += skippy_hls_demux_probe_info_get_size (info);
+  }
+  GST_OBJECT_UNLOCK (demux);
+  return GST_PAD_PROBE_OK;
+}
+
+// Follows the data leaving the download queue to maintain our playhead estimate
+static GstPadProbeReturn
+skippy_hls_demux_queue_src_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (user_data);
+  const GstSegment *segment;
+
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) != GST_EVENT_SEGMENT) {
+      return GST_PAD_PROBE_OK;
+    }
+    gst_event_parse_segment (GST_PAD_PROBE_INFO_EVENT (info), &segment);
+    GST_OBJECT_LOCK (demux);
+    demux->playback_position = segment->start;
+    skippy_hls_demux_update_playhead_locked (demux);
+    GST_OBJECT_UNLOCK (demux);
+    return GST_PAD_PROBE_OK;
+  }
+
+  GST_OBJECT_LOCK (demux);
+  demux->queue_bytes_out += skippy_hls_demux_probe_info_get_size (info);
+  skippy_hls_demux_update_playhead_locked (demux);
+  GST_OBJECT_UNLOCK (demux);
+  return GST_PAD_PROBE_OK;
+}
+
+// When we are the parser, tell downstream what it gets. Takes ownership of the caps.
+// Expects the GST object mutex to be locked
+static GstCaps*
+skippy_hls_demux_update_mp3_caps_locked (SkippyHLSDemux *demux, GstCaps *caps)
+{
+  if (!demux->mp3_framing || !demux->mp3_header_known || !caps) {
+    return caps;
+  }
+  caps = gst_caps_make_writable (caps);
+  gst_caps_set_simple (caps,
+    "parsed", G_TYPE_BOOLEAN, TRUE,
+    "rate", G_TYPE_INT, (gint) demux->mp3_header.sample_rate,
+    "channels", G_TYPE_INT, (gint) demux->mp3_header.channels,
+    NULL);
+  return caps;
+}
+
+// Picks up the stream parameters from the first MP3 frame we get
+static void
+skippy_hls_demux_mp3_inspect (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  GstMapInfo map;
+  gssize offset;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  offset = skippy_mp3_find_frame (map.data, map.size, &demux->mp3_header);
+  if (offset >= 0) {
+    demux->mp3_header_known = TRUE;
+    demux->mp3_vbr = skippy_mp3_frame_is_vbr (map.data + offset, map.size - offset, &demux->mp3_header);
+    GST_DEBUG_OBJECT (demux, "MP3 stream: MPEG-%u layer %u, %u bit/s%s, %u Hz", demux->mp3_header.version,
+      demux->mp3_header.layer, demux->mp3_header.bitrate, demux->mp3_vbr ? " (VBR)" : "", demux->mp3_header.sample_rate);
+    GST_OBJECT_LOCK (demux);
+    demux->caps = skippy_hls_demux_update_mp3_caps_locked (demux, demux->caps);
+    GST_OBJECT_UNLOCK (demux);
+  }
+  gst_buffer_unmap (buffer, &map);
+}
+
+// A seek range starts anywhere in a frame: drops what comes before the next frame header and
+// returns the time that frame starts at. Returns NULL if there is no frame start in the buffer.
+static GstBuffer*
+skippy_hls_demux_mp3_resync (SkippyHLSDemux *demux, GstBuffer *buffer, GstClockTime *pts)
+{
+  SkippyMp3Header header;
+  GstMapInfo map;
+  gssize offset;
+  gsize size = gst_buffer_get_size (buffer);
+  guint64 frames;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  offset = skippy_mp3_find_frame (map.data, map.size, &header);
+  gst_buffer_unmap (buffer, &map);
+  if (offset < 0) {
+    demux->mp3_resync_offset += size;
+    gst_buffer_unref (buffer);
+    return NULL;
+  }
+
+  // With a constant bitrate frames only differ by the padding byte, count them from the fragment start
+  frames = gst_util_uint64_scale_round (demux->mp3_resync_offset + offset, 8 * header.sample_rate,
+    (guint64) header.samples_per_frame * header.bitrate);
+  *pts = demux->mp3_resync_start + gst_util_uint64_scale (frames * header.samples_per_frame, GST_SECOND, header.sample_rate);
+  GST_DEBUG_OBJECT (demux, "Frame %" G_GUINT64_FORMAT " of the fragment at byte %" G_GINT64_FORMAT " starts at %" GST_TIME_FORMAT,
+    frames, demux->mp3_resync_offset + offset, GST_TIME_ARGS (*pts));
+  demux->mp3_resync_offset = -1;
+
+  if (offset) {
+    GstBuffer *buf = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL, offset, size - offset);
+    gst_buffer_unref (buffer);
+    buffer = buf;
+  }
+  return buffer;
+}
+
+// Time stamps a frame we split off as following the one before. Takes ownership of the frame.
+static GstBuffer*
+skippy_hls_demux_stamp_frame (SkippyHLSDemux *demux, GstBuffer *frame, GstClockTime duration, gboolean discont)
+{
+  frame = gst_buffer_make_writable (frame);
+  GST_BUFFER_PTS (frame) = demux->frame_next_pts;
+  GST_BUFFER_DTS (frame) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DURATION (frame) = duration;
+  if (demux->frame_next_pts != GST_CLOCK_TIME_NONE) {
+    demux->frame_next_pts += duration;
+  }
+  if (discont || demux->frame_discont) {
+    GST_BUFFER_FLAG_SET (frame, GST_BUFFER_FLAG_DISCONT);
+  } else {
+    GST_BUFFER_FLAG_UNSET (frame, GST_BUFFER_FLAG_DISCONT);
+  }
+  demux->frame_discont = FALSE;
+  return frame;
+}
+
+// Hands on whole MP3 frames with their time stamps and durations, downstream doesn't need to parse
+// Only called from the thread feeding the queue.
+static GstFlowReturn
+skippy_hls_demux_push_mp3_frames (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  GstBufferList *list = NULL;
+  GstBuffer *frame;
+  SkippyMp3Header header;
+  GstClockTime duration;
+  gboolean discont;
+
+  // We get a time stamp where the data starts with a frame (stream start, after seeking)
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    demux->frame_next_pts = GST_BUFFER_PTS (buffer);
+  }
+  demux->frame_discont |= GST_BUFFER_IS_DISCONT (buffer);
+  skippy_mp3_framer_push (demux->mp3_framer, buffer);
+
+  while ((frame = skippy_mp3_framer_next_frame (demux->mp3_framer, &header, &discont))) {
+    duration = gst_util_uint64_scale (header.samples_per_frame, GST_SECOND, header.sample_rate);
+    if (!list) {
+      list = gst_buffer_list_new ();
+    }
+    gst_buffer_list_add (list, skippy_hls_demux_stamp_frame (demux, frame, duration, discont));
+  }
+  return list ? skippy_hls_demux_push_list_to_queue (demux, list) : GST_FLOW_OK;
+}
+
+// Hands on what we received in slices of up to that size sharing the memory, 0 passes it through as it is
+// Only called from the thread feeding the queue.
+static GstFlowReturn
+skippy_hls_demux_push_slices (SkippyHLSDemux *demux, GstBuffer *buffer, gsize slice_size)
+{
+  GstBufferList *list;
+  GstBuffer *buf;
+  gsize offset, size = gst_buffer_get_size (buffer);
+
+  if (!slice_size || size <= slice_size) {
+    return skippy_hls_demux_push_to_queue (demux, buffer);
+  }
+  // The queue gets them all at once
+  list = gst_buffer_list_new_sized ((size + slice_size - 1) / slice_size);
+  for (offset = 0; offset < size; offset += slice_size) {
+    buf = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL, offset, MIN (slice_size, size - offset));
+    if (offset) {
+      // for all subsequent buffers unset discont flag and mark PTS
+      // as GST_CLOCK_TIME_NONE (continous data)
+      GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DISCONT);
+      GST_BUFFER_PTS (buf) = GST_CLOCK_TIME_NONE;
+    }
+    gst_buffer_list_add (list, buf);
+  }
+  gst_buffer_unref (buffer);
+  return skippy_hls_demux_push_list_to_queue (demux, list);
+}
+
+/* Ogg/Opus: packets out of the pages, time stamped from the granules */
+
+static GstCaps*
+skippy_hls_demux_opus_output_caps (SkippyHLSDemux *demux, GstCaps *caps)
+{
+  return gst_caps_from_string ("audio/x-opus, channel-mapping-family=0");
+}
+
+static GstFlowReturn
+skippy_hls_demux_opus_chain (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  GstFlowReturn ret_value = GST_FLOW_OK;
+  GstBuffer *buf;
+  gsize offset, size = gst_buffer_get_size (buffer);
+  gsize slice_size = demux->opus_slice_size;
+
+  if (!slice_size || size <= slice_size) {
+    ret_value = skippy_hls_demux_read_ogg_and_push_opus_packets (demux, buffer);
+    gst_buffer_unref (buffer);
+    return ret_value;
+  }
+  // Feed the Ogg reader slice by slice
+  for (offset = 0; offset < size && ret_value == GST_FLOW_OK; offset += slice_size) {
+    buf = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL, offset, MIN (slice_size, size - offset));
+    if (offset) {
+      GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DISCONT);
+      GST_BUFFER_PTS (buf) = GST_CLOCK_TIME_NONE;
+    }
+    ret_value = skippy_hls_demux_read_ogg_and_push_opus_packets (demux, buf);
+    gst_buffer_unref (buf);
+  }
+  gst_buffer_unref (buffer);
+  return ret_value;
+}
+
+static void
+skippy_hls_demux_opus_flush (SkippyHLSDemux *demux)
+{
+  skippy_ogg_framer_flush (demux->ogg_framer);
+  if (demux->opus_batch) {
+    gst_buffer_list_unref (demux->opus_batch);
+    demux->opus_batch = NULL;
+  }
+  demux->opus_batch_start = GST_CLOCK_TIME_NONE;
+  demux->opus_granule = -1;
+  demux->opus_seek_processing_pending = TRUE;
+  demux->last_page_pos_ms = 0;
+}
+
+/* MP3: resyncs after seek ranges, optionally split into frames */
+
+static GstCaps*
+skippy_hls_demux_mp3_output_caps (SkippyHLSDemux *demux, GstCaps *caps)
+{
+  return skippy_hls_demux_update_mp3_caps_locked (demux, gst_caps_copy (caps));
+}
+
+static GstBuffer*
+skippy_hls_demux_mp3_prepare (SkippyHLSDemux *demux, GstBuffer *buffer, GstClockTime *pts)
+{
+  if (G_UNLIKELY (!demux->mp3_header_known)) {
+    skippy_hls_demux_mp3_inspect (demux, buffer);
+  }
+  if (G_UNLIKELY (demux->mp3_resync_offset >= 0)) {
+    return skippy_hls_demux_mp3_resync (demux, buffer, pts);
+  }
+  return buffer;
+}
+
+static GstFlowReturn
+skippy_hls_demux_mp3_chain (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  if (demux->mp3_framing) {
+    // Frames are the slices then
+    return skippy_hls_demux_push_mp3_frames (demux, buffer);
+  }
+  return skippy_hls_demux_push_slices (demux, buffer, demux->mp3_slice_size);
+}
+
+static void
+skippy_hls_demux_mp3_flush (SkippyHLSDemux *demux)
+{
+  demux->mp3_resync_offset = -1;
+  skippy_mp3_framer_flush (demux->mp3_framer);
+  demux->frame_next_pts = GST_CLOCK_TIME_NONE;
+}
+
+/* AAC (ADTS): optionally split into frames */
+
+// When we are the parser, tell downstream what it gets. Takes ownership of the caps.
+// Expects the GST object mutex to be locked
+static GstCaps*
+skippy_hls_demux_update_aac_caps_locked (SkippyHLSDemux *demux, GstCaps *caps)
+{
+  if (!demux->aac_framing || !demux->aac_header_known || !caps) {
+    return caps;
+  }
+  caps = gst_caps_make_writable (caps);
+  gst_caps_set_simple (caps,
+    "framed", G_TYPE_BOOLEAN, TRUE,
+    "stream-format", G_TYPE_STRING, "adts",
+    "rate", G_TYPE_INT, (gint) demux->aac_header.sample_rate,
+    NULL);
+  if (demux->aac_header.channels) {
+    gst_caps_set_simple (caps, "channels", G_TYPE_INT, (gint) demux->aac_header.channels, NULL);
+  }
+  return caps;
+}
+
+// Picks up the stream parameters from the first ADTS frame we get
+static void
+skippy_hls_demux_aac_inspect (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  GstMapInfo map;
+
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  if (skippy_adts_find_frame (map.data, map.size, &demux->aac_header) >= 0) {
+    demux->aac_header_known = TRUE;
+    GST_DEBUG_OBJECT (demux, "AAC stream: MPEG-%u, object type %u, %u Hz, %u channels", demux->aac_header.version,
+      demux->aac_header.profile + 1, demux->aac_header.sample_rate, demux->aac_header.channels);
+    GST_OBJECT_LOCK (demux);
+    demux->caps = skippy_hls_demux_update_aac_caps_locked (demux, demux->caps);
+    GST_OBJECT_UNLOCK (demux);
+  }
+  gst_buffer_unmap (buffer, &map);
+}
+
+// Hands on whole ADTS frames with their time stamps and durations, like MP3 frames
+// Only called from the thread feeding the queue.
+static GstFlowReturn
+skippy_hls_demux_push_aac_frames (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  GstBufferList *list = NULL;
+  GstBuffer *frame;
+  SkippyAdtsHeader header;
+  GstClockTime duration;
+  gboolean discont;
+
+  // We get a time stamp where the data starts with a frame (stream start, after seeking, PES time stamps)
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    demux->frame_next_pts = GST_BUFFER_PTS (buffer);
+  }
+  demux->frame_discont |= GST_BUFFER_IS_DISCONT (buffer);
+  skippy_adts_framer_push (demux->aac_framer, buffer);
+
+  while ((frame = skippy_adts_framer_next_frame (demux->aac_framer, &header, &discont))) {
+    duration = gst_util_uint64_scale (header.samples_per_frame, GST_SECOND, header.sample_rate);
+    if (!list) {
+      list = gst_buffer_list_new ();
+    }
+    gst_buffer_list_add (list, skippy_hls_demux_stamp_frame (demux, frame, duration, discont));
+  }
+  return list ? skippy_hls_demux_push_list_to_queue (demux, list) : GST_FLOW_OK;
+}
+
+static GstCaps*
+skippy_hls_demux_aac_output_caps (SkippyHLSDemux *demux, GstCaps *caps)
+{
+  return skippy_hls_demux_update_aac_caps_locked (demux, gst_caps_copy (caps));
+}
+
+static GstBuffer*
+skippy_hls_demux_aac_prepare (SkippyHLSDemux *demux, GstBuffer *buffer, GstClockTime *pts)
+{
+  if (G_UNLIKELY (demux->aac_framing && !demux->aac_header_known)) {
+    skippy_hls_demux_aac_inspect (demux, buffer);
+  }
+  return buffer;
+}
+
+static GstFlowReturn
+skippy_hls_demux_aac_chain (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  if (demux->aac_framing) {
+    return skippy_hls_demux_push_aac_frames (demux, buffer);
+  }
+  return skippy_hls_demux_push_to_queue (demux, buffer);
+}
+
+static void
+skippy_hls_demux_aac_flush (SkippyHLSDemux *demux)
+{
+  skippy_adts_framer_flush (demux->aac_framer);
+  demux->frame_next_pts = GST_CLOCK_TIME_NONE;
+}
+
+/* Anything else: passed through for a parser downstream */
+
+static GstCaps*
+skippy_hls_demux_passthrough_output_caps (SkippyHLSDemux *demux, GstCaps *caps)
+{
+  return gst_caps_copy (caps);
+}
+
+static GstFlowReturn
+skippy_hls_demux_passthrough_chain (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  return skippy_hls_demux_push_to_queue (demux, buffer);
+}
+
+static void
+skippy_hls_demux_passthrough_flush (SkippyHLSDemux *demux)
+{
+}
+
+/* MPEG-TS: the audio PES payload goes on to the packetizer of what is inside */
+
+// Maps a PES time stamp onto our timeline. The first one after stream start or a seek, and any
+// jumping away from the one before (a discontinuity in the stream), get pinned to where the fragment starts.
+static GstClockTime
+skippy_hls_demux_ts_pes_time (SkippyHLSDemux *demux, gint64 ticks)
+{
+  GstClockTimeDiff time = gst_util_uint64_scale (ticks, GST_SECOND, SKIPPY_TS_CLOCK_RATE);
+  GstClockTimeDiff mapped = time + demux->ts_pts_offset;
+  GstClockTime position;
+
+  if (demux->ts_last_pts == GST_CLOCK_TIME_NONE || mapped < 0
+    || mapped + TS_PTS_MAX_GAP < (GstClockTimeDiff) demux->ts_last_pts
+    || mapped > (GstClockTimeDiff) (demux->ts_last_pts + TS_PTS_MAX_GAP)) {
+    GST_OBJECT_LOCK (demux);
+    position = demux->position;
+    GST_OBJECT_UNLOCK (demux);
+    GST_DEBUG_OBJECT (demux, "PES time stamp %" GST_TIME_FORMAT " starts at %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (time), GST_TIME_ARGS (position));
+    demux->ts_pts_offset = (GstClockTimeDiff) position - time;
+    mapped = position;
+  }
+  demux->ts_last_pts = mapped;
+  return mapped;
+}
+
+static GstCaps*
+skippy_hls_demux_ts_output_caps (SkippyHLSDemux *demux, GstCaps *caps)
+{
+  GstCaps *stream_caps;
+
+  // Until we've seen the PMT, the first buffer we hand on replaces these
+  if (!demux->ts_packetizer || !(stream_caps = skippy_ts_demuxer_get_caps (demux->ts_demuxer))) {
+    return gst_caps_copy (caps);
+  }
+  caps = demux->ts_packetizer->output_caps (demux, stream_caps);
+  gst_caps_unref (stream_caps);
+  return caps;
+}
+
+static GstBuffer*
+skippy_hls_demux_ts_prepare (SkippyHLSDemux *demux, GstBuffer *buffer, GstClockTime *pts)
+{
+  GstBuffer *pes, *payload = NULL;
+  GstCaps *stream_caps, *caps;
+  gint64 ticks;
+
+  skippy_ts_demuxer_push (demux->ts_demuxer, buffer);
+
+  if (G_UNLIKELY (!demux->ts_packetizer) && (stream_caps = skippy_ts_demuxer_get_caps (demux->ts_demuxer))) {
+    demux->ts_packetizer = skippy_hls_demux_find_packetizer (stream_caps);
+    GST_DEBUG_OBJECT (demux, "Using %s packetizer inside MPEG-TS for %" GST_PTR_FORMAT, demux->ts_packetizer->name, stream_caps);
+    GST_OBJECT_LOCK (demux);
+    caps = demux->ts_packetizer->output_caps (demux, stream_caps);
     if (demux->caps) {
       gst_caps_unref (demux->caps);
     }
+    demux->caps = caps;
+    GST_OBJECT_UNLOCK (demux);
+    gst_caps_unref (stream_caps);
+  }
+
+  // Whatever PES packets completed go on at once, stamped with the first time we have
+  while ((pes = skippy_ts_demuxer_next_pes (demux->ts_demuxer, &ticks))) {
+    if (ticks >= 0 && *pts == GST_CLOCK_TIME_NONE) {
+      *pts = skippy_hls_demux_ts_pes_time (demux, ticks);
+    }
+    payload = payload ? gst_buffer_append (payload, pes) : pes;
+  }
+  if (!payload || !demux->ts_packetizer) {
+    if (payload) {
+      gst_buffer_unref (payload);
+    }
+    return NULL;
+  }
+
+  if (demux->ts_packetizer->prepare) {
+    return demux->ts_packetizer->prepare (demux, payload, pts);
+  }
+  return payload;
+}
+
+static GstFlowReturn
+skippy_hls_demux_ts_chain (SkippyHLSDemux *demux, GstBuffer *buffer)
+{
+  return demux->ts_packetizer->chain (demux, buffer);
+}
+
+static void
+skippy_hls_demux_ts_flush (SkippyHLSDemux *demux)
+{
+  skippy_ts_demuxer_flush (demux->ts_demuxer);
+  if (demux->ts_packetizer) {
+    demux->ts_packetizer->flush (demux);
+  }
+  demux->ts_last_pts = GST_CLOCK_TIME_NONE;
+}
+
+struct _SkippyHLSDemuxPacketizer
+{
+  const gchar *name;
+  SkippyHLSDemuxCodec codec;
+  GstStaticCaps caps;           /* What we get from the downloader */
+  // Caps we announce downstream. Expects the GST object mutex to be locked.
+  GstCaps* (*output_caps) (SkippyHLSDemux *demux, GstCaps *caps);
+  // Optional: sees the received data before time stamps get set, may drop it (returns NULL) or set where it starts
+  GstBuffer* (*prepare) (SkippyHLSDemux *demux, GstBuffer *buffer, GstClockTime *pts);
+  // Takes what we received, time stamped if it starts at a known position
+  GstFlowReturn (*chain) (SkippyHLSDemux *demux, GstBuffer *buffer);
+  // Drops all state in between two buffers, for seeking
+  void (*flush) (SkippyHLSDemux *demux);
+};
+
+// First match wins, the last one takes anything
+static SkippyHLSDemuxPacketizer skippy_hls_demux_packetizers[] = {
+  { "Ogg/Opus", OPUS, GST_STATIC_CAPS ("audio/ogg"),
+    skippy_hls_demux_opus_output_caps, NULL, skippy_hls_demux_opus_chain, skippy_hls_demux_opus_flush },
+  { "AAC", AAC, GST_STATIC_CAPS ("audio/mpeg, mpegversion=(int){ 2, 4 }"),
+    skippy_hls_demux_aac_output_caps, skippy_hls_demux_aac_prepare, skippy_hls_demux_aac_chain, skippy_hls_demux_aac_flush },
+  { "MP3", MP3, GST_STATIC_CAPS ("audio/mpeg, mpegversion=(int)1"),
+    skippy_hls_demux_mp3_output_caps, skippy_hls_demux_mp3_prepare, skippy_hls_demux_mp3_chain, skippy_hls_demux_mp3_flush },
+  // Audio out of MPEG-TS, optional (see skippy_hls_demux_set_input_caps)
+  { "MPEG-TS", MPEGTS, GST_STATIC_CAPS ("video/mpegts"),
+    skippy_hls_demux_ts_output_caps, skippy_hls_demux_ts_prepare, skippy_hls_demux_ts_chain, skippy_hls_demux_ts_flush },
+  // Fragmented MP4 (CMAF), the init section goes ahead of the fragments as they are
+  { "fMP4", FMP4, GST_STATIC_CAPS ("video/quicktime; audio/x-m4a; application/x-3gp"),
+    skippy_hls_demux_passthrough_output_caps, NULL, skippy_hls_demux_passthrough_chain, skippy_hls_demux_passthrough_flush },
+  { "passthrough", UNKNOWN, GST_STATIC_CAPS_ANY,
+    skippy_hls_demux_passthrough_output_caps, NULL, skippy_hls_demux_passthrough_chain, skippy_hls_demux_passthrough_flush }
+};
+
+// Returns the packetizer taking these caps, NULL caps get the last resort
+static const SkippyHLSDemuxPacketizer*
+skippy_hls_demux_find_packetizer (GstCaps *caps)
+{
+  guint i;
+  GstCaps *packetizer_caps;
+  gboolean match;
+
+  for (i = 0; caps && i < G_N_ELEMENTS (skippy_hls_demux_packetizers) - 1; i++) {
+    packetizer_caps = gst_static_caps_get (&skippy_hls_demux_packetizers[i].caps);
+    match = gst_caps_can_intersect (packetizer_caps, caps);
+    gst_caps_unref (packetizer_caps);
+    if (match) {
+      break;
+    }
+  }
+  return &skippy_hls_demux_packetizers[i];
+}
+
+// Picks the packetizer for what the downloader gives us and the caps we announce for it
+//
+// MT-safe
+static void
+skippy_hls_demux_set_input_caps (SkippyHLSDemux *demux, GstCaps *caps)
+{
+  const SkippyHLSDemuxPacketizer *packetizer = skippy_hls_demux_find_packetizer (caps);
+
+  // Unless enabled, MPEG-TS is handed on for a demuxer downstream
+  if (packetizer->codec == MPEGTS && !demux->ts_demuxing) {
+    packetizer = skippy_hls_demux_find_packetizer (NULL);
+  }
+
+  GST_OBJECT_LOCK (demux);
+  if (demux->packetizer != packetizer) {
+    GST_DEBUG_OBJECT (demux, "Using %s packetizer for %" GST_PTR_FORMAT, packetizer->name, caps);
+  }
+  demux->packetizer = packetizer;
+  demux->dataCodec = packetizer->codec;
+  if (demux->caps) {
+    gst_caps_unref (demux->caps);
+  }
+  demux->caps = packetizer->output_caps (demux, caps);
+  GST_OBJECT_UNLOCK (demux);
+}
+
+static GstFlowReturn
+skippy_hls_demux_proxy_pad_chain (GstPad *pad, GstObject *parent, GstBuffer *buffer)
+{
+  GST_TRACE ("Got %" GST_PTR_FORMAT, buffer);
+
+  GstFlowReturn ret_value = GST_FLOW_OK;
+  gboolean set_discont = FALSE;
+  GstClockTime buffer_pts = GST_CLOCK_TIME_NONE, prepared_pts = GST_CLOCK_TIME_NONE;
+  gsize size;
+  SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (gst_pad_get_element_private (pad));
+  const SkippyHLSDemuxPacketizer *packetizer = demux->packetizer;
+  
+  if (!buffer) {
+    GST_WARNING ("Error: chain function invoked with NULL buffer!");
+    g_warn_if_reached ();
+    return ret_value;
+  }
+
+  size = gst_buffer_get_size (buffer);
+  if (!size) {
+    GST_WARNING ("Error: no data has been processed. Got an empty buffer!");
+    g_warn_if_reached ();
+    gst_buffer_unref (buffer);
+    return ret_value;
+  }
+
+  if (packetizer->prepare && !(buffer = packetizer->prepare (demux, buffer, &prepared_pts))) {
+    return ret_value;
+  }
+
+  GST_OBJECT_LOCK (demux);
+  if (G_UNLIKELY(demux->need_segment)) {
+    buffer_pts = prepared_pts != GST_CLOCK_TIME_NONE ? prepared_pts : demux->position;
+    if (!demux->need_stream_start) {
+      GST_DEBUG_OBJECT (demux, "Seek performed, buffer %p has discontinuity. Buffer PTS is %" GST_TIME_FORMAT, buffer, GST_TIME_ARGS (demux->position));
+      set_discont = TRUE;
+    }
+  } else {
+    set_discont = FALSE;
+    // Packetizers may know where data in the middle of the stream starts too
+    buffer_pts = prepared_pts;
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  // first send eventual events upfront data
+  skippy_hls_demux_update_downstream_events (demux, TRUE, TRUE);
+
+  // set proper discont flag and time stamp if needed, only metadata gets copied here
+  buffer = gst_buffer_make_writable (buffer);
+  if (set_discont) {
+    GST_DEBUG_OBJECT (demux, "Setting discontinuity on newly created buffer after seek");
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+  } else {
+    GST_BUFFER_FLAG_UNSET (buffer, GST_BUFFER_FLAG_DISCONT);
+  }
+  GST_BUFFER_PTS (buffer) = buffer_pts;
+  GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+
+  ret_value = packetizer->chain (demux, buffer);
+
+  if (ret_value != GST_FLOW_OK) {
+    GST_WARNING ("Proxy pad was %s while invoking queue chain function", gst_flow_get_name (ret_value));
+  }
+  return ret_value;
+}
+
+static gboolean
+skippy_hls_demux_proxy_pad_event (GstPad *pad, GstObject *parent, GstEvent *event)
+{
+  GST_LOG ("Got %" GST_PTR_FORMAT, event);
+
+  SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (gst_pad_get_element_private (pad));
+  GstCaps *caps;
+  switch (event->type) {
+  case GST_EVENT_CAPS:
     gst_event_parse_caps (event, &caps);
-    GstCaps *ogg_caps = gst_static_caps_get (&ogg_static_caps);
-    if (gst_caps_can_intersect (ogg_caps, caps)) {
-      demux->dataCodec = OPUS;
-      demux->caps = gst_caps_from_string ("audio/x-opus, channel-mapping-family=0");
-    } else {
-      demux->dataCodec = MP3;
-      demux->caps = gst_caps_copy (caps);
+    skippy_hls_demux_set_input_caps (demux, caps);
+  default:
+    break;
+  }
+
+  gst_event_unref (event);
+  return TRUE;
+}
+
+// Refreshes playlist - only called from the fetch
+//
+// MT-safe
+static gboolean
+skippy_hls_demux_refresh_playlist (SkippyHLSDemux * demux)
+{
+  SkippyFragment *download;
+  GstBuffer *buf = NULL;
+  GError* err = NULL;
+  SkippyUriDownloaderFetchReturn fetch_ret;
+  gboolean ret = FALSE;
+  gchar *current_playlist = skippy_m3u8_client_get_current_playlist (demux->client);
+  SkippyHlsInternalError load_playlist_result = NO_ERROR;
+
+  if (!current_playlist) {
+    return FALSE;
+  }
+
+  if (demux->force_secure_hls) {
+    skippy_hls_demux_append_query_param_to_hls_url (&current_playlist, "secure", "true");
+  }
+  
+  // Only our own renditions come in these formats
+  if (demux->caps && (demux->dataCodec == OPUS || demux->dataCodec == MP3)) {
+    const char* format = demux->dataCodec == OPUS ? OPUS_FORMAT_PARAM : MP3_FORMAT_PARAM;
+    http_replace_query_parameter (&current_playlist, FORMAT_PARAM, format);
+  }
+  
+  // Create a download
+  download = skippy_fragment_new (current_playlist);
+  download->start_time = 0;
+  download->stop_time = skippy_m3u8_client_get_total_duration (demux->client);
+
+  // Download it
+  fetch_ret = skippy_uri_downloader_fetch_fragment (demux->playlist_downloader,
+    download, // Media fragment to load
+    current_playlist, // Referrer
+    TRUE, // Compress (good for playlists)
+    TRUE, // Refresh (wipe out cached stuff)
+    skippy_hls_demux_is_caching_allowed (demux), // Allow caching directive
+    &err // Error
+  );
+
+  // Handle fetch result
+  switch (fetch_ret) {
+  case SKIPPY_URI_DOWNLOADER_COMPLETED:
+    skippy_hls_demux_post_stat_msg (demux, STAT_TIME_TO_PLAYLIST, download->download_stop_time - download->download_start_time, 0);
+    // Load M3U8 buffer into parser
+    buf = skippy_uri_downloader_get_buffer (demux->playlist_downloader);
+
+    g_clear_error (&err);
+
+    load_playlist_result = skippy_m3u8_client_load_playlist (demux->client, current_playlist, buf);
+
+    if (G_UNLIKELY(load_playlist_result != NO_ERROR)) {
+      if (load_playlist_result == PLAYLIST_INCOMPLETE) {
+        GST_ELEMENT_WARNING (demux, SKIPPY_HLS, PLAYLIST_INCOMPLETE_ON_REFRESH, ("While refreshing playlist: Incomplete M3U8 data."), ("%s", skippy_m3u8_client_get_current_raw_data (demux->client)));
+        demux->force_secure_hls = TRUE;
+      }
+      else {
+        GST_ELEMENT_ERROR (demux, SKIPPY_HLS, PLAYLIST_INVALID_UTF_CONTENT, ("While refreshing playlist: Invalid M3U8 data (buffer: %p)", buf), (NULL));
+      }
+      ret = FALSE;
+    }
+    else {
+      // The format we asked for may have changed
+      skippy_hls_demux_update_playlist_caps (demux);
+      ret = TRUE;
+    }
+    break;
+  case SKIPPY_URI_DOWNLOADER_FAILED:
+      if (g_error_matches (err, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_NOT_FOUND)) {
+        // playlist not found - if we have opus set as parm - threat this as recovery needed - try with mp3
+        if (strstr(current_playlist, FORMAT_OPUS_PARAM)) {
+          GST_WARNING ("Got 403 while refreshing playlist. Specified media format is not available anymore");
+          GST_ELEMENT_WARNING (demux, SKIPPY_HLS, UNSUPPORTED_MEDIA_FORMAT, ("Media format not supported."), (NULL));
+          skippy_hls_demux_pause_loop (demux);
+        }
+      }
+      ret = FALSE;
+      break;
+      
+  case SKIPPY_URI_DOWNLOADER_CANCELLED:
+  case SKIPPY_URI_DOWNLOADER_STALLED:
+  case SKIPPY_URI_DOWNLOADER_VOID:
+    if (err) {
+      GST_ERROR ("Error updating playlist: %s", err->message);
+    }
+    ret = FALSE;
+    break;
+  }
+
+  if (buf) {
+    gst_buffer_unref (buf);
+  }
+
+  g_clear_error (&err);
+  g_free (current_playlist);
+  return ret;
+}
+
+static GstClockTime
+skippy_hls_demux_get_time_until_retry_locked (SkippyHLSDemux * demux)
+{
+  double retry_timer = RETRY_TIME_BASE + RETRY_MAX_TIME_UNTIL / (1 + pow(M_E, -0.8 * (demux->download_failed_count - 8)));
+  retry_timer = g_rand_double_range (demux->rand_gen, 0, retry_timer);
+  return (GstClockTime) retry_timer;
+}
+
+// How far ahead of the playhead we buffer: the adapted target when we have one, download-ahead at most
+// Runs in the stream task loop.
+static GstClockTime
+skippy_hls_demux_get_buffer_target (SkippyHLSDemux * demux)
+{
+  if (!demux->adaptive_buffer || !GST_CLOCK_TIME_IS_VALID (demux->buffer_target)
+    || !GST_CLOCK_TIME_IS_VALID (demux->download_ahead)) {
+    return demux->download_ahead;
+  }
+  return MIN (demux->buffer_target, demux->download_ahead);
+}
+
+// Adapts the buffer target to the bandwidth estimate of the media downloader after a download completed, relative
+// to the media byte rate. The more the estimate varies and the closer it gets to what playback needs, the further
+// ahead we buffer.
+// Only called from the fetch.
+static void
+skippy_hls_demux_update_buffer_target (SkippyHLSDemux * demux)
+{
+  guint64 bandwidth = skippy_uri_downloader_get_bandwidth (demux->downloader);
+  GstClockTime min_target, max_target, target;
+  gdouble mean = 0, variance = 0, headroom, weight;
+  guint count, i;
+
+  if (!demux->adaptive_buffer || !GST_CLOCK_TIME_IS_VALID (demux->download_ahead) || !demux->media_byte_rate
+    || !bandwidth) {
+    return;
+  }
+  demux->throughputs[demux->throughput_count++ % THROUGHPUT_HISTORY] = bandwidth / 8.;
+
+  count = MIN (demux->throughput_count, THROUGHPUT_HISTORY);
+  if (count < ADAPTIVE_BUFFER_MIN_SAMPLES) {
+    return;
+  }
+  for (i = 0; i < count; i++) {
+    mean += demux->throughputs[i];
+  }
+  mean /= count;
+  for (i = 0; i < count; i++) {
+    variance += (demux->throughputs[i] - mean) * (demux->throughputs[i] - mean);
+  }
+  variance /= count;
+
+  // Linear in between the headroom bounds
+  headroom = (mean - sqrt (variance)) / demux->media_byte_rate;
+  weight = (ADAPTIVE_BUFFER_HIGH_HEADROOM - headroom) / (ADAPTIVE_BUFFER_HIGH_HEADROOM - ADAPTIVE_BUFFER_LOW_HEADROOM);
+  weight = CLAMP (weight, 0.0, 1.0);
+  max_target = demux->download_ahead;
+  min_target = MIN (MIN_BUFFER_DURATION, max_target);
+  target = min_target + (GstClockTime) (weight * (max_target - min_target));
+
+  GST_LOG_OBJECT (demux, "Throughput %.0f +/- %.0f bytes/s for media at %" G_GUINT64_FORMAT " bytes/s, headroom %.2f",
+    mean, sqrt (variance), demux->media_byte_rate, headroom);
+
+  // Always settle on the bounds, elsewhere only move in steps
+  if (GST_CLOCK_TIME_IS_VALID (demux->buffer_target) && target != min_target && target != max_target
+    && (target > demux->buffer_target ? target - demux->buffer_target : demux->buffer_target - target) < ADAPTIVE_BUFFER_STEP) {
+    return;
+  }
+  if (target == demux->buffer_target) {
+    return;
+  }
+  GST_INFO_OBJECT (demux, "Buffer target now %" GST_TIME_FORMAT, GST_TIME_ARGS (target));
+  demux->buffer_target = target;
+  skippy_hls_demux_post_stat_msg (demux, STAT_BUFFER_TARGET, target, (gsize) mean);
+}
+
+// Estimates how much media we hold in memory: what's in the download queue plus retained fragments
+// the queue already gave away, not counting what lives in the spill file
+// Runs in the stream task loop or the fetch, see skippy_hls_demux_handle_schedule.
+static gsize
+skippy_hls_demux_get_memory_usage (SkippyHLSDemux * demux, guint64 queue_level_bytes, GstClockTime pos)
+{
+  gsize usage = queue_level_bytes, spilled = 0;
+
+  if (pos != GST_CLOCK_TIME_NONE) {
+    usage += skippy_fragment_cache_get_size_behind (demux->fragment_cache, pos);
+  }
+  if (demux->spill_file) {
+    spilled = skippy_spill_file_get_used (demux->spill_file);
+  }
+  usage = usage > spilled ? usage - spilled : 0;
+
+  if (usage > demux->memory_usage_peak) {
+    demux->memory_usage_peak = usage;
+  }
+  return usage;
+}
+
+// Reads the playhead estimate and the amount of bytes in the download queue
+//
+// MT-safe
+static GstClockTime
+skippy_hls_demux_get_playhead (SkippyHLSDemux * demux, guint64 * queue_level_bytes)
+{
+  GstClockTime pos;
+  GST_OBJECT_LOCK (demux);
+  pos = demux->playback_position;
+  if (queue_level_bytes) {
+    *queue_level_bytes = demux->queue_bytes_in - demux->queue_bytes_out;
+  }
+  GST_OBJECT_UNLOCK (demux);
+  return pos;
+}
+
+// Has the download queue probe post a schedule event once the playhead reached wake_position or the queue drained
+// to wake_queue_bytes. Expects the GST object mutex to be locked.
+static void
+skippy_hls_demux_arm_wakeup_locked (SkippyHLSDemux * demux, GstClockTime wake_position, guint64 wake_queue_bytes)
+{
+  GST_DEBUG ("Will wait for playhead at %" GST_TIME_FORMAT " or %" G_GUINT64_FORMAT " queued bytes",
+    GST_TIME_ARGS (wake_position), wake_queue_bytes);
+  demux->wake_position = wake_position;
+  demux->wake_queue_bytes = wake_queue_bytes;
+  // The queue might have moved on since we looked at it
+  demux->wake_armed = !skippy_hls_demux_wakeup_due_locked (demux);
+  if (!demux->wake_armed) {
+    skippy_hls_demux_post_locked (demux, EVENT_SCHEDULE);
+    return;
+  }
+  skippy_hls_demux_start_timer_locked (demux, &demux->idle_source, SCHEDULER_MAX_IDLE, EVENT_SCHEDULE);
+}
+
+// Checks wether we should download another segment with respect to buffer size. If not, we get another
+// schedule event when it's time to check again. Only runs in the stream task loop.
+//
+// MT-safe
+static gboolean
+skippy_hls_check_buffer_ahead (SkippyHLSDemux * demux)
+{
+  GstClockTime pos, max_buffer_duration, high_watermark, low_watermark, lead;
+  guint64 current_level_bytes = 0, wake_queue_bytes;
+  gsize memory_usage;
+
+  // Check if we are linked yet (did we receive a proper playlist?)
+  GST_OBJECT_LOCK (demux);
+  if (!demux->srcpad) {
+    // Handling the first playlist schedules us again
+    g_warning ("No src pad (didn't get any M3U8 data yet probably), will wait for it.");
+    GST_OBJECT_UNLOCK (demux);
+    return FALSE;
+  }
+
+
+  // Check if wait condition is enabled - if not we can just continue
+  if (demux->continuing) {
+    GST_OBJECT_UNLOCK (demux);
+    // Continue downloading
+    skippy_hls_demux_begin_burst (demux);
+    return TRUE;
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  // Check upfront position relative to stream position
+  // If we branch here this means we might want to wait
+  pos = skippy_hls_demux_get_playhead (demux, &current_level_bytes);
+  max_buffer_duration = skippy_hls_demux_get_buffer_target (demux);
+
+  // Forget about fragments we played long enough ago
+  if (pos != GST_CLOCK_TIME_NONE) {
+    skippy_fragment_cache_evict (demux->fragment_cache, pos, FRAGMENT_CACHE_RETAIN_BEHIND);
+  }
+
+  GST_DEBUG ("Playback position is %" GST_TIME_FORMAT " , Max buffer duration is %" GST_TIME_FORMAT ", Queued position is %" GST_TIME_FORMAT
+    ", Download queue level (bytes) is %" G_GUINT64_FORMAT, GST_TIME_ARGS (pos), GST_TIME_ARGS(max_buffer_duration), GST_TIME_ARGS (demux->position_downloaded),
+             current_level_bytes);
+
+  // Check for wether we should limit downloading
+  // Hysteresis: a burst keeps going up to the high mark, then we idle until playback drained the buffer to the low mark
+  if (pos != GST_CLOCK_TIME_NONE && max_buffer_duration != GST_CLOCK_TIME_NONE) {
+    high_watermark = (GstClockTime) (max_buffer_duration * BUFFER_WATERMARK_HIGH_RATIO);
+    low_watermark = MIN ((GstClockTime) (max_buffer_duration * BUFFER_WATERMARK_LOW_RATIO), high_watermark);
+    // Leave some room to ride out a slow download when we wake up again
+    low_watermark = MAX (low_watermark, MIN (MIN_BUFFER_DURATION, high_watermark));
+    lead = demux->position_downloaded > pos ? demux->position_downloaded - pos : 0;
+
+    if (demux->burst_start_time ? lead >= high_watermark : lead > low_watermark) {
+      skippy_hls_demux_end_burst (demux);
+      GST_TRACE ("Waiting in task as we have preloaded enough (until %" GST_TIME_FORMAT " of media position)",
+        GST_TIME_ARGS (demux->position_downloaded));
+      // Wake up once playback reaches the low mark (or the queue runs dry)
+      GST_OBJECT_LOCK (demux);
+      skippy_hls_demux_arm_wakeup_locked (demux, demux->position_downloaded - low_watermark, 0);
+      GST_OBJECT_UNLOCK (demux);
+      return FALSE;
     }
+  }
+
+  // Byte watermark: don't start another fragment while over the memory budget
+  memory_usage = skippy_hls_demux_get_memory_usage (demux, current_level_bytes, pos);
+  if (demux->max_buffer_bytes && memory_usage >= demux->max_buffer_bytes && pos != GST_CLOCK_TIME_NONE) {
+    // Media ahead matters more than what we keep for seeking back
+    skippy_fragment_cache_evict (demux->fragment_cache, pos, 0);
+    memory_usage = skippy_hls_demux_get_memory_usage (demux, current_level_bytes, pos);
+  }
+  if (demux->max_buffer_bytes && memory_usage >= demux->max_buffer_bytes) {
+    GST_TRACE ("Waiting in task as we hold %" G_GSIZE_FORMAT " bytes of media (max %" G_GUINT64_FORMAT ")",
+      memory_usage, demux->max_buffer_bytes);
+    skippy_hls_demux_end_burst (demux);
+    // Wake up once playback consumed the excess
+    wake_queue_bytes = memory_usage - demux->max_buffer_bytes < current_level_bytes ?
+      current_level_bytes - (memory_usage - demux->max_buffer_bytes) - 1 : 0;
+    GST_OBJECT_LOCK (demux);
+    skippy_hls_demux_arm_wakeup_locked (demux, GST_CLOCK_TIME_NONE, wake_queue_bytes);
     GST_OBJECT_UNLOCK (demux);
-  default:
-    break;
+    return FALSE;
   }
 
-  gst_event_unref (event);
+  // No waiting needed
+  skippy_hls_demux_begin_burst (demux);
+  return TRUE;
+}
+
+static gboolean
+skippy_hlsdemux_proxy_pad_remove_sticky_eos (GstPad * pad, GstEvent ** event, gpointer udata)
+{
+  if (GST_EVENT_TYPE (*event) == GST_EVENT_EOS) {
+    gst_event_replace (event, NULL);
+    return FALSE;
+  }
   return TRUE;
 }
 
-// Refreshes playlist - only called from streaming thread
+static void
+skippy_hlsdemux_proxy_pad_reset (SkippyHLSDemux *demux)
+{
+  //flush the proxy pad to reset EOS state.
+  gst_pad_push_event (demux->queue_proxy_pad, gst_event_new_flush_start ());
+  gst_pad_push_event (demux->queue_proxy_pad, gst_event_new_flush_stop (TRUE));
+  //remove sticky EOS events
+  gst_pad_sticky_events_foreach (demux->queue_proxy_pad, skippy_hlsdemux_proxy_pad_remove_sticky_eos, NULL);
+  GST_OBJECT_FLAG_UNSET (demux->queue_proxy_pad, GST_PAD_FLAG_EOS);
+}
+
+// The header pages are at the start of the first fragment, which has the same URI for
+// a stream except for the (signed) query
+static gchar*
+skippy_hls_demux_opus_header_cache_key (SkippyFragment *first)
+{
+  const gchar *query = strchr (first->uri, '?');
+  return query ? g_strndup (first->uri, query - first->uri) : g_strdup (first->uri);
+}
+
+// Returns 0 if we don't know the header size for this stream
+//
+// MT-safe
+static gsize
+skippy_hls_demux_opus_header_cache_lookup (SkippyFragment *first)
+{
+  gchar *key = skippy_hls_demux_opus_header_cache_key (first);
+  gsize size = 0;
+
+  gpointer cached_key, value;
+
+  g_mutex_lock (&opus_header_cache_lock);
+  if (opus_header_cache && g_hash_table_lookup_extended (opus_header_cache, key, &cached_key, &value)) {
+    size = GPOINTER_TO_SIZE (value);
+    // Used last now
+    g_queue_remove (&opus_header_cache_order, cached_key);
+    g_queue_push_head (&opus_header_cache_order, cached_key);
+  }
+  g_mutex_unlock (&opus_header_cache_lock);
+  g_free (key);
+  return size;
+}
+
+// Evicts the stream used least recently once we're full
+//
+// MT-safe
+static void
+skippy_hls_demux_opus_header_cache_store (SkippyFragment *first, gsize size)
+{
+  gchar *key = skippy_hls_demux_opus_header_cache_key (first);
+  gpointer cached_key;
+
+  g_mutex_lock (&opus_header_cache_lock);
+  if (!opus_header_cache) {
+    opus_header_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  }
+  if (g_hash_table_lookup_extended (opus_header_cache, key, &cached_key, NULL)) {
+    g_queue_remove (&opus_header_cache_order, cached_key);
+    g_hash_table_remove (opus_header_cache, key);
+  } else if (g_queue_get_length (&opus_header_cache_order) >= OPUS_HEADER_CACHE_SIZE) {
+    g_hash_table_remove (opus_header_cache, g_queue_pop_tail (&opus_header_cache_order));
+  }
+  // The table owns the key, the queue only points to it
+  g_queue_push_head (&opus_header_cache_order, key);
+  g_hash_table_insert (opus_header_cache, key, GSIZE_TO_POINTER (size));
+  g_mutex_unlock (&opus_header_cache_lock);
+}
+
+// Returns the first fragment limited to the byte range holding the Opus header pages,
+// or NULL if the playlist has no fragments. Only called from the fetch.
+static SkippyFragment*
+skippy_hls_demux_get_opus_header_fragment (SkippyHLSDemux *demux)
+{
+  SkippyFragment *fragment = skippy_m3u8_client_get_fragment (demux->client, 0);
+  gsize size;
+
+  if (!fragment) {
+    return NULL;
+  }
+  // We can only cut off an encrypted fragment at the end of what we need once we know the padding
+  // is not concerned, keep it simple and load all of it
+  if (fragment->key_uri) {
+    return fragment;
+  }
+  size = skippy_hls_demux_opus_header_cache_lookup (fragment);
+  fragment->range_start = 0;
+  if (size) {
+    fragment->range_end = size;
+  } else if (!demux->opus_header_probe_failed) {
+    fragment->range_end = OPUS_HEADER_PROBE_SIZE;
+  }
+  GST_DEBUG_OBJECT (demux, "Loading Opus header from %s (Byte-Range=0 - %" G_GINT64_FORMAT ", %s)",
+    fragment->uri, fragment->range_end, size ? "known size" : "probing");
+  return fragment;
+}
+
+// Follows the pages at the start of the stream until the OpusTags packet is complete (RFC 7845, section 3).
+// The identification header has a page on its own, the comment header ends its last page, both have granule 0.
+static void
+skippy_hls_demux_opus_track_header (SkippyHLSDemux *demux, SkippyOggPage *page)
+{
+  SkippyFragment *first;
+  gsize page_size = gst_buffer_get_size (page->buffer);
+
+  if (page->flags & SKIPPY_OGG_PAGE_BOS) {
+    demux->opus_header_size = page_size;
+    return;
+  }
+  if (!demux->opus_header_size || page->granulepos != 0) {
+    // Not at the start of the stream
+    demux->opus_header_size = 0;
+    return;
+  }
+  demux->opus_header_size += page_size;
+  if (!page->n_segments || page->segments[page->n_segments - 1] == 255) {
+    // Comment header continues on the next page
+    return;
+  }
+
+  demux->opus_header_complete = TRUE;
+  GST_DEBUG_OBJECT (demux, "Opus header pages end at byte %" G_GSIZE_FORMAT, demux->opus_header_size);
+  first = skippy_m3u8_client_get_fragment (demux->client, 0);
+  if (first) {
+    skippy_hls_demux_opus_header_cache_store (first, demux->opus_header_size);
+    g_object_unref (first);
+  }
+}
+
+// Pushes a fragment retained from an earlier download instead of fetching it again.
+// Returns FALSE if we don't have it. Only called from the fetch.
 //
 // MT-safe
 static gboolean
-skippy_hls_demux_refresh_playlist (SkippyHLSDemux * demux)
+skippy_hls_demux_replay_cached_fragment (SkippyHLSDemux * demux, SkippyFragment * fragment)
 {
-  SkippyFragment *download;
-  GstBuffer *buf = NULL;
-  GError* err = NULL;
-  SkippyUriDownloaderFetchReturn fetch_ret;
-  gboolean ret = FALSE;
-  gchar *current_playlist = skippy_m3u8_client_get_current_playlist (demux->client);
-  SkippyHlsInternalError load_playlist_result = NO_ERROR;
+  GstBufferList *buffers;
+  GstBuffer *buf;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gboolean set_discont;
 
-  if (!current_playlist) {
+  buffers = skippy_fragment_cache_lookup (demux->fragment_cache, fragment->sequence_number);
+  if (!buffers) {
     return FALSE;
   }
 
-  if (demux->force_secure_hls) {
-    skippy_hls_demux_append_query_param_to_hls_url (&current_playlist, "secure", "true");
+  GST_DEBUG_OBJECT (demux, "Replaying retained fragment %" G_GUINT64_FORMAT " at %" GST_TIME_FORMAT,
+    fragment->sequence_number, GST_TIME_ARGS (fragment->start_time));
+
+  GST_OBJECT_LOCK (demux);
+  set_discont = demux->need_segment && !demux->need_stream_start;
+  GST_OBJECT_UNLOCK (demux);
+
+  skippy_hls_demux_update_downstream_events (demux, TRUE, TRUE);
+
+  // Only metadata gets copied here, the memory stays shared
+  buffers = gst_buffer_list_make_writable (buffers);
+  buf = gst_buffer_make_writable (gst_buffer_ref (gst_buffer_list_get (buffers, 0)));
+  GST_BUFFER_PTS (buf) = fragment->start_time;
+  if (set_discont) {
+    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
+  } else {
+    GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DISCONT);
+  }
+  gst_buffer_list_remove (buffers, 0, 1);
+  gst_buffer_list_insert (buffers, 0, buf);
+  // MP3 or AAC frames we push next follow the retained ones
+  buf = gst_buffer_list_get (buffers, gst_buffer_list_length (buffers) - 1);
+  if (GST_BUFFER_PTS_IS_VALID (buf) && GST_BUFFER_DURATION_IS_VALID (buf)) {
+    demux->frame_next_pts = GST_BUFFER_PTS (buf) + GST_BUFFER_DURATION (buf);
+  } else {
+    demux->frame_next_pts = fragment->stop_time;
   }
-  
-  if (demux->caps) {
-    const char* format = demux->dataCodec == OPUS ? OPUS_FORMAT_PARAM : MP3_FORMAT_PARAM;
-    http_replace_query_parameter (&current_playlist, FORMAT_PARAM, format);
+  ret = gst_pad_chain_list (demux->queue_sinkpad, buffers);
+
+  if (ret != GST_FLOW_OK) {
+    GST_WARNING ("Queue was %s while replaying fragment", gst_flow_get_name (ret));
   }
-  
-  // Create a download
-  download = skippy_fragment_new (current_playlist);
-  download->start_time = 0;
-  download->stop_time = skippy_m3u8_client_get_total_duration (demux->client);
 
-  // Download it
+  // Retained data starts at the fragment boundary, nothing to skip
+  demux->opus_seek_processing_pending = FALSE;
+  return TRUE;
+}
+
+// Stops waiting for a key fetch in flight once we get interrupted, e.g. by a seek
+static gboolean
+skippy_hls_demux_key_wait_cancelled (gpointer user_data)
+{
+  SkippyHLSDemux *demux = SKIPPY_HLS_DEMUX (user_data);
+
+  return skippy_uri_downloader_is_interrupted (demux->downloader);
+}
+
+// Makes sure an encrypted fragment carries its AES-128 key before we fetch it.
+// Keys are shared across all instances by URI, so only one fetch per key is ever in flight.
+// Only called from the fetch.
+//
+// MT-safe
+static SkippyUriDownloaderFetchReturn
+skippy_hls_demux_load_fragment_key (SkippyHLSDemux * demux, SkippyFragment * fragment, const gchar* referrer_uri, GError ** err)
+{
+  SkippyFragment *key_download;
+  SkippyUriDownloaderFetchReturn fetch_ret;
+  GstBuffer *buf = NULL;
+  guint claim;
+
+  if (!fragment->key_uri || fragment->key_loaded) {
+    return SKIPPY_URI_DOWNLOADER_COMPLETED;
+  }
+
+  switch (skippy_aes_key_cache_lookup (fragment->key_uri, fragment->key, &claim, skippy_hls_demux_key_wait_cancelled, demux)) {
+    case SKIPPY_AES_KEY_CACHE_HIT:
+      fragment->key_loaded = TRUE;
+      return SKIPPY_URI_DOWNLOADER_COMPLETED;
+    case SKIPPY_AES_KEY_CACHE_CANCELLED:
+      return SKIPPY_URI_DOWNLOADER_CANCELLED;
+    case SKIPPY_AES_KEY_CACHE_MISS:
+      break;
+  }
+
+  GST_DEBUG_OBJECT (demux, "Fetching key: %s", fragment->key_uri);
+
+  key_download = skippy_fragment_new (fragment->key_uri);
   fetch_ret = skippy_uri_downloader_fetch_fragment (demux->playlist_downloader,
-    download, // Media fragment to load
-    current_playlist, // Referrer
-    TRUE, // Compress (good for playlists)
-    TRUE, // Refresh (wipe out cached stuff)
+    key_download, // Key to load
+    referrer_uri, // Referrer
+    FALSE, // Compress
+    FALSE, // Refresh
     skippy_hls_demux_is_caching_allowed (demux), // Allow caching directive
-    &err // Error
+    err
   );
 
-  // Handle fetch result
-  switch (fetch_ret) {
-  case SKIPPY_URI_DOWNLOADER_COMPLETED:
-    skippy_hls_demux_post_stat_msg (demux, STAT_TIME_TO_PLAYLIST, download->download_stop_time - download->download_start_time, 0);
-    // Load M3U8 buffer into parser
+  if (fetch_ret == SKIPPY_URI_DOWNLOADER_COMPLETED) {
     buf = skippy_uri_downloader_get_buffer (demux->playlist_downloader);
+    if (buf && gst_buffer_get_size (buf) == SKIPPY_AES_BLOCK_SIZE) {
+      gst_buffer_extract (buf, 0, fragment->key, SKIPPY_AES_BLOCK_SIZE);
+      fragment->key_loaded = TRUE;
+      skippy_aes_key_cache_store (fragment->key_uri, fragment->key);
+    } else {
+      GST_WARNING_OBJECT (demux, "Invalid key data from %s", fragment->key_uri);
+      g_set_error (err, GST_STREAM_ERROR, GST_STREAM_ERROR_DECRYPT, "Invalid AES-128 key (%d bytes)",
+        buf ? (int) gst_buffer_get_size (buf) : 0);
+      fetch_ret = SKIPPY_URI_DOWNLOADER_FAILED;
+    }
+  }
 
-    g_clear_error (&err);
+  if (!fragment->key_loaded) {
+    skippy_aes_key_cache_release (fragment->key_uri, claim);
+  }
 
-    load_playlist_result = skippy_m3u8_client_load_playlist (demux->client, current_playlist, buf);
+  if (buf) {
+    gst_buffer_unref (buf);
+  }
+  g_object_unref (key_download);
+  return fetch_ret;
+}
 
-    if (G_UNLIKELY(load_playlist_result != NO_ERROR)) {
-      if (load_playlist_result == PLAYLIST_INCOMPLETE) {
-        GST_ELEMENT_WARNING (demux, SKIPPY_HLS, PLAYLIST_INCOMPLETE_ON_REFRESH, ("While refreshing playlist: Incomplete M3U8 data."), ("%s", skippy_m3u8_client_get_current_raw_data (demux->client)));
-        demux->force_secure_hls = TRUE;
-      }
-      else {
-        GST_ELEMENT_ERROR (demux, SKIPPY_HLS, PLAYLIST_INVALID_UTF_CONTENT, ("While refreshing playlist: Invalid M3U8 data (buffer: %p)", buf), (NULL));
-      }
-      ret = FALSE;
-    }
-    else {
-      ret = TRUE;
-    }
-    break;
-  case SKIPPY_URI_DOWNLOADER_FAILED:
-      if (g_error_matches (err, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_NOT_FOUND)) {
-        // playlist not found - if we have opus set as parm - threat this as recovery needed - try with mp3
-        if (strstr(current_playlist, FORMAT_OPUS_PARAM)) {
-          GST_WARNING ("Got 403 while refreshing playlist. Specified media format is not available anymore");
-          GST_ELEMENT_WARNING (demux, SKIPPY_HLS, UNSUPPORTED_MEDIA_FORMAT, ("Media format not supported."), (NULL));
-          gst_task_pause (demux->stream_task);
+// Pushes the media initialization section (EXT-X-MAP) of a fragment ahead of it, whenever it differs
+// from the one we pushed last or a seek starts a new segment. They are small and shared by many fragments,
+// so the ones we loaded are kept until the element gets reset.
+// Only called from the fetch.
+static SkippyUriDownloaderFetchReturn
+skippy_hls_demux_push_init_section (SkippyHLSDemux * demux, SkippyFragment * fragment, const gchar* referrer_uri, GError ** err)
+{
+  SkippyFragment *map_download;
+  SkippyUriDownloaderFetchReturn fetch_ret = SKIPPY_URI_DOWNLOADER_COMPLETED;
+  GstBuffer *buf;
+  GstCaps *caps;
+  gchar *key;
+  gboolean need_push, have_caps;
+
+  if (!fragment->map_uri) {
+    return SKIPPY_URI_DOWNLOADER_COMPLETED;
+  }
+
+  key = g_strdup_printf ("%s@%" G_GINT64_FORMAT "-%" G_GINT64_FORMAT, fragment->map_uri,
+    fragment->map_range_start, fragment->map_range_end);
+  GST_OBJECT_LOCK (demux);
+  need_push = g_strcmp0 (key, demux->init_section_key) || (demux->need_segment && !demux->need_stream_start);
+  GST_OBJECT_UNLOCK (demux);
+  if (!need_push) {
+    g_free (key);
+    return SKIPPY_URI_DOWNLOADER_COMPLETED;
+  }
+
+  buf = g_hash_table_lookup (demux->init_sections, key);
+  if (buf) {
+    gst_buffer_ref (buf);
+  } else {
+    GST_DEBUG_OBJECT (demux, "Fetching init section: %s (Byte-Range=%" G_GINT64_FORMAT " - %" G_GINT64_FORMAT ")",
+      fragment->map_uri, fragment->map_range_start, fragment->map_range_end);
+    map_download = skippy_fragment_new (fragment->map_uri);
+    map_download->range_start = fragment->map_range_start;
+    map_download->range_end = fragment->map_range_end;
+    fetch_ret = skippy_uri_downloader_fetch_fragment (demux->playlist_downloader,
+      map_download, // Init section to load
+      referrer_uri, // Referrer
+      FALSE, // Compress
+      FALSE, // Refresh
+      skippy_hls_demux_is_caching_allowed (demux), // Allow caching directive
+      err
+    );
+    g_object_unref (map_download);
+    if (fetch_ret == SKIPPY_URI_DOWNLOADER_COMPLETED) {
+      buf = skippy_uri_downloader_get_buffer (demux->playlist_downloader);
+      if (buf && gst_buffer_get_size (buf)) {
+        g_hash_table_insert (demux->init_sections, g_strdup (key), gst_buffer_ref (buf));
+      } else {
+        GST_WARNING_OBJECT (demux, "Empty init section from %s", fragment->map_uri);
+        g_set_error (err, GST_STREAM_ERROR, GST_STREAM_ERROR_DEMUX, "Empty initialization section");
+        fetch_ret = SKIPPY_URI_DOWNLOADER_FAILED;
+        if (buf) {
+          gst_buffer_unref (buf);
+          buf = NULL;
         }
       }
-      ret = FALSE;
-      break;
-      
-  case SKIPPY_URI_DOWNLOADER_CANCELLED:
-  case SKIPPY_URI_DOWNLOADER_VOID:
-    if (err) {
-      GST_ERROR ("Error updating playlist: %s", err->message);
     }
-    ret = FALSE;
-    break;
   }
 
   if (buf) {
-    gst_buffer_unref (buf);
+    GST_OBJECT_LOCK (demux);
+    have_caps = demux->caps != NULL;
+    GST_OBJECT_UNLOCK (demux);
+    // Media fragments alone don't tell much about what is in them, the init section does
+    if (!have_caps && (caps = gst_type_find_helper_for_buffer (GST_OBJECT (demux), buf, NULL))) {
+      skippy_hls_demux_set_input_caps (demux, caps);
+      gst_caps_unref (caps);
+      have_caps = TRUE;
+    }
+    if (have_caps) {
+      skippy_hls_demux_proxy_pad_chain (demux->queue_proxy_pad, GST_OBJECT (demux), buf);
+    } else {
+      GST_WARNING_OBJECT (demux, "Unknown type of init section %s", fragment->map_uri);
+      gst_buffer_unref (buf);
+    }
+    g_free (demux->init_section_key);
+    demux->init_section_key = key;
+    key = NULL;
   }
 
-  g_clear_error (&err);
-  g_free (current_playlist);
-  return ret;
+  g_free (key);
+  return fetch_ret;
+}
+
+// Loads a few bytes of an Opus fragment at the offset and looks for the first page starting there
+// that has a granule. Sets page_offset to -1 if there is none (i.e we are past the end).
+// Only called from the fetch.
+static SkippyUriDownloaderFetchReturn
+skippy_hls_demux_opus_probe_page (SkippyHLSDemux * demux, SkippyFragment * fragment, const gchar* referrer_uri,
+  gint64 offset, gint64 *page_offset, GstClockTime *page_time)
+{
+  SkippyFragment *probe;
+  SkippyUriDownloaderFetchReturn fetch_ret;
+  GstBuffer *buf;
+  GstMapInfo map;
+  GError *err = NULL;
+  gsize i, header_size, page_size;
+  guint j;
+  gint64 granule;
+
+  *page_offset = -1;
+
+  probe = skippy_fragment_new (fragment->uri);
+  probe->start_time = fragment->start_time;
+  probe->stop_time = fragment->stop_time;
+  probe->range_start = offset;
+  probe->range_end = offset + OPUS_SEEK_PROBE_SIZE;
+  fetch_ret = skippy_uri_downloader_fetch_fragment (demux->playlist_downloader,
+    probe, // Byte range to look at
+    referrer_uri, // Referrer
+    FALSE, // Compress
+    FALSE, // Refresh
+    skippy_hls_demux_is_caching_allowed (demux), // Allow caching directive
+    &err
+  );
+  g_object_unref (probe);
+  if (fetch_ret != SKIPPY_URI_DOWNLOADER_COMPLETED) {
+    GST_DEBUG_OBJECT (demux, "Probing at byte %" G_GINT64_FORMAT " failed: %s", offset, err ? err->message : "cancelled");
+    g_clear_error (&err);
+    return fetch_ret;
+  }
+
+  buf = skippy_uri_downloader_get_buffer (demux->playlist_downloader);
+  if (!buf) {
+    return fetch_ret;
+  }
+  gst_buffer_map (buf, &map, GST_MAP_READ);
+  // Page header: capture pattern, version 0, flags, granule, serial, sequence, CRC, lacing values
+  for (i = 0; i + 27 <= map.size; i++) {
+    if (memcmp (map.data + i, "OggS", 4) || map.data[i + 4] != 0 || map.data[i + 5] > 0x7) {
+      continue;
+    }
+    granule = GST_READ_UINT64_LE (map.data + i + 6);
+    if (granule >= 0) {
+      *page_offset = offset + i;
+      *page_time = skippy_hls_demux_opus_granule_to_time (demux, granule);
+      break;
+    }
+    // No packet ends on that page, go on with the next one
+    header_size = 27 + map.data[i + 26];
+    if (i + header_size > map.size) {
+      break;
+    }
+    for (j = 0, page_size = header_size; j < map.data[i + 26]; j++) {
+      page_size += map.data[i + 27 + j];
+    }
+    i += page_size - 1;
+  }
+  gst_buffer_unmap (buf, &map);
+  gst_buffer_unref (buf);
+  return fetch_ret;
 }
 
-static GstClockTime
-skippy_hls_demux_get_time_until_retry_locked (SkippyHLSDemux * demux)
+// Finds where to start loading an Opus fragment to get to the seek target, instead of loading and dropping all
+// pages before it. Bisects over byte ranges, guessing with the byte rate until we found a page past the target.
+// Returns the offset of a page ending before the target and the time it ends at. Only called from the fetch.
+static gint64
+skippy_hls_demux_opus_bisect_seek (SkippyHLSDemux * demux, SkippyFragment * fragment, const gchar* referrer_uri,
+  GstClockTime target, GstClockTime *start_time)
 {
-  double retry_timer = RETRY_TIME_BASE + RETRY_MAX_TIME_UNTIL / (1 + pow(M_E, -0.8 * (demux->download_failed_count - 8)));
-  retry_timer = g_rand_double_range (demux->rand_gen, 0, retry_timer);
-  return (GstClockTime) retry_timer;
-}
+  gint64 lo_offset = 0, hi_offset = -1, offset, page_offset;
+  GstClockTime lo_time = fragment->start_time, hi_time = GST_CLOCK_TIME_NONE, page_time;
+  guint64 byte_rate = demux->media_byte_rate ? demux->media_byte_rate : OPUS_DEFAULT_BYTE_RATE;
+  guint probes;
+
+  for (probes = 0; probes < OPUS_SEEK_MAX_PROBES; probes++) {
+    if (hi_offset < 0) {
+      offset = lo_offset + gst_util_uint64_scale (target - lo_time, byte_rate, GST_SECOND);
+    } else if (hi_time != GST_CLOCK_TIME_NONE && hi_time > lo_time) {
+      offset = lo_offset + gst_util_uint64_scale (hi_offset - lo_offset, target - lo_time, hi_time - lo_time);
+    } else {
+      offset = lo_offset + (hi_offset - lo_offset) / 2;
+    }
+    // Aim a little early, the page we find is after the offset and it ends after the audio it holds
+    offset = MAX (offset - OPUS_SEEK_PROBE_SIZE / 2, lo_offset);
+    if (offset <= lo_offset || (hi_offset >= 0 && offset >= hi_offset)) {
+      break;
+    }
 
-// Waits for task condition with timeout - Unlocks the GST object mutex, expects it to be locked
-// @param max_wait Max time this should wait in Gstreamer clock time units
-static void
-skippy_hls_stream_loop_wait_locked (SkippyHLSDemux * demux, GstClockTime max_wait)
-{
-  // Monotonic time in GLib is in useconds
-  gint64 max_wait_us = ( ( (gint64) max_wait) / GST_USECOND );
-  while (!demux->continuing) {
-    GST_DEBUG ("Will wait for a max time of %" GST_TIME_FORMAT, GST_TIME_ARGS (max_wait));
-    if (!g_cond_wait_until(&demux->wait_cond, GST_OBJECT_GET_LOCK (demux),
-      g_get_monotonic_time () + max_wait_us)) {
-      GST_TRACE ("Waiting timed out now");
+    if (skippy_hls_demux_opus_probe_page (demux, fragment, referrer_uri, offset, &page_offset, &page_time)
+      != SKIPPY_URI_DOWNLOADER_COMPLETED) {
       break;
+    }
+    GST_DEBUG_OBJECT (demux, "Probed byte %" G_GINT64_FORMAT ": page at %" G_GINT64_FORMAT " ends at %" GST_TIME_FORMAT,
+      offset, page_offset, GST_TIME_ARGS (page_offset < 0 ? GST_CLOCK_TIME_NONE : page_time));
+    if (page_offset < 0) {
+      hi_offset = offset;
+      hi_time = GST_CLOCK_TIME_NONE;
+    } else if (page_time <= target) {
+      lo_offset = page_offset;
+      lo_time = page_time;
+      if (target - page_time <= OPUS_SEEK_TOLERANCE) {
+        break;
+      }
     } else {
-      GST_TRACE ("Wait got interrupted");
+      hi_offset = page_offset;
+      hi_time = page_time;
     }
   }
-  GST_TRACE ("Continuing stream task now");
+
+  GST_DEBUG_OBJECT (demux, "Seek to %" GST_TIME_FORMAT " starts loading at byte %" G_GINT64_FORMAT " (%" GST_TIME_FORMAT ") after %u probes",
+    GST_TIME_ARGS (target), lo_offset, GST_TIME_ARGS (lo_time), probes);
+  *start_time = lo_time;
+  return lo_offset;
 }
 
-// Checks wether we should download another segment with respect to buffer size.
-// Only runs in the streaming thread.
-//
-// MT-safe
-static gboolean
-skippy_hls_check_buffer_ahead (SkippyHLSDemux * demux)
+// Decides wether the fragment we are about to download goes to the spill file
+// Runs in the fetch pool thread, handle_schedule doesn't start another fetch before this one is joined.
+static void
+skippy_hls_demux_prepare_spill (SkippyHLSDemux * demux, SkippyFragment * fragment)
 {
-  GstClockTime pos, max_buffer_duration, max_wait = 0;
-
-  // Check if we are linked yet (did we receive a proper playlist?)
-  GST_OBJECT_LOCK (demux);
-  if (!demux->srcpad) {
-    g_warning ("No src pad (didn't get any M3U8 data yet probably), will wait for it.");
-    skippy_hls_stream_loop_wait_locked (demux, (GstClockTime) G_MAXINT64);
-    demux->continuing = FALSE;
-    GST_OBJECT_UNLOCK (demux);
-    return FALSE;
-  }
+  gchar *spill_directory;
+  GstClockTime pos;
 
+  demux->spill_fragment = FALSE;
 
-  // Check if wait condition is enabled - if not we can just continue
-  if (demux->continuing) {
-    GST_OBJECT_UNLOCK (demux);
-    // Continue downloading
-    return TRUE;
-  }
+  GST_OBJECT_LOCK (demux);
+  spill_directory = g_strdup (demux->spill_directory);
+  pos = demux->playback_position;
   GST_OBJECT_UNLOCK (demux);
 
-  // Check upfront position relative to stream position
-  // If we branch here this means we might want to wait
-  pos = skippy_hls_demux_query_position (demux);
-  max_buffer_duration = demux->download_ahead;
-  
-
-  guint current_level_bytes = 0;
-  g_object_get (demux->download_queue, "current-level-bytes", &current_level_bytes, NULL);
-  GST_DEBUG ("Playback position is %" GST_TIME_FORMAT " , Max buffer duration is %" GST_TIME_FORMAT ", Queued position is %" GST_TIME_FORMAT
-    ", Download queue level (bytes) is %u", GST_TIME_ARGS (pos), GST_TIME_ARGS(max_buffer_duration), GST_TIME_ARGS (demux->position_downloaded),
-             current_level_bytes);
-
-  // Check for wether we should limit downloading
-  if (pos != GST_CLOCK_TIME_NONE && max_buffer_duration != GST_CLOCK_TIME_NONE
-    && demux->position_downloaded > pos + max_buffer_duration) {
-    // Diff' between current playhead and buffer-head in microseconds
-    max_wait = demux->position_downloaded - pos - max_buffer_duration;
-    GST_TRACE ("Waiting in task as we have preloaded enough (until %" GST_TIME_FORMAT " of media position)",
-      GST_TIME_ARGS (demux->position_downloaded));
-    // Timed-cond wait here
-    GST_OBJECT_LOCK (demux);
-    skippy_hls_stream_loop_wait_locked (demux, max_wait);
-    GST_OBJECT_UNLOCK (demux);
-    return FALSE;
+  if (!spill_directory || pos == GST_CLOCK_TIME_NONE || fragment->start_time <= pos + SPILL_AHEAD_THRESHOLD) {
+    g_free (spill_directory);
+    return;
   }
 
-  // No waiting needed
-  return TRUE;
-}
-
-static gboolean
-skippy_hlsdemux_proxy_pad_remove_sticky_eos (GstPad * pad, GstEvent ** event, gpointer udata)
-{
-  if (GST_EVENT_TYPE (*event) == GST_EVENT_EOS) {
-    gst_event_replace (event, NULL);
-    return FALSE;
+  if (!demux->spill_file) {
+    demux->spill_file = skippy_spill_file_new (spill_directory, SPILL_FILE_MAX_BYTES);
   }
-  return TRUE;
-}
-
-static void
-skippy_hlsdemux_proxy_pad_reset (SkippyHLSDemux *demux)
-{
-  //flush the proxy pad to reset EOS state.
-  gst_pad_push_event (demux->queue_proxy_pad, gst_event_new_flush_start ());
-  gst_pad_push_event (demux->queue_proxy_pad, gst_event_new_flush_stop (TRUE));
-  //remove sticky EOS events
-  gst_pad_sticky_events_foreach (demux->queue_proxy_pad, skippy_hlsdemux_proxy_pad_remove_sticky_eos, NULL);
-  GST_OBJECT_FLAG_UNSET (demux->queue_proxy_pad, GST_PAD_FLAG_EOS);
+  g_free (spill_directory);
+  demux->spill_fragment = demux->spill_file != NULL;
 }
 
-
-static void
-skippy_hlsdemux_opus_push_0_segment (SkippyHLSDemux *demux, gboolean is_discont) {
-  GstMapInfo info_map;
-  GstBuffer* opus_head_buffer = gst_buffer_new_and_alloc (129);
-  gst_buffer_map (opus_head_buffer, &info_map, GST_MAP_READWRITE);
-  memcpy (info_map.data, demux->opus_init_data, 129);
-  info_map.size = 129;
-  gst_buffer_unmap (opus_head_buffer, &info_map);
-  GST_BUFFER_FLAG_SET (opus_head_buffer, GST_BUFFER_FLAG_DISCONT);
-  GST_BUFFER_PTS (opus_head_buffer) = demux->position;
-  skippy_hls_demux_proxy_pad_chain(demux->queue_proxy_pad, NULL, opus_head_buffer);
-}
-
-// Streaming task function - implements all the HLS logic.
-// When this runs the streaming task mutex is/must be locked.
-//
-// MT-safe
-static void
-skippy_hls_demux_stream_loop (SkippyHLSDemux * demux)
+// Fetch function - implements all the HLS logic.
+// Loads the next fragment and handles the result. Runs in a pool thread, the stream task loop doesn't touch
+// any of the state involved until we're done.
+static SkippyHLSDemuxFetchOutcome
+skippy_hls_demux_fetch_next (SkippyHLSDemux * demux)
 {
   SkippyFragment *fragment = NULL, *current_opus_fragment = NULL;
   SkippyUriDownloaderFetchReturn fetch_ret = SKIPPY_URI_DOWNLOADER_VOID;
+  SkippyHLSDemuxFetchOutcome outcome = FETCH_NEXT;
   GError *err = NULL;
   gchar* referrer_uri = NULL;
   gboolean playlist_outdated = FALSE;
   gboolean media_segment_fatal_error = FALSE;
   gboolean opus_need_head  = FALSE;
-  GstClockTime time_until_retry;
-
-  GST_TRACE_OBJECT (demux, "Entering stream task");
+  gboolean from_cache = FALSE;
 
-  // Check current playback position against buffer levels
-  // Blocks and schedules timed-cond until next download
-  // Might be interrupted by a seek event and continue
-  if (!skippy_hls_check_buffer_ahead (demux)) {
-    return;
-  }
   GST_TRACE ("Will try to fetch next fragment ...");
 
   //g_usleep (1000*1000);
@@ -1355,30 +3179,23 @@ skippy_hls_demux_stream_loop (SkippyHLSDemux * demux)
   
   fragment = skippy_m3u8_client_get_current_fragment (demux->client);
   
-  if (fragment && demux->dataCodec == OPUS) {
-    current_opus_fragment = skippy_m3u8_client_get_current_fragment (demux->client);
-    // when we seek we first want to make sure that 0 segment is pushed
-    if (demux->need_segment && !demux->need_stream_start) {
-      if (demux->opus_0_fragment_cached) {
-        // if 0 segment is already buffered push it directly
-        demux->position = current_opus_fragment->start_time;
-        // skippy_hlsdemux_opus_push_0_segment(demux, TRUE);
-      } else {
-        // we are seeking but 0 segment is not buffered, so stream loop should
-        // fetch it
-        demux->opus_init_data_written = 0;
-        opus_need_head = TRUE;
-        fragment = skippy_m3u8_client_get_fragment (demux->client, 0);
-      }
-    } else {
-      // not seeking but we did not cache the whole 0 segment
-      // this may happen if download was canceled etc..
-      if (demux->opus_init_data_written != 129) {
-        // in this case stream loop should fetch 0 segment
-        demux->opus_init_data_written = 0;
-        opus_need_head = TRUE;
-        fragment = skippy_m3u8_client_get_fragment (demux->client, 0);
-      }
+  // The Opus header pages have to go through before anything else of the stream (i.e we seeked
+  // right away or the download got cancelled), unless the fragment we're up to carries them anyway
+  if (fragment && demux->dataCodec == OPUS && !demux->opus_header_complete && fragment->sequence_number != 0) {
+    current_opus_fragment = fragment;
+    opus_need_head = TRUE;
+    fragment = skippy_hls_demux_get_opus_header_fragment (demux);
+  }
+
+  // Load from whichever mirror does best right now
+  if (fragment) {
+    gchar *routed_uri = skippy_host_selector_route (demux->host_selector, fragment->uri);
+    g_free (fragment->uri);
+    fragment->uri = routed_uri;
+    if (demux->hedge_to_mirror) {
+      gchar *alternative = skippy_host_selector_get_alternative (demux->host_selector, fragment->uri);
+      skippy_uri_downloader_set_hedge_host (demux->downloader, alternative);
+      g_free (alternative);
     }
   }
   
@@ -1390,19 +3207,100 @@ skippy_hls_demux_stream_loop (SkippyHLSDemux * demux)
       demux->position = fragment->start_time;
     }
     GST_OBJECT_UNLOCK (demux);
+    skippy_hls_demux_mark_fragment (demux, demux->position,
+      opus_need_head ? current_opus_fragment->stop_time : fragment->stop_time);
     
-    GST_INFO_OBJECT (demux, "Pushing data for next fragment: %s (Byte-Range=%" G_GINT64_FORMAT " - %" G_GINT64_FORMAT ")",
-      fragment->uri, fragment->range_start, fragment->range_end);
-    // Tell downloader to push data
-    fetch_ret = skippy_uri_downloader_fetch_fragment (demux->downloader,
-      fragment, // Media fragment to load
-      referrer_uri, // Referrer
-      FALSE, // Compress (useless with coded media data)
-      FALSE, // Refresh disabled (don't wipe out cache)
-      skippy_hls_demux_is_caching_allowed (demux), // Allow caching directive
-      &err
-    );
-    skippy_hlsdemux_proxy_pad_reset (demux);
+    // Fragmented MP4 needs its init section in front
+    if (!opus_need_head) {
+      fetch_ret = skippy_hls_demux_push_init_section (demux, fragment, referrer_uri, &err);
+    }
+    if (fetch_ret != SKIPPY_URI_DOWNLOADER_COMPLETED && !opus_need_head) {
+      // Handled below like a failed fragment
+    } else if (!opus_need_head && skippy_hls_demux_replay_cached_fragment (demux, fragment)) {
+      // Seeking back into data we pushed before does not need the network
+      fetch_ret = SKIPPY_URI_DOWNLOADER_COMPLETED;
+      from_cache = TRUE;
+    } else {
+      GST_INFO_OBJECT (demux, "Pushing data for next fragment: %s (Byte-Range=%" G_GINT64_FORMAT " - %" G_GINT64_FORMAT ")",
+        fragment->uri, fragment->range_start, fragment->range_end);
+      // Encrypted media needs its key first
+      fetch_ret = skippy_hls_demux_load_fragment_key (demux, fragment, referrer_uri, &err);
+      if (fetch_ret == SKIPPY_URI_DOWNLOADER_COMPLETED) {
+        // Start an Opus fragment we seeked into from near the target
+        if (!opus_need_head && demux->dataCodec == OPUS && !fragment->key_uri
+          && demux->opus_seek_processing_pending && fragment->range_start == 0
+          && demux->last_seeking_position != GST_CLOCK_TIME_NONE
+          && demux->last_seeking_position >= fragment->start_time + OPUS_SEEK_MIN_SKIP
+          && demux->last_seeking_position < fragment->stop_time) {
+          GstClockTime range_start_time;
+          fragment->range_start = skippy_hls_demux_opus_bisect_seek (demux, fragment, referrer_uri,
+            demux->last_seeking_position, &range_start_time);
+          if (fragment->range_start) {
+            // What we push now starts later than we marked it
+            skippy_hls_demux_mark_fragment (demux, range_start_time, fragment->stop_time);
+          }
+        }
+        // Same for MP3, as long as bytes map to time linearly
+        if (demux->dataCodec == MP3 && !fragment->key_uri && !demux->mp3_vbr
+          && demux->need_segment && !demux->need_stream_start && fragment->range_start == 0
+          && demux->last_seeking_position != GST_CLOCK_TIME_NONE
+          && demux->last_seeking_position >= fragment->start_time + MP3_SEEK_MIN_SKIP
+          && demux->last_seeking_position < fragment->stop_time) {
+          guint64 byte_rate = demux->mp3_header_known ? demux->mp3_header.bitrate / 8 : MP3_DEFAULT_BYTE_RATE;
+          fragment->range_start = gst_util_uint64_scale (demux->last_seeking_position - fragment->start_time, byte_rate, GST_SECOND);
+          demux->mp3_resync_offset = fragment->range_start;
+          demux->mp3_resync_start = fragment->start_time;
+          GST_DEBUG_OBJECT (demux, "Seek to %" GST_TIME_FORMAT " starts loading at byte %" G_GINT64_FORMAT,
+            GST_TIME_ARGS (demux->last_seeking_position), fragment->range_start);
+          skippy_hls_demux_mark_fragment (demux, demux->last_seeking_position, fragment->stop_time);
+        }
+        // Retain what we push unless it's only a part of the fragment: the Opus head fetch,
+        // a range we seeked to or the fragment an Opus seek landed in (pages before the target are dropped)
+        if (!opus_need_head && !fragment->range_start && (demux->dataCodec != OPUS
+          || demux->last_seeking_position == GST_CLOCK_TIME_NONE
+          || demux->last_seeking_position < fragment->start_time)) {
+          skippy_fragment_cache_begin (demux->fragment_cache, fragment->sequence_number,
+            fragment->start_time, fragment->stop_time);
+        }
+        skippy_hls_demux_prepare_spill (demux, fragment);
+        demux->opus_header_fetch = opus_need_head;
+        // Tell downloader to push data
+        fetch_ret = skippy_uri_downloader_fetch_fragment (demux->downloader,
+          fragment, // Media fragment to load
+          referrer_uri, // Referrer
+          FALSE, // Compress (useless with coded media data)
+          FALSE, // Refresh disabled (don't wipe out cache)
+          skippy_hls_demux_is_caching_allowed (demux), // Allow caching directive
+          &err
+        );
+        // Whatever Opus packets are still batched belong to this fragment
+        skippy_hls_demux_flush_opus_batch (demux);
+        demux->mp3_resync_offset = -1;
+        if (opus_need_head) {
+          demux->opus_header_fetch = FALSE;
+          // Don't carry what followed the header in the range over into the next fragment
+          skippy_ogg_framer_flush (demux->ogg_framer);
+          if (fetch_ret == SKIPPY_URI_DOWNLOADER_COMPLETED && !demux->opus_header_complete) {
+            if (demux->opus_header_probe_failed || fragment->range_end < 0) {
+              // Nothing more to look at, go on with what the decoder makes of the stream
+              GST_WARNING_OBJECT (demux, "No Opus header in first fragment");
+              demux->opus_header_complete = TRUE;
+            } else {
+              GST_WARNING_OBJECT (demux, "Opus header not found in first %d bytes, loading whole fragment next", OPUS_HEADER_PROBE_SIZE);
+              demux->opus_header_probe_failed = TRUE;
+            }
+          }
+        }
+        // A resumed download only pushed the tail of the fragment, the downloader moved the range start for it
+        if (fetch_ret == SKIPPY_URI_DOWNLOADER_COMPLETED && !fragment->range_start) {
+          skippy_fragment_cache_commit (demux->fragment_cache);
+        } else {
+          skippy_fragment_cache_abort (demux->fragment_cache);
+        }
+        demux->spill_fragment = FALSE;
+        skippy_hlsdemux_proxy_pad_reset (demux);
+      }
+    }
   } else {
     GST_INFO_OBJECT (demux, "This playlist doesn't contain more fragments");
   }
@@ -1415,10 +3313,19 @@ skippy_hls_demux_stream_loop (SkippyHLSDemux * demux)
   case SKIPPY_URI_DOWNLOADER_VOID:
     // Error & fragment should be NULL
     skippy_hls_handle_end_of_playlist (demux);
+    outcome = FETCH_IDLE;
     break;
   case SKIPPY_URI_DOWNLOADER_CANCELLED:
     GST_DEBUG ("Fragment fetch got cancelled on purpose");
     break;
+  case SKIPPY_URI_DOWNLOADER_STALLED:
+    // Not a failure: no backoff, the next attempt resumes the same fragment where it stalled (on another mirror if any)
+    GST_INFO_OBJECT (demux, "Fragment fetch stalled, resuming right away: %s", err ? err->message : "");
+    skippy_host_selector_report_failure (demux->host_selector, fragment->uri);
+    GST_OBJECT_LOCK (demux);
+    demux->continuing = TRUE;
+    GST_OBJECT_UNLOCK (demux);
+    break;
   case SKIPPY_URI_DOWNLOADER_FAILED:
     // When failed
     //TODO: remove this check once we make sure Error instance is initialized in all cases when download fails
@@ -1428,7 +3335,7 @@ skippy_hls_demux_stream_loop (SkippyHLSDemux * demux)
         g_object_unref (fragment);
       }
       g_free (referrer_uri);
-      return;
+      return FETCH_NEXT;
     }
     GST_INFO ("Fragment fetch error: %s", err->message);
     // Actual download failure
@@ -1438,24 +3345,37 @@ skippy_hls_demux_stream_loop (SkippyHLSDemux * demux)
     GST_OBJECT_UNLOCK (demux);
     if (g_error_matches (err, GST_STREAM_ERROR, GST_STREAM_ERROR_WRONG_TYPE)) {
       REPORT_FATAL_ERROR (demux, STREAM, WRONG_TYPE, ("%s", err->message), (NULL));
-      gst_task_pause (demux->stream_task);
+      skippy_hls_demux_pause_loop (demux);
+      outcome = FETCH_IDLE;
       goto end_stream_loop;
     }
+    // Another mirror is likely to have it (403 and 404 included), try that one right away and resume
+    // where we stopped before waiting for a retry or a playlist update
+    skippy_host_selector_report_failure (demux->host_selector, fragment->uri);
+    if (skippy_host_selector_has_alternative (demux->host_selector, fragment->uri)) {
+      GST_INFO_OBJECT (demux, "Switching to another host after: %s", err->message);
+      GST_OBJECT_LOCK (demux);
+      demux->continuing = TRUE;
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    }
     // Handle 404 by reporting warning - do not signal error, use warning instead to be able to use the pipeline
     if (err && err->message &&
         g_error_matches (err, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_NOT_FOUND) &&
         g_str_has_prefix(err->message, "Not Found"))
     {
       GST_ELEMENT_WARNING (demux, RESOURCE, NOT_FOUND, ("Not Found"), ("Not Found"));
-      gst_task_pause (demux->stream_task);
+      skippy_hls_demux_pause_loop (demux);
+      outcome = FETCH_IDLE;
       goto end_stream_loop;
     }
-    guint buffered_bytes = 0;
-    g_object_get (demux->download_queue, "current-level-bytes", &buffered_bytes, NULL);
+    guint64 buffered_bytes = 0;
+    skippy_hls_demux_get_playhead (demux, &buffered_bytes);
       
     if (demux->download_failed_count > MAX_FAILED_COUNT && buffered_bytes == 0) {
       GST_ELEMENT_ERROR (demux, SKIPPY_HLS, MEDIA_LOADING_FAILED, ("Can not load media segments, possible connectivity problem."), (NULL));
-      gst_task_pause (demux->stream_task);
+      skippy_hls_demux_pause_loop (demux);
+      outcome = FETCH_IDLE;
       goto end_stream_loop;
     }
     
@@ -1482,8 +3402,25 @@ skippy_hls_demux_stream_loop (SkippyHLSDemux * demux)
   case SKIPPY_URI_DOWNLOADER_COMPLETED:
     GST_DEBUG ("Fragment download completed successfully");
     // Post stats message
-    skippy_hls_demux_post_stat_msg (demux, STAT_TIME_TO_DOWNLOAD_FRAGMENT,
-      fragment->download_stop_time - fragment->download_start_time, fragment->size);
+    if (!from_cache) {
+      skippy_hls_demux_post_stat_msg (demux, STAT_TIME_TO_DOWNLOAD_FRAGMENT,
+        fragment->download_stop_time - fragment->download_start_time, fragment->size);
+      skippy_host_selector_report_success (demux->host_selector, fragment->uri, fragment->time_to_first_byte,
+        fragment->size, fragment->download_stop_time - fragment->download_start_time);
+      demux->burst_bytes += fragment->size;
+      if (!opus_need_head && !fragment->range_start && fragment->size && fragment->stop_time > fragment->start_time) {
+        demux->media_byte_rate = gst_util_uint64_scale (fragment->size, GST_SECOND,
+          fragment->stop_time - fragment->start_time);
+        skippy_hls_demux_update_buffer_target (demux);
+      }
+    }
+    guint64 queue_level_bytes = 0;
+    GstClockTime playhead = skippy_hls_demux_get_playhead (demux, &queue_level_bytes);
+    skippy_hls_demux_post_stat_msg (demux, STAT_MEMORY_USAGE, 0,
+      skippy_hls_demux_get_memory_usage (demux, queue_level_bytes, playhead));
+    if (!from_cache && demux->hedging) {
+      skippy_hls_demux_post_stat_msg (demux, STAT_HEDGED_REQUESTS, 0, 0);
+    }
     // Reset failure counter, position and scheduling condition
     GST_OBJECT_LOCK (demux);
     if (!opus_need_head) {
@@ -1498,19 +3435,11 @@ skippy_hls_demux_stream_loop (SkippyHLSDemux * demux)
     break;
   }
 
-  GST_TRACE_OBJECT (demux, "Exiting task now ...");
+  GST_TRACE_OBJECT (demux, "Done with fragment");
 
   // Handle error
   if (playlist_outdated || media_segment_fatal_error) {
-    GST_OBJECT_LOCK (demux);
-    time_until_retry = skippy_hls_demux_get_time_until_retry_locked (demux);
-    GST_DEBUG ("Next retry scheduled in: %" GST_TIME_FORMAT, GST_TIME_ARGS (time_until_retry));
-    // Waits before retrying - might be interrupted by a PAUSED -> PLAYING transition or by a seek event
-    demux->continuing = FALSE;
-    skippy_hls_stream_loop_wait_locked (demux, time_until_retry);
-    // If there was an error we should not schedule but retry right away
-    demux->continuing = TRUE;
-    GST_OBJECT_UNLOCK (demux);
+    outcome = FETCH_RETRY;
   }
 
 end_stream_loop:
@@ -1523,6 +3452,213 @@ end_stream_loop:
   }
   g_free (referrer_uri);
   g_clear_error (&err);
+  return outcome;
+}
+
+// Runs in one of the shared pool threads
+static void
+skippy_hls_demux_fetch_job (gpointer data, gpointer user_data)
+{
+  SkippyHLSDemuxEvent *done = data;
+  SkippyHLSDemux *demux = gst_object_ref (done->demux);
+
+  done->outcome = skippy_hls_demux_fetch_next (demux);
+  skippy_hls_demux_post_event (demux, done);
+
+  GST_OBJECT_LOCK (demux);
+  demux->fetching = FALSE;
+  g_cond_broadcast (&demux->fetch_cond);
+  GST_OBJECT_UNLOCK (demux);
+  gst_object_unref (demux);
+}
+
+// New event, bound to what the loop does now. Keeps us alive until it's handled or dropped.
+// Expects the GST object mutex to be locked.
+static SkippyHLSDemuxEvent *
+skippy_hls_demux_event_new_locked (SkippyHLSDemux * demux, SkippyHLSDemuxEventType type)
+{
+  SkippyHLSDemuxEvent *event = g_slice_new0 (SkippyHLSDemuxEvent);
+
+  event->demux = gst_object_ref (demux);
+  event->type = type;
+  event->epoch = type == EVENT_SEEK ? demux->pause_epoch : demux->loop_epoch;
+  event->outcome = FETCH_NEXT;
+  return event;
+}
+
+static void
+skippy_hls_demux_event_free (gpointer data)
+{
+  SkippyHLSDemuxEvent *event = data;
+
+  if (event->seek) {
+    gst_event_unref (event->seek);
+  }
+  gst_object_unref (event->demux);
+  g_slice_free (SkippyHLSDemuxEvent, event);
+}
+
+// Schedules the next fragment unless we are busy with one or about to seek. Runs in the stream task loop.
+// The loop and the fetch share the download bookkeeping (bursts, buffer target, memory usage) without a lock:
+// the loop only touches it while no fetch is in flight and doesn't start the next one before the last one is joined.
+static void
+skippy_hls_demux_handle_schedule (SkippyHLSDemux * demux)
+{
+  SkippyHLSDemuxEvent *done;
+  gboolean busy;
+
+  GST_OBJECT_LOCK (demux);
+  busy = demux->fetching || demux->seeks_pending;
+  GST_OBJECT_UNLOCK (demux);
+  if (busy || !skippy_hls_check_buffer_ahead (demux)) {
+    return;
+  }
+
+  GST_OBJECT_LOCK (demux);
+  demux->wake_armed = FALSE;
+  done = skippy_hls_demux_event_new_locked (demux, EVENT_FETCH_DONE);
+  demux->fetching = TRUE;
+  GST_OBJECT_UNLOCK (demux);
+  skippy_task_pool_push (skippy_hls_demux_fetch_job, done);
+}
+
+// Goes on after a fetch as it asked us to. Runs in the stream task loop.
+static void
+skippy_hls_demux_handle_fetch_done (SkippyHLSDemux * demux, SkippyHLSDemuxFetchOutcome outcome)
+{
+  GstClockTime time_until_retry;
+
+  skippy_hls_demux_join_fetch (demux);
+
+  GST_OBJECT_LOCK (demux);
+  // The seek schedules us again
+  if (demux->seeks_pending) {
+    GST_OBJECT_UNLOCK (demux);
+    return;
+  }
+  switch (outcome) {
+  case FETCH_NEXT:
+    skippy_hls_demux_post_locked (demux, EVENT_SCHEDULE);
+    break;
+  case FETCH_RETRY:
+    time_until_retry = skippy_hls_demux_get_time_until_retry_locked (demux);
+    GST_DEBUG ("Next retry scheduled in: %" GST_TIME_FORMAT, GST_TIME_ARGS (time_until_retry));
+    demux->continuing = FALSE;
+    skippy_hls_demux_start_timer_locked (demux, &demux->retry_source, time_until_retry, EVENT_RETRY);
+    break;
+  case FETCH_IDLE:
+    break;
+  }
+  GST_OBJECT_UNLOCK (demux);
+}
+
+// Dispatches the events of the stream task loop, dropping the ones posted before we paused or seeked.
+// Runs in the shared loop thread we got, with the stream lock held so that pausing can wait for us.
+static gboolean
+skippy_hls_demux_handle_event (gpointer user_data)
+{
+  SkippyHLSDemuxEvent *event = user_data;
+  SkippyHLSDemux *demux = event->demux;
+  gboolean stale;
+
+  g_rec_mutex_lock (&demux->stream_lock);
+  GST_OBJECT_LOCK (demux);
+  stale = demux->loop_state != GST_TASK_STARTED
+    || event->epoch != (event->type == EVENT_SEEK ? demux->pause_epoch : demux->loop_epoch);
+  GST_OBJECT_UNLOCK (demux);
+  if (stale) {
+    GST_TRACE_OBJECT (demux, "Dropping stale event of type %d", event->type);
+    g_rec_mutex_unlock (&demux->stream_lock);
+    return G_SOURCE_REMOVE;
+  }
+
+  switch (event->type) {
+  case EVENT_SCHEDULE:
+    skippy_hls_demux_handle_schedule (demux);
+    break;
+  case EVENT_FETCH_DONE:
+    skippy_hls_demux_handle_fetch_done (demux, event->outcome);
+    break;
+  case EVENT_RETRY:
+    // After an error we should not wait for the buffer but retry right away
+    GST_OBJECT_LOCK (demux);
+    demux->continuing = TRUE;
+    GST_OBJECT_UNLOCK (demux);
+    skippy_hls_demux_handle_schedule (demux);
+    break;
+  case EVENT_SEEK:
+    skippy_hls_demux_apply_seek (demux, event->seek);
+    break;
+  }
+  g_rec_mutex_unlock (&demux->stream_lock);
+  return G_SOURCE_REMOVE;
+}
+
+// Posts an event for the stream task loop to handle as soon as it can. Takes ownership of the event.
+//
+// MT-safe
+static void
+skippy_hls_demux_post_event (SkippyHLSDemux * demux, SkippyHLSDemuxEvent * event)
+{
+  GSource *source = g_idle_source_new ();
+
+  g_source_set_callback (source, skippy_hls_demux_handle_event, event, skippy_hls_demux_event_free);
+  g_source_attach (source, demux->loop_context);
+  g_source_unref (source);
+}
+
+// Expects the GST object mutex to be locked
+static void
+skippy_hls_demux_post_locked (SkippyHLSDemux * demux, SkippyHLSDemuxEventType type)
+{
+  skippy_hls_demux_post_event (demux, skippy_hls_demux_event_new_locked (demux, type));
+}
+
+// (Re)starts one of our timers, posting an event of the given type when it fires.
+// Expects the GST object mutex to be locked.
+static void
+skippy_hls_demux_start_timer_locked (SkippyHLSDemux * demux, GSource ** timer, GstClockTime timeout,
+  SkippyHLSDemuxEventType type)
+{
+  if (*timer) {
+    g_source_destroy (*timer);
+    g_source_unref (*timer);
+  }
+  *timer = g_timeout_source_new ((guint) (timeout / GST_MSECOND));
+  g_source_set_callback (*timer, skippy_hls_demux_handle_event, skippy_hls_demux_event_new_locked (demux, type),
+    skippy_hls_demux_event_free);
+  g_source_attach (*timer, demux->loop_context);
+}
+
+// Drops all timers and the events posted so far. Expects the GST object mutex to be locked.
+static void
+skippy_hls_demux_reset_loop_locked (SkippyHLSDemux * demux)
+{
+  GSource **timers[] = { &demux->retry_source, &demux->idle_source };
+  guint i;
+
+  demux->loop_epoch++;
+  demux->wake_armed = FALSE;
+  for (i = 0; i < G_N_ELEMENTS (timers); i++) {
+    if (*timers[i]) {
+      g_source_destroy (*timers[i]);
+      g_source_unref (*timers[i]);
+      *timers[i] = NULL;
+    }
+  }
+}
+
+// Waits for the fetch to end, if there is one
+//
+// MT-safe
+static void
+skippy_hls_demux_join_fetch (SkippyHLSDemux * demux)
+{
+  GST_OBJECT_LOCK (demux);
+  while (demux->fetching) {
+    g_cond_wait (&demux->fetch_cond, GST_OBJECT_GET_LOCK (demux));
+  }
+  GST_OBJECT_UNLOCK (demux);
 }
 
 static
@@ -1581,14 +3717,67 @@ static void http_replace_query_parameter(gchar **url, const gchar* query_param_n
   g_free (new_param);
 }
 
+// Returns the number of 48kHz samples an Opus packet decodes to, from its TOC byte (RFC 6716, section 3.1)
+// Header packets have none, the pre-skip gets picked up from the identification header on the way.
+static guint
+skippy_hls_demux_opus_packet_samples (SkippyHLSDemux *demux, GstBuffer *packet)
+{
+  // Frame size per configuration (the upper 5 bits of the TOC byte)
+  static const guint16 frame_samples[32] = {
+    480, 960, 1920, 2880, 480, 960, 1920, 2880, 480, 960, 1920, 2880,   // SILK
+    480, 960, 480, 960,                                                 // Hybrid
+    120, 240, 480, 960, 120, 240, 480, 960, 120, 240, 480, 960, 120, 240, 480, 960 // CELT
+  };
+  guint8 data[12];
+  gsize size = gst_buffer_extract (packet, 0, data, sizeof (data));
+  guint frames;
+
+  if (size >= 8 && (!memcmp (data, "OpusHead", 8) || !memcmp (data, "OpusTags", 8))) {
+    if (size >= 12 && data[0] == 'O' && data[4] == 'H') {
+      demux->opus_pre_skip = GST_READ_UINT16_LE (data + 10);
+    }
+    return 0;
+  }
+  if (size < 1) {
+    return 0;
+  }
+
+  switch (data[0] & 0x3) {
+  case 0:
+    frames = 1;
+    break;
+  case 1:
+  case 2:
+    frames = 2;
+    break;
+  default:
+    frames = size >= 2 ? data[1] & 0x3f : 0;
+    break;
+  }
+  return frames * frame_samples[data[0] >> 3];
+}
+
+// Converts a granule position (48kHz samples including pre-skip) to our timeline
+static GstClockTime
+skippy_hls_demux_opus_granule_to_time (SkippyHLSDemux *demux, gint64 granule)
+{
+  if (granule <= demux->opus_pre_skip) {
+    return 0;
+  }
+  return gst_util_uint64_scale (granule - demux->opus_pre_skip, GST_SECOND, OPUS_SAMPLE_RATE);
+}
+
 static void
 skippy_hlsdemux_update_first_opus_buffer_after_seek (SkippyHLSDemux *demux, GstBuffer* opus_buffer)
 {
   GstClockTime opus_buffer_pts;
-  if (demux->last_page_pos_ms != 0) {
+  if (GST_BUFFER_PTS_IS_VALID (opus_buffer)) {
+    // exact time from the page granule
+    opus_buffer_pts = GST_BUFFER_PTS (opus_buffer);
+  } else if (demux->last_page_pos_ms != 0) {
     // if some ogg pages are skipped set the buffer pts to last page
     // granule position
-    opus_buffer_pts = (demux->last_page_pos_ms)*1000000;
+    opus_buffer_pts = demux->last_page_pos_ms * GST_MSECOND;
   } else {
     // if no pages are skipped use demux->position since it holds pts for
     // begging of the segment.
@@ -1612,38 +3801,76 @@ skippy_hlsdemux_update_first_opus_buffer_after_seek (SkippyHLSDemux *demux, GstB
 GstFlowReturn
 skippy_hls_demux_read_ogg_and_push_opus_packets(SkippyHLSDemux *demux, GstBuffer *buf)
 {
-  GstMapInfo in_map;
-  OpusPacket pkt, empty_pkt;
+  SkippyOggPage page;
+  GstBuffer *opus_buffer;
+  GstBuffer *packets[255];
+  guint packet_samples[255];
+  guint i, n_packets, page_samples;
+  gint64 sample, duration;
+  GstClockTime page_time;
   gboolean first_opus_buffer_processed = FALSE;
   GstFlowReturn ret_value = GST_FLOW_OK;
-  
-  gst_buffer_map(buf, &in_map, GST_MAP_READ);
 
-  onDataReceived(demux->oggDemux, in_map.data, in_map.size);
+  // Pages and packets keep referencing the memory of what we received, no copies
+  skippy_ogg_framer_push (demux->ogg_framer, gst_buffer_ref (buf));
   
   int page_cnt = 0;
-  while (readPage(demux->oggDemux)) {
+  while (skippy_ogg_framer_next_page (demux->ogg_framer, &page)) {
     GST_TRACE ("Reading ogg page %d.", ++page_cnt);
-    int64_t granCount = 0;
-    int cnt = 0;
-    double page_pos_ms = getCurrentPageGranule(demux->oggDemux) / 48.;
+    if (!demux->opus_header_complete) {
+      skippy_hls_demux_opus_track_header (demux, &page);
+    } else if (demux->opus_header_fetch && page.granulepos != 0) {
+      // Audio following the header in the range we loaded, it gets pushed with its own fragment
+      skippy_ogg_page_clear (&page);
+      continue;
+    }
+    // Same timeline as the packets, pre-skip excluded
+    page_time = page.granulepos >= 0 ? skippy_hls_demux_opus_granule_to_time (demux, page.granulepos) : GST_CLOCK_TIME_NONE;
     if (demux->last_seeking_position != GST_CLOCK_TIME_NONE &&
-        (page_pos_ms  <= demux->last_seeking_position/1000000.)) {
+        (page_time == GST_CLOCK_TIME_NONE || page_time <= demux->last_seeking_position)) {
       // After seeking discard all pages with granule pos less or equal
       // to seeking position. Discarding is done by reading packet from
-      // bitstream and doing nothing. TODO: maybe seek could be used
+      // bitstream and doing nothing. We usually start loading close to
+      // the target (see skippy_hls_demux_opus_bisect_seek).
       GST_TRACE ("Skipping page.");
-      while(readPacket(demux->oggDemux, &empty_pkt)){}
-      demux->last_page_pos_ms = page_pos_ms;
+      while ((opus_buffer = skippy_ogg_framer_next_packet (demux->ogg_framer, &page))) {
+        skippy_hls_demux_opus_packet_samples (demux, opus_buffer);
+        gst_buffer_unref (opus_buffer);
+      }
+      if (page.granulepos >= 0) {
+        demux->opus_granule = page.granulepos;
+        demux->last_page_pos_ms = page_time / GST_MSECOND;
+      }
+      skippy_ogg_page_clear (&page);
       continue;
     }
-    while(readPacket(demux->oggDemux, &pkt)) {
-      GstMapInfo info_map;
-      GstBuffer *opus_buffer = gst_buffer_new_and_alloc(pkt.len);
-      gst_buffer_map (opus_buffer, &info_map, GST_MAP_READWRITE);
-      memcpy (info_map.data, pkt.payload, pkt.len);
-      info_map.size = pkt.len;
-      gst_buffer_unmap(opus_buffer, &info_map);
+    n_packets = 0;
+    page_samples = 0;
+    while (n_packets < G_N_ELEMENTS (packets) && (opus_buffer = skippy_ogg_framer_next_packet (demux->ogg_framer, &page))) {
+      packet_samples[n_packets] = skippy_hls_demux_opus_packet_samples (demux, opus_buffer);
+      page_samples += packet_samples[n_packets];
+      packets[n_packets++] = opus_buffer;
+    }
+
+    // The granule is where the last packet completed on the page ends. On the last page it can be
+    // less than what the packets hold (end trimming), so count from the previous page there.
+    sample = page.granulepos - page_samples;
+    if ((page.flags & SKIPPY_OGG_PAGE_EOS) && demux->opus_granule >= 0) {
+      sample = demux->opus_granule;
+    }
+
+    for (i = 0; i < n_packets; i++) {
+      opus_buffer = packets[i];
+      if (page.granulepos >= 0 && packet_samples[i]) {
+        duration = MIN ((gint64) packet_samples[i], MAX (page.granulepos - sample, 0));
+        GST_BUFFER_PTS (opus_buffer) = skippy_hls_demux_opus_granule_to_time (demux, sample);
+        GST_BUFFER_DURATION (opus_buffer) = skippy_hls_demux_opus_granule_to_time (demux, sample + duration) - GST_BUFFER_PTS (opus_buffer);
+        sample += duration;
+      } else {
+        GST_BUFFER_PTS (opus_buffer) = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DURATION (opus_buffer) = GST_CLOCK_TIME_NONE;
+      }
+
       if (!first_opus_buffer_processed) {
         first_opus_buffer_processed  = TRUE;
         // check if this there was a seek command and if buffer pts
@@ -1652,25 +3879,39 @@ skippy_hls_demux_read_ogg_and_push_opus_packets(SkippyHLSDemux *demux, GstBuffer
           skippy_hlsdemux_update_first_opus_buffer_after_seek (demux, opus_buffer);
         }
         else {
-          // the pts is expected to be GST_CLOCK_TIME_NONE (continuous data)
-          GST_BUFFER_PTS(opus_buffer) = GST_BUFFER_PTS(buf);
           GST_BUFFER_IS_DISCONT (buf) ?
             GST_BUFFER_FLAG_SET (opus_buffer, GST_BUFFER_FLAG_DISCONT) :
             GST_BUFFER_FLAG_UNSET (opus_buffer, GST_BUFFER_FLAG_DISCONT);
         }
       } else {
         // after processing the first buffer all others are
-        // expected to be continuous, thus setting pts to GST_CLOCK_TIME_NONE
-        GST_BUFFER_PTS(opus_buffer) = GST_CLOCK_TIME_NONE;
+        // expected to be continuous
         GST_BUFFER_FLAG_UNSET (opus_buffer, GST_BUFFER_FLAG_DISCONT);
       }
       GST_BUFFER_DTS (opus_buffer) = GST_CLOCK_TIME_NONE;
-      ret_value = gst_pad_chain (demux->queue_sinkpad, opus_buffer);
+      if (!demux->opus_batch) {
+        demux->opus_batch = gst_buffer_list_new ();
+      }
+      gst_buffer_list_add (demux->opus_batch, opus_buffer);
+    }
+    if (page.granulepos >= 0) {
+      demux->opus_granule = page.granulepos;
+      demux->last_page_pos_ms = page_time / GST_MSECOND;
+    }
+
+    // Push once the batch covers enough media, the granule is the end time of the page
+    if (page.granulepos >= 0) {
+      GstClockTime page_end = gst_util_uint64_scale (page.granulepos, GST_SECOND, OPUS_SAMPLE_RATE);
+      if (demux->opus_batch_start == GST_CLOCK_TIME_NONE) {
+        demux->opus_batch_start = page_end;
+      }
+      if (!demux->opus_batch_duration || page_end >= demux->opus_batch_start + demux->opus_batch_duration) {
+        ret_value = skippy_hls_demux_flush_opus_batch (demux);
+      }
     }
-    demux->last_page_pos_ms = page_pos_ms;
+    skippy_ogg_page_clear (&page);
   }
   
-  gst_buffer_unmap(buf, &in_map);
   return ret_value;
 }
 
@@ -25,11 +25,17 @@
 #define __GST_HLS_DEMUX_H__
 
 #include <gst/gst.h>
-#include <gst/base/gstadapter.h>
-#include "oggOpusDec.h"
+#include <stdint.h>
 
 #include "skippy_m3u8.h"
 #include "skippy_uridownloader.h"
+#include "skippy_fragment_cache.h"
+#include "skippy_spill_file.h"
+#include "skippy_ogg_framer.h"
+#include "skippy_mp3_framer.h"
+#include "skippy_adts_framer.h"
+#include "skippy_ts_demuxer.h"
+#include "skippy_host_selector.h"
 
 G_BEGIN_DECLS
 #define TYPE_SKIPPY_HLS_DEMUX \
@@ -50,12 +56,22 @@ typedef struct _SkippyHLSDemuxClass SkippyHLSDemuxClass;
 // Constants for custom element message names
 #define SKIPPY_HLS_DEMUX_STATISTIC_MSG_NAME "adaptive-streaming-statistics"
 
+// Recent media downloads the buffer target adapts to
+#define THROUGHPUT_HISTORY 8
+
 typedef enum {
   UNKNOWN = 0,
   MP3,
-  OPUS
+  OPUS,
+  AAC,
+  FMP4,
+  MPEGTS
 } SkippyHLSDemuxCodec;
 
+// How the media of one codec gets from the downloader into the download queue, picked once per stream from the caps.
+// Defined in skippy_hlsdemux.c
+typedef struct _SkippyHLSDemuxPacketizer SkippyHLSDemuxPacketizer;
+
 /**
  * SkippyHLSDemux:
  *
@@ -72,7 +88,6 @@ struct _SkippyHLSDemux
   // Internal
   GstPad *queue_sinkpad;
   GstPad * queue_proxy_pad;
-  GstAdapter * out_adapter;
   
   /* Member objects */
   gboolean need_segment, need_stream_start;
@@ -83,15 +98,27 @@ struct _SkippyHLSDemux
   SkippyUriDownloader *downloader;
   SkippyUriDownloader *playlist_downloader;
   SkippyM3U8Client *client;     /* M3U8 client */
+  SkippyFragmentCache *fragment_cache; /* Fragments already pushed, replayed on seek */
+  SkippyHostSelector *host_selector; /* Mirror each fragment is loaded from */
+  SkippySpillFile *spill_file;  /* Far-ahead media, only used with a spill directory set */
   GRand *rand_gen;
+  GHashTable *init_sections;    /* Media initialization sections (EXT-X-MAP) we loaded, by URI and range */
+  gchar *init_section_key;      /* The one we pushed last */
 
 
-  COggDecoder oggDemux;
+  SkippyOggFramer *ogg_framer;
   
-  /* Streaming task */
-  GstTask *stream_task;
-  GRecMutex stream_lock;
-  GCond wait_cond;
+  /* Stream task, an event loop on one of the shared loop threads. Guarded by the object lock. */
+  GstTaskState loop_state;      /* Events only get handled while started */
+  GRecMutex stream_lock;        /* Held while handling an event */
+  GMainContext *loop_context;   /* Of the loop thread we got */
+  guint loop_epoch;             /* Bumped by pausing and seeking, drops the events posted before */
+  guint pause_epoch;            /* Bumped by pausing, drops the seeks posted before */
+  guint seeks_pending;          /* Seeks posted but not applied yet */
+  gboolean fetching;            /* A pool thread loads the next fragment while the loop goes on */
+  GCond fetch_cond;
+  GSource *retry_source;        /* Backoff after a failure */
+  GSource *idle_source;         /* Safety net while waiting for the download queue */
 
   /* Internal state */
   GstClockTime download_ahead;
@@ -102,14 +129,76 @@ struct _SkippyHLSDemux
   gint download_forbidden_count;
   gboolean continuing;
   gboolean force_secure_hls;
+
+  /* Buffer size handed on per codec, 0 for passthrough */
+  guint mp3_slice_size;
+  guint opus_slice_size;
+  GstClockTime opus_batch_duration;
+  gboolean mp3_framing;         /* Hand on whole, time stamped MP3 frames instead */
+  gboolean aac_framing;         /* Same for AAC in ADTS */
+  gboolean ts_demuxing;         /* Take the audio out of MPEG-TS ourselves instead of handing it on */
+
+  /* Stall watchdog of the media downloader */
+  guint stall_min_rate;         /* Bytes per second, 0 for none */
+  GstClockTime stall_window;
+  gboolean hedging;             /* Media downloader hedges slow requests, we post its stats */
+  gboolean hedge_to_mirror;     /* No hedge host given, hedge requests go to the next best mirror */
+
+  /* Memory budget */
+  guint64 max_buffer_bytes;     /* Byte watermark, 0 for none */
+  gchar *spill_directory;
+  gboolean spill_fragment;      /* Fragment currently downloading goes to the spill file */
+  guint64 media_byte_rate;      /* Bytes per second of media, measured on the last fragment */
+  GstClockTime playback_position; /* Playhead estimate, from what left the download queue */
+  gsize memory_usage_peak;
+
+  /* Burst scheduling */
+  gint64 burst_start_time;      /* Monotonic time the running download burst started, 0 when idle */
+  gsize burst_bytes;
+  GstClockTime radio_active_time; /* Sum of all burst durations */
+
+  /* Adaptive buffer target, between MIN_BUFFER_DURATION and download_ahead */
+  gboolean adaptive_buffer;
+  GstClockTime buffer_target;   /* GST_CLOCK_TIME_NONE until we measured enough */
+  gdouble throughputs[THROUGHPUT_HISTORY]; /* Bandwidth estimates after recent media downloads, bytes per second */
+  guint throughput_count;
+
+  /* Event-driven scheduling, all guarded by the object lock */
+  GQueue playhead_marks;        /* Fragment boundaries in the bytes going through the download queue */
+  guint64 queue_bytes_in;
+  guint64 queue_bytes_out;
+  gboolean wake_armed;          /* Stream task waits for one of the conditions below */
+  GstClockTime wake_position;
+  guint64 wake_queue_bytes;
   
   /* Codec specific state */
   SkippyHLSDemuxCodec dataCodec;
-  gchar* opus_init_data;
-  guint16 opus_init_data_written;
-  gboolean opus_0_fragment_cached;
+  const SkippyHLSDemuxPacketizer *packetizer;
+  gsize opus_header_size;       /* Bytes of header pages seen from the start of the stream */
+  gboolean opus_header_complete; /* Header pages of the current stream have been through */
+  gboolean opus_header_fetch;   /* Loading only the header pages of the first fragment */
+  gboolean opus_header_probe_failed; /* Header didn't fit in the probed range, load whole fragment */
   gboolean opus_seek_processing_pending;
   int64_t last_page_pos_ms;
+  GstBufferList *opus_batch;    /* Packets not handed to the download queue yet */
+  GstClockTime opus_batch_start;
+  guint16 opus_pre_skip;        /* Samples to drop at stream start, from the identification header */
+  gint64 opus_granule;          /* Granule of the last page we read, -1 after a seek */
+  SkippyMp3Header mp3_header;   /* From the first frame of the stream */
+  gboolean mp3_header_known;
+  gboolean mp3_vbr;
+  gint64 mp3_resync_offset;     /* Byte in the fragment where a seek range started, -1 when in sync */
+  GstClockTime mp3_resync_start; /* Start time of that fragment */
+  SkippyMp3Framer *mp3_framer;
+  SkippyAdtsHeader aac_header;  /* From the first frame of the stream */
+  gboolean aac_header_known;
+  SkippyAdtsFramer *aac_framer;
+  GstClockTime frame_next_pts;  /* Where the next MP3 or AAC frame we hand on starts */
+  gboolean frame_discont;
+  SkippyTsDemuxer *ts_demuxer;
+  const SkippyHLSDemuxPacketizer *ts_packetizer; /* Takes the audio inside, NULL until we know what it is */
+  GstClockTimeDiff ts_pts_offset; /* From PES time stamps to our timeline */
+  GstClockTime ts_last_pts;     /* Of the last PES we handed on, none to pin the next one to where its fragment starts */
 };
 
 struct _SkippyHLSDemuxClass
@@ -0,0 +1,384 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_host_selector.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "skippy_host_selector.h"
+
+// Weight of the latest download in the per host averages
+#define HOST_AVERAGE_WEIGHT 0.3
+// A host that failed is left alone for that long, doubling with each failure in a row up to the maximum
+#define HOST_FAILURE_COOLDOWN (5*G_USEC_PER_SEC)
+#define HOST_FAILURE_MAX_COOLDOWN (120*G_USEC_PER_SEC)
+// Hosts we didn't load from for that long get measured again
+#define HOST_REPROBE_INTERVAL (60*G_USEC_PER_SEC)
+
+GST_DEBUG_CATEGORY_STATIC (skippy_host_selector_debug);
+#define GST_CAT_DEFAULT skippy_host_selector_debug
+
+typedef struct
+{
+  gchar *authority;           /* host[:port] */
+  GstClockTime ttfb;          /* Averages of what we measured, valid once there are samples */
+  gdouble throughput;         /* Bytes per second */
+  gdouble error_rate;
+  guint samples;
+  guint failures;             /* In a row */
+  gint64 retry_after;         /* Monotonic time we may load from it again after failing */
+  gint64 last_used;           /* Monotonic time of the last report */
+} SkippyHost;
+
+struct _SkippyHostSelector
+{
+  GMutex lock;
+  GPtrArray *hosts;           /* SkippyHost */
+  gdouble fragment_size;      /* Average download size, to weigh latency against throughput */
+  SkippyHost *current;        /* Host we routed to last */
+};
+
+static gpointer skippy_host_selector_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_host_selector_debug, "skippyhls-host-selector", 0, "HLS mirror host selection");
+  return NULL;
+}
+
+static void
+skippy_host_free (gpointer data)
+{
+  SkippyHost *host = data;
+
+  g_free (host->authority);
+  g_slice_free (SkippyHost, host);
+}
+
+SkippyHostSelector *
+skippy_host_selector_new (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+  SkippyHostSelector *selector;
+
+  g_once (&init_once, skippy_host_selector_init_once, NULL);
+
+  selector = g_slice_new0 (SkippyHostSelector);
+  g_mutex_init (&selector->lock);
+  selector->hosts = g_ptr_array_new_with_free_func (skippy_host_free);
+  return selector;
+}
+
+void
+skippy_host_selector_free (SkippyHostSelector * selector)
+{
+  g_ptr_array_free (selector->hosts, TRUE);
+  g_mutex_clear (&selector->lock);
+  g_slice_free (SkippyHostSelector, selector);
+}
+
+gchar *
+skippy_host_selector_get_authority (const gchar * uri)
+{
+  GstUri *parsed = gst_uri_from_string (uri);
+  const gchar *host;
+  gchar *authority = NULL, *host_part;
+
+  if (!parsed) {
+    return NULL;
+  }
+  host = gst_uri_get_host (parsed);
+  if (host && host[0]) {
+    // IPv6 literals come without their brackets
+    if (strchr (host, ':')) {
+      host_part = g_strdup_printf ("[%s]", host);
+    } else {
+      host_part = g_strdup (host);
+    }
+    if (gst_uri_get_port (parsed) == GST_URI_NO_PORT) {
+      authority = host_part;
+    } else {
+      authority = g_strdup_printf ("%s:%u", host_part, gst_uri_get_port (parsed));
+      g_free (host_part);
+    }
+  }
+  gst_uri_unref (parsed);
+  return authority;
+}
+
+gchar *
+skippy_host_selector_replace_authority (const gchar * uri, const gchar * authority)
+{
+  GstUri *parsed, *authority_uri;
+  gchar *authority_string, *replaced;
+
+  if (!authority || !(parsed = gst_uri_from_string (uri))) {
+    return g_strdup (uri);
+  }
+  // Let GstUri tell host from port, IPv6 literals included
+  authority_string = g_strconcat ("http://", authority, NULL);
+  authority_uri = gst_uri_from_string (authority_string);
+  g_free (authority_string);
+  if (!authority_uri || !gst_uri_get_host (parsed)) {
+    if (authority_uri) {
+      gst_uri_unref (authority_uri);
+    }
+    gst_uri_unref (parsed);
+    return g_strdup (uri);
+  }
+  gst_uri_set_host (parsed, gst_uri_get_host (authority_uri));
+  gst_uri_set_port (parsed, gst_uri_get_port (authority_uri));
+  replaced = gst_uri_to_string (parsed);
+  gst_uri_unref (authority_uri);
+  gst_uri_unref (parsed);
+  return replaced;
+}
+
+// Index of the host with that authority or -1 if we don't know it. Expects the lock to be held.
+static gint
+skippy_host_selector_find (SkippyHostSelector * selector, const gchar * authority)
+{
+  SkippyHost *host;
+  guint i;
+
+  for (i = 0; authority && i < selector->hosts->len; i++) {
+    host = g_ptr_array_index (selector->hosts, i);
+    if (!g_ascii_strcasecmp (host->authority, authority)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Index of the host of the URI or -1 if we don't know it. Expects the lock to be held.
+static gint
+skippy_host_selector_lookup (SkippyHostSelector * selector, const gchar * uri)
+{
+  gchar *authority = skippy_host_selector_get_authority (uri);
+  gint index = skippy_host_selector_find (selector, authority);
+
+  g_free (authority);
+  return index;
+}
+
+// Adds a host at the given index, -1 to append. Expects the lock to be held.
+static void
+skippy_host_selector_add (SkippyHostSelector * selector, const gchar * authority, gint index)
+{
+  SkippyHost *host = g_slice_new0 (SkippyHost);
+
+  host->authority = g_strdup (authority);
+  g_ptr_array_insert (selector->hosts, index, host);
+}
+
+void
+skippy_host_selector_set_hosts (SkippyHostSelector * selector, const gchar * hosts)
+{
+  gchar **authorities = g_strsplit (hosts, ",", -1);
+  guint i;
+
+  g_mutex_lock (&selector->lock);
+  for (i = 0; authorities[i]; i++) {
+    g_strstrip (authorities[i]);
+    if (authorities[i][0] && skippy_host_selector_find (selector, authorities[i]) < 0) {
+      GST_DEBUG ("Adding mirror host %s", authorities[i]);
+      skippy_host_selector_add (selector, authorities[i], -1);
+    }
+  }
+  g_mutex_unlock (&selector->lock);
+  g_strfreev (authorities);
+}
+
+// Expected time to load an average fragment from the host, counting the retries its errors cost us.
+// Hosts we have no recent measurements for come first so we get some. Expects the lock to be held.
+static gdouble
+skippy_host_selector_get_cost (SkippyHostSelector * selector, SkippyHost * host, gint64 now)
+{
+  gdouble cost;
+
+  if (!host->samples || now - host->last_used > HOST_REPROBE_INTERVAL) {
+    return 0;
+  }
+  cost = (gdouble) host->ttfb / GST_SECOND;
+  if (host->throughput > 0) {
+    cost += selector->fragment_size / host->throughput;
+  }
+  return cost / (1 - MIN (host->error_rate, 0.9));
+}
+
+// The host that does best right now other than the one at the excluded index (-1 for none), NULL if there is
+// no other one. Expects the lock to be held.
+static SkippyHost *
+skippy_host_selector_pick (SkippyHostSelector * selector, gint excluded)
+{
+  SkippyHost *host, *best = NULL;
+  gint64 now = g_get_monotonic_time ();
+  gdouble cost, best_cost = 0;
+  guint i;
+
+  for (i = 0; i < selector->hosts->len; i++) {
+    host = g_ptr_array_index (selector->hosts, i);
+    if ((gint) i == excluded || host->retry_after > now) {
+      continue;
+    }
+    cost = skippy_host_selector_get_cost (selector, host, now);
+    if (!best || cost < best_cost) {
+      best = host;
+      best_cost = cost;
+    }
+  }
+  // All failed lately: the one that is due again first
+  if (!best) {
+    for (i = 0; i < selector->hosts->len; i++) {
+      host = g_ptr_array_index (selector->hosts, i);
+      if ((gint) i != excluded && (!best || host->retry_after < best->retry_after)) {
+        best = host;
+      }
+    }
+  }
+  return best;
+}
+
+gchar *
+skippy_host_selector_route (SkippyHostSelector * selector, const gchar * uri)
+{
+  SkippyHost *best;
+  gchar *authority = skippy_host_selector_get_authority (uri), *routed;
+
+  if (!authority) {
+    return g_strdup (uri);
+  }
+
+  g_mutex_lock (&selector->lock);
+  // The origin goes first, that's where we start out
+  if (skippy_host_selector_find (selector, authority) < 0) {
+    skippy_host_selector_add (selector, authority, 0);
+  }
+  g_free (authority);
+  if (selector->hosts->len < 2) {
+    g_mutex_unlock (&selector->lock);
+    return g_strdup (uri);
+  }
+
+  best = skippy_host_selector_pick (selector, -1);
+  if (best != selector->current) {
+    GST_INFO ("Loading from %s now", best->authority);
+    selector->current = best;
+  }
+  routed = skippy_host_selector_replace_authority (uri, best->authority);
+  g_mutex_unlock (&selector->lock);
+  return routed;
+}
+
+gchar *
+skippy_host_selector_get_alternative (SkippyHostSelector * selector, const gchar * uri)
+{
+  SkippyHost *alternative = NULL;
+  gchar *authority = NULL;
+
+  g_mutex_lock (&selector->lock);
+  if (selector->hosts->len >= 2) {
+    alternative = skippy_host_selector_pick (selector, skippy_host_selector_lookup (selector, uri));
+  }
+  if (alternative) {
+    authority = g_strdup (alternative->authority);
+  }
+  g_mutex_unlock (&selector->lock);
+  return authority;
+}
+
+void
+skippy_host_selector_report_success (SkippyHostSelector * selector, const gchar * uri,
+  GstClockTime time_to_first_byte, gsize bytes, GstClockTime download_time)
+{
+  SkippyHost *host;
+  gdouble throughput = 0;
+  gint index;
+
+  g_mutex_lock (&selector->lock);
+  if ((index = skippy_host_selector_lookup (selector, uri)) < 0 || selector->hosts->len < 2) {
+    g_mutex_unlock (&selector->lock);
+    return;
+  }
+  host = g_ptr_array_index (selector->hosts, index);
+  if (!GST_CLOCK_TIME_IS_VALID (time_to_first_byte) || time_to_first_byte > download_time) {
+    time_to_first_byte = 0;
+  }
+  if (download_time > time_to_first_byte) {
+    throughput = (gdouble) bytes * GST_SECOND / (download_time - time_to_first_byte);
+  }
+  if (!host->samples || g_get_monotonic_time () - host->last_used > HOST_REPROBE_INTERVAL) {
+    host->ttfb = time_to_first_byte;
+    host->throughput = throughput;
+  } else {
+    host->ttfb = (GstClockTime) (HOST_AVERAGE_WEIGHT * time_to_first_byte + (1 - HOST_AVERAGE_WEIGHT) * host->ttfb);
+    host->throughput = HOST_AVERAGE_WEIGHT * throughput + (1 - HOST_AVERAGE_WEIGHT) * host->throughput;
+  }
+  host->error_rate *= 1 - HOST_AVERAGE_WEIGHT;
+  host->samples++;
+  host->failures = 0;
+  host->retry_after = 0;
+  host->last_used = g_get_monotonic_time ();
+  selector->fragment_size = selector->fragment_size > 0 ?
+    HOST_AVERAGE_WEIGHT * bytes + (1 - HOST_AVERAGE_WEIGHT) * selector->fragment_size : bytes;
+  GST_LOG ("%s: %" GST_TIME_FORMAT " to first byte, %.0f bytes/s, %.2f error rate", host->authority,
+    GST_TIME_ARGS (host->ttfb), host->throughput, host->error_rate);
+  g_mutex_unlock (&selector->lock);
+}
+
+void
+skippy_host_selector_report_failure (SkippyHostSelector * selector, const gchar * uri)
+{
+  SkippyHost *host;
+  gint64 cooldown;
+  gint index;
+
+  g_mutex_lock (&selector->lock);
+  if ((index = skippy_host_selector_lookup (selector, uri)) < 0 || selector->hosts->len < 2) {
+    g_mutex_unlock (&selector->lock);
+    return;
+  }
+  host = g_ptr_array_index (selector->hosts, index);
+  host->error_rate = HOST_AVERAGE_WEIGHT + (1 - HOST_AVERAGE_WEIGHT) * host->error_rate;
+  host->failures++;
+  cooldown = (gint64) HOST_FAILURE_COOLDOWN << MIN (host->failures - 1, 5);
+  host->retry_after = g_get_monotonic_time () + MIN (cooldown, HOST_FAILURE_MAX_COOLDOWN);
+  host->last_used = g_get_monotonic_time ();
+  GST_WARNING ("%s failed %u times in a row, leaving it alone for %" G_GINT64_FORMAT " s", host->authority,
+    host->failures, MIN (cooldown, HOST_FAILURE_MAX_COOLDOWN) / G_USEC_PER_SEC);
+  g_mutex_unlock (&selector->lock);
+}
+
+gboolean
+skippy_host_selector_has_alternative (SkippyHostSelector * selector, const gchar * uri)
+{
+  SkippyHost *host;
+  gint64 now = g_get_monotonic_time ();
+  gint index;
+  guint i;
+  gboolean ret = FALSE;
+
+  g_mutex_lock (&selector->lock);
+  index = skippy_host_selector_lookup (selector, uri);
+  for (i = 0; i < selector->hosts->len && !ret; i++) {
+    host = g_ptr_array_index (selector->hosts, i);
+    ret = (gint) i != index && host->retry_after <= now;
+  }
+  g_mutex_unlock (&selector->lock);
+  return ret;
+}
@@ -0,0 +1,61 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_host_selector.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Picks which of several mirror hosts serving the same paths each fragment is loaded from, by the time to first byte,
+// throughput and error rate measured on earlier downloads. Hosts that failed are left alone for a while.
+// All functions are MT-safe.
+typedef struct _SkippyHostSelector SkippyHostSelector;
+
+SkippyHostSelector *skippy_host_selector_new (void);
+void skippy_host_selector_free (SkippyHostSelector * selector);
+
+// Comma separated list of mirrors as "host[:port]", the host of the first URI routed always takes part as well
+void skippy_host_selector_set_hosts (SkippyHostSelector * selector, const gchar * hosts);
+
+// Returns the URI with its host replaced by the best one right now
+gchar *skippy_host_selector_route (SkippyHostSelector * selector, const gchar * uri);
+
+// Returns the best host other than the one of the URI as "host[:port]", NULL if there is none. That's where
+// a hedge request for the URI goes.
+gchar *skippy_host_selector_get_alternative (SkippyHostSelector * selector, const gchar * uri);
+
+// Reports how a download from the host of the URI went
+void skippy_host_selector_report_success (SkippyHostSelector * selector, const gchar * uri,
+  GstClockTime time_to_first_byte, gsize bytes, GstClockTime download_time);
+void skippy_host_selector_report_failure (SkippyHostSelector * selector, const gchar * uri);
+
+// Whether there is another host than the one of the URI we could load from right now
+gboolean skippy_host_selector_has_alternative (SkippyHostSelector * selector, const gchar * uri);
+
+// Returns the authority of the URI as "host[:port]", NULL if it has none
+gchar *skippy_host_selector_get_authority (const gchar * uri);
+
+// Returns the URI with its authority replaced by the one given as "host[:port]", or a copy of it if there is none
+gchar *skippy_host_selector_replace_authority (const gchar * uri, const gchar * authority);
+
+G_END_DECLS
@@ -121,12 +121,33 @@ gchar* skippy_m3u8_client_get_current_raw_data (SkippyM3U8Client * client) {
   return client->priv->playlist_raw;
 }
 
+// Creates the fragment model for a playlist item - client mutex must be locked
+static SkippyFragment* skippy_m3u8_client_fragment_from_item (SkippyM3U8Client * client, const SkippyM3UItem& item)
+{
+  SkippyFragment *fragment = skippy_fragment_new (item.url.c_str());
+  fragment->sequence_number = item.index;
+  fragment->start_time = NANOSECONDS_TO_GST_TIME (item.start);
+  fragment->stop_time = NANOSECONDS_TO_GST_TIME (item.end);
+  fragment->duration = NANOSECONDS_TO_GST_TIME (item.duration);
+  if (item.encrypted) {
+    // Key URIs are commonly relative to the playlist
+    fragment->key_uri = gst_uri_join_strings (client->priv->playlist.uri.c_str(), item.keyUri.c_str());
+    memcpy (fragment->iv, item.iv, sizeof (fragment->iv));
+  }
+  if (!item.mapUri.empty()) {
+    // Same for init sections
+    fragment->map_uri = gst_uri_join_strings (client->priv->playlist.uri.c_str(), item.mapUri.c_str());
+    fragment->map_range_start = item.mapRangeStart;
+    fragment->map_range_end = item.mapRangeEnd;
+  }
+  return fragment;
+}
+
 // Called to get the next fragment
 SkippyFragment* skippy_m3u8_client_get_fragment (SkippyM3U8Client * client, guint64 sequence_number)
 {
   lock_guard<recursive_mutex> lock(client->priv->mutex);
 
-  SkippyFragment *fragment;
   SkippyM3UItem item;
 
   if (sequence_number >= client->priv->playlist.items.size()) {
@@ -135,18 +156,13 @@ SkippyFragment* skippy_m3u8_client_get_fragment (SkippyM3U8Client * client, guin
 
   item = client->priv->playlist.items.at (sequence_number);
 
-  fragment = skippy_fragment_new (item.url.c_str());
-  fragment->start_time = NANOSECONDS_TO_GST_TIME (item.start);
-  fragment->stop_time = NANOSECONDS_TO_GST_TIME (item.end);
-  fragment->duration = NANOSECONDS_TO_GST_TIME (item.duration);
-  return fragment;
+  return skippy_m3u8_client_fragment_from_item (client, item);
 }
 
 SkippyFragment* skippy_m3u8_client_get_current_fragment (SkippyM3U8Client * client)
 {
   lock_guard<recursive_mutex> lock(client->priv->mutex);
   
-  SkippyFragment *fragment;
   SkippyM3UItem item;
   
   if (client->priv->current_index >= client->priv->playlist.items.size()) {
@@ -155,11 +171,7 @@ SkippyFragment* skippy_m3u8_client_get_current_fragment (SkippyM3U8Client * clie
   
   item = client->priv->playlist.items.at (client->priv->current_index);
   
-  fragment = skippy_fragment_new (item.url.c_str());
-  fragment->start_time = NANOSECONDS_TO_GST_TIME (item.start);
-  fragment->stop_time = NANOSECONDS_TO_GST_TIME (item.end);
-  fragment->duration = NANOSECONDS_TO_GST_TIME (item.duration);
-  return fragment;
+  return skippy_m3u8_client_fragment_from_item (client, item);
 }
 
 void skippy_m3u8_client_advance_to_next_fragment (SkippyM3U8Client * client)
@@ -198,6 +210,15 @@ gchar* skippy_m3u8_client_get_uri(SkippyM3U8Client * client)
   return g_strdup(client->priv->playlist.uri.c_str());
 }
 
+gchar* skippy_m3u8_client_get_codecs (SkippyM3U8Client * client)
+{
+  lock_guard<recursive_mutex> lock(client->priv->mutex);
+  if (client->priv->playlist.codec.empty()) {
+    return NULL;
+  }
+  return g_strdup(client->priv->playlist.codec.c_str());
+}
+
 gchar* skippy_m3u8_client_get_playlist_for_bitrate (SkippyM3U8Client * client, guint bitrate)
 {
   //lock_guard<recursive_mutex> lock(client->priv->mutex);
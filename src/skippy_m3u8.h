@@ -62,6 +62,9 @@ gboolean skippy_m3u8_client_has_variant_playlist(SkippyM3U8Client * client);
 gboolean skippy_m3u8_client_is_live(SkippyM3U8Client * client);
 gboolean skippy_m3u8_client_is_caching_allowed(SkippyM3U8Client * client);
 
+// CODECS advertised for the playlist (RFC 6381, comma separated), NULL if none
+gchar* skippy_m3u8_client_get_codecs (SkippyM3U8Client * client);
+
 gchar* skippy_m3u8_client_get_current_raw_data (SkippyM3U8Client * client);
 
 G_END_DECLS
@@ -9,6 +9,9 @@
 
 #include <sstream>
 #include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <algorithm>
 
 #include <glib-object.h>
@@ -28,23 +31,31 @@ static const string default_delimiters ("# -.,:");
 static const string EXT("EXT");
 static const string X("X");
 static const string INF("INF");
-static const string ID("ID");
 static const string EXTM3U("EXTM3U");
 static const string EXTINF("EXTINF");
 static const string PLAYLIST("PLAYLIST");
 static const string TYPE("TYPE");
 static const string STREAM("STREAM");
-static const string PROGRAM("PROGRAM");
 static const string VERSION("VERSION");
-static const string BANDWIDTH("BANDWIDTH");
-static const string RES("READ");
-static const string CODEC("CODEC");
 static const string VOD("VOD");
 static const string EVENT("EVENT");
 static const string TARGETDURATION("TARGETDURATION");
 static const string MEDIA("MEDIA");
 static const string SEQUENCE("SEQUENCE");
 static const string ENDLIST("ENDLIST");
+static const string KEY("KEY");
+static const string MAP("MAP");
+// attribute names & values
+static const string METHOD("METHOD");
+static const string URI("URI");
+static const string IV("IV");
+static const string BYTERANGE("BYTERANGE");
+static const string PROGRAM_ID("PROGRAM-ID");
+static const string BANDWIDTH("BANDWIDTH");
+static const string RESOLUTION("RESOLUTION");
+static const string CODECS("CODECS");
+static const string METHOD_NONE("NONE");
+static const string METHOD_AES_128("AES-128");
 
 typedef vector<string> Tokens;
 Tokens custom_split(const string &s, const string &delim = default_delimiters) {
@@ -60,6 +71,83 @@ Tokens custom_split(const string &s, const string &delim = default_delimiters) {
 	return result;
 }
 
+static string trim(const string &s)
+{
+  static const string whitespace(" \t\r\n");
+  size_t first = s.find_first_not_of(whitespace);
+  if (first == string::npos) {
+    return "";
+  }
+  return s.substr(first, s.find_last_not_of(whitespace) - first + 1);
+}
+
+SkippyM3UAttributes skippy_m3u_parse_attribute_list(const string& attributes)
+{
+  SkippyM3UAttributes result;
+  size_t pos = 0;
+
+  while (pos < attributes.length()) {
+    size_t eq = attributes.find('=', pos);
+    if (eq == string::npos) {
+      break;
+    }
+    string name = trim(attributes.substr(pos, eq - pos));
+    string value;
+    pos = eq + 1;
+    if (pos < attributes.length() && attributes[pos] == '"') {
+      // Quoted strings may contain commas, read up to the closing quote
+      size_t closing = attributes.find('"', pos + 1);
+      if (closing == string::npos) {
+        closing = attributes.length();
+      }
+      value = attributes.substr(pos + 1, closing - pos - 1);
+      pos = attributes.find(',', closing);
+    } else {
+      size_t comma = attributes.find(',', pos);
+      value = trim(attributes.substr(pos, comma == string::npos ? string::npos : comma - pos));
+      pos = comma;
+    }
+    result[name] = value;
+    if (pos == string::npos) {
+      break;
+    }
+    pos++;
+  }
+  return result;
+}
+
+// Parses a hexadecimal-sequence (0x...) into a 128-bit IV, shorter values are zero-padded on the left
+static bool hexToIv(const string &hexString, uint8_t iv[16])
+{
+  if (hexString.length() < 3 || hexString[0] != '0' || (hexString[1] != 'x' && hexString[1] != 'X')) {
+    return false;
+  }
+  string digits = hexString.substr(2);
+  if (digits.length() > 32) {
+    return false;
+  }
+  digits.insert(0, 32 - digits.length(), '0');
+  for (size_t i = 0; i < digits.length(); i++) {
+    if (!isxdigit((unsigned char) digits[i])) {
+      return false;
+    }
+  }
+  for (int i = 0; i < 16; i++) {
+    iv[i] = (uint8_t) strtoul(digits.substr(i * 2, 2).c_str(), NULL, 16);
+  }
+  return true;
+}
+
+// Default IV when the key tag has none: media sequence number as big-endian 128-bit integer
+static void sequenceNumberToIv(uint64_t sequenceNo, uint8_t iv[16])
+{
+  memset(iv, 0, 16);
+  for (int i = 15; i >= 8; i--) {
+    iv[i] = (uint8_t) (sequenceNo & 0xff);
+    sequenceNo >>= 8;
+  }
+}
+
 SkippyM3UParser::SkippyM3UParser()
 :state (STATE_RESET)
 ,subState (SUBSTATE_RESET)
@@ -71,6 +159,10 @@ SkippyM3UParser::SkippyM3UParser()
 ,length(0)
 ,index(0)
 ,position(0)
+,encrypted(false)
+,keyHasIv(false)
+,mapRangeStart(0)
+,mapRangeEnd(-1)
 {}
 
 SkippyM3UPlaylist SkippyM3UParser::parse(string uri, const string& playlist)
@@ -156,6 +248,8 @@ void SkippyM3UParser::evalSubstate() {
   } else if ( token == EXTINF ) {
 
     subState = SUBSTATE_INF;
+    // Reset the segment length (duration) field, it has to last until the URL line
+    length = -1;
 
     LOG ("Sub-State to: INF");
 
@@ -163,6 +257,9 @@ void SkippyM3UParser::evalSubstate() {
       && token == INF) {
 
     subState = SUBSTATE_STREAM;
+    parseStreamInf();
+    // Attribute values don't tokenize, we've read them all
+    tokenIt = tokens.end();
 
     LOG ("Sub-State to: STREAM");
 
@@ -190,6 +287,19 @@ void SkippyM3UParser::evalSubstate() {
     targetDuration = tokenToUnsignedInt();
 
     LOG ("Target duration is: %u", targetDuration);
+  } else if (token == KEY) {
+
+    parseKey();
+    // Attributes have been parsed from the raw line, skip remaining tokens
+    // and keep the current sub-state (key tags may appear between EXTINF and URL)
+    tokenIt = tokens.end();
+
+  } else if (token == MAP) {
+
+    parseMap();
+    // Same as for keys
+    tokenIt = tokens.end();
+
   } else if (token == ENDLIST) {
 
     LOG("Sub-State to: RESET (end of list)");
@@ -215,6 +325,72 @@ uint64_t SkippyM3UParser::tokenToUnsignedInt()
   return i;
 }
 
+void SkippyM3UParser::parseKey()
+{
+  size_t colon = line.find(':');
+  if (colon == string::npos) {
+    return;
+  }
+
+  SkippyM3UAttributes attributes = skippy_m3u_parse_attribute_list(line.substr(colon + 1));
+  const string& method = attributes[METHOD];
+
+  if (method == METHOD_AES_128) {
+    encrypted = true;
+    keyUri = attributes[URI];
+    keyHasIv = hexToIv(attributes[IV], keyIv);
+    LOG ("Key: %s (explicit IV: %d)", keyUri.c_str(), (int) keyHasIv);
+  } else {
+    if (method != METHOD_NONE) {
+      LOG ("Unsupported key method: %s", method.c_str());
+    }
+    encrypted = false;
+    keyHasIv = false;
+    keyUri.clear();
+  }
+}
+
+void SkippyM3UParser::parseStreamInf()
+{
+  size_t colon = line.find(':');
+  if (colon == string::npos) {
+    return;
+  }
+
+  SkippyM3UAttributes attributes = skippy_m3u_parse_attribute_list(line.substr(colon + 1));
+  programId = strtoull(attributes[PROGRAM_ID].c_str(), NULL, 10);
+  // Bits per second in the tag
+  bandwidth = strtoull(attributes[BANDWIDTH].c_str(), NULL, 10) / 1000;
+  res = attributes[RESOLUTION];
+  codec = attributes[CODECS];
+  LOG ("Stream: %lu kbps, codecs %s", (unsigned long) bandwidth, codec.c_str());
+}
+
+void SkippyM3UParser::parseMap()
+{
+  size_t colon = line.find(':');
+  if (colon == string::npos) {
+    return;
+  }
+
+  SkippyM3UAttributes attributes = skippy_m3u_parse_attribute_list(line.substr(colon + 1));
+  mapUri = attributes[URI];
+  mapRangeStart = 0;
+  mapRangeEnd = -1;
+
+  // <length>[@<offset>], the offset defaults to 0 here
+  const string& range = attributes[BYTERANGE];
+  if (!range.empty()) {
+    size_t at = range.find('@');
+    uint64_t length = strtoull(range.c_str(), NULL, 10);
+    if (at != string::npos) {
+      mapRangeStart = strtoll(range.c_str() + at + 1, NULL, 10);
+    }
+    mapRangeEnd = mapRangeStart + length;
+  }
+  LOG ("Map: %s (range %ld - %ld)", mapUri.c_str(), (long) mapRangeStart, (long) mapRangeEnd);
+}
+
 void SkippyM3UParser::readLine() {
 
   switch(state) {
@@ -230,9 +406,6 @@ void SkippyM3UParser::readLine() {
     break;
   case STATE_META_LINE:
 
-    // Reset the segment length (duration) field
-    length = -1;
-
     // Tokenize the line
     metaTokenize();
 
@@ -254,24 +427,6 @@ void SkippyM3UParser::readLine() {
         LOG ("Got INF duration: %f", length);
         break;
       }
-      case SUBSTATE_STREAM:
-        if ( token == PROGRAM && nextToken () && token == ID ) {
-         nextToken();
-         programId = tokenToUnsignedInt();
-        }
-        else if ( token == CODEC ) {
-         nextToken();
-         codec = token;
-        }
-        else if ( token == RES) {
-         nextToken();
-         res = token;
-        }
-        else if ( token == BANDWIDTH) {
-         nextToken();
-         bandwidth = tokenToUnsignedInt();
-        }
-        break;
       case SUBSTATE_RESET:
       default:
         break;
@@ -292,13 +447,26 @@ void SkippyM3UParser::update(SkippyM3UPlaylist& playlist) {
     item.duration = length * UNIT_SECONDS;
     item.end = item.start + item.duration;
     item.url = url;
-    item.encrypted = false;
+    item.encrypted = encrypted;
     item.index = index;
+    memset(item.iv, 0, sizeof(item.iv));
+    item.mapUri = mapUri;
+    item.mapRangeStart = mapRangeStart;
+    item.mapRangeEnd = mapRangeEnd;
+    if (encrypted) {
+      item.keyUri = keyUri;
+      if (keyHasIv) {
+        memcpy(item.iv, keyIv, sizeof(item.iv));
+      } else {
+        sequenceNumberToIv(mediaSequenceNo + index, item.iv);
+      }
+    }
 
     playlist.items.push_back( item );
 
     position += item.duration;
     index++;
+    length = -1;
 
     LOG ("Added item: %s", url.c_str());
     break;
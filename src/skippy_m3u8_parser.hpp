@@ -10,6 +10,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 
 // Child item info
 struct SkippyM3UItem
@@ -20,6 +21,8 @@ struct SkippyM3UItem
   uint64_t start, end, duration; // Nanoseconds
   uint8_t iv[16];
   bool encrypted;
+  std::string mapUri; // Media initialization section (#EXT-X-MAP), empty if none
+  int64_t mapRangeStart, mapRangeEnd; // Byte range of it, end is exclusive and -1 for all of it
 };
 
 typedef std::vector<SkippyM3UItem> SkippyM3UPlaylistItems;
@@ -36,7 +39,7 @@ struct SkippyM3UPlaylist
   uint64_t bandwidthKbps; // kbps
   uint64_t targetDuration, totalDuration; // Nanoseconds
 
-  std::string codec;
+  std::string codec; // CODECS of the stream info tag (RFC 6381), empty if none
   std::string resolution;
   std::string uri;
   std::string type;
@@ -80,6 +83,9 @@ protected:
   void metaTokenize();
   bool nextToken();
   uint64_t tokenToUnsignedInt();
+  void parseKey();
+  void parseMap();
+  void parseStreamInf();
 
 private:
   // Parsing state
@@ -108,6 +114,22 @@ private:
   uint64_t index;
   uint64_t position;
   
+  // Key state vars (apply to all following items until the next key tag)
+  bool encrypted;
+  bool keyHasIv;
+  std::string keyUri;
+  uint8_t keyIv[16];
+
+  // Map state vars (apply to all following items until the next map tag)
+  std::string mapUri;
+  int64_t mapRangeStart, mapRangeEnd;
+
   // URI state vars
   std::string url;
 };
+
+typedef std::map<std::string, std::string> SkippyM3UAttributes;
+
+// Parses an attribute list (i.e the part after the colon of tags like #EXT-X-KEY)
+// Quoted-string values are returned without their quotes
+SkippyM3UAttributes skippy_m3u_parse_attribute_list(const std::string& attributes);
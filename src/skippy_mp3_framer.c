@@ -0,0 +1,243 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_mp3_framer.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include <string.h>
+
+#include <gst/base/gstadapter.h>
+
+#include "skippy_mp3_framer.h"
+
+#define ID3V1_SIZE 128
+#define ID3V2_HEADER_SIZE SKIPPY_MP3_TAG_HEADER_SIZE
+#define ID3V2_FLAG_FOOTER 0x10
+
+GST_DEBUG_CATEGORY_STATIC (skippy_mp3_framer_debug);
+#define GST_CAT_DEFAULT skippy_mp3_framer_debug
+
+struct _SkippyMp3Framer
+{
+  GstAdapter *adapter;
+  gboolean synced;      /* The data starts right after the last frame we returned */
+};
+
+// Kilobits per second by bitrate index, for MPEG-1 layer I, II, III and MPEG-2 layer I, II & III
+static const guint16 mp3_bitrates[5][16] = {
+  { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+  { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+  { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+  { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+  { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 }
+};
+
+static const guint mp3_sample_rates[3] = { 44100, 48000, 32000 };
+
+gboolean
+skippy_mp3_header_parse (guint32 header, SkippyMp3Header * info)
+{
+  guint version_bits, layer_bits, bitrate_index, rate_index, padding;
+
+  if ((header & 0xffe00000) != 0xffe00000) {
+    return FALSE;
+  }
+  version_bits = (header >> 19) & 0x3;
+  layer_bits = (header >> 17) & 0x3;
+  bitrate_index = (header >> 12) & 0xf;
+  rate_index = (header >> 10) & 0x3;
+  padding = (header >> 9) & 0x1;
+  if (version_bits == 1 || layer_bits == 0 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3) {
+    return FALSE;
+  }
+
+  info->version = version_bits == 3 ? 1 : 2;
+  info->layer = 4 - layer_bits;
+  info->bitrate = 1000 * mp3_bitrates[info->version == 1 ? info->layer - 1 : (info->layer == 1 ? 3 : 4)][bitrate_index];
+  // MPEG-2.5 halves the MPEG-2 rates again
+  info->sample_rate = mp3_sample_rates[rate_index] >> (version_bits == 3 ? 0 : (version_bits == 2 ? 1 : 2));
+  info->channels = ((header >> 6) & 0x3) == 3 ? 1 : 2;
+
+  if (info->layer == 1) {
+    info->samples_per_frame = 384;
+    info->frame_size = (12 * info->bitrate / info->sample_rate + padding) * 4;
+  } else {
+    info->samples_per_frame = (info->layer == 3 && info->version != 1) ? 576 : 1152;
+    info->frame_size = info->samples_per_frame / 8 * info->bitrate / info->sample_rate + padding;
+  }
+  return TRUE;
+}
+
+gssize
+skippy_mp3_find_frame (const guint8 * data, gsize size, SkippyMp3Header * info)
+{
+  SkippyMp3Header next;
+  gsize i;
+
+  for (i = 0; i + SKIPPY_MP3_HEADER_SIZE <= size; i++) {
+    if (data[i] != 0xff || !skippy_mp3_header_parse (GST_READ_UINT32_BE (data + i), info)) {
+      continue;
+    }
+    // A sync word can as well be in the middle of some payload, the next frame has to agree
+    if (i + info->frame_size + SKIPPY_MP3_HEADER_SIZE <= size
+      && (!skippy_mp3_header_parse (GST_READ_UINT32_BE (data + i + info->frame_size), &next)
+        || next.layer != info->layer || next.sample_rate != info->sample_rate)) {
+      continue;
+    }
+    return i;
+  }
+  return -1;
+}
+
+gboolean
+skippy_mp3_frame_is_vbr (const guint8 * data, gsize size, const SkippyMp3Header * info)
+{
+  gsize side_info_size;
+
+  // The Xing header follows the side information, VBRI always is at the same place.
+  // An "Info" header is what LAME writes for constant bitrates.
+  if (info->version == 1) {
+    side_info_size = info->channels == 1 ? 17 : 32;
+  } else {
+    side_info_size = info->channels == 1 ? 9 : 17;
+  }
+  if (size >= SKIPPY_MP3_HEADER_SIZE + side_info_size + 4
+    && !memcmp (data + SKIPPY_MP3_HEADER_SIZE + side_info_size, "Xing", 4)) {
+    return TRUE;
+  }
+  return size >= SKIPPY_MP3_HEADER_SIZE + 32 + 4 && !memcmp (data + SKIPPY_MP3_HEADER_SIZE + 32, "VBRI", 4);
+}
+
+static gpointer skippy_mp3_framer_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_mp3_framer_debug, "skippyhls-mp3-framer", 0, "HLS MP3 framer");
+  return NULL;
+}
+
+SkippyMp3Framer *
+skippy_mp3_framer_new (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+  SkippyMp3Framer *framer;
+
+  g_once (&init_once, skippy_mp3_framer_init_once, NULL);
+
+  framer = g_slice_new0 (SkippyMp3Framer);
+  framer->adapter = gst_adapter_new ();
+  return framer;
+}
+
+void
+skippy_mp3_framer_free (SkippyMp3Framer * framer)
+{
+  g_object_unref (framer->adapter);
+  g_slice_free (SkippyMp3Framer, framer);
+}
+
+void
+skippy_mp3_framer_flush (SkippyMp3Framer * framer)
+{
+  gst_adapter_clear (framer->adapter);
+  framer->synced = FALSE;
+}
+
+void
+skippy_mp3_framer_push (SkippyMp3Framer * framer, GstBuffer * buffer)
+{
+  gst_adapter_push (framer->adapter, buffer);
+}
+
+gssize
+skippy_mp3_tag_size (const guint8 * data, gsize avail)
+{
+  if (avail >= 3 && !memcmp (data, "TAG", 3)) {
+    return ID3V1_SIZE;
+  }
+  if (avail >= 3 && !memcmp (data, "ID3", 3)) {
+    if (avail < ID3V2_HEADER_SIZE) {
+      return -1;
+    }
+    // Sync-safe integer, 7 bits per byte
+    return ID3V2_HEADER_SIZE + (data[9] | (data[8] << 7) | (data[7] << 14) | (data[6] << 21))
+      + ((data[5] & ID3V2_FLAG_FOOTER) ? ID3V2_HEADER_SIZE : 0);
+  }
+  return avail < 3 ? -1 : 0;
+}
+
+GstBuffer *
+skippy_mp3_framer_next_frame (SkippyMp3Framer * framer, SkippyMp3Header * info, gboolean * discont)
+{
+  const guint8 *data;
+  gsize avail;
+  gssize skip;
+
+  *discont = !framer->synced;
+
+  while ((avail = gst_adapter_available (framer->adapter)) >= SKIPPY_MP3_HEADER_SIZE) {
+    data = gst_adapter_map (framer->adapter, MIN (avail, ID3V2_HEADER_SIZE));
+
+    // Tags come in front of a fragment (timed metadata) and don't break the stream
+    skip = skippy_mp3_tag_size (data, MIN (avail, ID3V2_HEADER_SIZE));
+    if (skip != 0) {
+      gst_adapter_unmap (framer->adapter);
+      if (skip < 0 || (gsize) skip > avail) {
+        return NULL;
+      }
+      GST_DEBUG ("Skipping ID3 tag of %" G_GSSIZE_FORMAT " bytes", skip);
+      gst_adapter_flush (framer->adapter, skip);
+      continue;
+    }
+
+    if (framer->synced && skippy_mp3_header_parse (GST_READ_UINT32_BE (data), info)) {
+      gst_adapter_unmap (framer->adapter);
+    } else {
+      gst_adapter_unmap (framer->adapter);
+      // Lost track: the first frame header we find has to be confirmed by the one following it
+      data = gst_adapter_map (framer->adapter, avail);
+      skip = skippy_mp3_find_frame (data, avail, info);
+      if (skip >= 0 && skip + info->frame_size + SKIPPY_MP3_HEADER_SIZE > avail) {
+        // Can't confirm yet
+        gst_adapter_unmap (framer->adapter);
+        gst_adapter_flush (framer->adapter, skip);
+        return NULL;
+      }
+      gst_adapter_unmap (framer->adapter);
+      if (skip < 0) {
+        gst_adapter_flush (framer->adapter, avail - (SKIPPY_MP3_HEADER_SIZE - 1));
+        return NULL;
+      }
+      if (skip > 0) {
+        GST_DEBUG ("Skipping %" G_GSSIZE_FORMAT " bytes to resync", skip);
+        gst_adapter_flush (framer->adapter, skip);
+        // Might have been a tag we only see the end of, check again from here
+        *discont = TRUE;
+        framer->synced = FALSE;
+        continue;
+      }
+      framer->synced = TRUE;
+    }
+
+    if (gst_adapter_available (framer->adapter) < info->frame_size) {
+      return NULL;
+    }
+    return gst_adapter_take_buffer_fast (framer->adapter, info->frame_size);
+  }
+  return NULL;
+}
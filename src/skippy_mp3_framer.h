@@ -0,0 +1,76 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_mp3_framer.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define SKIPPY_MP3_HEADER_SIZE 4
+
+// What an MPEG audio frame header (ISO 11172-3 / 13818-3) tells us about the frame
+typedef struct
+{
+  guint version;                /* 1 for MPEG-1, 2 for MPEG-2 and MPEG-2.5 */
+  guint layer;
+  guint bitrate;                /* Bits per second */
+  guint sample_rate;
+  guint channels;
+  guint samples_per_frame;
+  gsize frame_size;             /* Bytes including the header */
+} SkippyMp3Header;
+
+// Returns FALSE if that is not a valid frame header (free format frames are not supported)
+gboolean skippy_mp3_header_parse (guint32 header, SkippyMp3Header * info);
+
+// Looks for the first frame in the data, confirmed by the header of the frame following it
+// if that is in the data too. Returns its offset or -1.
+gssize skippy_mp3_find_frame (const guint8 * data, gsize size, SkippyMp3Header * info);
+
+// Whether the frame at the start of the data carries a Xing or VBRI header, i.e the stream has a variable bitrate
+gboolean skippy_mp3_frame_is_vbr (const guint8 * data, gsize size, const SkippyMp3Header * info);
+
+// Size of the ID3 tag at the start of the data, 0 if there is none and -1 if we need more data to tell.
+// Looking at SKIPPY_MP3_TAG_HEADER_SIZE bytes is always enough to tell. Packed audio of any kind carries them.
+#define SKIPPY_MP3_TAG_HEADER_SIZE 10
+gssize skippy_mp3_tag_size (const guint8 * data, gsize avail);
+
+// Splits an MPEG audio stream into whole frames, dropping ID3 tags and garbage in between.
+// Frames reference the memory of the buffers pushed in like with the Ogg framer.
+typedef struct _SkippyMp3Framer SkippyMp3Framer;
+
+SkippyMp3Framer *skippy_mp3_framer_new (void);
+void skippy_mp3_framer_free (SkippyMp3Framer * framer);
+
+// Takes ownership of the buffer
+void skippy_mp3_framer_push (SkippyMp3Framer * framer, GstBuffer * buffer);
+
+// Returns the next complete frame or NULL if there is none yet. Discont is set when the frame doesn't
+// follow the one returned before, i.e we had to resync. Caller owns the returned buffer.
+GstBuffer *skippy_mp3_framer_next_frame (SkippyMp3Framer * framer, SkippyMp3Header * info, gboolean * discont);
+
+// Drops all pending data, for seeking
+void skippy_mp3_framer_flush (SkippyMp3Framer * framer);
+
+G_END_DECLS
@@ -0,0 +1,202 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_ogg_framer.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include <string.h>
+
+#include <gst/base/gstadapter.h>
+
+#include "skippy_ogg_framer.h"
+
+#define OGG_CAPTURE_PATTERN 0x4f676753 /* "OggS" */
+#define OGG_HEADER_SIZE 27
+
+GST_DEBUG_CATEGORY_STATIC (skippy_ogg_framer_debug);
+#define GST_CAT_DEFAULT skippy_ogg_framer_debug
+
+struct _SkippyOggFramer
+{
+  GstAdapter *adapter;
+  GstBuffer *pending;   /* Start of a packet continued on the next page */
+};
+
+static gpointer skippy_ogg_framer_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_ogg_framer_debug, "skippyhls-ogg-framer", 0, "HLS Ogg framer");
+  return NULL;
+}
+
+SkippyOggFramer *
+skippy_ogg_framer_new (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+  SkippyOggFramer *framer;
+
+  g_once (&init_once, skippy_ogg_framer_init_once, NULL);
+
+  framer = g_slice_new0 (SkippyOggFramer);
+  framer->adapter = gst_adapter_new ();
+  return framer;
+}
+
+void
+skippy_ogg_framer_free (SkippyOggFramer * framer)
+{
+  skippy_ogg_framer_flush (framer);
+  g_object_unref (framer->adapter);
+  g_slice_free (SkippyOggFramer, framer);
+}
+
+void
+skippy_ogg_framer_flush (SkippyOggFramer * framer)
+{
+  gst_adapter_clear (framer->adapter);
+  if (framer->pending) {
+    gst_buffer_unref (framer->pending);
+    framer->pending = NULL;
+  }
+}
+
+void
+skippy_ogg_framer_push (SkippyOggFramer * framer, GstBuffer * buffer)
+{
+  gst_adapter_push (framer->adapter, buffer);
+}
+
+// We don't verify the page checksum, the transport already guarantees integrity
+gboolean
+skippy_ogg_framer_next_page (SkippyOggFramer * framer, SkippyOggPage * page)
+{
+  guint8 header[OGG_HEADER_SIZE];
+  gsize avail, header_size, body_size;
+  gssize sync;
+  guint i;
+
+  memset (page, 0, sizeof (SkippyOggPage));
+
+  while ((avail = gst_adapter_available (framer->adapter)) >= OGG_HEADER_SIZE) {
+    // Find the capture pattern, everything in front of it is garbage
+    sync = gst_adapter_masked_scan_uint32 (framer->adapter, 0xffffffff, OGG_CAPTURE_PATTERN, 0, avail);
+    if (sync < 0) {
+      GST_DEBUG ("No Ogg page in %" G_GSIZE_FORMAT " bytes", avail);
+      gst_adapter_flush (framer->adapter, avail - 3);
+      return FALSE;
+    }
+    if (sync > 0) {
+      GST_DEBUG ("Skipping %" G_GSSIZE_FORMAT " bytes to resync", sync);
+      gst_adapter_flush (framer->adapter, sync);
+      continue;
+    }
+
+    gst_adapter_copy (framer->adapter, header, 0, OGG_HEADER_SIZE);
+    // Stream structure version must be 0
+    if (header[4] != 0) {
+      gst_adapter_flush (framer->adapter, 1);
+      continue;
+    }
+
+    page->n_segments = header[26];
+    header_size = OGG_HEADER_SIZE + page->n_segments;
+    if (avail < header_size) {
+      return FALSE;
+    }
+    gst_adapter_copy (framer->adapter, page->segments, OGG_HEADER_SIZE, page->n_segments);
+    body_size = 0;
+    for (i = 0; i < page->n_segments; i++) {
+      body_size += page->segments[i];
+    }
+    if (avail < header_size + body_size) {
+      return FALSE;
+    }
+
+    // Shares the memory we got pushed, possibly spread over several memories
+    page->buffer = gst_adapter_take_buffer_fast (framer->adapter, header_size + body_size);
+    page->header_size = header_size;
+    page->flags = header[5];
+    page->granulepos = (gint64) GST_READ_UINT64_LE (header + 6);
+    page->serialno = GST_READ_UINT32_LE (header + 14);
+
+    if (page->flags & SKIPPY_OGG_PAGE_CONTINUED) {
+      page->skip_continued = framer->pending == NULL;
+    } else if (framer->pending) {
+      GST_DEBUG ("Dropping unfinished packet of %" G_GSIZE_FORMAT " bytes", gst_buffer_get_size (framer->pending));
+      gst_buffer_unref (framer->pending);
+      framer->pending = NULL;
+    }
+    return TRUE;
+  }
+  return FALSE;
+}
+
+GstBuffer *
+skippy_ogg_framer_next_packet (SkippyOggFramer * framer, SkippyOggPage * page)
+{
+  GstBuffer *packet;
+  gsize start, len;
+  gboolean complete;
+  guint8 lacing;
+
+  while (page->segment < page->n_segments) {
+    start = page->offset;
+    len = 0;
+    complete = FALSE;
+    // A packet ends with the first lacing value below 255
+    while (page->segment < page->n_segments) {
+      lacing = page->segments[page->segment++];
+      len += lacing;
+      if (lacing < 255) {
+        complete = TRUE;
+        break;
+      }
+    }
+    page->offset += len;
+
+    if (page->skip_continued) {
+      page->skip_continued = FALSE;
+      continue;
+    }
+    if (!len && !framer->pending) {
+      continue;
+    }
+
+    packet = len ? gst_buffer_copy_region (page->buffer, GST_BUFFER_COPY_MEMORY, page->header_size + start, len) : gst_buffer_new ();
+    if (framer->pending) {
+      packet = gst_buffer_append (framer->pending, packet);
+      framer->pending = NULL;
+    }
+    if (!complete) {
+      framer->pending = packet;
+      return NULL;
+    }
+    return packet;
+  }
+  return NULL;
+}
+
+void
+skippy_ogg_page_clear (SkippyOggPage * page)
+{
+  if (page->buffer) {
+    gst_buffer_unref (page->buffer);
+    page->buffer = NULL;
+  }
+}
@@ -0,0 +1,74 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_ogg_framer.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Ogg page flags (header type)
+#define SKIPPY_OGG_PAGE_CONTINUED 0x01
+#define SKIPPY_OGG_PAGE_BOS 0x02
+#define SKIPPY_OGG_PAGE_EOS 0x04
+
+// Splits an Ogg bitstream into pages and packets without copying the payload:
+// pages reference the memory of the buffers pushed in, packets are sub-buffers of their page.
+// Only packets spanning several received buffers or pages end up with more than one memory.
+typedef struct _SkippyOggFramer SkippyOggFramer;
+
+typedef struct
+{
+  GstBuffer *buffer;            /* Whole page including the header */
+  gint64 granulepos;
+  guint32 serialno;
+  guint8 flags;
+  guint n_segments;
+  guint8 segments[255];         /* Lacing values */
+  gsize header_size;
+
+  /* Packet iteration */
+  guint segment;
+  gsize offset;
+  gboolean skip_continued;      /* Page continues a packet we don't have the start of */
+} SkippyOggPage;
+
+SkippyOggFramer *skippy_ogg_framer_new (void);
+void skippy_ogg_framer_free (SkippyOggFramer * framer);
+
+// Takes ownership of the buffer
+void skippy_ogg_framer_push (SkippyOggFramer * framer, GstBuffer * buffer);
+
+// Returns FALSE when there is no complete page yet. Release the page with skippy_ogg_page_clear.
+gboolean skippy_ogg_framer_next_page (SkippyOggFramer * framer, SkippyOggPage * page);
+
+// Returns the next packet completed on that page, NULL when there is none left.
+// A packet continuing on the next page is kept by the framer until it is complete. Caller owns the returned buffer.
+GstBuffer *skippy_ogg_framer_next_packet (SkippyOggFramer * framer, SkippyOggPage * page);
+
+void skippy_ogg_page_clear (SkippyOggPage * page);
+
+// Drops all pending data, for seeking
+void skippy_ogg_framer_flush (SkippyOggFramer * framer);
+
+G_END_DECLS
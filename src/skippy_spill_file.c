@@ -0,0 +1,232 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_spill_file.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <glib/gstdio.h>
+
+#include "skippy_spill_file.h"
+
+// Allocation granularity inside the file
+#define SPILL_SLOT_SIZE 4096
+
+GST_DEBUG_CATEGORY_STATIC (skippy_spill_file_debug);
+#define GST_CAT_DEFAULT skippy_spill_file_debug
+
+struct _SkippySpillFile
+{
+  gint ref_count;
+  GMutex lock;
+  guint8 *data;         /* Mapping of the whole file */
+  gsize capacity;
+  guint8 *slots;        /* Slot usage map (one byte per slot) */
+  gsize n_slots;
+  gsize cursor;         /* Next slot to try, data is mostly released in the order it was stored */
+  gsize used;           /* Bytes allocated */
+};
+
+typedef struct
+{
+  SkippySpillFile *spill;
+  gsize first_slot;
+  gsize n_slots;
+} SkippySpillRegion;
+
+static gpointer skippy_spill_file_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_spill_file_debug, "skippyhls-spill-file", 0, "HLS buffer spill file");
+  return NULL;
+}
+
+SkippySpillFile *
+skippy_spill_file_new (const gchar * dir, gsize capacity)
+{
+  static GOnce init_once = G_ONCE_INIT;
+  SkippySpillFile *spill;
+  gchar *path;
+  gint fd;
+  guint8 *data;
+
+  g_once (&init_once, skippy_spill_file_init_once, NULL);
+
+  g_return_val_if_fail (dir, NULL);
+
+  capacity = (capacity + SPILL_SLOT_SIZE - 1) / SPILL_SLOT_SIZE * SPILL_SLOT_SIZE;
+  g_return_val_if_fail (capacity > 0, NULL);
+
+  path = g_build_filename (dir, "skippyhls-spill-XXXXXX", NULL);
+  fd = g_mkstemp (path);
+  if (fd < 0) {
+    GST_ERROR ("Could not create spill file in %s", dir);
+    g_free (path);
+    return NULL;
+  }
+  // Nobody else needs to see the file, it lives as long as the mapping
+  g_unlink (path);
+
+  if (ftruncate (fd, capacity) != 0) {
+    GST_ERROR ("Could not allocate %" G_GSIZE_FORMAT " bytes for spill file %s", capacity, path);
+    close (fd);
+    g_free (path);
+    return NULL;
+  }
+
+  data = mmap (NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED) {
+    GST_ERROR ("Could not map spill file %s", path);
+    g_free (path);
+    return NULL;
+  }
+
+  GST_DEBUG ("Created spill file %s (%" G_GSIZE_FORMAT " bytes)", path, capacity);
+  g_free (path);
+
+  spill = g_slice_new0 (SkippySpillFile);
+  spill->ref_count = 1;
+  g_mutex_init (&spill->lock);
+  spill->data = data;
+  spill->capacity = capacity;
+  spill->n_slots = capacity / SPILL_SLOT_SIZE;
+  spill->slots = g_malloc0 (spill->n_slots);
+  return spill;
+}
+
+SkippySpillFile *
+skippy_spill_file_ref (SkippySpillFile * spill)
+{
+  g_atomic_int_inc (&spill->ref_count);
+  return spill;
+}
+
+void
+skippy_spill_file_unref (SkippySpillFile * spill)
+{
+  if (!g_atomic_int_dec_and_test (&spill->ref_count)) {
+    return;
+  }
+  munmap (spill->data, spill->capacity);
+  g_free (spill->slots);
+  g_mutex_clear (&spill->lock);
+  g_slice_free (SkippySpillFile, spill);
+}
+
+// Finds n contiguous free slots starting at the cursor (wrapping around once)
+// Spill lock must be held. Returns n_slots when there is no room.
+static gsize
+skippy_spill_file_find_slots_locked (SkippySpillFile * spill, gsize n)
+{
+  gsize start, i, run = 0, scanned;
+
+  if (n > spill->n_slots) {
+    return spill->n_slots;
+  }
+
+  start = spill->cursor;
+  for (scanned = 0; scanned < spill->n_slots + n; scanned++) {
+    i = (spill->cursor + scanned) % spill->n_slots;
+    // Regions can't wrap around the end of the file
+    if (i == 0) {
+      run = 0;
+      start = 0;
+    }
+    if (spill->slots[i]) {
+      run = 0;
+      start = i + 1;
+      continue;
+    }
+    if (++run == n) {
+      return start;
+    }
+  }
+  return spill->n_slots;
+}
+
+static void
+skippy_spill_file_release_region (gpointer user_data)
+{
+  SkippySpillRegion *region = user_data;
+  SkippySpillFile *spill = region->spill;
+
+  g_mutex_lock (&spill->lock);
+  memset (spill->slots + region->first_slot, 0, region->n_slots);
+  spill->used -= region->n_slots * SPILL_SLOT_SIZE;
+  g_mutex_unlock (&spill->lock);
+
+  skippy_spill_file_unref (spill);
+  g_slice_free (SkippySpillRegion, region);
+}
+
+// MT-safe
+GstBuffer *
+skippy_spill_file_store (SkippySpillFile * spill, GstBuffer * buffer)
+{
+  gsize size = gst_buffer_get_size (buffer);
+  gsize n = (size + SPILL_SLOT_SIZE - 1) / SPILL_SLOT_SIZE;
+  gsize first;
+  SkippySpillRegion *region;
+  GstBuffer *spilled;
+  guint8 *dest;
+
+  if (size == 0) {
+    return NULL;
+  }
+
+  g_mutex_lock (&spill->lock);
+  first = skippy_spill_file_find_slots_locked (spill, n);
+  if (first == spill->n_slots) {
+    g_mutex_unlock (&spill->lock);
+    GST_LOG ("Spill file is full");
+    return NULL;
+  }
+  memset (spill->slots + first, 1, n);
+  spill->used += n * SPILL_SLOT_SIZE;
+  spill->cursor = (first + n) % spill->n_slots;
+  g_mutex_unlock (&spill->lock);
+
+  dest = spill->data + first * SPILL_SLOT_SIZE;
+  gst_buffer_extract (buffer, 0, dest, size);
+
+  region = g_slice_new (SkippySpillRegion);
+  region->spill = skippy_spill_file_ref (spill);
+  region->first_slot = first;
+  region->n_slots = n;
+
+  spilled = gst_buffer_new ();
+  gst_buffer_append_memory (spilled,
+    gst_memory_new_wrapped (0, dest, n * SPILL_SLOT_SIZE, 0, size, region, skippy_spill_file_release_region));
+  gst_buffer_copy_into (spilled, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+  return spilled;
+}
+
+// MT-safe
+gsize
+skippy_spill_file_get_used (SkippySpillFile * spill)
+{
+  gsize used;
+  g_mutex_lock (&spill->lock);
+  used = spill->used;
+  g_mutex_unlock (&spill->lock);
+  return used;
+}
@@ -0,0 +1,45 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_spill_file.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Memory-mapped temporary file that buffers can be moved into. Its pages are file-backed,
+// so the kernel can write them out and reclaim them under memory pressure instead of killing us.
+// Reference counted: buffers stored in the file keep it alive.
+typedef struct _SkippySpillFile SkippySpillFile;
+
+SkippySpillFile *skippy_spill_file_new (const gchar * dir, gsize capacity);
+SkippySpillFile *skippy_spill_file_ref (SkippySpillFile * spill);
+void skippy_spill_file_unref (SkippySpillFile * spill);
+
+// Copies the buffer data into the file and returns a buffer backed by it (metadata copied over),
+// or NULL when the file is full. Does not take ownership of the passed buffer.
+GstBuffer *skippy_spill_file_store (SkippySpillFile * spill, GstBuffer * buffer);
+
+// Bytes currently allocated in the file
+gsize skippy_spill_file_get_used (SkippySpillFile * spill);
+
+G_END_DECLS
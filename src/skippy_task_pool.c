@@ -0,0 +1,149 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_task_pool.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "skippy_task_pool.h"
+
+// Loop threads, up to one per processor
+#define MAX_LOOPS 8
+// Idle pool threads we keep around for the next job
+#define MAX_UNUSED_THREADS 4
+
+GST_DEBUG_CATEGORY_STATIC (skippy_task_pool_debug);
+#define GST_CAT_DEFAULT skippy_task_pool_debug
+
+typedef struct
+{
+  GMainContext *context;
+  GMainLoop *loop;
+  GThread *thread;
+  guint users;
+} SkippyTaskPoolLoop;
+
+typedef struct
+{
+  GFunc func;
+  gpointer data;
+} SkippyTaskPoolJob;
+
+// Created once and kept for the lifetime of the process
+static GMutex pool_lock;
+static SkippyTaskPoolLoop *loops;
+static guint loop_count;
+static GThreadPool *workers;
+
+static gpointer
+skippy_task_pool_run_loop (gpointer user_data)
+{
+  SkippyTaskPoolLoop *loop = user_data;
+
+  g_main_context_push_thread_default (loop->context);
+  g_main_loop_run (loop->loop);
+  g_main_context_pop_thread_default (loop->context);
+  return NULL;
+}
+
+static void
+skippy_task_pool_run_job (gpointer job_data, gpointer user_data)
+{
+  SkippyTaskPoolJob *job = job_data;
+
+  job->func (job->data, NULL);
+  g_slice_free (SkippyTaskPoolJob, job);
+}
+
+static gpointer
+skippy_task_pool_init_once (gpointer user_data)
+{
+  guint i;
+
+  GST_DEBUG_CATEGORY_INIT (skippy_task_pool_debug, "skippyhls-task-pool", 0, "HLS shared threads");
+
+  loop_count = CLAMP (g_get_num_processors (), 1, MAX_LOOPS);
+  loops = g_new0 (SkippyTaskPoolLoop, loop_count);
+  for (i = 0; i < loop_count; i++) {
+    loops[i].context = g_main_context_new ();
+    loops[i].loop = g_main_loop_new (loops[i].context, FALSE);
+    loops[i].thread = g_thread_new ("skippyhls-loop", skippy_task_pool_run_loop, &loops[i]);
+  }
+  // Jobs block for as long as a download takes, so we don't limit the threads running at once
+  workers = g_thread_pool_new (skippy_task_pool_run_job, NULL, -1, FALSE, NULL);
+  g_thread_pool_set_max_unused_threads (MAX_UNUSED_THREADS);
+
+  GST_INFO ("Started %u loop threads", loop_count);
+  return NULL;
+}
+
+static void
+skippy_task_pool_init (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+
+  g_once (&init_once, skippy_task_pool_init_once, NULL);
+}
+
+GMainContext *
+skippy_task_pool_acquire_loop (void)
+{
+  SkippyTaskPoolLoop *loop;
+  guint i;
+
+  skippy_task_pool_init ();
+
+  g_mutex_lock (&pool_lock);
+  loop = &loops[0];
+  for (i = 1; i < loop_count; i++) {
+    if (loops[i].users < loop->users) {
+      loop = &loops[i];
+    }
+  }
+  loop->users++;
+  g_mutex_unlock (&pool_lock);
+  return g_main_context_ref (loop->context);
+}
+
+void
+skippy_task_pool_release_loop (GMainContext * context)
+{
+  guint i;
+
+  g_mutex_lock (&pool_lock);
+  for (i = 0; i < loop_count; i++) {
+    if (loops[i].context == context) {
+      loops[i].users--;
+      break;
+    }
+  }
+  g_mutex_unlock (&pool_lock);
+  g_main_context_unref (context);
+}
+
+void
+skippy_task_pool_push (GFunc func, gpointer data)
+{
+  SkippyTaskPoolJob *job = g_slice_new (SkippyTaskPoolJob);
+
+  skippy_task_pool_init ();
+
+  job->func = func;
+  job->data = data;
+  g_thread_pool_push (workers, job, NULL);
+}
@@ -0,0 +1,40 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_task_pool.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Threads shared by all demuxers of the process, so that their count doesn't grow with the number of streams:
+// a few loop threads each running a GMainContext the demuxers post their events to, and a pool blocking work
+// like fetches goes to. All functions are MT-safe.
+
+// Returns the context of the loop thread with the fewest users, to hand back with skippy_task_pool_release_loop
+GMainContext *skippy_task_pool_acquire_loop (void);
+void skippy_task_pool_release_loop (GMainContext * context);
+
+// Runs func (data) in one of the pool threads
+void skippy_task_pool_push (GFunc func, gpointer data);
+
+G_END_DECLS
@@ -0,0 +1,367 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_ts_demuxer.c:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include <string.h>
+
+#include <gst/base/gstadapter.h>
+
+#include "skippy_ts_demuxer.h"
+
+#define TS_SYNC_BYTE 0x47
+#define TS_PID_PAT 0x0000
+#define TS_TABLE_ID_PAT 0x00
+#define TS_TABLE_ID_PMT 0x02
+#define TS_PES_HEADER_SIZE 9
+
+#define TS_STREAM_TYPE_MPEG1_AUDIO 0x03
+#define TS_STREAM_TYPE_MPEG2_AUDIO 0x04
+#define TS_STREAM_TYPE_AAC_ADTS 0x0f
+#define TS_STREAM_TYPE_AAC_LATM 0x11
+
+#define TS_PTS_WRAP (G_GINT64_CONSTANT (1) << 33)
+
+GST_DEBUG_CATEGORY_STATIC (skippy_ts_demuxer_debug);
+#define GST_CAT_DEFAULT skippy_ts_demuxer_debug
+
+typedef struct
+{
+  GstBuffer *payload;
+  gint64 pts;
+} SkippyTsPes;
+
+struct _SkippyTsDemuxer
+{
+  GstAdapter *adapter;
+  gint pmt_pid;                 /* -1 until we have seen the PAT */
+  gint audio_pid;               /* -1 until we have seen the PMT */
+  guint8 stream_type;
+  gint continuity;              /* Counter of the last audio packet, -1 after a flush */
+  GByteArray *pes_data;         /* Payload of the PES packet we are collecting, NULL if none */
+  gsize pes_size;               /* Its size from the header, 0 if unbounded */
+  gint64 pes_pts;
+  gint64 pts_wrap;              /* Added to PTS values once they wrapped around */
+  gint64 last_pts;
+  GQueue done;                  /* Complete PES packets */
+};
+
+static gpointer skippy_ts_demuxer_init_once (gpointer user_data)
+{
+  GST_DEBUG_CATEGORY_INIT (skippy_ts_demuxer_debug, "skippyhls-ts-demuxer", 0, "HLS MPEG-TS audio demuxer");
+  return NULL;
+}
+
+SkippyTsDemuxer *
+skippy_ts_demuxer_new (void)
+{
+  static GOnce init_once = G_ONCE_INIT;
+  SkippyTsDemuxer *demuxer;
+
+  g_once (&init_once, skippy_ts_demuxer_init_once, NULL);
+
+  demuxer = g_slice_new0 (SkippyTsDemuxer);
+  demuxer->adapter = gst_adapter_new ();
+  g_queue_init (&demuxer->done);
+  skippy_ts_demuxer_reset (demuxer);
+  return demuxer;
+}
+
+static void
+skippy_ts_pes_free (SkippyTsPes * pes)
+{
+  gst_buffer_unref (pes->payload);
+  g_slice_free (SkippyTsPes, pes);
+}
+
+void
+skippy_ts_demuxer_free (SkippyTsDemuxer * demuxer)
+{
+  skippy_ts_demuxer_flush (demuxer);
+  g_object_unref (demuxer->adapter);
+  g_slice_free (SkippyTsDemuxer, demuxer);
+}
+
+void
+skippy_ts_demuxer_flush (SkippyTsDemuxer * demuxer)
+{
+  gst_adapter_clear (demuxer->adapter);
+  if (demuxer->pes_data) {
+    g_byte_array_unref (demuxer->pes_data);
+    demuxer->pes_data = NULL;
+  }
+  g_queue_foreach (&demuxer->done, (GFunc) skippy_ts_pes_free, NULL);
+  g_queue_clear (&demuxer->done);
+  demuxer->continuity = -1;
+  // Wherever we land, time stamps don't relate to the ones before
+  demuxer->pts_wrap = 0;
+  demuxer->last_pts = -1;
+}
+
+void
+skippy_ts_demuxer_reset (SkippyTsDemuxer * demuxer)
+{
+  skippy_ts_demuxer_flush (demuxer);
+  demuxer->pmt_pid = -1;
+  demuxer->audio_pid = -1;
+  demuxer->stream_type = 0;
+}
+
+GstCaps *
+skippy_ts_demuxer_get_caps (SkippyTsDemuxer * demuxer)
+{
+  switch (demuxer->stream_type) {
+  case TS_STREAM_TYPE_MPEG1_AUDIO:
+  case TS_STREAM_TYPE_MPEG2_AUDIO:
+    return gst_caps_from_string ("audio/mpeg, mpegversion=(int)1");
+  case TS_STREAM_TYPE_AAC_ADTS:
+    return gst_caps_from_string ("audio/mpeg, mpegversion=(int)4, stream-format=(string)adts");
+  case TS_STREAM_TYPE_AAC_LATM:
+    return gst_caps_from_string ("audio/mpeg, mpegversion=(int)4, stream-format=(string)loas");
+  default:
+    return NULL;
+  }
+}
+
+// Returns the section a PSI payload starts with, NULL if it isn't complete in the packet
+static const guint8 *
+skippy_ts_demuxer_get_section (const guint8 * payload, gsize size, guint8 table_id, gsize * section_size)
+{
+  const guint8 *section;
+  gsize pointer;
+
+  if (size < 1) {
+    return NULL;
+  }
+  pointer = payload[0];
+  if (1 + pointer + 3 > size) {
+    return NULL;
+  }
+  section = payload + 1 + pointer;
+  size -= 1 + pointer;
+  // We don't need the CRC
+  *section_size = 3 + (((section[1] & 0x0f) << 8) | section[2]);
+  if (section[0] != table_id || *section_size > size || *section_size < 12 + 4) {
+    return NULL;
+  }
+  *section_size -= 4;
+  return section;
+}
+
+static void
+skippy_ts_demuxer_parse_pat (SkippyTsDemuxer * demuxer, const guint8 * payload, gsize size)
+{
+  const guint8 *section;
+  gsize section_size, i;
+
+  if (!(section = skippy_ts_demuxer_get_section (payload, size, TS_TABLE_ID_PAT, &section_size))) {
+    return;
+  }
+  for (i = 8; i + 4 <= section_size; i += 4) {
+    // Program 0 is the network information
+    if (section[i] || section[i + 1]) {
+      demuxer->pmt_pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+      GST_DEBUG ("PMT on PID %d", demuxer->pmt_pid);
+      return;
+    }
+  }
+}
+
+static void
+skippy_ts_demuxer_parse_pmt (SkippyTsDemuxer * demuxer, const guint8 * payload, gsize size)
+{
+  const guint8 *section;
+  gsize section_size, i;
+  guint8 stream_type;
+
+  if (!(section = skippy_ts_demuxer_get_section (payload, size, TS_TABLE_ID_PMT, &section_size))) {
+    return;
+  }
+  // Skip program info descriptors, then loop over the elementary streams
+  for (i = 12 + (((section[10] & 0x0f) << 8) | section[11]); i + 5 <= section_size;
+    i += 5 + (((section[i + 3] & 0x0f) << 8) | section[i + 4])) {
+    stream_type = section[i];
+    if (stream_type == TS_STREAM_TYPE_MPEG1_AUDIO || stream_type == TS_STREAM_TYPE_MPEG2_AUDIO
+      || stream_type == TS_STREAM_TYPE_AAC_ADTS || stream_type == TS_STREAM_TYPE_AAC_LATM) {
+      demuxer->audio_pid = ((section[i + 1] & 0x1f) << 8) | section[i + 2];
+      demuxer->stream_type = stream_type;
+      GST_DEBUG ("Audio stream type 0x%02x on PID %d", stream_type, demuxer->audio_pid);
+      return;
+    }
+  }
+  GST_WARNING ("No audio stream we know in PMT");
+}
+
+static void
+skippy_ts_demuxer_finish_pes (SkippyTsDemuxer * demuxer)
+{
+  SkippyTsPes *pes;
+  gsize size;
+
+  if (!demuxer->pes_data) {
+    return;
+  }
+  if (demuxer->pes_data->len) {
+    pes = g_slice_new (SkippyTsPes);
+    size = demuxer->pes_data->len;
+    pes->payload = gst_buffer_new_wrapped (g_byte_array_free (demuxer->pes_data, FALSE), size);
+    pes->pts = demuxer->pes_pts;
+    g_queue_push_tail (&demuxer->done, pes);
+  } else {
+    g_byte_array_unref (demuxer->pes_data);
+  }
+  demuxer->pes_data = NULL;
+}
+
+// 33 bits spread over 5 bytes with marker bits in between
+static gint64
+skippy_ts_demuxer_read_timestamp (const guint8 * data)
+{
+  return ((gint64) (data[0] & 0x0e) << 29) | (data[1] << 22) | ((data[2] & 0xfe) << 14)
+    | (data[3] << 7) | (data[4] >> 1);
+}
+
+static void
+skippy_ts_demuxer_start_pes (SkippyTsDemuxer * demuxer, const guint8 * payload, gsize size)
+{
+  gsize header_size, pes_size;
+  gint64 pts = -1;
+
+  skippy_ts_demuxer_finish_pes (demuxer);
+
+  if (size < TS_PES_HEADER_SIZE || payload[0] || payload[1] || payload[2] != 0x01) {
+    GST_WARNING ("Invalid PES header");
+    return;
+  }
+  pes_size = (payload[4] << 8) | payload[5];
+  header_size = TS_PES_HEADER_SIZE + payload[8];
+  if (header_size > size) {
+    GST_WARNING ("PES header doesn't fit in packet");
+    return;
+  }
+  if ((payload[7] & 0x80) && payload[8] >= 5) {
+    pts = skippy_ts_demuxer_read_timestamp (payload + TS_PES_HEADER_SIZE) + demuxer->pts_wrap;
+    if (demuxer->last_pts >= 0 && pts + TS_PTS_WRAP / 2 < demuxer->last_pts) {
+      demuxer->pts_wrap += TS_PTS_WRAP;
+      pts += TS_PTS_WRAP;
+    }
+    demuxer->last_pts = pts;
+  }
+
+  demuxer->pes_data = g_byte_array_new ();
+  // The size counts from after the size field
+  demuxer->pes_size = pes_size > header_size - 6 ? pes_size - (header_size - 6) : 0;
+  demuxer->pes_pts = pts;
+  g_byte_array_append (demuxer->pes_data, payload + header_size, size - header_size);
+}
+
+static void
+skippy_ts_demuxer_parse_packet (SkippyTsDemuxer * demuxer, const guint8 * packet)
+{
+  gboolean unit_start = packet[1] & 0x40;
+  gint pid = ((packet[1] & 0x1f) << 8) | packet[2];
+  guint adaptation = (packet[3] >> 4) & 0x3;
+  gint continuity = packet[3] & 0x0f;
+  gsize offset = 4;
+
+  if (adaptation & 0x2) {
+    offset += 1 + packet[4];
+  }
+  if (!(adaptation & 0x1) || offset >= SKIPPY_TS_PACKET_SIZE) {
+    return;
+  }
+
+  if (pid == TS_PID_PAT && unit_start) {
+    skippy_ts_demuxer_parse_pat (demuxer, packet + offset, SKIPPY_TS_PACKET_SIZE - offset);
+  } else if (pid == demuxer->pmt_pid && unit_start && demuxer->audio_pid < 0) {
+    skippy_ts_demuxer_parse_pmt (demuxer, packet + offset, SKIPPY_TS_PACKET_SIZE - offset);
+  } else if (pid == demuxer->audio_pid) {
+    if (demuxer->continuity >= 0 && continuity == demuxer->continuity) {
+      // Duplicate packet
+      return;
+    }
+    if (demuxer->continuity >= 0 && continuity != ((demuxer->continuity + 1) & 0x0f) && demuxer->pes_data) {
+      GST_WARNING ("Lost audio packets, dropping PES packet");
+      g_byte_array_unref (demuxer->pes_data);
+      demuxer->pes_data = NULL;
+    }
+    demuxer->continuity = continuity;
+
+    if (unit_start) {
+      skippy_ts_demuxer_start_pes (demuxer, packet + offset, SKIPPY_TS_PACKET_SIZE - offset);
+    } else if (demuxer->pes_data) {
+      g_byte_array_append (demuxer->pes_data, packet + offset, SKIPPY_TS_PACKET_SIZE - offset);
+    }
+    if (demuxer->pes_data && demuxer->pes_size && demuxer->pes_data->len >= demuxer->pes_size) {
+      g_byte_array_set_size (demuxer->pes_data, demuxer->pes_size);
+      skippy_ts_demuxer_finish_pes (demuxer);
+    }
+  }
+}
+
+void
+skippy_ts_demuxer_push (SkippyTsDemuxer * demuxer, GstBuffer * buffer)
+{
+  guint8 packet[SKIPPY_TS_PACKET_SIZE];
+  gsize avail;
+  const guint8 *data;
+  gsize skip;
+
+  gst_adapter_push (demuxer->adapter, buffer);
+
+  while ((avail = gst_adapter_available (demuxer->adapter)) >= SKIPPY_TS_PACKET_SIZE) {
+    // Resync on a sync byte followed by another one a packet later, if we have that much
+    avail = MIN (avail, 2 * SKIPPY_TS_PACKET_SIZE);
+    data = gst_adapter_map (demuxer->adapter, avail);
+    for (skip = 0; skip + SKIPPY_TS_PACKET_SIZE <= avail; skip++) {
+      if (data[skip] == TS_SYNC_BYTE && (skip + SKIPPY_TS_PACKET_SIZE >= avail
+        || data[skip + SKIPPY_TS_PACKET_SIZE] == TS_SYNC_BYTE)) {
+        break;
+      }
+    }
+    if (!skip) {
+      memcpy (packet, data + skip, SKIPPY_TS_PACKET_SIZE);
+    }
+    gst_adapter_unmap (demuxer->adapter);
+    if (skip) {
+      GST_DEBUG ("Skipping %" G_GSIZE_FORMAT " bytes to next packet", skip);
+      gst_adapter_flush (demuxer->adapter, skip);
+      continue;
+    }
+    gst_adapter_flush (demuxer->adapter, SKIPPY_TS_PACKET_SIZE);
+    skippy_ts_demuxer_parse_packet (demuxer, packet);
+  }
+}
+
+GstBuffer *
+skippy_ts_demuxer_next_pes (SkippyTsDemuxer * demuxer, gint64 * pts)
+{
+  SkippyTsPes *pes = g_queue_pop_head (&demuxer->done);
+  GstBuffer *payload;
+
+  if (!pes) {
+    return NULL;
+  }
+  payload = pes->payload;
+  *pts = pes->pts;
+  g_slice_free (SkippyTsPes, pes);
+  return payload;
+}
@@ -0,0 +1,54 @@
+/* skippyHLS
+ *
+ * Copyright (C) 2015, SoundCloud Ltd. (http://soundcloud.com)
+ *
+ * skippy_ts_demuxer.h:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#pragma once
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define SKIPPY_TS_PACKET_SIZE 188
+#define SKIPPY_TS_CLOCK_RATE 90000
+
+// Pulls the elementary stream of the first audio program out of an MPEG transport stream (ISO 13818-1).
+// Only what audio-only HLS needs: PAT and PMT sections fitting in one packet, a single AAC or MPEG audio PID.
+typedef struct _SkippyTsDemuxer SkippyTsDemuxer;
+
+SkippyTsDemuxer *skippy_ts_demuxer_new (void);
+void skippy_ts_demuxer_free (SkippyTsDemuxer * demuxer);
+
+// Takes ownership of the buffer
+void skippy_ts_demuxer_push (SkippyTsDemuxer * demuxer, GstBuffer * buffer);
+
+// Returns the payload of the next complete audio PES packet or NULL if there is none yet.
+// PTS is in 90 kHz ticks, unwrapped over the 33 bits, or -1 if the packet has none. Caller owns the returned buffer.
+GstBuffer *skippy_ts_demuxer_next_pes (SkippyTsDemuxer * demuxer, gint64 * pts);
+
+// Caps of the audio stream as announced by the PMT, NULL until we have seen it. Caller owns the returned caps.
+GstCaps *skippy_ts_demuxer_get_caps (SkippyTsDemuxer * demuxer);
+
+// Drops all pending data, for seeking. The program we found stays.
+void skippy_ts_demuxer_flush (SkippyTsDemuxer * demuxer);
+
+// Also forgets the program, for a new stream
+void skippy_ts_demuxer_reset (SkippyTsDemuxer * demuxer);
+
+G_END_DECLS
@@ -29,6 +29,10 @@
 
 #include "skippy_fragment.h"
 #include "skippy_uridownloader.h"
+#include "skippy_aes.h"
+#include "skippy_bandwidth_estimator.h"
+#include "skippy_host_selector.h"
+#include "skippy_task_pool.h"
 
 #include <string.h>
 
@@ -37,6 +41,17 @@
 #define GST_CAT_DEFAULT skippy_uridownloader_debug
 GST_DEBUG_CATEGORY (skippy_uridownloader_debug);
 
+// Hedging goes by the times to first byte of that many recent requests, once we have seen enough of them
+#define HEDGE_TTFB_HISTORY 32
+#define HEDGE_MIN_SAMPLES 8
+
+typedef enum {
+  SKIPPY_URI_DOWNLOADER_HEDGE_NONE,
+  SKIPPY_URI_DOWNLOADER_HEDGE_PENDING,  /* Sent, neither responded yet */
+  SKIPPY_URI_DOWNLOADER_HEDGE_WON,      /* Responded first, we go on with it */
+  SKIPPY_URI_DOWNLOADER_HEDGE_LOST,     /* Our own request responded first */
+} SkippyUriDownloaderHedgeState;
+
 G_DEFINE_TYPE (SkippyUriDownloader, skippy_uri_downloader, GST_TYPE_BIN);
 
 #define SKIPPY_URI_DOWNLOADER_GET_PRIVATE(obj)  \
@@ -62,13 +77,64 @@ struct _SkippyUriDownloaderPrivate
   gboolean fetching;
   gboolean got_segment;
   gboolean download_canceled;
+  gboolean decrypting;
+
+  SkippyAesDecryptor decryptor;
 
   gsize bytes_loaded;
   gsize bytes_total;
 
   gulong urisrcpad_probe_id;
+
+  // Parallel range requests
+  guint parallel_ranges;
+  gsize parallel_min_size;
+  GPtrArray *range_downloaders; /* Our children loading the ranges after the first one */
+  GPtrArray *ranges;            /* SkippyUriDownloaderRequest of the ongoing fetch, NULL if not split */
+  gsize split_offset;           /* Where our own request stops when split */
+  gchar *referer;               /* Of the ongoing fetch, for the range requests */
+  gboolean allow_cache;
+
+  // Stall watchdog, window counters are shared with the streaming thread under the object lock
+  guint stall_min_rate;         /* Bytes per second, 0 for no watchdog */
+  GstClockTime stall_window;
+  gint64 window_start;          /* Monotonic time in microseconds */
+  gsize window_bytes;
+  gboolean stalled;
+
+  // Hedged requests, shared with the streaming threads of both requests under our object lock
+  guint hedge_percentile;       /* Of recent times to first byte after which we send a second request, 0 for none */
+  gchar *hedge_host;            /* Authority the second request goes to, NULL for ours */
+  SkippyUriDownloader *hedge_downloader; /* Our child sending the second request */
+  SkippyUriDownloader *hedge_parent;     /* Set on that child */
+  GPtrArray *hedge;             /* SkippyUriDownloaderRequest of the ongoing fetch, NULL if none */
+  SkippyUriDownloaderHedgeState hedge_state;
+  GstClockTime hedge_delay;     /* For the ongoing fetch */
+  gint64 request_start;         /* Monotonic time in microseconds */
+  GstClockTime ttfbs[HEDGE_TTFB_HISTORY];
+  guint ttfb_count;
+  guint request_count;
+  guint hedge_count;
+  guint hedge_win_count;
+
+  SkippyBandwidthEstimator *bandwidth; /* Shared with our children */
+  gboolean measuring;           /* Began a transfer on it */
 };
 
+// A request one of our children sends for us in a shared pool thread: a byte range after the first one or a hedge
+typedef struct
+{
+  SkippyUriDownloader *downloader;
+  SkippyFragment *fragment;
+  gchar *referer;
+  gboolean allow_cache;
+  GMutex lock;
+  GCond cond;
+  gboolean done;                /* The pool thread is through with it, guarded by the lock */
+  SkippyUriDownloaderFetchReturn ret;
+  GError *err;
+} SkippyUriDownloaderRequest;
+
 static GstStaticPadTemplate srcpadtemplate = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
@@ -131,7 +197,34 @@ skippy_uri_downloader_init (SkippyUriDownloader * downloader)
   downloader->priv->set_uri = FALSE;
   downloader->priv->download_canceled = FALSE;
   downloader->priv->previous_was_interrupted = FALSE;
+  downloader->priv->decrypting = FALSE;
   downloader->priv->urisrcpad_probe_id = 0;
+  downloader->priv->parallel_ranges = 0;
+  downloader->priv->parallel_min_size = 0;
+  downloader->priv->range_downloaders = g_ptr_array_new ();
+  downloader->priv->ranges = NULL;
+  downloader->priv->split_offset = 0;
+  downloader->priv->referer = NULL;
+  downloader->priv->allow_cache = TRUE;
+  downloader->priv->stall_min_rate = 0;
+  downloader->priv->stall_window = GST_CLOCK_TIME_NONE;
+  downloader->priv->window_start = 0;
+  downloader->priv->window_bytes = 0;
+  downloader->priv->stalled = FALSE;
+  downloader->priv->hedge_percentile = 0;
+  downloader->priv->hedge_host = NULL;
+  downloader->priv->hedge_downloader = NULL;
+  downloader->priv->hedge_parent = NULL;
+  downloader->priv->hedge = NULL;
+  downloader->priv->hedge_state = SKIPPY_URI_DOWNLOADER_HEDGE_NONE;
+  downloader->priv->hedge_delay = GST_CLOCK_TIME_NONE;
+  downloader->priv->request_start = 0;
+  downloader->priv->ttfb_count = 0;
+  downloader->priv->request_count = 0;
+  downloader->priv->hedge_count = 0;
+  downloader->priv->hedge_win_count = 0;
+  downloader->priv->bandwidth = skippy_bandwidth_estimator_new ();
+  downloader->priv->measuring = FALSE;
 
   // Add typefind
   downloader->priv->typefind = gst_element_factory_make ("typefind", NULL);
@@ -159,6 +252,7 @@ skippy_uri_downloader_init (SkippyUriDownloader * downloader)
 // This will compare two URIs by their string representation without the query part
 // We use this to compare URIs without considering time or user-auth-dependent CDN tokens in order to enable
 // caching or resuming for either resource whenever it is attempted to download it.
+// The host is left out as well, mirrors serve the same resources so a download can resume on another one.
 static gboolean
 compare_uri_resource_path (gchar* uri1, gchar *uri2)
 {
@@ -170,6 +264,10 @@ compare_uri_resource_path (gchar* uri1, gchar *uri2)
   next_uri = gst_uri_from_string (uri2);
   gst_uri_set_query_string (prev_uri, "");
   gst_uri_set_query_string (next_uri, "");
+  gst_uri_set_host (prev_uri, "");
+  gst_uri_set_host (next_uri, "");
+  gst_uri_set_port (prev_uri, GST_URI_NO_PORT);
+  gst_uri_set_port (next_uri, GST_URI_NO_PORT);
   prev_uri_no_query = gst_uri_to_string (prev_uri);
   next_uri_no_query = gst_uri_to_string (next_uri);
 
@@ -226,6 +324,8 @@ skippy_uri_downloader_reset (SkippyUriDownloader * downloader, SkippyFragment* n
 
   downloader->priv->got_segment = FALSE;
   downloader->priv->flushing = FALSE;
+  downloader->priv->split_offset = 0;
+  downloader->priv->stalled = FALSE;
 
   // Clear error when present
   g_clear_error (&downloader->priv->err);
@@ -301,6 +401,11 @@ skippy_uri_downloader_finalize (GObject * object)
   SkippyUriDownloader *downloader = SKIPPY_URI_DOWNLOADER (object);
   g_cond_clear (&downloader->priv->cond);
   g_mutex_clear (&downloader->priv->download_lock);
+  // The range downloaders themselves are our children
+  g_ptr_array_free (downloader->priv->range_downloaders, TRUE);
+  g_free (downloader->priv->referer);
+  g_free (downloader->priv->hedge_host);
+  skippy_bandwidth_estimator_unref (downloader->priv->bandwidth);
   G_OBJECT_CLASS (skippy_uri_downloader_parent_class)->finalize (object);
 }
 
@@ -315,14 +420,152 @@ skippy_uri_downloader_prepare (SkippyUriDownloader * downloader, gchar* uri)
   g_mutex_unlock (&downloader->priv->download_lock);
 }
 
+// Our children measure into our estimate, the link is the same and ranges load at the same time
+// as our own request. Only called on children that never fetched yet.
+static void
+skippy_uri_downloader_share_bandwidth (SkippyUriDownloader * downloader, SkippyUriDownloader * child)
+{
+  skippy_bandwidth_estimator_unref (child->priv->bandwidth);
+  child->priv->bandwidth = skippy_bandwidth_estimator_ref (downloader->priv->bandwidth);
+}
+
+// Setter for parallel range requests - can not be called concurrently with itself.
+// Takes effect with the next fragment we get the size of.
+//
+// MT-safe
+void
+skippy_uri_downloader_set_parallel_ranges (SkippyUriDownloader * downloader, guint count, gsize min_range_size)
+{
+  SkippyUriDownloader *range_downloader;
+
+  // Ranges load into their own buffer, one unlinked downloader each
+  while (count > 1 && downloader->priv->range_downloaders->len < count - 1) {
+    range_downloader = skippy_uri_downloader_new (FALSE);
+    skippy_uri_downloader_share_bandwidth (downloader, range_downloader);
+    gst_bin_add (GST_BIN (downloader), GST_ELEMENT (range_downloader));
+    gst_element_sync_state_with_parent (GST_ELEMENT (range_downloader));
+    GST_OBJECT_LOCK (downloader);
+    g_ptr_array_add (downloader->priv->range_downloaders, range_downloader);
+    GST_OBJECT_UNLOCK (downloader);
+  }
+  GST_OBJECT_LOCK (downloader);
+  downloader->priv->parallel_ranges = count;
+  downloader->priv->parallel_min_size = min_range_size;
+  GST_OBJECT_UNLOCK (downloader);
+}
+
+// Setter for the stall watchdog, takes effect with the next fetch
+//
+// MT-safe
+void
+skippy_uri_downloader_set_stall_watchdog (SkippyUriDownloader * downloader, guint min_rate, GstClockTime window)
+{
+  g_return_if_fail (min_rate == 0 || GST_CLOCK_TIME_IS_VALID (window));
+
+  GST_OBJECT_LOCK (downloader);
+  downloader->priv->stall_min_rate = min_rate;
+  downloader->priv->stall_window = window;
+  GST_OBJECT_UNLOCK (downloader);
+}
+
+// Setter for hedged requests - can not be called concurrently with itself.
+// Takes effect with the next fetch.
+//
+// MT-safe
+void
+skippy_uri_downloader_set_hedging (SkippyUriDownloader * downloader, guint percentile, const gchar * alternate_host)
+{
+  SkippyUriDownloader *hedge_downloader;
+
+  g_return_if_fail (percentile <= 100);
+
+  if (percentile && !downloader->priv->hedge_downloader) {
+    hedge_downloader = skippy_uri_downloader_new (FALSE);
+    hedge_downloader->priv->hedge_parent = downloader;
+    skippy_uri_downloader_share_bandwidth (downloader, hedge_downloader);
+    gst_bin_add (GST_BIN (downloader), GST_ELEMENT (hedge_downloader));
+    gst_element_sync_state_with_parent (GST_ELEMENT (hedge_downloader));
+    GST_OBJECT_LOCK (downloader);
+    downloader->priv->hedge_downloader = hedge_downloader;
+    GST_OBJECT_UNLOCK (downloader);
+  }
+  GST_OBJECT_LOCK (downloader);
+  downloader->priv->hedge_percentile = percentile;
+  GST_OBJECT_UNLOCK (downloader);
+  skippy_uri_downloader_set_hedge_host (downloader, alternate_host);
+}
+
+// Setter for the host hedge requests go to. Takes effect with the next hedge request.
+//
+// MT-safe
+void
+skippy_uri_downloader_set_hedge_host (SkippyUriDownloader * downloader, const gchar * alternate_host)
+{
+  GST_OBJECT_LOCK (downloader);
+  g_free (downloader->priv->hedge_host);
+  downloader->priv->hedge_host = g_strdup (alternate_host);
+  GST_OBJECT_UNLOCK (downloader);
+}
+
+// Counts of fetches while hedging was on, of how many got hedged and of how many the hedge request won
+//
+// MT-safe
+void
+skippy_uri_downloader_get_hedge_stats (SkippyUriDownloader * downloader, guint * requests, guint * hedged, guint * won)
+{
+  GST_OBJECT_LOCK (downloader);
+  *requests = downloader->priv->request_count;
+  *hedged = downloader->priv->hedge_count;
+  *won = downloader->priv->hedge_win_count;
+  GST_OBJECT_UNLOCK (downloader);
+}
+
+// Estimated bandwidth of the link in bits per second as measured on what we fetched, 0 if unknown yet
+//
+// MT-safe
+guint64
+skippy_uri_downloader_get_bandwidth (SkippyUriDownloader * downloader)
+{
+  return skippy_bandwidth_estimator_get (downloader->priv->bandwidth);
+}
+
+// Forces the caps typefind puts on what we fetch - can not be called concurrently with fetch & prepare
+//
+// MT-safe
+void
+skippy_uri_downloader_set_caps (SkippyUriDownloader * downloader, GstCaps * caps)
+{
+  GstCaps *current = NULL;
+  gboolean unchanged;
+
+  g_object_get (downloader->priv->typefind, "force-caps", &current, NULL);
+  unchanged = current == caps || (current && caps && gst_caps_is_equal (current, caps));
+  if (current) {
+    gst_caps_unref (current);
+  }
+  if (unchanged) {
+    return;
+  }
+
+  GST_DEBUG_OBJECT (downloader, "Forcing caps: %" GST_PTR_FORMAT, caps);
+  g_mutex_lock (&downloader->priv->download_lock);
+  // Typefind only looks at them when its pads get activated
+  gst_element_set_state (downloader->priv->typefind, GST_STATE_READY);
+  g_object_set (downloader->priv->typefind, "force-caps", caps, NULL);
+  gst_element_sync_state_with_parent (downloader->priv->typefind);
+  g_mutex_unlock (&downloader->priv->download_lock);
+}
+
 // Getter for buffer - can not be called concurrently with fetch & prepare
 //
 // MT-safe
 GstBuffer* skippy_uri_downloader_get_buffer (SkippyUriDownloader *downloader)
 {
-  GstBuffer* buf;
+  GstBuffer* buf = NULL;
   g_mutex_lock (&downloader->priv->download_lock);
-  buf = gst_buffer_ref(downloader->priv->buffer);
+  if (downloader->priv->buffer) {
+    buf = gst_buffer_ref(downloader->priv->buffer);
+  }
   g_mutex_unlock (&downloader->priv->download_lock);
   return buf;
 }
@@ -364,6 +607,71 @@ skippy_uri_downloader_handle_bytes_received (SkippyUriDownloader* downloader,
   );
 }
 
+// Posts the current bandwidth estimate on the bus: Called by URL source element streaming thread.
+static void
+skippy_uri_downloader_post_bandwidth (SkippyUriDownloader* downloader)
+{
+  guint64 bandwidth = skippy_bandwidth_estimator_get (downloader->priv->bandwidth);
+
+  GST_DEBUG_OBJECT (downloader, "Estimated bandwidth: %" G_GUINT64_FORMAT " bits/s", bandwidth);
+
+  gst_element_post_message (GST_ELEMENT (downloader),
+     gst_message_new_element (GST_OBJECT(downloader),
+       gst_structure_new (SKIPPY_HLS_DEMUX_BANDWIDTH_MSG_NAME,
+         "bandwidth-estimate", G_TYPE_UINT64, bandwidth,
+         NULL)
+     )
+  );
+}
+
+// Decrypts a chunk of downloaded data. Takes ownership of the passed buffer and returns the plaintext
+// buffer (might be empty as the decryptor holds back the last block until more data arrives).
+// Download mutex is locked when this is called (only while fetch executes).
+static GstBuffer*
+skippy_uri_downloader_decrypt_buffer (SkippyUriDownloader* downloader, GstBuffer* buf, gboolean is_last)
+{
+  GstMapInfo in_map, out_map;
+  GstBuffer* out = gst_buffer_new_allocate (NULL, gst_buffer_get_size (buf) + 2 * SKIPPY_AES_BLOCK_SIZE, NULL);
+  gsize out_len;
+
+  gst_buffer_map (buf, &in_map, GST_MAP_READ);
+  gst_buffer_map (out, &out_map, GST_MAP_WRITE);
+  out_len = skippy_aes_decryptor_process (&downloader->priv->decryptor, in_map.data, in_map.size, out_map.data, is_last);
+  gst_buffer_unmap (out, &out_map);
+  gst_buffer_unmap (buf, &in_map);
+
+  gst_buffer_set_size (out, out_len);
+  gst_buffer_copy_into (out, buf, GST_BUFFER_COPY_METADATA, 0, -1);
+  gst_buffer_unref (buf);
+
+  if (is_last) {
+    downloader->priv->decrypting = FALSE;
+  }
+  return out;
+}
+
+// Pushes out the last plaintext block when the download ended without us knowing the total size upfront
+// Download mutex is locked when this is called (only while fetch executes).
+static void
+skippy_uri_downloader_flush_decryptor (SkippyUriDownloader* downloader)
+{
+  GstBuffer* tail = skippy_uri_downloader_decrypt_buffer (downloader, gst_buffer_new (), TRUE);
+
+  if (gst_buffer_get_size (tail) == 0) {
+    gst_buffer_unref (tail);
+    return;
+  }
+
+  if (gst_pad_is_linked (downloader->priv->srcpad)) {
+    gst_pad_push (downloader->priv->srcpad, tail);
+  } else {
+    if (downloader->priv->buffer == NULL) {
+      downloader->priv->buffer = gst_buffer_new ();
+    }
+    downloader->priv->buffer = gst_buffer_append (downloader->priv->buffer, tail);
+  }
+}
+
 // Handles an EOS from the data source thread. Aquires the object lock and signals the condition to unblock fetch function.
 // Download mutex is locked when this is called (only while fetch executes).
 static void
@@ -376,6 +684,10 @@ skippy_uri_downloader_handle_eos (SkippyUriDownloader* downloader)
 
     downloader->priv->fragment->download_stop_time = gst_util_get_timestamp ();
 
+    if (downloader->priv->decrypting) {
+      skippy_uri_downloader_flush_decryptor (downloader);
+    }
+
     // FIXME: seems when data comes from filesystem caches we can get less data than the segment advertises (encryption padding?)
     // Make sure we send a 100% callback and have a valid byte number
     if (downloader->priv->bytes_loaded != downloader->priv->bytes_total) {
@@ -390,6 +702,313 @@ skippy_uri_downloader_handle_eos (SkippyUriDownloader* downloader)
   }
 }
 
+// Cancels whatever our children load for us. Expects our object lock to be held.
+static void
+skippy_uri_downloader_cancel_requests_locked (GPtrArray * requests)
+{
+  SkippyUriDownloaderRequest *request;
+  guint i;
+
+  for (i = 0; requests && i < requests->len; i++) {
+    request = g_ptr_array_index (requests, i);
+    request->fragment->cancelled = TRUE;
+    skippy_uri_downloader_cancel (request->downloader, FALSE);
+  }
+}
+
+static void
+skippy_uri_downloader_request_job (gpointer data, gpointer user_data)
+{
+  SkippyUriDownloaderRequest *request = data;
+
+  request->ret = skippy_uri_downloader_fetch_fragment (request->downloader, request->fragment,
+    request->referer, FALSE, FALSE, request->allow_cache, &request->err);
+
+  g_mutex_lock (&request->lock);
+  request->done = TRUE;
+  g_cond_signal (&request->cond);
+  g_mutex_unlock (&request->lock);
+}
+
+// Waits for the pool thread to be through with the request
+static void
+skippy_uri_downloader_request_join (SkippyUriDownloaderRequest *request)
+{
+  g_mutex_lock (&request->lock);
+  while (!request->done) {
+    g_cond_wait (&request->cond, &request->lock);
+  }
+  g_mutex_unlock (&request->lock);
+}
+
+// Has one of our children load the given URI and byte range in a pool thread. Expects the object lock to be held.
+static SkippyUriDownloaderRequest*
+skippy_uri_downloader_request_new (SkippyUriDownloader* downloader, SkippyUriDownloader* child, const gchar* uri,
+  gint64 range_start, gint64 range_end)
+{
+  SkippyUriDownloaderRequest *request = g_slice_new0 (SkippyUriDownloaderRequest);
+  SkippyFragment *fragment = downloader->priv->fragment;
+
+  request->downloader = child;
+  request->fragment = skippy_fragment_new (uri);
+  request->fragment->start_time = fragment->start_time;
+  request->fragment->stop_time = fragment->stop_time;
+  request->fragment->range_start = range_start;
+  request->fragment->range_end = range_end;
+  request->referer = g_strdup (downloader->priv->referer);
+  request->allow_cache = downloader->priv->allow_cache;
+  request->ret = SKIPPY_URI_DOWNLOADER_VOID;
+  g_mutex_init (&request->lock);
+  g_cond_init (&request->cond);
+  skippy_task_pool_push (skippy_uri_downloader_request_job, request);
+  return request;
+}
+
+// Without a Content-Length the byte segment has a duration of -1, which bytes_total takes over as is
+static gboolean
+skippy_uri_downloader_size_known (SkippyUriDownloader* downloader)
+{
+  return downloader->priv->bytes_total > 0 && downloader->priv->bytes_total != (gsize) -1;
+}
+
+// Once we know the size of a fragment we load as a whole, requests all of it after the first range at once.
+// Our own request goes on with the first range.
+// Download mutex is locked when this is called (only while fetch executes).
+static void
+skippy_uri_downloader_start_ranges (SkippyUriDownloader* downloader)
+{
+  SkippyFragment *fragment = downloader->priv->fragment;
+  gsize total = downloader->priv->bytes_total, range_size;
+  guint count, i;
+
+  GST_OBJECT_LOCK (downloader);
+  count = MIN (downloader->priv->parallel_ranges, downloader->priv->range_downloaders->len + 1);
+  if (downloader->priv->parallel_min_size) {
+    count = MIN (count, total / downloader->priv->parallel_min_size);
+  }
+  GST_OBJECT_UNLOCK (downloader);
+  // Resumed downloads and seek ranges are loaded as they are
+  if (count < 2 || downloader->priv->previous_was_interrupted || fragment->range_start || fragment->range_end >= 0
+    || !gst_pad_is_linked (downloader->priv->srcpad)) {
+    return;
+  }
+
+  range_size = total / count;
+  GST_DEBUG_OBJECT (downloader, "Loading %" G_GSIZE_FORMAT " bytes in %u ranges of %" G_GSIZE_FORMAT " bytes",
+    total, count, range_size);
+
+  GST_OBJECT_LOCK (downloader);
+  downloader->priv->split_offset = range_size;
+  downloader->priv->ranges = g_ptr_array_new ();
+  for (i = 1; i < count; i++) {
+    g_ptr_array_add (downloader->priv->ranges, skippy_uri_downloader_request_new (downloader,
+      g_ptr_array_index (downloader->priv->range_downloaders, i - 1), fragment->uri,
+      i * range_size, i == count - 1 ? (gint64) total : (gint64) ((i + 1) * range_size)));
+  }
+  GST_OBJECT_UNLOCK (downloader);
+}
+
+// Hands on what the given requests loaded in order as they complete. Cancels and waits for whatever
+// we don't need anymore when push is FALSE or one of them fails. Returns how the requests went.
+// Download mutex is locked when this is called (only while fetch executes).
+static SkippyUriDownloaderFetchReturn
+skippy_uri_downloader_finish_requests (SkippyUriDownloader* downloader, GPtrArray** requests_ptr, gboolean push, GError ** err)
+{
+  SkippyUriDownloaderFetchReturn ret = SKIPPY_URI_DOWNLOADER_COMPLETED;
+  SkippyUriDownloaderRequest *request;
+  GPtrArray *requests;
+  GstBuffer *buf;
+  gboolean is_last;
+  guint i;
+
+  GST_OBJECT_LOCK (downloader);
+  requests = *requests_ptr;
+  GST_OBJECT_UNLOCK (downloader);
+
+  for (i = 0; i < requests->len; i++) {
+    request = g_ptr_array_index (requests, i);
+    if (!push || ret != SKIPPY_URI_DOWNLOADER_COMPLETED) {
+      GST_OBJECT_LOCK (downloader);
+      request->fragment->cancelled = TRUE;
+      GST_OBJECT_UNLOCK (downloader);
+      skippy_uri_downloader_cancel (request->downloader, FALSE);
+    }
+    skippy_uri_downloader_request_join (request);
+    if (!push || ret != SKIPPY_URI_DOWNLOADER_COMPLETED) {
+      continue;
+    }
+    ret = request->ret;
+    if (ret != SKIPPY_URI_DOWNLOADER_COMPLETED) {
+      GST_WARNING_OBJECT (downloader, "Request for %" G_GINT64_FORMAT " - %" G_GINT64_FORMAT " failed: %s",
+        request->fragment->range_start, request->fragment->range_end, request->err ? request->err->message : "cancelled");
+      if (request->err) {
+        *err = g_error_copy (request->err);
+      }
+      continue;
+    }
+    if (!(buf = skippy_uri_downloader_get_buffer (request->downloader))) {
+      continue;
+    }
+    // Same as what came through the probe
+    downloader->priv->fragment->size += gst_buffer_get_size (buf);
+    downloader->priv->bytes_loaded += gst_buffer_get_size (buf);
+    downloader->priv->bytes_total = MAX (downloader->priv->bytes_total, downloader->priv->bytes_loaded);
+    skippy_uri_downloader_handle_bytes_received (downloader,
+      downloader->priv->fragment->start_time, downloader->priv->fragment->stop_time,
+      downloader->priv->bytes_loaded, downloader->priv->bytes_total);
+    if (downloader->priv->decrypting) {
+      is_last = i == requests->len - 1;
+      buf = skippy_uri_downloader_decrypt_buffer (downloader, buf, is_last);
+    }
+    if (!gst_buffer_get_size (buf)) {
+      gst_buffer_unref (buf);
+    } else if (gst_pad_is_linked (downloader->priv->srcpad)) {
+      gst_pad_push (downloader->priv->srcpad, buf);
+    } else {
+      if (downloader->priv->buffer == NULL) {
+        downloader->priv->buffer = gst_buffer_new ();
+      }
+      downloader->priv->buffer = gst_buffer_append (downloader->priv->buffer, buf);
+    }
+  }
+
+  GST_OBJECT_LOCK (downloader);
+  *requests_ptr = NULL;
+  GST_OBJECT_UNLOCK (downloader);
+  for (i = 0; i < requests->len; i++) {
+    request = g_ptr_array_index (requests, i);
+    g_object_unref (request->fragment);
+    g_free (request->referer);
+    g_clear_error (&request->err);
+    g_mutex_clear (&request->lock);
+    g_cond_clear (&request->cond);
+    g_slice_free (SkippyUriDownloaderRequest, request);
+  }
+  g_ptr_array_free (requests, TRUE);
+
+  if (push && ret == SKIPPY_URI_DOWNLOADER_COMPLETED) {
+    downloader->priv->fragment->download_stop_time = gst_util_get_timestamp ();
+  }
+  return ret;
+}
+
+// Cancels and waits for whatever our children still load for us.
+// Download mutex is locked when this is called (only while fetch executes).
+static void
+skippy_uri_downloader_stop_requests (SkippyUriDownloader* downloader)
+{
+  if (downloader->priv->ranges) {
+    skippy_uri_downloader_finish_requests (downloader, &downloader->priv->ranges, FALSE, NULL);
+  }
+  if (downloader->priv->hedge) {
+    skippy_uri_downloader_finish_requests (downloader, &downloader->priv->hedge, FALSE, NULL);
+  }
+}
+
+// Time to first byte after which we send a hedge request, none until we have seen enough requests.
+// Expects the object lock to be held.
+static GstClockTime
+skippy_uri_downloader_get_hedge_delay_locked (SkippyUriDownloader* downloader)
+{
+  GstClockTime sorted[HEDGE_TTFB_HISTORY], tmp;
+  guint count = MIN (downloader->priv->ttfb_count, HEDGE_TTFB_HISTORY), i, j;
+
+  if (!downloader->priv->hedge_percentile || count < HEDGE_MIN_SAMPLES) {
+    return GST_CLOCK_TIME_NONE;
+  }
+  // Few enough to sort on the spot
+  memcpy (sorted, downloader->priv->ttfbs, count * sizeof (GstClockTime));
+  for (i = 1; i < count; i++) {
+    tmp = sorted[i];
+    for (j = i; j > 0 && sorted[j - 1] > tmp; j--) {
+      sorted[j] = sorted[j - 1];
+    }
+    sorted[j] = tmp;
+  }
+  return sorted[MIN (count - 1, count * downloader->priv->hedge_percentile / 100)];
+}
+
+// Keeps the last time to first byte. Expects the object lock to be held.
+static void
+skippy_uri_downloader_add_ttfb_locked (SkippyUriDownloader* downloader, GstClockTime ttfb)
+{
+  downloader->priv->ttfbs[downloader->priv->ttfb_count % HEDGE_TTFB_HISTORY] = ttfb;
+  downloader->priv->ttfb_count++;
+}
+
+// Called whenever the fetch wait times out with hedging on. Sends the hedge request once our own request
+// took longer to respond than the delay. Expects the object lock to be held.
+static void
+skippy_uri_downloader_check_hedge_locked (SkippyUriDownloader* downloader)
+{
+  gchar *uri;
+
+  if (downloader->priv->hedge_state != SKIPPY_URI_DOWNLOADER_HEDGE_NONE || downloader->priv->got_segment
+    || g_get_monotonic_time () < downloader->priv->request_start + (gint64) (downloader->priv->hedge_delay / GST_USECOND)) {
+    return;
+  }
+  // Ours with the authority replaced when there is an alternate host
+  uri = skippy_host_selector_replace_authority (downloader->priv->fragment->uri, downloader->priv->hedge_host);
+  GST_INFO_OBJECT (downloader, "No response after %" GST_TIME_FORMAT ", hedging with %s",
+    GST_TIME_ARGS (downloader->priv->hedge_delay), uri);
+  downloader->priv->hedge_state = SKIPPY_URI_DOWNLOADER_HEDGE_PENDING;
+  downloader->priv->hedge_count++;
+  downloader->priv->hedge = g_ptr_array_new ();
+  g_ptr_array_add (downloader->priv->hedge, skippy_uri_downloader_request_new (downloader,
+    downloader->priv->hedge_downloader, uri, downloader->priv->fragment->range_start,
+    downloader->priv->fragment->range_end));
+  g_free (uri);
+}
+
+// First response to a request of ours or of our hedge child decides which one we keep
+// Download mutex is locked when this is called (only while fetch executes).
+static void
+skippy_uri_downloader_handle_response (SkippyUriDownloader* downloader)
+{
+  SkippyUriDownloader *parent = downloader->priv->hedge_parent;
+  GstClockTime elapsed;
+
+  // Our hedge child responded: it wins unless our own request was faster
+  if (parent) {
+    GST_OBJECT_LOCK (parent);
+    if (parent->priv->hedge_state == SKIPPY_URI_DOWNLOADER_HEDGE_PENDING) {
+      elapsed = (g_get_monotonic_time () - parent->priv->request_start) * GST_USECOND;
+      GST_INFO_OBJECT (parent, "Hedge request won after %" GST_TIME_FORMAT, GST_TIME_ARGS (elapsed));
+      parent->priv->hedge_state = SKIPPY_URI_DOWNLOADER_HEDGE_WON;
+      parent->priv->hedge_win_count++;
+      parent->priv->fragment->time_to_first_byte = elapsed;
+      // Ours would have taken at least that long
+      skippy_uri_downloader_add_ttfb_locked (parent, elapsed);
+      g_cond_signal (&parent->priv->cond);
+    }
+    GST_OBJECT_UNLOCK (parent);
+    return;
+  }
+
+  GST_OBJECT_LOCK (downloader);
+  if (downloader->priv->hedge_state != SKIPPY_URI_DOWNLOADER_HEDGE_WON) {
+    downloader->priv->fragment->time_to_first_byte = (g_get_monotonic_time () - downloader->priv->request_start) * GST_USECOND;
+  }
+  switch (downloader->priv->hedge_state) {
+  case SKIPPY_URI_DOWNLOADER_HEDGE_NONE:
+    skippy_uri_downloader_add_ttfb_locked (downloader, downloader->priv->fragment->time_to_first_byte);
+    break;
+  case SKIPPY_URI_DOWNLOADER_HEDGE_PENDING:
+    skippy_uri_downloader_add_ttfb_locked (downloader, downloader->priv->fragment->time_to_first_byte);
+    downloader->priv->hedge_state = SKIPPY_URI_DOWNLOADER_HEDGE_LOST;
+    skippy_uri_downloader_cancel_requests_locked (downloader->priv->hedge);
+    break;
+  case SKIPPY_URI_DOWNLOADER_HEDGE_WON:
+  case SKIPPY_URI_DOWNLOADER_HEDGE_LOST:
+    break;
+  }
+  // What we get is of no use anymore
+  if (downloader->priv->hedge_state == SKIPPY_URI_DOWNLOADER_HEDGE_WON) {
+    downloader->priv->flushing = TRUE;
+  }
+  GST_OBJECT_UNLOCK (downloader);
+}
+
 // Handles segment events from URI data source thread - this tells us about the size of the next chunk we are loading
 // Download mutex is locked when this is called (only while fetch executes).
 static gboolean
@@ -416,6 +1035,15 @@ skippy_uri_downloader_handle_data_segment (SkippyUriDownloader* downloader, cons
       downloader->priv->bytes_loaded = segment->position;
       downloader->priv->bytes_total = segment->duration;
       downloader->priv->got_segment = TRUE;
+      skippy_uri_downloader_handle_response (downloader);
+      // Measuring from here leaves the time to first byte out
+      if (!downloader->priv->flushing) {
+        skippy_bandwidth_estimator_begin (downloader->priv->bandwidth);
+        downloader->priv->measuring = TRUE;
+      }
+      if (skippy_uri_downloader_size_known (downloader) && downloader->priv->hedge_state != SKIPPY_URI_DOWNLOADER_HEDGE_WON) {
+        skippy_uri_downloader_start_ranges (downloader);
+      }
     }
 
   } else {
@@ -500,6 +1128,7 @@ skippy_uri_downloader_src_probe_buffer (GstPad *pad, GstPadProbeInfo *info, gpoi
   SkippyUriDownloader *downloader = SKIPPY_URI_DOWNLOADER (user_data);
   GstBuffer* buf = GST_PAD_PROBE_INFO_BUFFER(info);
   gsize bytes = gst_buffer_get_size (buf);
+  gboolean is_last;
 
   GST_TRACE_OBJECT (downloader, "Got %" GST_PTR_FORMAT " of size %" G_GSIZE_FORMAT, buf, bytes);
 
@@ -514,6 +1143,32 @@ skippy_uri_downloader_src_probe_buffer (GstPad *pad, GstPadProbeInfo *info, gpoi
     return GST_PAD_PROBE_DROP;
   }
 
+  // When split, our own request stops at the first range
+  if (downloader->priv->split_offset && downloader->priv->bytes_loaded + bytes >= downloader->priv->split_offset) {
+    bytes = downloader->priv->split_offset - downloader->priv->bytes_loaded;
+    if (bytes < gst_buffer_get_size (buf)) {
+      buf = gst_buffer_make_writable (buf);
+      gst_buffer_resize (buf, 0, bytes);
+      GST_PAD_PROBE_INFO_DATA (info) = buf;
+    }
+    // Drops what comes after this one and unblocks fetch to go on with the other ranges
+    downloader->priv->flushing = TRUE;
+    skippy_uri_downloader_complete (downloader);
+    if (!bytes) {
+      return GST_PAD_PROBE_DROP;
+    }
+  }
+
+  // Feed the stall watchdog
+  GST_OBJECT_LOCK (downloader);
+  downloader->priv->window_bytes += bytes;
+  GST_OBJECT_UNLOCK (downloader);
+
+  // Feed the bandwidth estimate, telling about it every now and then
+  if (skippy_bandwidth_estimator_add_bytes (downloader->priv->bandwidth, bytes)) {
+    skippy_uri_downloader_post_bandwidth (downloader);
+  }
+
   // Increment size on fragment model
   downloader->priv->fragment->size += bytes;
   // Count bytes up
@@ -523,6 +1178,17 @@ skippy_uri_downloader_src_probe_buffer (GstPad *pad, GstPadProbeInfo *info, gpoi
     downloader->priv->fragment->start_time, downloader->priv->fragment->stop_time,
     downloader->priv->bytes_loaded, downloader->priv->bytes_total);
 
+  // Decrypt incrementally as the bytes arrive, replacing the probed buffer
+  if (downloader->priv->decrypting) {
+    is_last = skippy_uri_downloader_size_known (downloader) && downloader->priv->bytes_loaded >= downloader->priv->bytes_total
+      && !downloader->priv->split_offset;
+    buf = skippy_uri_downloader_decrypt_buffer (downloader, buf, is_last);
+    GST_PAD_PROBE_INFO_DATA (info) = buf;
+    if (gst_buffer_get_size (buf) == 0) {
+      return GST_PAD_PROBE_DROP;
+    }
+  }
+
   // This is only if we are not linked: Drop the buffer and append to our own
   // internal buffer.
   if (!gst_pad_is_linked (downloader->priv->srcpad)) {
@@ -752,6 +1418,48 @@ skippy_uri_downloader_deinit_uri_src (SkippyUriDownloader * downloader)
   }
 }
 
+// Called whenever the fetch wait times out with the watchdog on. Tells wether we loaded too little over the
+// window that just ended, otherwise starts the next window. Expects the object lock to be held.
+static gboolean
+skippy_uri_downloader_check_stall_locked (SkippyUriDownloader * downloader)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 elapsed = now - downloader->priv->window_start;
+  guint64 rate;
+
+  if (elapsed < (gint64) (downloader->priv->stall_window / GST_USECOND)) {
+    return FALSE;
+  }
+  rate = gst_util_uint64_scale (downloader->priv->window_bytes, G_USEC_PER_SEC, elapsed);
+  if (rate < downloader->priv->stall_min_rate) {
+    GST_WARNING_OBJECT (downloader, "Download stalled at %" G_GUINT64_FORMAT " bytes/s over the last %" GST_TIME_FORMAT,
+      rate, GST_TIME_ARGS (elapsed * GST_USECOND));
+    downloader->priv->stalled = TRUE;
+    return TRUE;
+  }
+  downloader->priv->window_start = now;
+  downloader->priv->window_bytes = 0;
+  return FALSE;
+}
+
+// When the fetch wait has to wake up for the stall watchdog or to send a hedge request, in monotonic time or -1 for never.
+// Expects the object lock to be held.
+static gint64
+skippy_uri_downloader_get_wake_time_locked (SkippyUriDownloader * downloader)
+{
+  gint64 wake_time = -1, hedge_time;
+
+  if (downloader->priv->stall_min_rate) {
+    wake_time = downloader->priv->window_start + (gint64) (downloader->priv->stall_window / GST_USECOND);
+  }
+  if (GST_CLOCK_TIME_IS_VALID (downloader->priv->hedge_delay) && !downloader->priv->got_segment
+    && downloader->priv->hedge_state == SKIPPY_URI_DOWNLOADER_HEDGE_NONE) {
+    hedge_time = downloader->priv->request_start + (gint64) (downloader->priv->hedge_delay / GST_USECOND);
+    wake_time = wake_time < 0 ? hedge_time : MIN (wake_time, hedge_time);
+  }
+  return wake_time;
+}
+
 // Handle failure downloading in fetch function
 // Download mutex is locked when this is called (only while fetch executes).
 static SkippyUriDownloaderFetchReturn
@@ -779,6 +1487,7 @@ SkippyUriDownloaderFetchReturn skippy_uri_downloader_fetch_fragment (SkippyUriDo
   const gchar * referer, gboolean compress, gboolean refresh, gboolean allow_cache, GError ** err)
 {
   GstStateChangeReturn ret;
+  gint64 wake_time;
 
   g_return_val_if_fail (downloader, SKIPPY_URI_DOWNLOADER_FAILED);
   g_return_val_if_fail (fragment, SKIPPY_URI_DOWNLOADER_FAILED);
@@ -793,6 +1502,9 @@ SkippyUriDownloaderFetchReturn skippy_uri_downloader_fetch_fragment (SkippyUriDo
 
   // Storing the current fragment info
   downloader->priv->fragment = g_object_ref (fragment);
+  g_free (downloader->priv->referer);
+  downloader->priv->referer = g_strdup (referer);
+  downloader->priv->allow_cache = allow_cache;
 
   // Make sure we have our data source component set up and wired
   if (!skippy_uri_downloader_create_src (downloader, fragment->uri)) {
@@ -800,10 +1512,16 @@ SkippyUriDownloaderFetchReturn skippy_uri_downloader_fetch_fragment (SkippyUriDo
     return SKIPPY_URI_DOWNLOADER_FAILED;
   }
 
-  // If we were interrupted previously, resume at this point
+  // If we were interrupted previously, resume at this point (the decryptor state carries on as well)
   if (downloader->priv->previous_was_interrupted) {
-    fragment->range_start = downloader->priv->bytes_loaded + 1;
+    fragment->range_start = downloader->priv->bytes_loaded;
     fragment->range_end = downloader->priv->bytes_total;
+  } else {
+    downloader->priv->decrypting = fragment->key_uri != NULL && fragment->key_loaded;
+    if (downloader->priv->decrypting) {
+      GST_DEBUG_OBJECT (downloader, "Fragment is encrypted, decrypting with key from %s", fragment->key_uri);
+      skippy_aes_decryptor_init (&downloader->priv->decryptor, fragment->key, fragment->iv);
+    }
   }
 
   // Setup URL & range
@@ -814,6 +1532,18 @@ SkippyUriDownloaderFetchReturn skippy_uri_downloader_fetch_fragment (SkippyUriDo
     return skippy_uri_downloader_handle_failure (downloader, err);
   }
 
+  // The first window starts with the request, so does the wait for a response
+  GST_OBJECT_LOCK (downloader);
+  downloader->priv->request_start = downloader->priv->window_start = g_get_monotonic_time ();
+  downloader->priv->window_bytes = 0;
+  downloader->priv->hedge_state = SKIPPY_URI_DOWNLOADER_HEDGE_NONE;
+  downloader->priv->hedge_delay = downloader->priv->hedge_downloader ?
+    skippy_uri_downloader_get_hedge_delay_locked (downloader) : GST_CLOCK_TIME_NONE;
+  if (downloader->priv->hedge_percentile) {
+    downloader->priv->request_count++;
+  }
+  GST_OBJECT_UNLOCK (downloader);
+
   // Let data flow ...
   ret = gst_element_set_state (downloader->priv->urisrc, GST_STATE_PLAYING);
   GST_TRACE ("Setting URI data source to PLAYING: %s", gst_element_state_change_return_get_name (ret));
@@ -832,12 +1562,25 @@ SkippyUriDownloaderFetchReturn skippy_uri_downloader_fetch_fragment (SkippyUriDo
    *   - the download succeed (EOS in the src pad)
    *   - the download failed (Error message on the fetcher bus)
    */
-  while (!(fragment->cancelled || fragment->completed || downloader->priv->download_canceled)) {
+  while (!(fragment->cancelled || fragment->completed || downloader->priv->download_canceled
+    || downloader->priv->hedge_state == SKIPPY_URI_DOWNLOADER_HEDGE_WON)) {
   //while (!downloader->priv->download_done)
     // Indicate we are downloading
     downloader->priv->fetching = TRUE;
-    g_cond_wait (&downloader->priv->cond, GST_OBJECT_GET_LOCK (downloader));
-    GST_DEBUG ("Condition has been signalled");
+    wake_time = skippy_uri_downloader_get_wake_time_locked (downloader);
+    if (wake_time < 0) {
+      g_cond_wait (&downloader->priv->cond, GST_OBJECT_GET_LOCK (downloader));
+      GST_DEBUG ("Condition has been signalled");
+    } else if (!g_cond_wait_until (&downloader->priv->cond, GST_OBJECT_GET_LOCK (downloader), wake_time)) {
+      if (downloader->priv->stall_min_rate && skippy_uri_downloader_check_stall_locked (downloader)) {
+        // Whatever still arrives from here on is not counted, so a retry resumes at the right byte
+        downloader->priv->flushing = TRUE;
+        break;
+      }
+      if (GST_CLOCK_TIME_IS_VALID (downloader->priv->hedge_delay)) {
+        skippy_uri_downloader_check_hedge_locked (downloader);
+      }
+    }
   }
 
   gboolean is_canceled = downloader->priv->download_canceled;
@@ -855,18 +1598,63 @@ SkippyUriDownloaderFetchReturn skippy_uri_downloader_fetch_fragment (SkippyUriDo
   // After this we are sure the streaming thread of the data source will not push any more data or events
   // and all messages from the URI src element are flushed (in sync with this call)
 
+  // Until the next response the link is idle
+  if (downloader->priv->measuring) {
+    skippy_bandwidth_estimator_end (downloader->priv->bandwidth);
+    downloader->priv->measuring = FALSE;
+  }
+
+  // Too slow, the caller can resume right away (the source may have errored out on the way down)
+  if (downloader->priv->stalled && !(fragment->cancelled || is_canceled)) {
+    skippy_uri_downloader_stop_requests (downloader);
+    g_set_error (err, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_READ, "Download stalled after %" G_GSIZE_FORMAT " bytes",
+      downloader->priv->bytes_loaded);
+    g_mutex_unlock (&downloader->priv->download_lock);
+    return SKIPPY_URI_DOWNLOADER_STALLED;
+  }
+
   // Handle errors (even when completed data)
-  if (downloader->priv->err) {
+  if (downloader->priv->err && downloader->priv->hedge_state != SKIPPY_URI_DOWNLOADER_HEDGE_WON) {
+    skippy_uri_downloader_stop_requests (downloader);
     g_mutex_unlock (&downloader->priv->download_lock);
     return skippy_uri_downloader_handle_failure (downloader, err);
   }
 
   // Cancellation (this is when we have been intendendly cancelled)
   if (fragment->cancelled || is_canceled) {
+    skippy_uri_downloader_stop_requests (downloader);
     g_mutex_unlock (&downloader->priv->download_lock);
     return SKIPPY_URI_DOWNLOADER_CANCELLED;
   }
 
+  // A hedge request that lost is of no use anymore, one that won brings the whole of it
+  if (downloader->priv->hedge && downloader->priv->hedge_state != SKIPPY_URI_DOWNLOADER_HEDGE_WON) {
+    skippy_uri_downloader_finish_requests (downloader, &downloader->priv->hedge, FALSE, NULL);
+  }
+
+  // The rest of a split fragment comes from the range requests, all of it from a hedge request that won. If one fails,
+  // what we got so far stays counted and a retry resumes from there like with any interrupted download.
+  if (((downloader->priv->hedge
+    && skippy_uri_downloader_finish_requests (downloader, &downloader->priv->hedge, TRUE, err) != SKIPPY_URI_DOWNLOADER_COMPLETED)
+    || (downloader->priv->ranges
+    && skippy_uri_downloader_finish_requests (downloader, &downloader->priv->ranges, TRUE, err) != SKIPPY_URI_DOWNLOADER_COMPLETED))) {
+    GST_OBJECT_LOCK (downloader);
+    is_canceled = downloader->priv->download_canceled || fragment->cancelled;
+    downloader->priv->download_canceled = FALSE;
+    // Our own request completed with the first range only or not at all
+    fragment->completed = FALSE;
+    GST_OBJECT_UNLOCK (downloader);
+    g_mutex_unlock (&downloader->priv->download_lock);
+    if (is_canceled) {
+      g_clear_error (err);
+      return SKIPPY_URI_DOWNLOADER_CANCELLED;
+    }
+    if (!*err) {
+      g_set_error (err, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_READ, "Request failed");
+    }
+    return SKIPPY_URI_DOWNLOADER_FAILED;
+  }
+
   // Successful completion
   g_mutex_unlock (&downloader->priv->download_lock);
   return SKIPPY_URI_DOWNLOADER_COMPLETED;
@@ -898,6 +1686,9 @@ static void skippy_uri_downloader_cancel (SkippyUriDownloader * downloader, gboo
   if (downloader->priv->fragment) {
     downloader->priv->fragment->cancelled = TRUE;
   }
+  // Requests of our children go down with ours
+  skippy_uri_downloader_cancel_requests_locked (downloader->priv->ranges);
+  skippy_uri_downloader_cancel_requests_locked (downloader->priv->hedge);
   GST_TRACE_OBJECT (downloader, "Signaling wait condition.");
   g_cond_signal (&downloader->priv->cond);
   GST_OBJECT_UNLOCK (downloader);
@@ -907,6 +1698,18 @@ void skippy_uri_downloader_interrupt (SkippyUriDownloader * downloader)
 {
   GST_DEBUG ("Interrupt");
   skippy_uri_downloader_cancel (downloader, TRUE);
+  // Fetches waiting for a key somebody else is loading give up as well
+  skippy_aes_key_cache_wake ();
+}
+
+gboolean skippy_uri_downloader_is_interrupted (SkippyUriDownloader * downloader)
+{
+  gboolean interrupted;
+
+  GST_OBJECT_LOCK (downloader);
+  interrupted = downloader->priv->download_canceled;
+  GST_OBJECT_UNLOCK (downloader);
+  return interrupted;
 }
 
 void skippy_uri_downloader_continue (SkippyUriDownloader * downloader)
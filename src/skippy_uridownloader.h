@@ -36,6 +36,7 @@ G_BEGIN_DECLS
 
 // Constants for custom element message names
 #define SKIPPY_HLS_DEMUX_DOWNLOADING_MSG_NAME "skippy-hlsdemux-download"
+#define SKIPPY_HLS_DEMUX_BANDWIDTH_MSG_NAME "skippy-hlsdemux-bandwidth"
 
 typedef struct _SkippyUriDownloader SkippyUriDownloader;
 typedef struct _SkippyUriDownloaderPrivate SkippyUriDownloaderPrivate;
@@ -48,6 +49,7 @@ typedef enum {
 	SKIPPY_URI_DOWNLOADER_FAILED,
 	SKIPPY_URI_DOWNLOADER_CANCELLED,
 	SKIPPY_URI_DOWNLOADER_COMPLETED,
+	SKIPPY_URI_DOWNLOADER_STALLED,
 } SkippyUriDownloaderFetchReturn;
 
 struct _SkippyUriDownloader
@@ -75,8 +77,35 @@ SkippyUriDownloaderFetchReturn skippy_uri_downloader_fetch_fragment (SkippyUriDo
 	const gchar * referer, gboolean compress, gboolean refresh, gboolean allow_cache, GError ** err);
 GstBuffer* skippy_uri_downloader_get_buffer (SkippyUriDownloader *downloader);
 
+// Splits fragments we fetch as a whole into up to that many byte ranges, loaded at once over their own requests
+// as soon as we know the size. Ranges are at least min_range_size bytes. A count of 0 or 1 loads them in one piece.
+void skippy_uri_downloader_set_parallel_ranges (SkippyUriDownloader * downloader, guint count, gsize min_range_size);
+
+// Aborts fetches loading less than min_rate bytes per second over a whole window with SKIPPY_URI_DOWNLOADER_STALLED.
+// Fetching the same URI again right after resumes where we stopped. A min_rate of 0 disables the watchdog.
+void skippy_uri_downloader_set_stall_watchdog (SkippyUriDownloader * downloader, guint min_rate, GstClockTime window);
+
+// Sends a second request for what we fetch when the first one takes longer to respond than the given percentile
+// of recent times to first byte, to the alternate host if not NULL (as in "host[:port]"). Whichever responds first
+// is kept, the other one cancelled. A percentile of 0 disables hedging.
+void skippy_uri_downloader_set_hedging (SkippyUriDownloader * downloader, guint percentile, const gchar * alternate_host);
+
+// Changes where hedge requests go, NULL for the host of what we fetch
+void skippy_uri_downloader_set_hedge_host (SkippyUriDownloader * downloader, const gchar * alternate_host);
+void skippy_uri_downloader_get_hedge_stats (SkippyUriDownloader * downloader, guint * requests, guint * hedged, guint * won);
+
+// Bandwidth of the link in bits per second, estimated from the data arriving during our fetches. Updates get
+// posted on the bus as SKIPPY_HLS_DEMUX_BANDWIDTH_MSG_NAME messages with a "bandwidth-estimate" field, once a second at most.
+guint64 skippy_uri_downloader_get_bandwidth (SkippyUriDownloader * downloader);
+
+// Caps of what we fetch if known upfront, the data doesn't get typefound then. NULL to sniff it again.
+void skippy_uri_downloader_set_caps (SkippyUriDownloader * downloader, GstCaps * caps);
+
 void skippy_uri_downloader_interrupt (SkippyUriDownloader * downloader);
 
+// TRUE from an interrupt until we continue
+gboolean skippy_uri_downloader_is_interrupted (SkippyUriDownloader * downloader);
+
 void skippy_uri_downloader_continue (SkippyUriDownloader * downloader);
 
 G_END_DECLS
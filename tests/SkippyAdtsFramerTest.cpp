@@ -0,0 +1,271 @@
+#include <gst/gst.h>
+
+#include "skippy_adts_framer.h"
+#include "SkippyHLSTestBytes.hpp"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+// Sample rate indices
+#define RATE_48000 3
+#define RATE_44100 4
+#define RATE_22050 7
+
+struct FrameParams
+{
+	guint rate_index;
+	guint channels;
+	gsize size;
+	bool mpeg2;
+	bool crc;
+	guint blocks;
+};
+
+static const FrameParams LC_44100 = {RATE_44100, 2, 371, false, false, 1};
+
+// An AAC LC frame with a payload that never contains a sync byte
+static Bytes make_frame(const FrameParams& params, guint8 seed)
+{
+	Bytes frame(params.size);
+	frame[0] = 0xff;
+	frame[1] = 0xf0 | (params.mpeg2 ? 0x08 : 0x00) | (params.crc ? 0x00 : 0x01);
+	frame[2] = (1 << 6) | (params.rate_index << 2) | (params.channels >> 2);
+	frame[3] = ((params.channels & 0x3) << 6) | ((params.size >> 11) & 0x3);
+	frame[4] = (params.size >> 3) & 0xff;
+	frame[5] = ((params.size & 0x7) << 5) | 0x1f;
+	frame[6] = 0xfc | ((params.blocks - 1) & 0x3);
+	for (size_t i = SKIPPY_ADTS_HEADER_SIZE; i < frame.size(); i++) {
+		frame[i] = (guint8) ((seed + i) % 200);
+	}
+	return frame;
+}
+
+static Bytes make_frame(guint8 seed)
+{
+	return make_frame(LC_44100, seed);
+}
+
+static Bytes id3v2_tag(size_t body_size)
+{
+	Bytes tag = {'I', 'D', '3', 0x04, 0x00, 0x00,
+		(guint8) ((body_size >> 21) & 0x7f), (guint8) ((body_size >> 14) & 0x7f), (guint8) ((body_size >> 7) & 0x7f), (guint8) (body_size & 0x7f)};
+	tag.insert(tag.end(), body_size, 0x00);
+	return tag;
+}
+
+static void assert_frame(SkippyAdtsFramer* framer, const Bytes& expected, gboolean expected_discont)
+{
+	SkippyAdtsHeader info;
+	gboolean discont;
+	GstBuffer *frame = skippy_adts_framer_next_frame(framer, &info, &discont);
+	ASSERT (frame);
+	ASSERT (discont == expected_discont);
+	ASSERT (info.frame_size == expected.size());
+	ASSERT (buffer_bytes(frame) == expected);
+	gst_buffer_unref(frame);
+}
+
+static void assert_no_frame(SkippyAdtsFramer* framer)
+{
+	SkippyAdtsHeader info;
+	gboolean discont;
+	ASSERT (skippy_adts_framer_next_frame(framer, &info, &discont) == NULL);
+}
+
+static void test_header_parse()
+{
+	const struct {
+		FrameParams params;
+		guint version, sample_rate, channels, samples_per_frame;
+		gsize header_size;
+	} valid[] = {
+		{LC_44100, 4, 44100, 2, 1024, 7},
+		{{RATE_48000, 1, 200, true, false, 1}, 2, 48000, 1, 1024, 7},
+		{{RATE_22050, 6, 1500, false, true, 1}, 4, 22050, 6, 1024, 9},
+		{{RATE_44100, 2, 8191, false, false, 4}, 4, 44100, 2, 4096, 7},
+		// Channels from a program config element
+		{{RATE_44100, 0, 300, false, false, 1}, 4, 44100, 0, 1024, 7},
+	};
+	SkippyAdtsHeader info;
+
+	for (size_t i = 0; i < G_N_ELEMENTS(valid); i++) {
+		Bytes frame = make_frame(valid[i].params, 1);
+		ASSERT (skippy_adts_header_parse(frame.data(), &info));
+		ASSERT (info.version == valid[i].version);
+		ASSERT (info.profile == 1);
+		ASSERT (info.sample_rate == valid[i].sample_rate);
+		ASSERT (info.channels == valid[i].channels);
+		ASSERT (info.samples_per_frame == valid[i].samples_per_frame);
+		ASSERT (info.header_size == valid[i].header_size);
+		ASSERT (info.frame_size == valid[i].params.size);
+	}
+
+	Bytes frame = make_frame(1);
+	ASSERT (skippy_adts_header_parse(frame.data(), &info));
+	// No complete sync word
+	frame[1] = 0xe1;
+	ASSERT (!skippy_adts_header_parse(frame.data(), &info));
+	// A layer other than 0, e.g. an MPEG audio header
+	frame[1] = 0xf3;
+	ASSERT (!skippy_adts_header_parse(frame.data(), &info));
+	// Reserved sample rate
+	frame = make_frame({13, 2, 371, false, false, 1}, 1);
+	ASSERT (!skippy_adts_header_parse(frame.data(), &info));
+	// A frame has to be longer than its header
+	frame = make_frame(1);
+	frame[3] = 0x80;
+	frame[4] = 0x00;
+	frame[5] = 0xff;
+	ASSERT (!skippy_adts_header_parse(frame.data(), &info));
+	frame = make_frame({RATE_44100, 2, 9, false, true, 1}, 1);
+	ASSERT (!skippy_adts_header_parse(frame.data(), &info));
+}
+
+static void test_find_frame()
+{
+	SkippyAdtsHeader info;
+	Bytes data = {0x00, 0x01, 0xff, 0xf1, 0x50, 0x80, 0x2e, 0x7f, 0xfc, 0x03};
+	Bytes first = make_frame(1);
+
+	// The false sync word at 2 is not followed by another frame, the real one at 10 is
+	append(data, first);
+	append(data, make_frame(2));
+	ASSERT (skippy_adts_find_frame(data.data(), data.size(), &info) == 10);
+	ASSERT (info.frame_size == first.size());
+
+	// The next frame has to agree on the sample rate, so the 48 kHz frame following is taken instead
+	data = first;
+	append(data, make_frame({RATE_48000, 2, 300, false, false, 1}, 3));
+	ASSERT (skippy_adts_find_frame(data.data(), data.size(), &info) == (gssize) first.size());
+	ASSERT (info.sample_rate == 48000);
+
+	// Without the data to confirm it, the first header will do
+	ASSERT (skippy_adts_find_frame(first.data(), first.size(), &info) == 0);
+	ASSERT (skippy_adts_find_frame(first.data() + 1, first.size() - 1, &info) == -1);
+}
+
+static void test_tags()
+{
+	SkippyAdtsFramer *framer = skippy_adts_framer_new();
+	Bytes aac = id3v2_tag(53);
+	Bytes first = make_frame(1), second = make_frame(2), third = make_frame(3);
+
+	// Every fragment of packed audio starts with a tag carrying its time stamp
+	append(aac, first);
+	append(aac, second);
+	append(aac, id3v2_tag(53));
+	append(aac, third);
+	skippy_adts_framer_push(framer, make_buffer(aac));
+
+	assert_frame(framer, first, TRUE);
+	assert_frame(framer, second, FALSE);
+	assert_frame(framer, third, FALSE);
+	assert_no_frame(framer);
+	skippy_adts_framer_free(framer);
+}
+
+static void test_resync()
+{
+	SkippyAdtsFramer *framer = skippy_adts_framer_new();
+	Bytes aac, first = make_frame(1), second = make_frame(2), third = make_frame(3), fourth = make_frame(4);
+
+	// Garbage between frames makes us look for two frames in a row again
+	aac = first;
+	append(aac, second);
+	aac.insert(aac.end(), {0x01, 0xff, 0xf1, 0x50, 0x80, 0x2e, 0x7f, 0xfc, 0x02});
+	append(aac, third);
+	append(aac, fourth);
+	aac.insert(aac.end(), fourth.begin(), fourth.begin() + SKIPPY_ADTS_HEADER_SIZE);
+	skippy_adts_framer_push(framer, make_buffer(aac));
+
+	assert_frame(framer, first, TRUE);
+	assert_frame(framer, second, FALSE);
+	assert_frame(framer, third, TRUE);
+	assert_frame(framer, fourth, FALSE);
+	// Only the header of the last one is there
+	assert_no_frame(framer);
+
+	// Nothing that looks like a frame, only the last bytes that could start a header are kept
+	skippy_adts_framer_flush(framer);
+	skippy_adts_framer_push(framer, make_buffer(Bytes(100, 0x55)));
+	assert_no_frame(framer);
+	aac = first;
+	append(aac, second);
+	skippy_adts_framer_push(framer, make_buffer(aac));
+	assert_frame(framer, first, TRUE);
+	assert_frame(framer, second, FALSE);
+	skippy_adts_framer_free(framer);
+}
+
+static void test_split_pushes()
+{
+	SkippyAdtsFramer *framer = skippy_adts_framer_new();
+	Bytes aac = id3v2_tag(40);
+	std::vector<Bytes> frames;
+	size_t count = 0;
+
+	// With and without CRC
+	for (guint8 i = 0; i < 5; i++) {
+		frames.push_back(make_frame({RATE_22050, 1, (gsize) (150 + i), false, i % 2 == 1, 1}, i));
+		append(aac, frames.back());
+	}
+
+	// Frames come out whole and in order, however the data trickles in
+	for (size_t i = 0; i < aac.size(); i++) {
+		SkippyAdtsHeader info;
+		gboolean discont;
+		GstBuffer *frame;
+
+		skippy_adts_framer_push(framer, make_buffer(Bytes(1, aac[i])));
+		while ((frame = skippy_adts_framer_next_frame(framer, &info, &discont))) {
+			Bytes data = buffer_bytes(frame);
+			gst_buffer_unref(frame);
+
+			ASSERT (count < frames.size());
+			ASSERT (data == frames[count]);
+			ASSERT (info.header_size == (count % 2 == 1 ? 9 : 7));
+			ASSERT (discont == (count == 0));
+			count++;
+		}
+	}
+	ASSERT (count == frames.size());
+	skippy_adts_framer_free(framer);
+}
+
+static void test_flush()
+{
+	SkippyAdtsFramer *framer = skippy_adts_framer_new();
+	Bytes aac, first = make_frame(1), second = make_frame(2), third = make_frame(3), fourth = make_frame(4);
+
+	aac = first;
+	aac.insert(aac.end(), second.begin(), second.begin() + 100);
+	skippy_adts_framer_push(framer, make_buffer(aac));
+	assert_frame(framer, first, TRUE);
+	assert_no_frame(framer);
+
+	// After a seek the stream has to be found again
+	skippy_adts_framer_flush(framer);
+	aac = third;
+	append(aac, fourth);
+	skippy_adts_framer_push(framer, make_buffer(aac));
+	assert_frame(framer, third, TRUE);
+	assert_frame(framer, fourth, FALSE);
+	skippy_adts_framer_free(framer);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	test_header_parse();
+	test_find_frame();
+	test_tags();
+	test_resync();
+	test_split_pushes();
+	test_flush();
+
+	LOG ("All test assertions passed");
+	return 0;
+}
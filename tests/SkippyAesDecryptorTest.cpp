@@ -0,0 +1,220 @@
+#include <string.h>
+#include <nettle/aes.h>
+#include <nettle/cbc.h>
+#include <gst/gst.h>
+
+#include "skippy_aes.h"
+#include "SkippyHLSTestBytes.hpp"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+// CBC-AES128 example from NIST SP 800-38A, F.2.1
+static const guint8 NIST_KEY[] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+static const guint8 NIST_IV[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+static const guint8 NIST_PLAINTEXT[] = {
+	0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+	0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+	0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+	0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10};
+static const guint8 NIST_CIPHERTEXT[] = {
+	0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+	0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+	0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+	0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7};
+
+// PKCS7 pads and encrypts the way a segmenter would
+static Bytes encrypt(const Bytes& plaintext)
+{
+	struct aes128_ctx ctx;
+	guint8 iv[SKIPPY_AES_BLOCK_SIZE];
+	guint8 pad = SKIPPY_AES_BLOCK_SIZE - plaintext.size() % SKIPPY_AES_BLOCK_SIZE;
+	Bytes padded(plaintext), ciphertext;
+
+	padded.insert(padded.end(), pad, pad);
+	ciphertext.resize(padded.size());
+	aes128_set_encrypt_key(&ctx, NIST_KEY);
+	memcpy(iv, NIST_IV, SKIPPY_AES_BLOCK_SIZE);
+	cbc_encrypt(&ctx, (nettle_cipher_func *) aes128_encrypt, SKIPPY_AES_BLOCK_SIZE, iv, padded.size(), ciphertext.data(), padded.data());
+	return ciphertext;
+}
+
+// Feeds the ciphertext in chunks of chunk_size, optionally flagging the end with an empty chunk of its own
+static Bytes decrypt(const Bytes& ciphertext, size_t chunk_size, bool separate_last = false)
+{
+	SkippyAesDecryptor dec;
+	Bytes plaintext;
+	size_t offset = 0;
+
+	skippy_aes_decryptor_init(&dec, NIST_KEY, NIST_IV);
+	do {
+		size_t size = MIN(chunk_size, ciphertext.size() - offset);
+		bool is_last = !separate_last && offset + size == ciphertext.size();
+		Bytes out(size + 2 * SKIPPY_AES_BLOCK_SIZE);
+		gsize out_len = skippy_aes_decryptor_process(&dec, ciphertext.data() + offset, size, out.data(), is_last);
+
+		ASSERT (out_len <= size + 2 * SKIPPY_AES_BLOCK_SIZE);
+		plaintext.insert(plaintext.end(), out.begin(), out.begin() + out_len);
+		offset += size;
+	} while (offset < ciphertext.size());
+
+	if (separate_last) {
+		guint8 out[2 * SKIPPY_AES_BLOCK_SIZE];
+		gsize out_len = skippy_aes_decryptor_process(&dec, NULL, 0, out, TRUE);
+		plaintext.insert(plaintext.end(), out, out + out_len);
+	}
+	return plaintext;
+}
+
+static void test_known_answer()
+{
+	Bytes ciphertext(NIST_CIPHERTEXT, NIST_CIPHERTEXT + sizeof(NIST_CIPHERTEXT));
+	SkippyAesDecryptor dec;
+	guint8 out[sizeof(NIST_CIPHERTEXT) + 2 * SKIPPY_AES_BLOCK_SIZE];
+
+	// The last plaintext block ends in 0x10 without being padding, so it has to come out unchanged
+	ASSERT (decrypt(ciphertext, ciphertext.size()) == Bytes(NIST_PLAINTEXT, NIST_PLAINTEXT + sizeof(NIST_PLAINTEXT)));
+
+	// Until the end is flagged, the last block is held back
+	skippy_aes_decryptor_init(&dec, NIST_KEY, NIST_IV);
+	ASSERT (skippy_aes_decryptor_process(&dec, NIST_CIPHERTEXT, sizeof(NIST_CIPHERTEXT), out, FALSE) == 3 * SKIPPY_AES_BLOCK_SIZE);
+	ASSERT (memcmp(out, NIST_PLAINTEXT, 3 * SKIPPY_AES_BLOCK_SIZE) == 0);
+	ASSERT (skippy_aes_decryptor_process(&dec, NULL, 0, out, TRUE) == SKIPPY_AES_BLOCK_SIZE);
+	ASSERT (memcmp(out, NIST_PLAINTEXT + 3 * SKIPPY_AES_BLOCK_SIZE, SKIPPY_AES_BLOCK_SIZE) == 0);
+}
+
+static void test_padding()
+{
+	// Every amount of padding, from a whole block down to a single byte
+	for (size_t size = 0; size <= 3 * SKIPPY_AES_BLOCK_SIZE; size++) {
+		Bytes plaintext = make_bytes(size, 3);
+		Bytes ciphertext = encrypt(plaintext);
+
+		ASSERT (decrypt(ciphertext, ciphertext.size()) == plaintext);
+		ASSERT (decrypt(ciphertext, ciphertext.size(), true) == plaintext);
+	}
+}
+
+static void test_chunking()
+{
+	const size_t chunk_sizes[] = {1, 5, 15, 16, 17, 31, 32, 33, 1000};
+	Bytes plaintext = make_bytes(1000, 3);
+	Bytes ciphertext = encrypt(plaintext);
+
+	for (size_t i = 0; i < G_N_ELEMENTS(chunk_sizes); i++) {
+		ASSERT (decrypt(ciphertext, chunk_sizes[i]) == plaintext);
+		ASSERT (decrypt(ciphertext, chunk_sizes[i], true) == plaintext);
+	}
+}
+
+static void test_invalid_ciphertext()
+{
+	Bytes plaintext = make_bytes(40, 3);
+	Bytes ciphertext = encrypt(plaintext);
+
+	// Trailing bytes that don't make up a block are dropped, the padding is still stripped
+	ciphertext.insert(ciphertext.end(), 3, 0x00);
+	ASSERT (decrypt(ciphertext, 7) == plaintext);
+
+	// Invalid padding is kept rather than guessed at
+	plaintext = make_bytes(32, 3);
+	plaintext.insert(plaintext.end(), SKIPPY_AES_BLOCK_SIZE - 2, 0x00);
+	plaintext.push_back(0x03);
+	plaintext.push_back(0x02);
+	ciphertext = encrypt(plaintext);
+	ciphertext.resize(ciphertext.size() - SKIPPY_AES_BLOCK_SIZE);
+	ASSERT (decrypt(ciphertext, ciphertext.size()) == plaintext);
+}
+
+static gboolean cancelled(gpointer user_data)
+{
+	return *(gboolean *) user_data;
+}
+
+static void test_key_cache()
+{
+	guint8 key[SKIPPY_AES_BLOCK_SIZE];
+	guint owner_claim, claim, other_claim;
+	const gchar *uri = "http://www.example.com/SkippyAesDecryptorTest/key";
+	const gchar *failed_uri = "http://www.example.com/SkippyAesDecryptorTest/failed-key";
+
+	// The first lookup claims the fetch, after storing everybody gets the key
+	ASSERT (skippy_aes_key_cache_lookup(uri, key, &owner_claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_MISS);
+	skippy_aes_key_cache_store(uri, NIST_KEY);
+	memset(key, 0, sizeof(key));
+	ASSERT (skippy_aes_key_cache_lookup(uri, key, &claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_HIT);
+	ASSERT (memcmp(key, NIST_KEY, SKIPPY_AES_BLOCK_SIZE) == 0);
+
+	// A failed fetch gives the claim up so that the next lookup can retry
+	ASSERT (skippy_aes_key_cache_lookup(failed_uri, key, &claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_MISS);
+	ASSERT (claim != 0);
+	skippy_aes_key_cache_release(failed_uri, claim);
+	ASSERT (skippy_aes_key_cache_lookup(failed_uri, key, &other_claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_MISS);
+	ASSERT (other_claim != 0 && other_claim != claim);
+	// Releasing somebody else's claim, e.g. after timing out waiting for it, leaves the fetch in flight alone
+	skippy_aes_key_cache_release(failed_uri, claim);
+	skippy_aes_key_cache_release(failed_uri, 0);
+	gboolean is_cancelled = TRUE;
+	ASSERT (skippy_aes_key_cache_lookup(failed_uri, key, &claim, cancelled, &is_cancelled) == SKIPPY_AES_KEY_CACHE_CANCELLED);
+	ASSERT (claim == 0);
+	skippy_aes_key_cache_store(failed_uri, NIST_IV);
+	ASSERT (skippy_aes_key_cache_lookup(failed_uri, key, &claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_HIT);
+	ASSERT (memcmp(key, NIST_IV, SKIPPY_AES_BLOCK_SIZE) == 0);
+
+	// Releasing a loaded key keeps it
+	skippy_aes_key_cache_release(uri, owner_claim);
+	ASSERT (skippy_aes_key_cache_lookup(uri, key, &claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_HIT);
+	ASSERT (memcmp(key, NIST_KEY, SKIPPY_AES_BLOCK_SIZE) == 0);
+
+	// Waiting for a fetch in flight stops once cancelled, a loaded key is still returned
+	const gchar *pending_uri = "http://www.example.com/SkippyAesDecryptorTest/pending-key";
+	ASSERT (skippy_aes_key_cache_lookup(pending_uri, key, &claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_MISS);
+	ASSERT (skippy_aes_key_cache_lookup(pending_uri, key, &other_claim, cancelled, &is_cancelled) == SKIPPY_AES_KEY_CACHE_CANCELLED);
+	ASSERT (skippy_aes_key_cache_lookup(uri, key, &other_claim, cancelled, &is_cancelled) == SKIPPY_AES_KEY_CACHE_HIT);
+	skippy_aes_key_cache_release(pending_uri, claim);
+}
+
+static void test_key_cache_eviction()
+{
+	guint8 key[SKIPPY_AES_BLOCK_SIZE];
+	guint pending_claim, claim;
+	const gchar *pending_uri = "http://www.example.com/SkippyAesDecryptorTest/eviction/pending-key";
+	const gchar *used_uri = "http://www.example.com/SkippyAesDecryptorTest/eviction/used-key";
+
+	ASSERT (skippy_aes_key_cache_lookup(pending_uri, key, &pending_claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_MISS);
+	skippy_aes_key_cache_store(used_uri, NIST_KEY);
+
+	// Filling the cache up evicts the keys used least recently, but neither fetches in flight nor keys just used
+	for (guint i = 0; i < SKIPPY_AES_KEY_CACHE_SIZE; i++) {
+		gchar *uri = g_strdup_printf("http://www.example.com/SkippyAesDecryptorTest/eviction/key-%u", i);
+		skippy_aes_key_cache_store(uri, NIST_IV);
+		g_free(uri);
+		ASSERT (skippy_aes_key_cache_lookup(used_uri, key, &claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_HIT);
+	}
+
+	gboolean is_cancelled = TRUE;
+	ASSERT (skippy_aes_key_cache_lookup(pending_uri, key, &claim, cancelled, &is_cancelled) == SKIPPY_AES_KEY_CACHE_CANCELLED);
+	ASSERT (skippy_aes_key_cache_lookup(used_uri, key, &claim, NULL, NULL) == SKIPPY_AES_KEY_CACHE_HIT);
+	ASSERT (skippy_aes_key_cache_lookup("http://www.example.com/SkippyAesDecryptorTest/eviction/key-0", key, &claim, NULL, NULL)
+		== SKIPPY_AES_KEY_CACHE_MISS);
+	ASSERT (skippy_aes_key_cache_lookup("http://www.example.com/SkippyAesDecryptorTest/eviction/key-255", key, &claim, NULL, NULL)
+		== SKIPPY_AES_KEY_CACHE_HIT);
+	skippy_aes_key_cache_release(pending_uri, pending_claim);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	test_known_answer();
+	test_padding();
+	test_chunking();
+	test_invalid_ciphertext();
+	test_key_cache();
+	test_key_cache_eviction();
+
+	LOG ("All test assertions passed");
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include <gst/gst.h>
+
+#include "skippy_bandwidth_estimator.h"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+// How long the estimator makes a sample span at least
+#define SAMPLE_DURATION (200*G_TIME_SPAN_MILLISECOND)
+
+// Bits per second of that many bytes arriving over a sample, give or take the time sleeping overshoots
+static bool near_rate(guint64 estimate, gsize bytes)
+{
+	guint64 expected = (guint64) bytes * 8 * G_TIME_SPAN_SECOND / SAMPLE_DURATION;
+	return estimate <= expected && estimate >= expected * 3 / 4;
+}
+
+// Completes a sample of the transfer with that many bytes
+static gboolean add_sample(SkippyBandwidthEstimator* estimator, gsize bytes)
+{
+	g_usleep(SAMPLE_DURATION);
+	return skippy_bandwidth_estimator_add_bytes(estimator, bytes);
+}
+
+static void test_samples()
+{
+	SkippyBandwidthEstimator *estimator = skippy_bandwidth_estimator_new();
+	guint64 estimate;
+
+	// Nothing before a transfer began and its first data arrived
+	ASSERT (!skippy_bandwidth_estimator_add_bytes(estimator, 100000));
+	skippy_bandwidth_estimator_begin(estimator);
+	ASSERT (!skippy_bandwidth_estimator_add_bytes(estimator, 100000));
+	ASSERT (skippy_bandwidth_estimator_get(estimator) == 0);
+
+	// The first sample is the estimate, reported right away but not again within a second
+	ASSERT (add_sample(estimator, 100000));
+	estimate = skippy_bandwidth_estimator_get(estimator);
+	ASSERT (near_rate(estimate, 100000));
+	ASSERT (!add_sample(estimator, 100000));
+	ASSERT (near_rate(skippy_bandwidth_estimator_get(estimator), 100000));
+
+	// Data coming in after the transfer ended doesn't count
+	skippy_bandwidth_estimator_end(estimator);
+	estimate = skippy_bandwidth_estimator_get(estimator);
+	ASSERT (!add_sample(estimator, 1000000));
+	ASSERT (skippy_bandwidth_estimator_get(estimator) == estimate);
+	skippy_bandwidth_estimator_unref(estimator);
+}
+
+static void test_outliers()
+{
+	SkippyBandwidthEstimator *estimator = skippy_bandwidth_estimator_new();
+	guint64 estimate;
+
+	skippy_bandwidth_estimator_begin(estimator);
+	skippy_bandwidth_estimator_add_bytes(estimator, 1);
+	add_sample(estimator, 100000);
+	estimate = skippy_bandwidth_estimator_get(estimator);
+
+	// Single samples far off either way are dropped, a change of direction starts counting over
+	add_sample(estimator, 1000000);
+	ASSERT (skippy_bandwidth_estimator_get(estimator) == estimate);
+	add_sample(estimator, 10000);
+	ASSERT (skippy_bandwidth_estimator_get(estimator) == estimate);
+	add_sample(estimator, 1000000);
+	add_sample(estimator, 1000000);
+	ASSERT (skippy_bandwidth_estimator_get(estimator) == estimate);
+
+	// The third one in a row means the link changed, the estimate moves to their average
+	add_sample(estimator, 1000000);
+	ASSERT (near_rate(skippy_bandwidth_estimator_get(estimator), 1000000));
+	skippy_bandwidth_estimator_unref(estimator);
+}
+
+static void test_parallel_transfers()
+{
+	SkippyBandwidthEstimator *estimator = skippy_bandwidth_estimator_new();
+	SkippyBandwidthEstimator *shared = skippy_bandwidth_estimator_ref(estimator);
+	guint64 estimate;
+
+	// Data of transfers running at the same time adds up
+	skippy_bandwidth_estimator_begin(estimator);
+	skippy_bandwidth_estimator_add_bytes(estimator, 1);
+	skippy_bandwidth_estimator_begin(shared);
+	g_usleep(SAMPLE_DURATION / 2);
+	skippy_bandwidth_estimator_add_bytes(shared, 50000);
+	g_usleep(SAMPLE_DURATION / 2);
+	skippy_bandwidth_estimator_add_bytes(estimator, 50000);
+	estimate = skippy_bandwidth_estimator_get(estimator);
+	ASSERT (near_rate(estimate, 100000));
+
+	// Measuring goes on until the last one ended, which takes in what is left
+	skippy_bandwidth_estimator_end(estimator);
+	skippy_bandwidth_estimator_add_bytes(shared, 200000);
+	g_usleep(SAMPLE_DURATION);
+	skippy_bandwidth_estimator_end(shared);
+	ASSERT (skippy_bandwidth_estimator_get(estimator) > estimate);
+
+	// Ending more than began doesn't keep the next transfer from being measured
+	skippy_bandwidth_estimator_end(estimator);
+	skippy_bandwidth_estimator_begin(estimator);
+	skippy_bandwidth_estimator_add_bytes(estimator, 1);
+	estimate = skippy_bandwidth_estimator_get(estimator);
+	add_sample(estimator, 100000);
+	ASSERT (skippy_bandwidth_estimator_get(estimator) != estimate);
+	skippy_bandwidth_estimator_unref(shared);
+	skippy_bandwidth_estimator_unref(estimator);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	test_samples();
+	test_outliers();
+	test_parallel_transfers();
+
+	LOG ("All test assertions passed");
+	return 0;
+}
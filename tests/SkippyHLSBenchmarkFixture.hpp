@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+
+// Fixture and process sampling shared by the benchmarks: a playlist of MP3 silence fragments on disk,
+// referenced with file:// URIs so no network is involved
+
+// MPEG-1 Layer III, 128 kbit/s, 44.1 kHz, no padding: 417 bytes and 1152 samples per frame
+static const guint MP3_FRAME_SIZE = 417;
+static const guint MP3_FRAMES_PER_FRAGMENT = 77;
+
+struct ProcessSample
+{
+	guint threads;
+	guint64 rssKb;
+	guint64 cpuUsec;
+};
+
+static std::string fixture_fragment_path(const std::string& dir, guint index)
+{
+	gchar *name = g_strdup_printf("%s/fragment%u.mp3", dir.c_str(), index);
+	std::string path = name;
+	g_free(name);
+	return path;
+}
+
+// Writes the playlist with the given number of 2 s fragments, returns its path
+static std::string write_fixture(const std::string& dir, guint fragment_count)
+{
+	std::vector<char> frame(MP3_FRAME_SIZE, 0);
+	std::string playlist = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:2\n#EXT-X-MEDIA-SEQUENCE:1\n";
+
+	frame[0] = (char) 0xFF;
+	frame[1] = (char) 0xFB;
+	frame[2] = (char) 0x90;
+	frame[3] = (char) 0x00;
+
+	for (guint i = 0; i < fragment_count; i++) {
+		std::string name = fixture_fragment_path(dir, i);
+		gchar *uri = g_filename_to_uri(name.c_str(), NULL, NULL);
+		FILE *file = fopen(name.c_str(), "wb");
+
+		g_assert(file);
+		for (guint j = 0; j < MP3_FRAMES_PER_FRAGMENT; j++) {
+			fwrite(frame.data(), 1, frame.size(), file);
+		}
+		fclose(file);
+
+		playlist += "#EXTINF:2.011,\n";
+		playlist += uri;
+		playlist += "\n";
+		g_free(uri);
+	}
+	playlist += "#EXT-X-ENDLIST\n";
+
+	std::string path = dir + "/playlist.m3u8";
+	g_assert(g_file_set_contents(path.c_str(), playlist.c_str(), -1, NULL));
+	return path;
+}
+
+static void remove_fixture(const std::string& dir, guint fragment_count)
+{
+	for (guint i = 0; i < fragment_count; i++) {
+		g_remove(fixture_fragment_path(dir, i).c_str());
+	}
+	g_remove((dir + "/playlist.m3u8").c_str());
+	g_rmdir(dir.c_str());
+}
+
+static ProcessSample sample_process()
+{
+	ProcessSample sample = {0, 0, 0};
+	struct rusage usage;
+	gchar *status = NULL;
+
+	if (g_file_get_contents("/proc/self/status", &status, NULL, NULL)) {
+		gchar **lines = g_strsplit(status, "\n", -1);
+		for (gchar **line = lines; *line; line++) {
+			if (g_str_has_prefix(*line, "Threads:")) {
+				sample.threads = (guint) g_ascii_strtoull(*line + strlen("Threads:"), NULL, 10);
+			} else if (g_str_has_prefix(*line, "VmRSS:")) {
+				sample.rssKb = g_ascii_strtoull(*line + strlen("VmRSS:"), NULL, 10);
+			}
+		}
+		g_strfreev(lines);
+		g_free(status);
+	}
+
+	getrusage(RUSAGE_SELF, &usage);
+	sample.cpuUsec = (guint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC
+		+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+	return sample;
+}
@@ -0,0 +1,105 @@
+#include <string>
+#include <gst/gst.h>
+
+#include "skippyHLS/skippy_hls.h"
+#include "SkippyHLSBenchmarkFixture.hpp"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+// Enough media for the CPU time to be measurable: 200 fragments of 32 kB
+static const guint FRAGMENT_COUNT = 200;
+// What the proxy pad used to re-chunk everything to
+static const guint LEGACY_SLICE_SIZE = 4096;
+static const guint RUNS = 3;
+
+struct ChainCount
+{
+	guint64 calls;
+	guint64 buffers;
+	guint64 bytes;
+};
+
+// Counts what the demuxer chains into its download queue, buffer lists being one call
+static GstPadProbeReturn count_chain(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	ChainCount *count = (ChainCount*) user_data;
+
+	count->calls++;
+	if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+		GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+		for (guint i = 0; i < gst_buffer_list_length(list); i++) {
+			count->buffers++;
+			count->bytes += gst_buffer_get_size(gst_buffer_list_get(list, i));
+		}
+	} else {
+		count->buffers++;
+		count->bytes += gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+// Plays the playlist as fast as it loads, with the MP3 slice size given (0 passes buffers through)
+static void run_playlist(const std::string& playlist, guint slice_size)
+{
+	ChainCount count = {0, 0, 0};
+	gchar *description = g_strdup_printf("filesrc location=\"%s\" ! application/x-hls ! skippyhlsdemux name=demux ! fakesink sync=false",
+		playlist.c_str());
+	GstElement *pipeline = gst_parse_launch(description, NULL);
+	g_free(description);
+	ASSERT (pipeline);
+
+	GstElement *demux = gst_bin_get_by_name(GST_BIN(pipeline), "demux");
+	GstContext *context = gst_context_new("skippy-hls", FALSE);
+	gst_structure_set(gst_context_writable_structure(context), SKIPPY_HLS_MP3_SLICE_SIZE, G_TYPE_UINT, slice_size, NULL);
+	gst_element_set_context(demux, context);
+	gst_context_unref(context);
+
+	GstElement *queue = gst_bin_get_by_name(GST_BIN(demux), "skippyhlsdemux-download-queue");
+	ASSERT (queue);
+	GstPad *queue_sinkpad = gst_element_get_static_pad(queue, "sink");
+	gst_pad_add_probe(queue_sinkpad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+		count_chain, &count, NULL);
+	gst_object_unref(queue_sinkpad);
+	gst_object_unref(queue);
+	gst_object_unref(demux);
+
+	ProcessSample start = sample_process();
+	ASSERT (gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+	GstMessage *msg = gst_bus_timed_pop_filtered(GST_ELEMENT_BUS(pipeline), 60 * GST_SECOND,
+		(GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+	ProcessSample end = sample_process();
+
+	ASSERT (msg && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS);
+	gst_message_unref(msg);
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(pipeline);
+
+	double mb = count.bytes / (1024. * 1024.);
+	ASSERT (count.bytes > 0);
+	LOG ("%s: %.1f MB in %" G_GUINT64_FORMAT " chain calls and %" G_GUINT64_FORMAT " buffers, %.1f calls/MB, %.2f ms CPU/MB",
+		slice_size ? "Slicing" : "Passthrough", mb, count.calls, count.buffers, count.calls / mb,
+		(end.cpuUsec - start.cpuUsec) / 1000. / mb);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+	skippy_hlsdemux_setup(GST_RANK_PRIMARY);
+
+	gchar *dir = g_dir_make_tmp("skippyhls-benchmark-XXXXXX", NULL);
+	ASSERT (dir);
+	std::string playlist = write_fixture(dir, FRAGMENT_COUNT);
+
+	// Alternate so that warming up favors neither
+	for (guint i = 0; i < RUNS; i++) {
+		run_playlist(playlist, 0);
+		run_playlist(playlist, LEGACY_SLICE_SIZE);
+	}
+
+	remove_fixture(dir, FRAGMENT_COUNT);
+	g_free(dir);
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+
+#include "skippyHLS/skippy_hls.h"
+#include "SkippyHLSBenchmarkFixture.hpp"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+// How many demuxers we run at once, and for how long we let them play before sampling
+static const guint STREAM_COUNTS[] = {1, 10, 100, 500};
+static const guint RUN_SECONDS = 5;
+static const guint FRAGMENT_COUNT = 10;
+
+static void run_streams(const std::string& playlist, guint count)
+{
+	std::vector<GstElement*> pipelines;
+	gchar *description = g_strdup_printf("filesrc location=\"%s\" ! application/x-hls ! skippyhlsdemux ! fakesink sync=true",
+		playlist.c_str());
+	ProcessSample before = sample_process();
+
+	for (guint i = 0; i < count; i++) {
+		GError *err = NULL;
+		GstElement *pipeline = gst_parse_launch(description, &err);
+
+		if (err) {
+			LOG ("Failed to create pipeline: %s", err->message);
+			g_error_free(err);
+		}
+		ASSERT (pipeline);
+		ASSERT (gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+		pipelines.push_back(pipeline);
+	}
+	g_free(description);
+
+	// Sample once everything is streaming, not while the pipelines are still being built
+	ProcessSample start = sample_process();
+	g_usleep(RUN_SECONDS * G_USEC_PER_SEC);
+	ProcessSample end = sample_process();
+
+	for (guint i = 0; i < count; i++) {
+		GstMessage *msg = gst_bus_pop_filtered(GST_ELEMENT_BUS(pipelines[i]), GST_MESSAGE_ERROR);
+		if (msg) {
+			GError *err = NULL;
+			gst_message_parse_error(msg, &err, NULL);
+			LOG ("Stream %u failed: %s", i, err->message);
+			g_error_free(err);
+			gst_message_unref(msg);
+		}
+		gst_element_set_state(pipelines[i], GST_STATE_NULL);
+		gst_object_unref(pipelines[i]);
+	}
+
+	LOG ("%u streams: %.2f threads, %.1f kB RSS, %.2f%% CPU per stream (%u threads, %" G_GUINT64_FORMAT " kB RSS in total)",
+		count,
+		(double) ((gint) end.threads - (gint) before.threads) / count,
+		(double) ((gint64) end.rssKb - (gint64) before.rssKb) / count,
+		100.0 * (end.cpuUsec - start.cpuUsec) / (RUN_SECONDS * G_USEC_PER_SEC) / count,
+		end.threads, end.rssKb);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+	skippy_hlsdemux_setup(GST_RANK_PRIMARY);
+
+	gchar *dir = g_dir_make_tmp("skippyhls-benchmark-XXXXXX", NULL);
+	ASSERT (dir);
+	std::string playlist = write_fixture(dir, FRAGMENT_COUNT);
+
+	for (guint i = 0; i < G_N_ELEMENTS(STREAM_COUNTS); i++) {
+		run_streams(playlist, STREAM_COUNTS[i]);
+	}
+
+	remove_fixture(dir, FRAGMENT_COUNT);
+	g_free(dir);
+	return 0;
+}
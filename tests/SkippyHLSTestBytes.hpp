@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <gst/gst.h>
+
+// Byte building shared by the tests that feed crafted streams to the framers and demuxers
+
+typedef std::vector<guint8> Bytes;
+
+// Bytes counting up from the seed, as payload that is easy to tell apart
+static inline Bytes make_bytes(size_t size, guint8 seed)
+{
+	Bytes bytes(size);
+	for (size_t i = 0; i < size; i++) {
+		bytes[i] = (guint8) (seed + i);
+	}
+	return bytes;
+}
+
+static inline void append(Bytes& bytes, const Bytes& more)
+{
+	bytes.insert(bytes.end(), more.begin(), more.end());
+}
+
+static inline Bytes concat(const Bytes& first, const Bytes& second)
+{
+	Bytes bytes(first);
+	append(bytes, second);
+	return bytes;
+}
+
+// A buffer with a copy of the bytes, to be pushed
+static inline GstBuffer* make_buffer(const Bytes& bytes)
+{
+	return gst_buffer_new_wrapped(g_memdup(bytes.data(), bytes.size()), bytes.size());
+}
+
+// Copies the contents out of a buffer we got back, which may be spread over several memories
+static inline Bytes buffer_bytes(GstBuffer* buffer)
+{
+	Bytes bytes(gst_buffer_get_size(buffer));
+	g_assert(gst_buffer_extract(buffer, 0, bytes.data(), bytes.size()) == bytes.size());
+	return bytes;
+}
@@ -0,0 +1,123 @@
+#include <gst/gst.h>
+
+#include <string>
+
+#include "skippy_host_selector.h"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+#define ORIGIN_URI "http://origin.example.com/live/1.ts"
+
+// Takes the returned string, "" for NULL
+static std::string take(gchar* string)
+{
+	std::string ret = string ? string : "";
+	g_free(string);
+	return ret;
+}
+
+static void test_authority()
+{
+	ASSERT (take(skippy_host_selector_get_authority("http://example.com/live/1.ts")) == "example.com");
+	ASSERT (take(skippy_host_selector_get_authority("http://example.com:8080/live/1.ts")) == "example.com:8080");
+	// IPv6 literals keep their brackets, so a port can follow
+	ASSERT (take(skippy_host_selector_get_authority("http://[::1]:8080/live/1.ts")) == "[::1]:8080");
+	ASSERT (take(skippy_host_selector_get_authority("http://[2001:db8::1]/live/1.ts")) == "[2001:db8::1]");
+	ASSERT (take(skippy_host_selector_get_authority("file:///live/1.ts")) == "");
+
+	// The port goes with the host, added or dropped
+	ASSERT (take(skippy_host_selector_replace_authority("http://example.com/live/1.ts", "mirror.example.com:8080"))
+		== "http://mirror.example.com:8080/live/1.ts");
+	ASSERT (take(skippy_host_selector_replace_authority("http://example.com:8080/live/1.ts", "[2001:db8::1]:8443"))
+		== "http://[2001:db8::1]:8443/live/1.ts");
+	ASSERT (take(skippy_host_selector_replace_authority("http://[::1]:8080/live/1.ts", "mirror.example.com"))
+		== "http://mirror.example.com/live/1.ts");
+	ASSERT (take(skippy_host_selector_replace_authority("http://[::1]:8080/live/1.ts", "[2001:db8::1]"))
+		== "http://[2001:db8::1]/live/1.ts");
+	ASSERT (take(skippy_host_selector_replace_authority("http://example.com/live/1.ts", NULL)) == "http://example.com/live/1.ts");
+}
+
+static void test_cost_ordering()
+{
+	SkippyHostSelector *selector = skippy_host_selector_new();
+	const std::string mirror_uri = "http://mirror.example.com/live/1.ts", ipv6_uri = "http://[2001:db8::1]:8443/live/1.ts";
+
+	// Without mirrors everything stays at the origin
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == ORIGIN_URI);
+	skippy_host_selector_report_failure(selector, ORIGIN_URI);
+	ASSERT (!skippy_host_selector_has_alternative(selector, ORIGIN_URI));
+
+	// Hosts get measured in order, starting with the origin
+	skippy_host_selector_set_hosts(selector, "mirror.example.com, [2001:db8::1]:8443,mirror.example.com");
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == ORIGIN_URI);
+	// 1.1 s for 100 kB
+	skippy_host_selector_report_success(selector, ORIGIN_URI, 100 * GST_MSECOND, 100000, 1100 * GST_MSECOND);
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == mirror_uri);
+	// 0.55 s
+	skippy_host_selector_report_success(selector, mirror_uri.c_str(), 50 * GST_MSECOND, 100000, 550 * GST_MSECOND);
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == ipv6_uri);
+	// 0.6 s, most of it waiting for the first byte
+	skippy_host_selector_report_success(selector, ipv6_uri.c_str(), 500 * GST_MSECOND, 100000, 600 * GST_MSECOND);
+
+	// The cheapest one wins, the next cheapest is the alternative
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == mirror_uri);
+	ASSERT (take(skippy_host_selector_get_alternative(selector, mirror_uri.c_str())) == "[2001:db8::1]:8443");
+	ASSERT (take(skippy_host_selector_get_alternative(selector, ipv6_uri.c_str())) == "mirror.example.com");
+
+	// A failing host is left alone
+	skippy_host_selector_report_failure(selector, mirror_uri.c_str());
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == ipv6_uri);
+	ASSERT (take(skippy_host_selector_get_alternative(selector, ipv6_uri.c_str())) == "origin.example.com");
+	ASSERT (skippy_host_selector_has_alternative(selector, mirror_uri.c_str()));
+
+	// Reports about hosts we don't know change nothing
+	skippy_host_selector_report_failure(selector, "http://unknown.example.com/live/1.ts");
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == ipv6_uri);
+	skippy_host_selector_free(selector);
+}
+
+static void test_cooldown()
+{
+	SkippyHostSelector *selector = skippy_host_selector_new();
+	const std::string mirror_uri = "http://mirror.example.com/live/1.ts";
+
+	skippy_host_selector_set_hosts(selector, "mirror.example.com");
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == ORIGIN_URI);
+
+	// A failing origin makes us switch
+	skippy_host_selector_report_failure(selector, ORIGIN_URI);
+	skippy_host_selector_report_failure(selector, ORIGIN_URI);
+	ASSERT (skippy_host_selector_has_alternative(selector, ORIGIN_URI));
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == mirror_uri);
+
+	// All hosts failing, the one that is due again first is taken. Having failed twice, the origin
+	// waits twice as long as the mirror failing once after it
+	skippy_host_selector_report_failure(selector, mirror_uri.c_str());
+	ASSERT (!skippy_host_selector_has_alternative(selector, ORIGIN_URI));
+	ASSERT (!skippy_host_selector_has_alternative(selector, mirror_uri.c_str()));
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == mirror_uri);
+	ASSERT (take(skippy_host_selector_get_alternative(selector, mirror_uri.c_str())) == "origin.example.com");
+	skippy_host_selector_report_failure(selector, mirror_uri.c_str());
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == ORIGIN_URI);
+
+	// A success ends the cooldown
+	skippy_host_selector_report_success(selector, mirror_uri.c_str(), 100 * GST_MSECOND, 100000, GST_SECOND);
+	ASSERT (skippy_host_selector_has_alternative(selector, ORIGIN_URI));
+	ASSERT (take(skippy_host_selector_route(selector, ORIGIN_URI)) == mirror_uri);
+	skippy_host_selector_free(selector);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	test_authority();
+	test_cost_ordering();
+	test_cooldown();
+
+	LOG ("All test assertions passed");
+	return 0;
+}
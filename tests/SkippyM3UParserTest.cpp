@@ -82,10 +82,95 @@ static void test_parse_fixture_with_14_items()
 	}
 }
 
+static void test_parse_fixture_with_aes_keys()
+{
+	std::string uri = "tests/fixture_aes.m3u8";
+	std::string playlist = get_content_from_file(uri);
+
+	SkippyM3UParser p;
+	SkippyM3UPlaylist list = p.parse(uri, playlist);
+
+	ASSERT (list.items.size() == 4);
+
+	// Explicit IV, quoted URI containing a comma
+	ASSERT (list.items[0].encrypted);
+	ASSERT (list.items[0].keyUri == "https://keys.example.com/key?id=1,2");
+	for (int i = 0; i < 16; i++) {
+		ASSERT (list.items[0].iv[i] == i);
+	}
+
+	// No IV attribute: IV is the media sequence number of the item (7 + 1)
+	ASSERT (list.items[1].encrypted);
+	ASSERT (list.items[1].keyUri == "https://keys.example.com/key?id=3");
+	for (int i = 0; i < 15; i++) {
+		ASSERT (list.items[1].iv[i] == 0);
+	}
+	ASSERT (list.items[1].iv[15] == 8);
+
+	// METHOD=NONE disables encryption again
+	ASSERT (!list.items[2].encrypted);
+	ASSERT (list.items[2].url == "https://media.example.com/segment2.mp3");
+
+	// A key tag between EXTINF and URL applies to that item and keeps its duration
+	ASSERT (list.items[3].encrypted);
+	ASSERT (list.items[3].keyUri == "https://keys.example.com/key?id=4");
+	ASSERT (list.items[3].iv[15] == 10);
+	ASSERT (list.items[3].duration == 2000000000);
+	ASSERT (list.items[3].start == list.items[2].end);
+}
+
+static void test_parse_fixture_with_init_sections()
+{
+	std::string uri = "tests/fixture_map.m3u8";
+	std::string playlist = get_content_from_file(uri);
+
+	SkippyM3UParser p;
+	SkippyM3UPlaylist list = p.parse(uri, playlist);
+
+	ASSERT (list.items.size() == 4);
+
+	// Map with a byte range applies to all following items
+	ASSERT (list.items[0].mapUri == "init.mp4");
+	ASSERT (list.items[0].mapRangeStart == 0);
+	ASSERT (list.items[0].mapRangeEnd == 720);
+	ASSERT (list.items[1].mapUri == "init.mp4");
+	ASSERT (list.items[1].mapRangeEnd == 720);
+
+	// Until the next one, without a range this time
+	ASSERT (list.items[2].mapUri == "https://media.example.com/init-2.mp4");
+	ASSERT (list.items[2].mapRangeStart == 0);
+	ASSERT (list.items[2].mapRangeEnd == -1);
+	ASSERT (list.items[2].url == "https://media.example.com/segment2.m4s");
+
+	// Same for a map tag between EXTINF and URL
+	ASSERT (list.items[3].mapUri == "https://media.example.com/init-3.mp4");
+	ASSERT (list.items[3].duration == 2000000000);
+	ASSERT (list.items[3].start == list.items[2].end);
+}
+
+static void test_parse_fixture_with_codecs()
+{
+	std::string uri = "tests/fixture_codecs.m3u8";
+	std::string playlist = get_content_from_file(uri);
+
+	SkippyM3UParser p;
+	SkippyM3UPlaylist list = p.parse(uri, playlist);
+
+	ASSERT (list.isComplete);
+	ASSERT (list.items.size() == 2);
+	ASSERT (list.codec == "mp4a.40.2,mp4a.40.5");
+	ASSERT (list.bandwidthKbps == 128);
+	ASSERT (list.programId == 1);
+	ASSERT (list.items[1].url == "https://media.example.com/segment1.aac");
+}
+
 int
 main (int argc, char **argv)
 {
 	test_parse_fixture_with_14_items();
+	test_parse_fixture_with_aes_keys();
+	test_parse_fixture_with_init_sections();
+	test_parse_fixture_with_codecs();
 
 	LOG ("All test assertions passed");
 
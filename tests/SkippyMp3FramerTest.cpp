@@ -0,0 +1,290 @@
+#include <string.h>
+#include <gst/gst.h>
+
+#include "skippy_mp3_framer.h"
+#include "SkippyHLSTestBytes.hpp"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+// MPEG-1 layer III, 128 kbit/s, 44.1 kHz, stereo, without and with padding
+#define MPEG1_HEADER 0xfffb9000
+#define MPEG1_PADDED_HEADER 0xfffb9200
+// MPEG-2 layer III, 64 kbit/s, 22.05 kHz, stereo
+#define MPEG2_HEADER 0xfff38000
+
+// A frame with the header given and a payload that never contains a sync byte
+static Bytes make_frame(guint32 header, guint8 seed)
+{
+	SkippyMp3Header info;
+	ASSERT (skippy_mp3_header_parse(header, &info));
+
+	Bytes frame(info.frame_size);
+	frame[0] = header >> 24;
+	frame[1] = header >> 16;
+	frame[2] = header >> 8;
+	frame[3] = header;
+	for (size_t i = SKIPPY_MP3_HEADER_SIZE; i < frame.size(); i++) {
+		frame[i] = (guint8) ((seed + i) % 200);
+	}
+	return frame;
+}
+
+static Bytes id3v2_tag(size_t body_size, bool footer = false)
+{
+	Bytes tag = {'I', 'D', '3', 0x04, 0x00, (guint8) (footer ? 0x10 : 0x00),
+		(guint8) ((body_size >> 21) & 0x7f), (guint8) ((body_size >> 14) & 0x7f), (guint8) ((body_size >> 7) & 0x7f), (guint8) (body_size & 0x7f)};
+	tag.insert(tag.end(), body_size, 0x00);
+	if (footer) {
+		Bytes size(tag.begin() + 6, tag.begin() + 10);
+		tag.insert(tag.end(), {'3', 'D', 'I', 0x04, 0x00, 0x10});
+		append(tag, size);
+	}
+	return tag;
+}
+
+static Bytes id3v1_tag()
+{
+	Bytes tag = {'T', 'A', 'G'};
+	tag.insert(tag.end(), 125, 0x20);
+	return tag;
+}
+
+static void assert_frame(SkippyMp3Framer* framer, const Bytes& expected, gboolean expected_discont)
+{
+	SkippyMp3Header info;
+	gboolean discont;
+	GstBuffer *frame = skippy_mp3_framer_next_frame(framer, &info, &discont);
+	ASSERT (frame);
+	ASSERT (discont == expected_discont);
+	ASSERT (info.frame_size == expected.size());
+	ASSERT (buffer_bytes(frame) == expected);
+	gst_buffer_unref(frame);
+}
+
+static void assert_no_frame(SkippyMp3Framer* framer)
+{
+	SkippyMp3Header info;
+	gboolean discont;
+	ASSERT (skippy_mp3_framer_next_frame(framer, &info, &discont) == NULL);
+}
+
+static void test_header_parse()
+{
+	const struct {
+		guint32 header;
+		guint version, layer, bitrate, sample_rate, channels, samples_per_frame;
+		gsize frame_size;
+	} valid[] = {
+		{MPEG1_HEADER, 1, 3, 128000, 44100, 2, 1152, 417},
+		{MPEG1_PADDED_HEADER, 1, 3, 128000, 44100, 2, 1152, 418},
+		{0xfffb90c0, 1, 3, 128000, 44100, 1, 1152, 417},
+		{0xfffda400, 1, 2, 192000, 48000, 2, 1152, 576},
+		{0xffffc400, 1, 1, 384000, 48000, 2, 384, 384},
+		{MPEG2_HEADER, 2, 3, 64000, 22050, 2, 576, 208},
+		// MPEG-2.5
+		{0xffe31800, 2, 3, 8000, 8000, 2, 576, 72},
+	};
+	const guint32 invalid[] = {
+		0x00000000,
+		0xfff09000,     // No complete sync word
+		0xffeb9000,     // Reserved version
+		0xfff99000,     // Reserved layer
+		0xfffb0000,     // Free format
+		0xfffbf000,     // Bad bitrate
+		0xfffb9c00,     // Reserved sample rate
+	};
+	SkippyMp3Header info;
+
+	for (size_t i = 0; i < G_N_ELEMENTS(valid); i++) {
+		ASSERT (skippy_mp3_header_parse(valid[i].header, &info));
+		ASSERT (info.version == valid[i].version);
+		ASSERT (info.layer == valid[i].layer);
+		ASSERT (info.bitrate == valid[i].bitrate);
+		ASSERT (info.sample_rate == valid[i].sample_rate);
+		ASSERT (info.channels == valid[i].channels);
+		ASSERT (info.samples_per_frame == valid[i].samples_per_frame);
+		ASSERT (info.frame_size == valid[i].frame_size);
+	}
+	for (size_t i = 0; i < G_N_ELEMENTS(invalid); i++) {
+		ASSERT (!skippy_mp3_header_parse(invalid[i], &info));
+	}
+}
+
+static void test_find_frame()
+{
+	SkippyMp3Header info;
+	Bytes data = {0x00, 0x01, 0xff, 0xfb, 0x90, 0x00, 0x02, 0x03, 0xff, 0x04};
+	Bytes first = make_frame(MPEG1_HEADER, 1);
+
+	// The false sync word at 2 is not followed by another frame, the real one at 10 is
+	append(data, first);
+	append(data, make_frame(MPEG1_PADDED_HEADER, 2));
+	ASSERT (skippy_mp3_find_frame(data.data(), data.size(), &info) == 10);
+	ASSERT (info.frame_size == first.size());
+
+	// The next frame has to agree on the sample rate, so the MPEG-2 frame following is taken instead
+	data = first;
+	append(data, make_frame(MPEG2_HEADER, 3));
+	ASSERT (skippy_mp3_find_frame(data.data(), data.size(), &info) == (gssize) first.size());
+	ASSERT (info.sample_rate == 22050);
+
+	// Without the data to confirm it, the first header will do
+	ASSERT (skippy_mp3_find_frame(first.data(), first.size(), &info) == 0);
+	ASSERT (skippy_mp3_find_frame(first.data() + 1, first.size() - 1, &info) == -1);
+}
+
+static void test_frame_is_vbr()
+{
+	SkippyMp3Header info;
+	Bytes frame = make_frame(MPEG1_HEADER, 1), mono = make_frame(0xfffb90c0, 1), mpeg2 = make_frame(MPEG2_HEADER, 1);
+
+	ASSERT (skippy_mp3_header_parse(MPEG1_HEADER, &info));
+	ASSERT (!skippy_mp3_frame_is_vbr(frame.data(), frame.size(), &info));
+	memcpy(frame.data() + 4 + 32, "Info", 4);
+	ASSERT (!skippy_mp3_frame_is_vbr(frame.data(), frame.size(), &info));
+	memcpy(frame.data() + 4 + 32, "Xing", 4);
+	ASSERT (skippy_mp3_frame_is_vbr(frame.data(), frame.size(), &info));
+	ASSERT (!skippy_mp3_frame_is_vbr(frame.data(), 4 + 32 + 3, &info));
+	memcpy(frame.data() + 4 + 32, "VBRI", 4);
+	ASSERT (skippy_mp3_frame_is_vbr(frame.data(), frame.size(), &info));
+
+	// The Xing header moves with the side information size
+	ASSERT (skippy_mp3_header_parse(0xfffb90c0, &info));
+	memcpy(mono.data() + 4 + 17, "Xing", 4);
+	ASSERT (skippy_mp3_frame_is_vbr(mono.data(), mono.size(), &info));
+	ASSERT (skippy_mp3_header_parse(MPEG2_HEADER, &info));
+	memcpy(mpeg2.data() + 4 + 17, "Xing", 4);
+	ASSERT (skippy_mp3_frame_is_vbr(mpeg2.data(), mpeg2.size(), &info));
+}
+
+static void test_tags()
+{
+	SkippyMp3Framer *framer = skippy_mp3_framer_new();
+	Bytes mp3 = id3v2_tag(20);
+	Bytes first = make_frame(MPEG1_HEADER, 1), second = make_frame(MPEG1_PADDED_HEADER, 2), third = make_frame(MPEG1_HEADER, 3);
+	Bytes fourth = make_frame(MPEG1_HEADER, 4);
+
+	// Tags in front of and between frames are dropped without breaking the stream
+	append(mp3, first);
+	append(mp3, second);
+	append(mp3, id3v2_tag(30, true));
+	append(mp3, third);
+	append(mp3, id3v1_tag());
+	append(mp3, fourth);
+	skippy_mp3_framer_push(framer, make_buffer(mp3));
+
+	assert_frame(framer, first, TRUE);
+	assert_frame(framer, second, FALSE);
+	assert_frame(framer, third, FALSE);
+	assert_frame(framer, fourth, FALSE);
+	assert_no_frame(framer);
+	skippy_mp3_framer_free(framer);
+}
+
+static void test_resync()
+{
+	SkippyMp3Framer *framer = skippy_mp3_framer_new();
+	Bytes mp3, first = make_frame(MPEG1_HEADER, 1), second = make_frame(MPEG1_HEADER, 2);
+	Bytes third = make_frame(MPEG1_HEADER, 3), fourth = make_frame(MPEG1_HEADER, 4);
+
+	// Garbage between frames makes us look for two frames in a row again
+	mp3 = first;
+	append(mp3, second);
+	mp3.insert(mp3.end(), {0x01, 0xff, 0xfb, 0x90, 0x00, 0x02, 0x03});
+	append(mp3, third);
+	append(mp3, fourth);
+	mp3.insert(mp3.end(), fourth.begin(), fourth.begin() + SKIPPY_MP3_HEADER_SIZE);
+	skippy_mp3_framer_push(framer, make_buffer(mp3));
+
+	assert_frame(framer, first, TRUE);
+	assert_frame(framer, second, FALSE);
+	assert_frame(framer, third, TRUE);
+	assert_frame(framer, fourth, FALSE);
+	// Only the header of the last one is there
+	assert_no_frame(framer);
+
+	// Nothing that looks like a frame, only the last bytes that could start a header are kept
+	skippy_mp3_framer_flush(framer);
+	skippy_mp3_framer_push(framer, make_buffer(Bytes(100, 0x55)));
+	assert_no_frame(framer);
+	mp3 = first;
+	append(mp3, second);
+	skippy_mp3_framer_push(framer, make_buffer(mp3));
+	assert_frame(framer, first, TRUE);
+	assert_frame(framer, second, FALSE);
+	skippy_mp3_framer_free(framer);
+}
+
+static void test_split_pushes()
+{
+	SkippyMp3Framer *framer = skippy_mp3_framer_new();
+	Bytes mp3 = id3v2_tag(40);
+	std::vector<Bytes> frames;
+	size_t count = 0;
+
+	for (guint8 i = 0; i < 5; i++) {
+		frames.push_back(make_frame(MPEG2_HEADER, i));
+		append(mp3, frames.back());
+	}
+
+	// Frames come out whole and in order, however the data trickles in
+	for (size_t i = 0; i < mp3.size(); i++) {
+		SkippyMp3Header info;
+		gboolean discont;
+		GstBuffer *frame;
+
+		skippy_mp3_framer_push(framer, make_buffer(Bytes(1, mp3[i])));
+		while ((frame = skippy_mp3_framer_next_frame(framer, &info, &discont))) {
+			Bytes data = buffer_bytes(frame);
+			gst_buffer_unref(frame);
+
+			ASSERT (count < frames.size());
+			ASSERT (data == frames[count]);
+			ASSERT (discont == (count == 0));
+			count++;
+		}
+	}
+	ASSERT (count == frames.size());
+	skippy_mp3_framer_free(framer);
+}
+
+static void test_flush()
+{
+	SkippyMp3Framer *framer = skippy_mp3_framer_new();
+	Bytes mp3, first = make_frame(MPEG1_HEADER, 1), second = make_frame(MPEG1_HEADER, 2);
+	Bytes third = make_frame(MPEG1_HEADER, 3), fourth = make_frame(MPEG1_HEADER, 4);
+
+	mp3 = first;
+	mp3.insert(mp3.end(), second.begin(), second.begin() + 100);
+	skippy_mp3_framer_push(framer, make_buffer(mp3));
+	assert_frame(framer, first, TRUE);
+	assert_no_frame(framer);
+
+	// After a seek the stream has to be found again
+	skippy_mp3_framer_flush(framer);
+	mp3 = third;
+	append(mp3, fourth);
+	skippy_mp3_framer_push(framer, make_buffer(mp3));
+	assert_frame(framer, third, TRUE);
+	assert_frame(framer, fourth, FALSE);
+	skippy_mp3_framer_free(framer);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	test_header_parse();
+	test_find_frame();
+	test_frame_is_vbr();
+	test_tags();
+	test_resync();
+	test_split_pushes();
+	test_flush();
+
+	LOG ("All test assertions passed");
+	return 0;
+}
@@ -0,0 +1,270 @@
+#include <gst/gst.h>
+
+#include "skippy_ogg_framer.h"
+#include "SkippyHLSTestBytes.hpp"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+#define SERIALNO 0x12345678
+
+// Appends a page with a zero checksum. With continues set, the last packet goes on on the next page
+// and has to be a multiple of 255 bytes.
+static void write_page(Bytes& ogg, guint8 flags, gint64 granulepos, const std::vector<Bytes>& packets, bool continues = false)
+{
+	Bytes lacing, body;
+
+	for (size_t i = 0; i < packets.size(); i++) {
+		size_t size = packets[i].size();
+		lacing.insert(lacing.end(), size / 255, 255);
+		if (continues && i == packets.size() - 1) {
+			ASSERT (size % 255 == 0);
+		} else {
+			lacing.push_back(size % 255);
+		}
+		append(body, packets[i]);
+	}
+	ASSERT (lacing.size() <= 255);
+
+	const guint8 header[] = {'O', 'g', 'g', 'S', 0x00, flags};
+	ogg.insert(ogg.end(), header, header + sizeof(header));
+	for (int i = 0; i < 8; i++) {
+		ogg.push_back((guint8) ((guint64) granulepos >> (8 * i)));
+	}
+	for (int i = 0; i < 4; i++) {
+		ogg.push_back((guint8) (SERIALNO >> (8 * i)));
+	}
+	ogg.insert(ogg.end(), 4, 0x00);
+	ogg.insert(ogg.end(), 4, 0x00);
+	ogg.push_back(lacing.size());
+	append(ogg, lacing);
+	append(ogg, body);
+}
+
+static void assert_packet(SkippyOggFramer* framer, SkippyOggPage* page, const Bytes& expected)
+{
+	GstBuffer *packet = skippy_ogg_framer_next_packet(framer, page);
+	ASSERT (packet);
+	ASSERT (buffer_bytes(packet) == expected);
+	gst_buffer_unref(packet);
+}
+
+static void assert_page_done(SkippyOggFramer* framer, SkippyOggPage* page)
+{
+	ASSERT (skippy_ogg_framer_next_packet(framer, page) == NULL);
+	skippy_ogg_page_clear(page);
+}
+
+static void test_pages_and_packets()
+{
+	SkippyOggFramer *framer = skippy_ogg_framer_new();
+	SkippyOggPage page;
+	Bytes ogg, head = make_bytes(19, 1), first = make_bytes(100, 2), second = make_bytes(510, 3);
+
+	write_page(ogg, SKIPPY_OGG_PAGE_BOS, 0, {head});
+	// 510 bytes take two lacing values of 255 and a terminating 0
+	write_page(ogg, SKIPPY_OGG_PAGE_EOS, 960, {first, second});
+	skippy_ogg_framer_push(framer, make_buffer(ogg));
+
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (page.flags == SKIPPY_OGG_PAGE_BOS);
+	ASSERT (page.granulepos == 0);
+	ASSERT (page.serialno == SERIALNO);
+	ASSERT (page.n_segments == 1);
+	ASSERT (page.header_size == 28);
+	ASSERT (gst_buffer_get_size(page.buffer) == 28 + head.size());
+	assert_packet(framer, &page, head);
+	assert_page_done(framer, &page);
+
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (page.flags == SKIPPY_OGG_PAGE_EOS);
+	ASSERT (page.granulepos == 960);
+	ASSERT (page.n_segments == 4);
+	assert_packet(framer, &page, first);
+	assert_packet(framer, &page, second);
+	assert_page_done(framer, &page);
+
+	ASSERT (!skippy_ogg_framer_next_page(framer, &page));
+	skippy_ogg_framer_free(framer);
+}
+
+static void test_packet_spanning_pages()
+{
+	SkippyOggFramer *framer = skippy_ogg_framer_new();
+	SkippyOggPage page;
+	Bytes ogg, first = make_bytes(50, 1), start = make_bytes(510, 2), end = make_bytes(300, 3), last = make_bytes(20, 4);
+	Bytes exact = make_bytes(255, 5);
+
+	write_page(ogg, 0, 960, {first, start}, true);
+	write_page(ogg, SKIPPY_OGG_PAGE_CONTINUED, 1920, {end, last});
+	// A packet of exactly 255 bytes ends with a zero lacing value on the next page
+	write_page(ogg, 0, -1, {exact}, true);
+	write_page(ogg, SKIPPY_OGG_PAGE_CONTINUED, 2880, {Bytes()});
+	skippy_ogg_framer_push(framer, make_buffer(ogg));
+
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (!page.skip_continued);
+	assert_packet(framer, &page, first);
+	assert_page_done(framer, &page);
+
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (!page.skip_continued);
+	assert_packet(framer, &page, concat(start, end));
+	assert_packet(framer, &page, last);
+	assert_page_done(framer, &page);
+
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (page.granulepos == -1);
+	assert_page_done(framer, &page);
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	assert_packet(framer, &page, exact);
+	assert_page_done(framer, &page);
+
+	skippy_ogg_framer_free(framer);
+}
+
+static void test_skip_continued()
+{
+	SkippyOggFramer *framer = skippy_ogg_framer_new();
+	SkippyOggPage page;
+	Bytes ogg, tail = make_bytes(40, 1), next = make_bytes(30, 2), unfinished = make_bytes(255, 3), other = make_bytes(10, 4);
+
+	// Starting in the middle of a packet, e.g. after seeking: its end is skipped
+	write_page(ogg, SKIPPY_OGG_PAGE_CONTINUED, 960, {tail, next});
+	// A packet that is never finished is dropped when a page without the continued flag comes
+	write_page(ogg, 0, -1, {unfinished}, true);
+	write_page(ogg, 0, 1920, {other});
+	skippy_ogg_framer_push(framer, make_buffer(ogg));
+
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (page.skip_continued);
+	assert_packet(framer, &page, next);
+	assert_page_done(framer, &page);
+
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	assert_page_done(framer, &page);
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	assert_packet(framer, &page, other);
+	assert_page_done(framer, &page);
+
+	skippy_ogg_framer_free(framer);
+}
+
+static void test_resync()
+{
+	SkippyOggFramer *framer = skippy_ogg_framer_new();
+	SkippyOggPage page;
+	Bytes ogg, first = make_bytes(60, 1), second = make_bytes(70, 2);
+	const guint8 bad_version[] = {'O', 'g', 'g', 'S', 0x01};
+
+	// Garbage in front, a false capture pattern and a header with an unknown version in between
+	ogg = {0x00, 'O', 'g', 'g', 0x12};
+	write_page(ogg, 0, 960, {first});
+	ogg.insert(ogg.end(), bad_version, bad_version + sizeof(bad_version));
+	ogg.insert(ogg.end(), 30, 0x55);
+	write_page(ogg, 0, 1920, {second});
+	skippy_ogg_framer_push(framer, make_buffer(ogg));
+
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (page.granulepos == 960);
+	assert_packet(framer, &page, first);
+	assert_page_done(framer, &page);
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (page.granulepos == 1920);
+	assert_packet(framer, &page, second);
+	assert_page_done(framer, &page);
+	ASSERT (!skippy_ogg_framer_next_page(framer, &page));
+
+	// Data without any page is dropped, except for what could be the start of a capture pattern
+	ogg = Bytes(100, 0x55);
+	ogg.insert(ogg.end(), {'O', 'g', 'g'});
+	skippy_ogg_framer_push(framer, make_buffer(ogg));
+	ASSERT (!skippy_ogg_framer_next_page(framer, &page));
+	ogg = {'S'};
+	write_page(ogg, 0, 2880, {first});
+	ogg.erase(ogg.begin() + 1, ogg.begin() + 5);
+	skippy_ogg_framer_push(framer, make_buffer(ogg));
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (page.granulepos == 2880);
+	assert_packet(framer, &page, first);
+	assert_page_done(framer, &page);
+
+	skippy_ogg_framer_free(framer);
+}
+
+static void test_split_pushes()
+{
+	SkippyOggFramer *framer = skippy_ogg_framer_new();
+	SkippyOggPage page;
+	Bytes ogg, first = make_bytes(300, 1), start = make_bytes(255, 2), end = make_bytes(7, 3);
+	std::vector<Bytes> packets;
+
+	write_page(ogg, SKIPPY_OGG_PAGE_BOS, 0, {first, start}, true);
+	write_page(ogg, SKIPPY_OGG_PAGE_CONTINUED, 960, {end});
+
+	// Pages are only returned once complete, however the data trickles in
+	for (size_t i = 0; i < ogg.size(); i++) {
+		skippy_ogg_framer_push(framer, make_buffer(Bytes(1, ogg[i])));
+		while (skippy_ogg_framer_next_page(framer, &page)) {
+			GstBuffer *packet;
+			while ((packet = skippy_ogg_framer_next_packet(framer, &page))) {
+				packets.push_back(buffer_bytes(packet));
+				gst_buffer_unref(packet);
+			}
+			skippy_ogg_page_clear(&page);
+		}
+	}
+
+	ASSERT (packets.size() == 2);
+	ASSERT (packets[0] == first);
+	ASSERT (packets[1] == concat(start, end));
+	skippy_ogg_framer_free(framer);
+}
+
+static void test_flush()
+{
+	SkippyOggFramer *framer = skippy_ogg_framer_new();
+	SkippyOggPage page;
+	Bytes ogg, start = make_bytes(255, 1), partial, tail = make_bytes(20, 2), next = make_bytes(30, 3);
+
+	// A packet left unfinished and half a page
+	write_page(ogg, 0, -1, {start}, true);
+	write_page(partial, SKIPPY_OGG_PAGE_CONTINUED, 960, {tail});
+	ogg.insert(ogg.end(), partial.begin(), partial.begin() + 20);
+	skippy_ogg_framer_push(framer, make_buffer(ogg));
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	assert_page_done(framer, &page);
+	ASSERT (!skippy_ogg_framer_next_page(framer, &page));
+
+	// After flushing, the end of that packet is skipped rather than appended
+	skippy_ogg_framer_flush(framer);
+	skippy_ogg_framer_push(framer, make_buffer(partial));
+	ogg.clear();
+	write_page(ogg, 0, 1920, {next});
+	skippy_ogg_framer_push(framer, make_buffer(ogg));
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	ASSERT (page.skip_continued);
+	assert_page_done(framer, &page);
+	ASSERT (skippy_ogg_framer_next_page(framer, &page));
+	assert_packet(framer, &page, next);
+	assert_page_done(framer, &page);
+
+	skippy_ogg_framer_free(framer);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	test_pages_and_packets();
+	test_packet_spanning_pages();
+	test_skip_continued();
+	test_resync();
+	test_split_pushes();
+	test_flush();
+
+	LOG ("All test assertions passed");
+	return 0;
+}
@@ -0,0 +1,372 @@
+#include <gst/gst.h>
+
+#include "skippy_ts_demuxer.h"
+#include "SkippyHLSTestBytes.hpp"
+
+#define LOG(...) g_message(__VA_ARGS__)
+
+#define ASSERT(expr) g_assert(expr)
+
+#define PMT_PID 0x100
+#define AUDIO_PID 0x101
+#define VIDEO_PID 0x102
+
+// Appends a transport packet, stuffing the adaptation field so that the payload ends the packet.
+// With adaptation_only set, the packet carries an adaptation field and no payload.
+static void write_packet(Bytes& ts, guint16 pid, bool unit_start, guint8 continuity, const Bytes& payload, bool adaptation_only = false)
+{
+	size_t start = ts.size();
+	size_t payload_size = adaptation_only ? 0 : payload.size();
+
+	ASSERT (payload_size <= SKIPPY_TS_PACKET_SIZE - 4);
+	ts.push_back(0x47);
+	ts.push_back((unit_start ? 0x40 : 0x00) | ((pid >> 8) & 0x1f));
+	ts.push_back(pid & 0xff);
+	if (adaptation_only) {
+		ts.push_back(0x20 | (continuity & 0x0f));
+	} else if (payload_size < SKIPPY_TS_PACKET_SIZE - 4) {
+		ts.push_back(0x30 | (continuity & 0x0f));
+	} else {
+		ts.push_back(0x10 | (continuity & 0x0f));
+	}
+	if (adaptation_only || payload_size < SKIPPY_TS_PACKET_SIZE - 4) {
+		size_t adaptation_size = SKIPPY_TS_PACKET_SIZE - 4 - 1 - payload_size;
+		ts.push_back(adaptation_size);
+		if (adaptation_size) {
+			ts.push_back(0x00);
+			ts.insert(ts.end(), adaptation_size - 1, 0xff);
+		}
+	}
+	if (!adaptation_only) {
+		append(ts, payload);
+	}
+	ASSERT (ts.size() - start == SKIPPY_TS_PACKET_SIZE);
+}
+
+// PSI payload: pointer field, filler it points over, the section with a zero CRC and stuffing up to the packet end
+static Bytes psi_payload(const Bytes& section, guint8 pointer = 0)
+{
+	Bytes payload;
+
+	payload.push_back(pointer);
+	payload.insert(payload.end(), pointer, 0xaa);
+	append(payload, section);
+	payload.insert(payload.end(), 4, 0x00);
+	payload.insert(payload.end(), SKIPPY_TS_PACKET_SIZE - 4 - payload.size(), 0xff);
+	return payload;
+}
+
+static Bytes pat_section(guint16 pmt_pid)
+{
+	// Network information on program 0 first, which we have to skip
+	Bytes section = {0x00, 0xb0, 0x00, 0x00, 0x01, 0xc1, 0x00, 0x00,
+		0x00, 0x00, 0xe0, 0x10,
+		0x00, 0x01, (guint8) (0xe0 | (pmt_pid >> 8)), (guint8) (pmt_pid & 0xff)};
+	section[2] = section.size() - 3 + 4;
+	return section;
+}
+
+static Bytes pmt_section(guint8 audio_stream_type)
+{
+	// Program info with a descriptor, then a video stream with one as well before the audio stream
+	Bytes section = {0x02, 0xb0, 0x00, 0x00, 0x01, 0xc1, 0x00, 0x00,
+		(guint8) (0xe0 | (VIDEO_PID >> 8)), (guint8) (VIDEO_PID & 0xff), 0xf0, 0x03, 0x0e, 0x01, 0xff,
+		0x1b, (guint8) (0xe0 | (VIDEO_PID >> 8)), (guint8) (VIDEO_PID & 0xff), 0xf0, 0x02, 0x52, 0x00,
+		audio_stream_type, (guint8) (0xe0 | (AUDIO_PID >> 8)), (guint8) (AUDIO_PID & 0xff), 0xf0, 0x00};
+	section[2] = section.size() - 3 + 4;
+	return section;
+}
+
+// PES header with a PTS, bounded to the payload size unless told otherwise
+static Bytes pes_header(gint64 pts, size_t payload_size, bool bounded = true)
+{
+	size_t pes_length = bounded ? 3 + 5 + payload_size : 0;
+	Bytes header = {0x00, 0x00, 0x01, 0xc0, (guint8) (pes_length >> 8), (guint8) (pes_length & 0xff), 0x80, 0x80, 0x05,
+		(guint8) (0x21 | ((pts >> 29) & 0x0e)), (guint8) ((pts >> 22) & 0xff), (guint8) (((pts >> 14) & 0xfe) | 0x01),
+		(guint8) ((pts >> 7) & 0xff), (guint8) (((pts << 1) & 0xfe) | 0x01)};
+	return header;
+}
+
+// Splits a PES packet over as many audio packets as it takes, returns the next continuity counter
+static guint8 write_pes(Bytes& ts, guint8 continuity, gint64 pts, const Bytes& payload, bool bounded = true)
+{
+	Bytes pes = pes_header(pts, payload.size(), bounded);
+	size_t offset = 0;
+
+	append(pes, payload);
+	while (offset < pes.size()) {
+		size_t size = MIN(pes.size() - offset, (size_t) SKIPPY_TS_PACKET_SIZE - 4);
+		write_packet(ts, AUDIO_PID, offset == 0, continuity++, Bytes(pes.begin() + offset, pes.begin() + offset + size));
+		offset += size;
+	}
+	return continuity & 0x0f;
+}
+
+static void write_program(Bytes& ts, guint8 audio_stream_type = 0x0f)
+{
+	write_packet(ts, 0x0000, true, 0, psi_payload(pat_section(PMT_PID)));
+	write_packet(ts, PMT_PID, true, 0, psi_payload(pmt_section(audio_stream_type)));
+}
+
+static void push(SkippyTsDemuxer* demuxer, const Bytes& ts, size_t chunk_size = 0)
+{
+	size_t offset = 0;
+
+	if (!chunk_size) {
+		chunk_size = ts.size();
+	}
+	while (offset < ts.size()) {
+		size_t size = MIN(chunk_size, ts.size() - offset);
+		skippy_ts_demuxer_push(demuxer, make_buffer(Bytes(ts.begin() + offset, ts.begin() + offset + size)));
+		offset += size;
+	}
+}
+
+static void assert_pes(SkippyTsDemuxer* demuxer, const Bytes& payload, gint64 expected_pts)
+{
+	gint64 pts = -2;
+	GstBuffer *buffer = skippy_ts_demuxer_next_pes(demuxer, &pts);
+	ASSERT (buffer);
+	ASSERT (pts == expected_pts);
+	ASSERT (buffer_bytes(buffer) == payload);
+	gst_buffer_unref(buffer);
+}
+
+static void assert_no_pes(SkippyTsDemuxer* demuxer)
+{
+	gint64 pts;
+	ASSERT (skippy_ts_demuxer_next_pes(demuxer, &pts) == NULL);
+}
+
+static void assert_caps(SkippyTsDemuxer* demuxer, const gchar* expected)
+{
+	GstCaps *caps = skippy_ts_demuxer_get_caps(demuxer);
+	GstCaps *expected_caps = gst_caps_from_string(expected);
+
+	ASSERT (caps);
+	ASSERT (gst_caps_is_equal(caps, expected_caps));
+	gst_caps_unref(caps);
+	gst_caps_unref(expected_caps);
+}
+
+static void test_program_and_pes()
+{
+	SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+	Bytes ts, first = make_bytes(300, 1), second = make_bytes(100, 7);
+	guint8 continuity = 0;
+
+	ASSERT (skippy_ts_demuxer_get_caps(demuxer) == NULL);
+	write_program(ts);
+	continuity = write_pes(ts, continuity, 900000, first);
+	continuity = write_pes(ts, continuity, 902160, second);
+	push(demuxer, ts);
+
+	assert_caps(demuxer, "audio/mpeg, mpegversion=(int)4, stream-format=(string)adts");
+	// Bounded packets are done as soon as all of their payload is there
+	assert_pes(demuxer, first, 900000);
+	assert_pes(demuxer, second, 902160);
+	assert_no_pes(demuxer);
+	skippy_ts_demuxer_free(demuxer);
+}
+
+static void test_stream_types()
+{
+	const struct {
+		guint8 type;
+		const gchar *caps;
+	} types[] = {
+		{0x03, "audio/mpeg, mpegversion=(int)1"},
+		{0x04, "audio/mpeg, mpegversion=(int)1"},
+		{0x11, "audio/mpeg, mpegversion=(int)4, stream-format=(string)loas"},
+	};
+
+	for (size_t i = 0; i < G_N_ELEMENTS(types); i++) {
+		SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+		Bytes ts;
+		write_program(ts, types[i].type);
+		push(demuxer, ts);
+		assert_caps(demuxer, types[i].caps);
+		skippy_ts_demuxer_free(demuxer);
+	}
+}
+
+static void test_pointer_field()
+{
+	SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+	Bytes ts, payload = make_bytes(50, 3);
+
+	// Sections start after whatever the pointer field points over
+	write_packet(ts, 0x0000, true, 0, psi_payload(pat_section(PMT_PID), 5));
+	write_packet(ts, PMT_PID, true, 0, psi_payload(pmt_section(0x0f), 17));
+	write_pes(ts, 0, 1000, payload);
+	push(demuxer, ts);
+
+	assert_caps(demuxer, "audio/mpeg, mpegversion=(int)4, stream-format=(string)adts");
+	assert_pes(demuxer, payload, 1000);
+	skippy_ts_demuxer_free(demuxer);
+}
+
+static void test_adaptation_only_packet()
+{
+	SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+	Bytes ts, payload = make_bytes(250, 9), pes = pes_header(2000, payload.size());
+
+	append(pes, payload);
+	write_program(ts);
+	write_packet(ts, AUDIO_PID, true, 0, Bytes(pes.begin(), pes.begin() + 184));
+	// Carries no payload, so the continuity counter stays where it is (e.g. PCR only)
+	write_packet(ts, AUDIO_PID, false, 0, Bytes(), true);
+	write_packet(ts, AUDIO_PID, false, 1, Bytes(pes.begin() + 184, pes.end()));
+	push(demuxer, ts);
+
+	assert_pes(demuxer, payload, 2000);
+	assert_no_pes(demuxer);
+	skippy_ts_demuxer_free(demuxer);
+}
+
+static void test_continuity()
+{
+	SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+	Bytes ts, lost = make_bytes(400, 2), pes = pes_header(3000, lost.size());
+	Bytes duplicated = make_bytes(250, 5), after = make_bytes(80, 4);
+	guint8 continuity;
+
+	append(pes, lost);
+	write_program(ts);
+	// The second of three packets goes missing: the whole PES packet is dropped
+	write_packet(ts, AUDIO_PID, true, 0, Bytes(pes.begin(), pes.begin() + 184));
+	write_packet(ts, AUDIO_PID, false, 2, Bytes(pes.begin() + 368, pes.end()));
+	// A packet repeated with the same counter is only taken once
+	pes = pes_header(4000, duplicated.size());
+	append(pes, duplicated);
+	write_packet(ts, AUDIO_PID, true, 3, Bytes(pes.begin(), pes.begin() + 184));
+	write_packet(ts, AUDIO_PID, true, 3, Bytes(pes.begin(), pes.begin() + 184));
+	write_packet(ts, AUDIO_PID, false, 4, Bytes(pes.begin() + 184, pes.end()));
+	// Counters wrap around after 15
+	continuity = write_pes(ts, 5, 5000, make_bytes(184 * 10, 6));
+	ASSERT (continuity == 0);
+	write_pes(ts, continuity, 6000, after);
+	push(demuxer, ts);
+
+	assert_pes(demuxer, duplicated, 4000);
+	assert_pes(demuxer, make_bytes(184 * 10, 6), 5000);
+	assert_pes(demuxer, after, 6000);
+	assert_no_pes(demuxer);
+	skippy_ts_demuxer_free(demuxer);
+}
+
+static void test_pts_wrap()
+{
+	SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+	const gint64 wrap = G_GINT64_CONSTANT(1) << 33;
+	Bytes ts, payload = make_bytes(20, 8);
+	guint8 continuity = 0;
+
+	write_program(ts);
+	continuity = write_pes(ts, continuity, wrap - 90000, payload);
+	continuity = write_pes(ts, continuity, 1000, payload);
+	continuity = write_pes(ts, continuity, 91000, payload);
+	push(demuxer, ts);
+
+	// 33 bits all set survive reading, what follows the wrap goes on from there
+	assert_pes(demuxer, payload, wrap - 90000);
+	assert_pes(demuxer, payload, wrap + 1000);
+	assert_pes(demuxer, payload, wrap + 91000);
+
+	// Seeking starts over
+	skippy_ts_demuxer_flush(demuxer);
+	ts.clear();
+	write_pes(ts, 0, 2000, payload);
+	push(demuxer, ts);
+	assert_pes(demuxer, payload, 2000);
+	skippy_ts_demuxer_free(demuxer);
+}
+
+static void test_unbounded_pes()
+{
+	SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+	Bytes ts, first = make_bytes(184 * 2 + 100 - 14, 1), second = make_bytes(30, 2);
+	guint8 continuity;
+
+	write_program(ts);
+	continuity = write_pes(ts, 0, 7000, first, false);
+	push(demuxer, ts);
+	// Only the next one starting tells where it ends
+	assert_no_pes(demuxer);
+
+	ts.clear();
+	write_pes(ts, continuity, 8000, second, false);
+	push(demuxer, ts);
+	assert_pes(demuxer, first, 7000);
+	assert_no_pes(demuxer);
+	skippy_ts_demuxer_free(demuxer);
+}
+
+static void test_resync()
+{
+	SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+	Bytes ts = {0x00, 0x47, 0x12, 0x47}, packets, payload = make_bytes(500, 3);
+	Bytes garbage = {0x47, 0x00, 0x01};
+
+	// Garbage in front, sync bytes in it included, and in between packets
+	write_program(ts);
+	write_pes(packets, 0, 9000, payload);
+	ts.insert(ts.end(), packets.begin(), packets.begin() + SKIPPY_TS_PACKET_SIZE);
+	append(ts, garbage);
+	ts.insert(ts.end(), packets.begin() + SKIPPY_TS_PACKET_SIZE, packets.end());
+	// Arriving in pieces not aligned to packets
+	push(demuxer, ts, 61);
+
+	assert_caps(demuxer, "audio/mpeg, mpegversion=(int)4, stream-format=(string)adts");
+	assert_pes(demuxer, payload, 9000);
+	skippy_ts_demuxer_free(demuxer);
+}
+
+static void test_flush_and_reset()
+{
+	SkippyTsDemuxer *demuxer = skippy_ts_demuxer_new();
+	Bytes ts, pes = pes_header(1000, 300), payload = make_bytes(40, 5);
+
+	write_program(ts);
+	// Half a PES packet and half a transport packet pending
+	write_packet(ts, AUDIO_PID, true, 0, Bytes(pes.begin(), pes.begin() + 14));
+	ts.insert(ts.end(), 100, 0x47);
+	push(demuxer, ts);
+	assert_no_pes(demuxer);
+
+	// The program stays across a flush, the pending data doesn't
+	skippy_ts_demuxer_flush(demuxer);
+	ts.clear();
+	write_pes(ts, 7, 2000, payload);
+	push(demuxer, ts);
+	assert_pes(demuxer, payload, 2000);
+
+	// A reset forgets the program as well
+	skippy_ts_demuxer_reset(demuxer);
+	ASSERT (skippy_ts_demuxer_get_caps(demuxer) == NULL);
+	ts.clear();
+	write_pes(ts, 8, 3000, payload);
+	push(demuxer, ts);
+	assert_no_pes(demuxer);
+	skippy_ts_demuxer_free(demuxer);
+}
+
+int
+main (int argc, char **argv)
+{
+	gst_init(&argc, &argv);
+
+	test_program_and_pes();
+	test_stream_types();
+	test_pointer_field();
+	test_adaptation_only_packet();
+	test_continuity();
+	test_pts_wrap();
+	test_unbounded_pes();
+	test_resync();
+	test_flush_and_reset();
+
+	LOG ("All test assertions passed");
+
+	return 0;
+}